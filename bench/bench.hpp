@@ -0,0 +1,137 @@
+//
+// bench.hpp
+// *********
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace aegis
+{
+
+namespace bench
+{
+
+/// Run f iterations times after a short warmup
+/**
+ * @returns Average nanoseconds per iteration
+ */
+template<typename F>
+double run(std::size_t iterations, F && f)
+{
+    for (std::size_t i = 0; i < iterations / 10 + 1; ++i)
+        f();
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+        f();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / iterations;
+}
+
+/// Print one result line
+inline void report(const char * name, double ns_per_op, std::size_t bytes_per_op = 0)
+{
+    if (bytes_per_op)
+        std::printf("%-40s %12.1f ns/op %10.1f MB/s\n", name, ns_per_op, bytes_per_op / ns_per_op * 1000.0);
+    else
+        std::printf("%-40s %12.1f ns/op\n", name, ns_per_op);
+}
+
+/// Load gateway payloads captured one per line, for example from core::set_on_websocket_event
+inline std::vector<std::string> load_capture(const char * path)
+{
+    std::vector<std::string> payloads;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+        if (!line.empty())
+            payloads.push_back(line);
+    return payloads;
+}
+
+inline std::string user_json(uint64_t id)
+{
+    return "{\"id\":\"" + std::to_string(id) + "\",\"username\":\"user" + std::to_string(id % 9973)
+        + "\",\"discriminator\":\"" + std::to_string(1000 + id % 9000)
+        + "\",\"avatar\":\"a_1f2e3d4c5b6a79881f2e3d4c5b6a7988\",\"bot\":false}";
+}
+
+/// MESSAGE_CREATE dispatch as sent by the gateway
+inline std::string message_create(uint64_t id = 700000000000000001)
+{
+    return "{\"t\":\"MESSAGE_CREATE\",\"s\":42,\"op\":0,\"d\":{\"type\":0,\"tts\":false,"
+        "\"timestamp\":\"2020-05-04T12:34:56.789000+00:00\",\"pinned\":false,\"nonce\":\"" + std::to_string(id)
+        + "\",\"mentions\":[],\"mention_roles\":[\"300000000000000001\"],\"mention_everyone\":false,"
+        "\"member\":{\"roles\":[\"300000000000000001\"],\"nick\":null,\"mute\":false,\"joined_at\":\"2019-01-01T00:00:00.000000+00:00\",\"deaf\":false},"
+        "\"id\":\"" + std::to_string(id) + "\",\"flags\":0,\"embeds\":[],\"edited_timestamp\":null,"
+        "\"content\":\"hello there, this is a typical chat message of moderate length\","
+        "\"channel_id\":\"200000000000000001\",\"author\":" + user_json(500000000000000001)
+        + ",\"attachments\":[],\"guild_id\":\"100000000000000001\"}}";
+}
+
+/// PRESENCE_UPDATE dispatch as sent by the gateway
+inline std::string presence_update(uint64_t user_id = 500000000000000001)
+{
+    return "{\"t\":\"PRESENCE_UPDATE\",\"s\":43,\"op\":0,\"d\":{\"user\":{\"id\":\"" + std::to_string(user_id)
+        + "\"},\"status\":\"online\",\"roles\":[\"300000000000000001\"],\"guild_id\":\"100000000000000001\","
+        "\"game\":{\"type\":0,\"name\":\"a game\",\"created_at\":1588595696789},"
+        "\"client_status\":{\"desktop\":\"online\"},\"activities\":[{\"type\":0,\"name\":\"a game\",\"created_at\":1588595696789}]}}";
+}
+
+/// TYPING_START dispatch as sent by the gateway
+inline std::string typing_start(uint64_t user_id = 500000000000000001)
+{
+    return "{\"t\":\"TYPING_START\",\"s\":44,\"op\":0,\"d\":{\"user_id\":\"" + std::to_string(user_id)
+        + "\",\"timestamp\":1588595696,\"member\":{\"user\":" + user_json(user_id)
+        + ",\"roles\":[\"300000000000000001\"],\"nick\":null,\"mute\":false,\"joined_at\":\"2019-01-01T00:00:00.000000+00:00\",\"deaf\":false},"
+        "\"channel_id\":\"200000000000000001\",\"guild_id\":\"100000000000000001\"}}";
+}
+
+/// GUILD_CREATE dispatch with the given number of members, channels and roles
+inline std::string guild_create(std::size_t members, std::size_t channels = 50, std::size_t roles = 20)
+{
+    std::string s = "{\"t\":\"GUILD_CREATE\",\"s\":1,\"op\":0,\"d\":{\"id\":\"100000000000000001\",\"name\":\"bench guild\","
+        "\"icon\":null,\"owner_id\":\"500000000000000001\",\"region\":\"us-east\",\"afk_channel_id\":null,\"afk_timeout\":300,"
+        "\"verification_level\":1,\"default_message_notifications\":0,\"explicit_content_filter\":0,\"mfa_level\":0,"
+        "\"large\":true,\"unavailable\":false,\"member_count\":" + std::to_string(members) + ",\"features\":[],\"emojis\":[],\"voice_states\":[],\"roles\":[";
+    for (std::size_t i = 0; i < roles; ++i)
+    {
+        if (i)
+            s += ',';
+        s += "{\"id\":\"" + std::to_string(300000000000000001 + i) + "\",\"name\":\"role" + std::to_string(i)
+            + "\",\"color\":0,\"hoist\":false,\"position\":" + std::to_string(i) + ",\"permissions\":104324161,\"managed\":false,\"mentionable\":false}";
+    }
+    s += "],\"channels\":[";
+    for (std::size_t i = 0; i < channels; ++i)
+    {
+        if (i)
+            s += ',';
+        s += "{\"id\":\"" + std::to_string(200000000000000001 + i) + "\",\"type\":0,\"name\":\"channel" + std::to_string(i)
+            + "\",\"position\":" + std::to_string(i) + ",\"parent_id\":null,\"topic\":null,\"nsfw\":false,\"rate_limit_per_user\":0,"
+            "\"permission_overwrites\":[{\"id\":\"300000000000000002\",\"type\":\"role\",\"allow\":1024,\"deny\":0}]}";
+    }
+    s += "],\"members\":[";
+    for (std::size_t i = 0; i < members; ++i)
+    {
+        if (i)
+            s += ',';
+        s += "{\"user\":" + user_json(500000000000000001 + i) + ",\"roles\":[\"" + std::to_string(300000000000000001 + i % roles)
+            + "\"],\"nick\":null,\"mute\":false,\"joined_at\":\"2019-01-01T00:00:00.000000+00:00\",\"deaf\":false}";
+    }
+    s += "],\"presences\":[]}}";
+    return s;
+}
+
+}
+
+}
@@ -0,0 +1,122 @@
+//
+// entity_cache.cpp
+// ****************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+// Hammers entity_cache and a single map behind one shared_mutex, the layout it replaced,
+// from several threads with a PRESENCE_UPDATE-like mix of lookups and inserts.
+// usage: aegis_bench_entity_cache [threads]
+
+#include "bench.hpp"
+#include <aegis.hpp>
+#include <cstdlib>
+#include <thread>
+
+namespace
+{
+
+struct entity
+{
+    explicit entity(aegis::snowflake id) : id(id) {}
+    aegis::snowflake id;
+    uint64_t touched = 0;
+};
+
+/// One unordered_map behind one shared_mutex
+class locked_map
+{
+public:
+    entity * find(aegis::snowflake id) const
+    {
+        std::shared_lock<aegis::shared_mutex> l(_m);
+        auto it = _map.find(id);
+        return it == _map.end() ? nullptr : it->second.get();
+    }
+
+    template<typename Factory>
+    entity * get_or_create(aegis::snowflake id, Factory && make)
+    {
+        std::unique_lock<aegis::shared_mutex> l(_m);
+        auto & e = _map[id];
+        if (!e)
+            e = make();
+        return e.get();
+    }
+
+private:
+    mutable aegis::shared_mutex _m;
+    std::unordered_map<aegis::snowflake, std::unique_ptr<entity>> _map;
+};
+
+constexpr uint64_t ops_per_thread = 1000000;
+constexpr uint64_t known_users = 100000;
+
+/// Each thread looks up known users and every eighth op creates a new one
+template<typename Cache>
+double contend(Cache & cache, std::size_t threads)
+{
+    return aegis::bench::run(3, [&]
+    {
+        static std::atomic<uint64_t> next_id{ 600000000000000001 };
+        std::vector<std::thread> workers;
+        for (std::size_t t = 0; t < threads; ++t)
+            workers.emplace_back([&, t]
+            {
+                uint64_t x = 0x9E3779B97F4A7C15ull * (t + 1);
+                for (uint64_t i = 0; i < ops_per_thread; ++i)
+                {
+                    x ^= x << 13;
+                    x ^= x >> 7;
+                    x ^= x << 17;
+                    if ((i & 7) == 0)
+                    {
+                        const aegis::snowflake id = next_id.fetch_add(1, std::memory_order_relaxed);
+                        cache.get_or_create(id, [id] { return std::unique_ptr<entity>(new entity(id)); })->touched++;
+                    }
+                    else if (auto e = cache.find(500000000000000001 + (x % known_users) * 4194304))
+                        (void)e;
+                }
+            });
+        for (auto & w : workers)
+            w.join();
+    }) / static_cast<double>(threads * ops_per_thread);
+}
+
+template<typename Cache>
+void fill(Cache & cache)
+{
+    for (uint64_t i = 0; i < known_users; ++i)
+    {
+        const aegis::snowflake id = 500000000000000001 + i * 4194304;
+        cache.get_or_create(id, [id] { return std::unique_ptr<entity>(new entity(id)); });
+    }
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    std::size_t max_threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : std::thread::hardware_concurrency();
+    if (max_threads == 0)
+        max_threads = 4;
+
+    locked_map single;
+    aegis::entity_cache<entity> striped;
+    fill(single);
+    fill(striped);
+
+    for (std::size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        std::printf("%zu threads\n", threads);
+        const double one = contend(single, threads);
+        aegis::bench::report("  single shared_mutex map", one);
+        const double many = contend(striped, threads);
+        aegis::bench::report("  entity_cache", many);
+        std::printf("  %.2fx\n", one / many);
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+//
+// futures.cpp
+// ***********
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+// Completes promises from an io_context pool and chains continuations onto them, the
+// pattern of core::async().then() and of REST calls under heavy fan-out.
+// usage: aegis_bench_futures [threads] [chains]
+
+#include "bench.hpp"
+#include <aegis.hpp>
+#include <cstdlib>
+#include <thread>
+
+int main(int argc, char * argv[])
+{
+    std::size_t threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4;
+    const std::size_t chains = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000;
+    if (threads == 0)
+        threads = 1;
+
+    asio::io_context io;
+    auto work = asio::make_work_guard(io);
+    std::vector<std::thread> pool;
+    for (std::size_t i = 0; i < threads; ++i)
+        pool.emplace_back([&] { io.run(); });
+
+    std::printf("%zu io threads, %zu chains\n", threads, chains);
+
+    // three continuations per chain, attached while the value is still being produced
+    std::atomic<std::size_t> done{ 0 };
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < chains; ++i)
+    {
+        aegis::promise<int> p(&io);
+        auto f = p.get_future();
+        asio::post(io, [p = std::move(p), i]() mutable { p.set_value(static_cast<int>(i)); });
+        f.then([](int v) { return v + 1; })
+            .then([](int v) { return std::to_string(v); })
+            .then([&done](std::string) { done.fetch_add(1, std::memory_order_relaxed); });
+    }
+    while (done.load(std::memory_order_relaxed) < chains)
+        std::this_thread::yield();
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    aegis::bench::report("post + then x3, per chain", ns / chains);
+
+    // continuation attached to an already completed future
+    ns = aegis::bench::run(chains, [] { aegis::make_ready_future<int>(1).then([](int v) { return v + 1; }).get(); });
+    aegis::bench::report("ready future + then + get", ns);
+
+    // a caller blocking on each result in turn
+    long sum = 0;
+    ns = aegis::bench::run(chains / 10, [&]
+    {
+        aegis::promise<int> p(&io);
+        auto f = p.get_future();
+        asio::post(io, [p = std::move(p)]() mutable { p.set_value(2); });
+        sum += f.then([](int v) { return v * 2; }).get();
+    });
+    aegis::bench::report("post + then + blocking get", ns);
+
+    work.reset();
+    for (auto & t : pool)
+        t.join();
+    return sum == 0;
+}
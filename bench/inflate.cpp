@@ -0,0 +1,119 @@
+//
+// inflate.cpp
+// ***********
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+// Replays a zlib-stream gateway session through shards::zlib_stream.
+// usage: aegis_bench_inflate [capture file, one payload per line]
+
+#include "bench.hpp"
+#include <aegis/shards/zlib_stream.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <zlib.h>
+
+namespace
+{
+
+/// Compress payloads the way the gateway does, one Z_SYNC_FLUSH frame each on a shared stream
+std::vector<std::string> deflate_session(const std::vector<std::string> & payloads)
+{
+    z_stream z{};
+    deflateInit(&z, Z_DEFAULT_COMPRESSION);
+    std::vector<std::string> frames;
+    for (auto & p : payloads)
+    {
+        std::string out(deflateBound(&z, static_cast<uLong>(p.size())) + 16, '\0');
+        z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(p.data()));
+        z.avail_in = static_cast<uInt>(p.size());
+        z.next_out = reinterpret_cast<Bytef *>(&out[0]);
+        z.avail_out = static_cast<uInt>(out.size());
+        deflate(&z, Z_SYNC_FLUSH);
+        out.resize(out.size() - z.avail_out);
+        frames.push_back(std::move(out));
+    }
+    deflateEnd(&z);
+    return frames;
+}
+
+/// Inflate every frame of a session, each split into parts payloads
+std::size_t replay(aegis::shards::zlib_stream & zs, const std::vector<std::string> & frames, std::size_t parts)
+{
+    zs.end();
+    zs.init();
+    std::size_t bytes = 0;
+    for (auto & f : frames)
+    {
+        const std::size_t step = f.size() / parts + 1;
+        for (std::size_t off = 0; off < f.size(); off += step)
+        {
+            const std::size_t len = std::min(step, f.size() - off);
+            auto res = zs.feed(f.data() + off, len);
+            if (res == aegis::shards::zlib_stream::result::error)
+            {
+                std::printf("inflate failed: %s\n", zs.error());
+                std::exit(1);
+            }
+            if (res == aegis::shards::zlib_stream::result::inflated)
+                bytes += zs.size();
+        }
+    }
+    return bytes;
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    std::vector<std::string> payloads;
+    if (argc > 1)
+        payloads = aegis::bench::load_capture(argv[1]);
+    else
+    {
+        // one large guild followed by the chat traffic that dominates a running bot
+        payloads.push_back(aegis::bench::guild_create(20000));
+        for (uint64_t i = 0; i < 5000; ++i)
+            payloads.push_back(aegis::bench::message_create(700000000000000001 + i));
+    }
+    if (payloads.empty())
+    {
+        std::printf("no payloads\n");
+        return 1;
+    }
+
+    std::size_t raw = 0;
+    for (auto & p : payloads)
+        raw += p.size();
+    const auto frames = deflate_session(payloads);
+    std::size_t compressed = 0;
+    for (auto & f : frames)
+        compressed += f.size();
+    std::printf("%zu frames, %zu bytes inflated, %zu bytes compressed\n", frames.size(), raw, compressed);
+
+    aegis::shards::zlib_stream zs;
+    std::size_t out = 0;
+    double ns = aegis::bench::run(20, [&] { out = replay(zs, frames, 1); });
+    if (out != raw)
+    {
+        std::printf("inflated %zu bytes, expected %zu\n", out, raw);
+        return 1;
+    }
+    aegis::bench::report("session, whole frames", ns, raw);
+    aegis::bench::report("  per frame", ns / frames.size());
+
+    ns = aegis::bench::run(20, [&] { out = replay(zs, frames, 3); });
+    if (out != raw)
+    {
+        std::printf("inflated %zu bytes of split frames, expected %zu\n", out, raw);
+        return 1;
+    }
+    aegis::bench::report("session, frames split in 3 payloads", ns, raw);
+    aegis::bench::report("  per frame", ns / frames.size());
+
+    std::printf("buffer high-water size %zu bytes\n", zs.capacity());
+    return 0;
+}
@@ -0,0 +1,59 @@
+//
+// json_reader.cpp
+// ***************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+// Reads MESSAGE_CREATE and GUILD_CREATE dispatches with json_reader and with a json
+// DOM plus from_json, the two ways the gateway handlers can consume them.
+// usage: aegis_bench_json_reader [guild member count]
+
+#include "bench.hpp"
+#include <aegis.hpp>
+#include <cstdlib>
+
+namespace
+{
+
+template<typename T>
+void read_dom(const std::string & payload, T & out)
+{
+    out = nlohmann::json::parse(payload)["d"].get<T>();
+}
+
+template<typename T>
+void read_reader(const std::string & payload, T & out)
+{
+    aegis::json_reader r(payload);
+    if (aegis::gateway::events::seek_dispatch_data(r))
+        aegis::gateway::objects::from_reader(r, out);
+}
+
+template<typename T>
+void compare(const char * name, const std::string & payload, std::size_t iterations)
+{
+    std::printf("%s, %zu bytes\n", name, payload.size());
+
+    T obj;
+    double ns = aegis::bench::run(iterations, [&] { T o; read_dom(payload, o); obj = std::move(o); });
+    aegis::bench::report("  json::parse + from_json", ns, payload.size());
+    const double dom = ns;
+
+    ns = aegis::bench::run(iterations, [&] { T o; read_reader(payload, o); obj = std::move(o); });
+    aegis::bench::report("  json_reader + from_reader", ns, payload.size());
+    std::printf("  %.2fx\n", dom / ns);
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    const std::size_t members = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+
+    compare<aegis::gateway::objects::message>("MESSAGE_CREATE", aegis::bench::message_create(), 200000);
+    compare<aegis::gateway::objects::guild>("GUILD_CREATE", aegis::bench::guild_create(members), 20);
+    return 0;
+}
@@ -0,0 +1,138 @@
+//
+// object_pool.cpp
+// ***************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+// Creates and destroys cached users through their object_pool and through the global
+// allocator, as a cold start bulk load and as member churn from several threads.
+// usage: aegis_bench_object_pool [user count] [threads]
+
+#include "bench.hpp"
+#include <aegis.hpp>
+#include <cstdlib>
+#include <thread>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+using aegis::user;
+
+/// Resident set size in bytes, 0 where it can not be read
+std::size_t resident_bytes()
+{
+#if defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    std::size_t pages = 0;
+    std::size_t resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+struct pooled
+{
+    static void reserve(std::size_t count) { aegis::object_pool<user>::instance().reserve(count); }
+    static user * make(uint64_t id) { return new user(id); }
+    static void destroy(user * u) { delete u; }
+};
+
+struct global
+{
+    static void reserve(std::size_t) {}
+    static user * make(uint64_t id) { return ::new user(id); }
+    static void destroy(user * u) { ::delete u; }
+};
+
+/// Create count users, as GUILD_CREATE does for its members at startup
+template<typename Alloc>
+void load(std::vector<user *> & users, std::size_t count)
+{
+    Alloc::reserve(count);
+    users.resize(count);
+    for (std::size_t i = 0; i < count; ++i)
+        users[i] = Alloc::make(500000000000000001 + i);
+}
+
+template<typename Alloc>
+void unload(std::vector<user *> & users)
+{
+    for (auto u : users)
+        Alloc::destroy(u);
+    users.clear();
+}
+
+/// Each thread replaces its users one by one, as members leave and join
+template<typename Alloc>
+void churn(std::vector<user *> & users, std::size_t threads)
+{
+    std::vector<std::thread> workers;
+    const std::size_t per_thread = users.size() / threads;
+    for (std::size_t t = 0; t < threads; ++t)
+        workers.emplace_back([&, t]
+        {
+            for (std::size_t i = t * per_thread; i < (t + 1) * per_thread; ++i)
+            {
+                const uint64_t id = users[i]->get_id() + users.size();
+                Alloc::destroy(users[i]);
+                users[i] = Alloc::make(id);
+            }
+        });
+    for (auto & w : workers)
+        w.join();
+}
+
+template<typename Alloc>
+void measure(const char * name, std::size_t count, std::size_t threads)
+{
+    std::vector<user *> users;
+    users.reserve(count);
+    const std::size_t rss = resident_bytes();
+
+    auto start = std::chrono::steady_clock::now();
+    load<Alloc>(users, count);
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    std::printf("%s\n", name);
+    aegis::bench::report("  load", ns / count);
+    std::printf("  resident growth %zu KB\n", (resident_bytes() - rss) / 1024);
+
+    start = std::chrono::steady_clock::now();
+    churn<Alloc>(users, threads);
+    ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    aegis::bench::report("  churn", ns / count);
+
+    start = std::chrono::steady_clock::now();
+    unload<Alloc>(users);
+    ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    aegis::bench::report("  unload", ns / count);
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    const std::size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    std::size_t threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4;
+    if (threads == 0)
+        threads = 1;
+
+    std::printf("%zu users of %zu bytes, churn on %zu threads\n", count, sizeof(user), threads);
+    // the pool runs first, it never returns its slabs so the global allocator can not
+    // grow into them and both start from fresh memory
+    measure<pooled>("object_pool", count, threads);
+    measure<global>("global allocator", count, threads);
+
+    auto stats = aegis::object_pool<user>::instance().get_stats();
+    std::printf("pool holds %llu slabs, %llu slots, %llu bytes\n", static_cast<unsigned long long>(stats.slabs),
+                static_cast<unsigned long long>(stats.capacity), static_cast<unsigned long long>(stats.bytes));
+    return 0;
+}
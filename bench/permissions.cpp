@@ -0,0 +1,158 @@
+//
+// permissions.cpp
+// ***************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+// Compares the per-check work of guild::base_permissions and guild::get_permissions without
+// the permission cache, walking roles and channel overwrites as the guild does on a miss,
+// with the shared-locked map lookups that serve a cached result. The guild cache can only be
+// filled from the gateway, so both paths are modeled here on the same GUILD_CREATE data.
+// usage: aegis_bench_permissions [role count]
+
+#include "bench.hpp"
+#include <aegis.hpp>
+#include <cstdlib>
+
+namespace
+{
+
+using aegis::snowflake;
+using aegis::gateway::objects::role;
+using aegis::gateway::objects::permission_overwrite;
+
+struct guild_model
+{
+    snowflake guild_id;
+    mutable aegis::shared_mutex m;
+    std::unordered_map<snowflake, role> roles;
+    std::unordered_map<int64_t, permission_overwrite> overrides;
+
+    /// Same lookup as guild::get_role, a linear walk returning a copy
+    role get_role(int64_t r) const
+    {
+        std::shared_lock<aegis::shared_mutex> l(m);
+        for (auto & kv : roles)
+            if (kv.second.role_id == r)
+                return kv.second;
+        throw std::out_of_range("role does not exist");
+    }
+};
+
+struct member_model
+{
+    snowflake id;
+    mutable aegis::shared_mutex m;
+    aegis::small_vector<snowflake, 4> roles;
+};
+
+int64_t compute_base(const guild_model & g, const member_model & mem)
+{
+    int64_t permissions = g.get_role(g.guild_id)._permission.get_allow_perms();
+    aegis::small_vector<snowflake, 4> member_roles;
+    {
+        std::shared_lock<aegis::shared_mutex> l(mem.m);
+        member_roles = mem.roles;
+    }
+    for (auto & rl : member_roles)
+        permissions |= g.get_role(rl)._permission.get_allow_perms();
+    return (permissions & 0x8) ? ~0 : permissions;
+}
+
+int64_t compute_channel(const guild_model & g, const member_model & mem)
+{
+    int64_t permissions = compute_base(g, mem);
+    if (permissions & 0x8)
+        return ~0;
+    auto it = g.overrides.find(g.guild_id);
+    if (it != g.overrides.end())
+    {
+        permissions &= ~it->second.deny;
+        permissions |= it->second.allow;
+    }
+    int64_t allow = 0;
+    int64_t deny = 0;
+    aegis::small_vector<snowflake, 4> member_roles;
+    {
+        std::shared_lock<aegis::shared_mutex> l(mem.m);
+        member_roles = mem.roles;
+    }
+    for (auto & rl : member_roles)
+    {
+        auto ow = g.overrides.find(rl);
+        if (ow != g.overrides.end())
+        {
+            allow |= ow->second.allow;
+            deny |= ow->second.deny;
+        }
+    }
+    permissions &= ~deny;
+    permissions |= allow;
+    auto ow = g.overrides.find(mem.id);
+    if (ow != g.overrides.end())
+    {
+        permissions &= ~ow->second.deny;
+        permissions |= ow->second.allow;
+    }
+    return permissions;
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+    const std::size_t role_count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 40;
+
+    auto obj = nlohmann::json::parse(aegis::bench::guild_create(1, 50, role_count))["d"].get<aegis::gateway::objects::guild>();
+
+    guild_model g;
+    g.guild_id = obj.id;
+    role everyone;
+    everyone.role_id = obj.id;
+    everyone.name = "@everyone";
+    everyone._permission = 104324161;
+    g.roles.emplace(everyone.role_id, everyone);
+    for (auto & r : obj.roles)
+        g.roles.emplace(r.role_id, r);
+    for (auto & o : obj.channels.front().permission_overwrites)
+        g.overrides.emplace(o.id, o);
+
+    member_model mem;
+    mem.id = 500000000000000001;
+    for (std::size_t i = 0; i < 4 && i < obj.roles.size(); ++i)
+        mem.roles.push_back(obj.roles[obj.roles.size() - 1 - i * (obj.roles.size() / 4)].role_id);
+
+    const snowflake channel_id = obj.channels.front().id;
+    aegis::shared_mutex perm_m;
+    std::unordered_map<snowflake, int64_t> base_perms{ { mem.id, compute_base(g, mem) } };
+    std::unordered_map<snowflake, std::unordered_map<snowflake, int64_t>> channel_perms;
+    channel_perms[channel_id][mem.id] = compute_channel(g, mem);
+
+    std::printf("%zu roles, member with %zu, %zu channel overwrites\n", g.roles.size(), mem.roles.size(), g.overrides.size());
+
+    int64_t sink = 0;
+    double uncached = aegis::bench::run(1000000, [&] { sink ^= compute_base(g, mem); });
+    aegis::bench::report("base_permissions, computed", uncached);
+    double cached = aegis::bench::run(1000000, [&]
+    {
+        std::shared_lock<aegis::shared_mutex> l(perm_m);
+        sink ^= base_perms.find(mem.id)->second;
+    });
+    aegis::bench::report("base_permissions, cached", cached);
+    std::printf("  %.2fx\n", uncached / cached);
+
+    uncached = aegis::bench::run(1000000, [&] { sink ^= compute_channel(g, mem); });
+    aegis::bench::report("get_permissions, computed", uncached);
+    cached = aegis::bench::run(1000000, [&]
+    {
+        std::shared_lock<aegis::shared_mutex> l(perm_m);
+        sink ^= channel_perms.find(channel_id)->second.find(mem.id)->second;
+    });
+    aegis::bench::report("get_permissions, cached", cached);
+    std::printf("  %.2fx\n", uncached / cached);
+
+    return sink == 42;
+}
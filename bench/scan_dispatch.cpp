@@ -0,0 +1,80 @@
+//
+// scan_dispatch.cpp
+// *****************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+// Reads the envelope of gateway traffic with a full json::parse and with scan_dispatch,
+// the cost paid per payload before core decides whether to skip an event.
+// usage: aegis_bench_scan_dispatch [capture file, one payload per line]
+
+#include "bench.hpp"
+#include <aegis.hpp>
+
+int main(int argc, char * argv[])
+{
+    std::vector<std::string> payloads;
+    if (argc > 1)
+        payloads = aegis::bench::load_capture(argv[1]);
+    else
+    {
+        // presence and typing storms with the occasional message, typical of a large bot
+        for (uint64_t i = 0; i < 10000; ++i)
+        {
+            if (i % 10 == 0)
+                payloads.push_back(aegis::bench::message_create(700000000000000001 + i));
+            else if (i % 3 == 0)
+                payloads.push_back(aegis::bench::typing_start(500000000000000001 + i));
+            else
+                payloads.push_back(aegis::bench::presence_update(500000000000000001 + i));
+        }
+    }
+    if (payloads.empty())
+    {
+        std::printf("no payloads\n");
+        return 1;
+    }
+
+    std::size_t bytes = 0;
+    for (auto & p : payloads)
+        bytes += p.size();
+    std::printf("%zu payloads, %zu bytes\n", payloads.size(), bytes);
+
+    std::size_t seen = 0;
+    double ns = aegis::bench::run(20, [&]
+    {
+        seen = 0;
+        for (auto & p : payloads)
+        {
+            auto j = nlohmann::json::parse(p);
+            auto t = j.find("t");
+            if (t != j.end() && t->is_string())
+                seen += aegis::gateway::events::get_event_type(t->get_ref<const std::string &>()) != aegis::gateway::events::event_type::UNKNOWN;
+        }
+    });
+    const std::size_t parsed = seen;
+    aegis::bench::report("json::parse", ns, bytes);
+    aegis::bench::report("  per payload", ns / payloads.size());
+    const double dom = ns;
+
+    ns = aegis::bench::run(20, [&]
+    {
+        seen = 0;
+        aegis::gateway::events::dispatch_header hdr;
+        for (auto & p : payloads)
+            if (aegis::gateway::events::scan_dispatch(p, hdr))
+                seen += aegis::gateway::events::get_event_type(hdr.t) != aegis::gateway::events::event_type::UNKNOWN;
+    });
+    if (seen != parsed)
+    {
+        std::printf("scan_dispatch found %zu events, json::parse %zu\n", seen, parsed);
+        return 1;
+    }
+    aegis::bench::report("scan_dispatch", ns, bytes);
+    aegis::bench::report("  per payload", ns / payloads.size());
+    std::printf("%.2fx\n", dom / ns);
+    return 0;
+}
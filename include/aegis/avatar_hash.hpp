@@ -0,0 +1,134 @@
+//
+// avatar_hash.hpp
+// ***************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#pragma once
+
+#include "aegis/config.hpp"
+#include "aegis/string_pool.hpp"
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace aegis
+{
+
+/// Avatar or icon hash packed into 16 bytes
+/**
+ * Discord image hashes are 32 hex characters, prefixed with "a_" when animated. Those are
+ * stored as their 16 binary bytes plus a flag. Anything else is kept as an interned string
+ * so the original text is always returned unchanged.
+ */
+class avatar_hash
+{
+public:
+    avatar_hash() noexcept = default;
+
+    /// Pack a hash as sent by Discord
+    /**
+     * @param hash Hash string, empty for no avatar
+     */
+    explicit avatar_hash(const std::string & hash)
+    {
+        if (hash.empty())
+            return;
+
+        std::size_t offset = 0;
+        bool animated = false;
+        if (hash.size() == 34 && hash[0] == 'a' && hash[1] == '_')
+        {
+            offset = 2;
+            animated = true;
+        }
+        if (hash.size() - offset == 32 && _pack(hash.data() + offset))
+        {
+            _flags = packed | (animated ? is_animated : 0);
+            return;
+        }
+        _other = string_pool::global().intern(hash);
+    }
+
+    /// Whether no avatar is set
+    bool empty() const noexcept
+    {
+        return !(_flags & packed) && _other.empty();
+    }
+
+    /// Whether the hash is of an animated image
+    bool animated() const noexcept
+    {
+        return (_flags & is_animated) || _other.str().compare(0, 2, "a_") == 0;
+    }
+
+    /// Get the hash as sent by Discord
+    /**
+     * @returns Hash string, empty if no avatar is set
+     */
+    std::string str() const
+    {
+        if (!(_flags & packed))
+            return _other.str();
+
+        static const char digits[] = "0123456789abcdef";
+        std::string out;
+        out.reserve(34);
+        if (_flags & is_animated)
+            out += "a_";
+        for (auto b : _bytes)
+        {
+            out += digits[b >> 4];
+            out += digits[b & 0x0F];
+        }
+        return out;
+    }
+
+    bool operator==(const avatar_hash & other) const noexcept
+    {
+        return _flags == other._flags && _bytes == other._bytes && _other.str() == other._other.str();
+    }
+
+    bool operator!=(const avatar_hash & other) const noexcept
+    {
+        return !(*this == other);
+    }
+
+private:
+    enum : uint8_t
+    {
+        packed = 1,
+        is_animated = 2
+    };
+
+    static int _nibble(char c) noexcept
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        return -1;
+    }
+
+    bool _pack(const char * hex) noexcept
+    {
+        for (std::size_t i = 0; i < _bytes.size(); ++i)
+        {
+            int hi = _nibble(hex[i * 2]);
+            int lo = _nibble(hex[i * 2 + 1]);
+            if (hi < 0 || lo < 0)
+                return false;
+            _bytes[i] = static_cast<uint8_t>((hi << 4) | lo);
+        }
+        return true;
+    }
+
+    std::array<uint8_t, 16> _bytes{};
+    uint8_t _flags = 0;
+    interned_string _other;
+};
+
+}
@@ -0,0 +1,103 @@
+//
+// cache_stats.hpp
+// ***************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#pragma once
+
+#include "aegis/config.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace aegis
+{
+
+/// Entry count and approximate memory of one kind of cached object
+struct cache_usage
+{
+    uint64_t count = 0; /**< Number of cached objects */
+    uint64_t bytes = 0; /**< Approximate bytes held, including owned strings and containers */
+    uint64_t buckets = 0; /**< Hashtable buckets summed over every table holding these objects */
+
+    /// Entries per bucket over every table holding these objects
+    /**
+     * @returns Load factor, or 0 if the objects are not held in a hashtable
+     */
+    double load_factor() const noexcept
+    {
+        return buckets ? static_cast<double>(count) / static_cast<double>(buckets) : 0.0;
+    }
+};
+
+/// Approximate memory held by each cache
+/**
+ * Byte counts are estimates from object sizes, container capacities and string capacities.
+ * They do not include allocator overhead and are meant for comparing caches and watching
+ * them grow rather than for matching the process RSS exactly.
+ * @see core::get_cache_memory_stats
+ */
+struct cache_memory_stats
+{
+    cache_usage users; /**< User objects in the user cache */
+    cache_usage guild_info; /**< Per guild member data held by users */
+    cache_usage guilds; /**< Guild objects in the guild cache */
+    cache_usage members; /**< Member maps of guilds, one entry per guild a user is in */
+    cache_usage channels; /**< Channel objects in the channel cache */
+    cache_usage roles; /**< Roles of all guilds */
+    cache_usage emojis; /**< Emojis of all guilds */
+    cache_usage voice_states; /**< Voice states of all guilds */
+    cache_usage overwrites; /**< Permission overwrites of all channels */
+    cache_usage permissions; /**< Cached computed permissions of all guilds */
+    cache_usage strings; /**< Interned usernames, nicknames and non standard avatar hashes */
+    cache_usage stale; /**< Removed objects waiting to be reclaimed */
+
+    /// Sum of the bytes of every cache
+    uint64_t total_bytes() const noexcept
+    {
+        return users.bytes + guild_info.bytes + guilds.bytes + members.bytes + channels.bytes
+            + roles.bytes + emojis.bytes + voice_states.bytes + overwrites.bytes
+            + permissions.bytes + strings.bytes + stale.bytes;
+    }
+};
+
+namespace detail
+{
+
+/// Heap bytes of a string beyond the object itself
+inline std::size_t string_bytes(const std::string & s) noexcept
+{
+    // libstdc++ and libc++ store up to 15 and 22 characters inline respectively
+    return s.capacity() > 15 ? s.capacity() + 1 : 0;
+}
+
+/// Heap bytes of a vector of trivially sized elements
+template<typename T>
+inline std::size_t vector_bytes(const std::vector<T> & v) noexcept
+{
+    return v.capacity() * sizeof(T);
+}
+
+/// Add the nodes and bucket array of an unordered container to a usage entry
+/**
+ * Each node is counted as its value plus a next pointer and a cached hash.
+ * @param map Container to account
+ * @param usage Entry to add to
+ */
+template<typename Map>
+inline void add_hashtable(const Map & map, cache_usage & usage) noexcept
+{
+    usage.count += map.size();
+    usage.buckets += map.bucket_count();
+    usage.bytes += map.bucket_count() * sizeof(void *)
+        + map.size() * (sizeof(typename Map::value_type) + sizeof(void *) + sizeof(std::size_t));
+}
+
+}
+
+}
@@ -19,6 +19,8 @@
 #include "aegis/gateway/objects/channel.hpp"
 #include <shared_mutex>
 #include "aegis/futures.hpp"
+#include "aegis/cache_stats.hpp"
+#include "aegis/object_pool.hpp"
 
 namespace aegis
 {
@@ -180,6 +182,8 @@ public:
      */
     AEGIS_DECL channel(const snowflake channel_id, const snowflake guild_id, core * _bot, asio::io_context & _io, ratelimit::ratelimit_mgr & _ratelimit);
 
+    AEGIS_POOLED_ENTITY(channel)
+
     /// Get a reference to the guild object this channel belongs to
     /**
      * @throws aegis::exception Thrown on failure.
@@ -697,6 +701,11 @@ private:
 
     AEGIS_DECL void _load_with_guild_nolock(guild & _guild, const json & obj, shards::shard * _shard);
 
+#if !defined(AEGIS_DISABLE_ALL_CACHE)
+    /// Add this channel and its permission overwrites to stats
+    AEGIS_DECL void _memory_usage(cache_memory_stats & stats) const noexcept;
+#endif
+
     snowflake channel_id; /**< snowflake of this channel */
     snowflake guild_id; /**< snowflake of the guild this channel belongs to */
     guild * _guild; /**< Pointer to the guild this channel belongs to */
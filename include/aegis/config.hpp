@@ -96,6 +96,15 @@
 # define AEGIS_CXX17
 #endif // (__cplusplus >= 201703) || (_MSVC_LANG >= 201703)
 
+// Support for co_await on aegis::future and aegis::task
+#if !defined(AEGIS_HAS_COROUTINES) && !defined(AEGIS_DISABLE_COROUTINES)
+# if defined(__cpp_impl_coroutine) && defined(__has_include)
+#  if __has_include(<coroutine>)
+#   define AEGIS_HAS_COROUTINES 1
+#  endif // __has_include(<coroutine>)
+# endif // defined(__cpp_impl_coroutine) && defined(__has_include)
+#endif // !defined(AEGIS_HAS_COROUTINES) && !defined(AEGIS_DISABLE_COROUTINES)
+
 // Support for std::optional over built-in
 #if !defined(AEGIS_HAS_STD_OPTIONAL)
 # if (__cplusplus >= 201703)
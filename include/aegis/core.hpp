@@ -26,6 +26,12 @@
 #include "aegis/utility.hpp"
 #include "aegis/snowflake.hpp"
 #include "aegis/futures.hpp"
+#include "aegis/coroutine.hpp"
+#include "aegis/entity_cache.hpp"
+#include "aegis/epoch.hpp"
+#include "aegis/cache_stats.hpp"
+#include "aegis/worker_pool.hpp"
+#include "aegis/metrics.hpp"
 //#include "aegis/ratelimit/ratelimit.hpp"
 //#include "aegis/ratelimit/bucket.hpp"
 #include "aegis/rest/rest_controller.hpp"
@@ -35,12 +41,18 @@
 #include "aegis/gateway/objects/channel.hpp"
 #include "aegis/gateway/objects/guild.hpp"
 #include "aegis/gateway/objects/activity.hpp"
+#include "aegis/gateway/events/event_type.hpp"
 
 #include <spdlog/spdlog.h>
+#include <array>
+#include <atomic>
+#include <chrono>
 
 #include <thread>
 #include <condition_variable>
+#include <mutex>
 #include <shared_mutex>
+#include <unordered_set>
 
 namespace aegis
 {
@@ -69,14 +81,6 @@ using message_ptr = websocketpp::config::asio_client::message_type::ptr;
 
 using ratelimit_mgr_t = aegis::ratelimit::ratelimit_mgr;
 
-struct thread_state
-{
-    std::thread thd;
-    bool active = false;
-    std::chrono::steady_clock::time_point start_time;
-    std::function<void(void)> fn;
-};
-
 /// Gateway intents for masking out events on the websocket.
 /// Use as a bitfield with create_bot_t::intents().
 // https://github.com/discordapp/discord-api-docs/pull/1307
@@ -99,6 +103,100 @@ enum intent : uint32_t {
 	DirectMessageTyping = (1 << 14)
 };
 
+/// Ordering guarantee for dispatching gateway events to handlers
+/// Use with create_bot_t::event_order().
+enum class event_order
+{
+    unordered, /**< Events run on any io_context thread as soon as one is free */
+    per_shard, /**< Events of a shard run one at a time in the order they were received */
+    per_guild /**< Events of a guild run in order, events of different guilds run in parallel */
+};
+
+/// How cached users are evicted
+/// Use with cache_policy::eviction().
+enum class cache_eviction
+{
+    none, /**< Users are kept until they leave every guild. max_users and max_bytes evict least recently seen */
+    lru, /**< Least recently seen users are evicted once max_users or max_bytes is exceeded */
+    ttl /**< Users not seen within the ttl are evicted, then least recently seen if still over a limit */
+};
+
+/// Runtime limits on what the caches hold
+/// Use with create_bot_t::cache_policy().
+struct cache_policy
+{
+    /// Maximum number of cached users, 0 for no limit
+    cache_policy & max_users(uint64_t param) noexcept { _max_users = param; return *this; }
+    /// Approximate maximum bytes of cached users, 0 for no limit
+    cache_policy & max_bytes(uint64_t param) noexcept { _max_bytes = param; return *this; }
+    /// Eviction strategy and, for cache_eviction::ttl, how long an unseen user is kept
+    cache_policy & eviction(cache_eviction param, std::chrono::seconds ttl = std::chrono::seconds(3600)) noexcept { _eviction = param; _ttl = ttl; return *this; }
+    /// How often the user cache is checked against the limits
+    cache_policy & sweep_interval(std::chrono::seconds param) noexcept { _sweep_interval = param; return *this; }
+    /// Whether guild roles are cached. Permission checks need roles
+    cache_policy & roles(bool param) noexcept { _roles = param; return *this; }
+    /// Whether guild emojis are cached
+    cache_policy & emojis(bool param) noexcept { _emojis = param; return *this; }
+    /// Whether voice states are cached
+    cache_policy & voice_states(bool param) noexcept { _voice_states = param; return *this; }
+    /// Whether PRESENCE_UPDATE creates and updates users. When off, presences are only passed to callbacks
+    cache_policy & presences(bool param) noexcept { _presences = param; return *this; }
+    /// Whether MESSAGE_UPDATE and TYPING_START add unknown users and channels. When off, those events are skipped unless a callback is set
+    cache_policy & event_users(bool param) noexcept { _event_users = param; return *this; }
+
+    /// Whether any limit or eviction is configured
+    bool evicts() const noexcept
+    {
+        return _max_users || _max_bytes || _eviction != cache_eviction::none;
+    }
+
+    uint64_t _max_users{ 0 };
+    uint64_t _max_bytes{ 0 };
+    cache_eviction _eviction{ cache_eviction::none };
+    std::chrono::seconds _ttl{ 3600 };
+    std::chrono::seconds _sweep_interval{ 60 };
+    bool _roles{ true };
+    bool _emojis{ true };
+    bool _voice_states{ true };
+    bool _presences{ true };
+    bool _event_users{ true };
+};
+
+/// Phases of loading a guild from GUILD_CREATE or READY
+enum class ingest_phase : uint8_t
+{
+    roles, /**< Loading roles */
+    member_create, /**< Finding or creating the user of every member */
+    member_load, /**< Loading member and per guild data into users */
+    channels, /**< Loading channels */
+    presences, /**< Loading presences */
+    emojis, /**< Loading emojis */
+    voice_states, /**< Loading voice states */
+    read, /**< Reading the guild payload */
+    count /**< Number of phases. Must remain last */
+};
+
+/// Number of guild loading phases
+constexpr std::size_t ingest_phase_count = static_cast<std::size_t>(ingest_phase::count);
+
+/// Totals of guild loading since the bot started
+/// @see core::get_ingest_stats
+struct ingest_stats
+{
+    uint64_t guilds = 0; /**< Guilds loaded, including reloads by GUILD_UPDATE */
+    uint64_t members = 0; /**< Members loaded from guild member lists */
+    uint64_t channels = 0; /**< Channels loaded from guild channel lists */
+    std::array<std::chrono::nanoseconds, ingest_phase_count> phase_time{}; /**< Time spent in each phase, summed over all threads */
+    uint64_t startup_pending = 0; /**< Guilds listed by READY that have not been created yet */
+    std::chrono::milliseconds startup{ 0 }; /**< From the first READY until every guild it listed was created, 0 until then */
+
+    /// Get the time spent in a phase
+    std::chrono::nanoseconds time(ingest_phase phase) const noexcept
+    {
+        return phase_time[static_cast<std::size_t>(phase)];
+    }
+};
+
 struct create_guild_t
 {
     create_guild_t & name(const std::string & param) { _name = param; return *this; }
@@ -158,6 +256,52 @@ struct create_bot_t
      * @param log_name The name of the log to create. Will be created in a subdfolder called "log"
      */
     create_bot_t & log_name(const std::string &log_name) noexcept { _log_name = log_name; return *this; }
+    /**
+     * Sets the number of REST requests per second permitted across all ratelimit buckets.
+     * If this is not called, the default is 50, Discord's global limit for most bots
+     * @param param Requests per second
+     */
+    create_bot_t & global_ratelimit(uint32_t param) noexcept { _global_ratelimit = param; return *this; }
+    /**
+     * Sets the order in which gateway events are handed to event handlers.
+     * Ordered events are serialized on one of `strands` asio strands chosen by shard or guild id, so
+     * e.g. MESSAGE_UPDATE never runs before its MESSAGE_CREATE. Events without a guild
+     * (DMs, READY, etc) are ordered per shard when per_guild is chosen.
+     * If this is not called, events are unordered
+     * @param order event_order
+     * @param strands Number of strands events are spread across
+     */
+    create_bot_t & event_order(aegis::event_order order, uint32_t strands = 64) noexcept { _event_order = order; _event_strands = strands; return *this; }
+    /**
+     * Sets limits on what the caches hold and how users are evicted.
+     * Evicted users are detached from their guilds and freed once no event handler can still
+     * reference them. If this is not called, everything is cached and nothing is evicted
+     * @param param cache_policy
+     */
+    create_bot_t & cache_policy(const aegis::cache_policy & param) noexcept { _cache_policy = param; return *this; }
+    /**
+     * Load guilds in parallel while starting up.
+     * Guilds listed in READY are loaded as separate tasks on the strand of their guild, so
+     * with event_order::per_guild or unordered they load on several threads. Ignored with
+     * event_order::per_shard, where every event of a shard, guild loads included, runs in order.
+     * @param param Whether startup guild loading runs in parallel
+     */
+    create_bot_t & bulk_ingest(bool param) noexcept { _bulk_ingest = param; return *this; }
+    /**
+     * Sets how the threads running the bot's io_context are sized and scaled.
+     * Unused when an io_context is supplied. If this is not called, thread_count threads are
+     * started and the pool does not resize
+     * @param param worker_pool_config
+     */
+    create_bot_t & worker_pool(const aegis::worker_pool_config & param) noexcept { _worker_pool = param; return *this; }
+    /**
+     * Record latency histograms of gateway events, REST requests and the io_context.
+     * Adds JSON parse, queue and handler time per event type and shard, REST latency per
+     * bucket and status, ratelimit wait per bucket, and event loop lag
+     * @see core::get_metrics
+     * @param param Whether metrics are recorded
+     */
+    create_bot_t & metrics(bool param) noexcept { _metrics = param; return *this; }
 private:
     friend aegis::core;
     std::string _token;
@@ -166,6 +310,13 @@ private:
     uint32_t _force_shard_count{ 0 };
     uint32_t _cluster_id { 0 };
     uint32_t _max_clusters { 0 };
+    uint32_t _global_ratelimit{ 50 };
+    aegis::event_order _event_order{ aegis::event_order::unordered };
+    uint32_t _event_strands{ 64 };
+    aegis::cache_policy _cache_policy;
+    aegis::worker_pool_config _worker_pool;
+    bool _bulk_ingest{ false };
+    bool _metrics{ false };
     bool _file_logging{ false };
     std::string _log_name { "aegis.log" };
     spdlog::level::level_enum _log_level{ spdlog::level::level_enum::info };
@@ -383,6 +534,15 @@ public:
      */
     AEGIS_DECL int64_t get_user_count() const noexcept;
 
+    /// Get the approximate memory held by each cache
+    /**
+     * Walks every cached guild, channel and user, taking each one's lock in turn, so
+     * the cost grows with the size of the cache. Meant for periodic monitoring.
+     * @see cache_memory_stats
+     * @returns Entry counts, approximate bytes and hashtable load of each cache
+     */
+    AEGIS_DECL cache_memory_stats get_cache_memory_stats() const;
+
     /// Get count of unique channels tracked
     /**
      * @returns int64_t of channel count
@@ -404,6 +564,7 @@ public:
 
     /// Obtain a pointer to a user by snowflake without locking - for interal user
     /**
+     * @deprecated The user cache locks internally per stripe. Equivalent to find_user
      * @param id Snowflake of user to search for
      * @returns Pointer to user or nullptr
      */
@@ -415,6 +576,14 @@ public:
      * @returns Pointer to user
      */
     AEGIS_DECL user * user_create(snowflake id) noexcept;
+
+    /// Obtain pointers to many users by snowflake, creating those that do not exist
+    /**
+     * Each partition of the user cache is locked once for the whole batch.
+     * @param ids Snowflakes of the users
+     * @param out Receives the user of each id, in the order of ids
+     */
+    AEGIS_DECL void user_create_bulk(const std::vector<snowflake> & ids, std::vector<user *> & out);
 #endif
 
     /// Get the snowflake of the bot
@@ -435,6 +604,7 @@ public:
 
     /// Obtain a pointer to a channel by snowflake without locking - for internal use
     /**
+     * @deprecated The channel cache locks internally per stripe. Equivalent to find_channel
      * @param id Snowflake of channel to search for
      * @returns Pointer to channel or nullptr
      */
@@ -456,6 +626,7 @@ public:
 
     /// Obtain a pointer to a guild by snowflake without locking - for internal use
     /**
+     * @deprecated The guild cache locks internally per stripe. Equivalent to find_guild
      * @param id Snowflake of guild to search for
      * @returns Pointer to guild or nullptr
      */
@@ -534,6 +705,108 @@ public:
      */
     AEGIS_DECL void update_presence(const std::string& text, gateway::objects::activity::activity_type type = gateway::objects::activity::Game, gateway::objects::presence::user_status status = gateway::objects::presence::Online);
 
+    /// Get the number of times a gateway event has been dispatched
+    /**
+     * Counters are updated atomically and may be read from any thread.
+     * @param type Event type
+     * @returns Event count
+     */
+    uint64_t get_event_count(gateway::events::event_type type) const noexcept
+    {
+        if (type >= gateway::events::event_type::UNKNOWN)
+            return 0;
+        return _event_count[static_cast<std::size_t>(type)].load(std::memory_order_relaxed);
+    }
+
+    /// Get the total number of gateway events dispatched
+    /**
+     * @returns Event count
+     */
+    uint64_t get_event_count() const noexcept
+    {
+        uint64_t total = 0;
+        for (auto & count : _event_count)
+            total += count.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    /// Get the number of gateway events dropped without parsing
+    /**
+     * Dispatches are skipped when no callback is registered for them and the cache
+     * does not need them.
+     * @returns Skipped event count
+     */
+    uint64_t get_skipped_event_count() const noexcept
+    {
+        return _events_skipped.load(std::memory_order_relaxed);
+    }
+
+    /// Get the epoch manager guarding removed guilds, channels and users
+    /**
+     * Hold an epoch_guard on it to keep entity pointers valid outside of an event handler.
+     * @see epoch_guard
+     * @returns Reference to the epoch manager
+     */
+    epoch_manager & get_epoch() noexcept
+    {
+        return _epoch;
+    }
+
+    /// Get the counters of removed entities that have been freed
+    /**
+     * @returns Retired, reclaimed and pending counts and the bytes reclaimed
+     */
+    reclaim_stats get_reclaim_stats() const
+    {
+        return _epoch.get_stats();
+    }
+
+    /// Get the cache policy the bot was created with
+    const aegis::cache_policy & get_cache_policy() const noexcept
+    {
+        return _cache_policy;
+    }
+
+    /// Get the busy and idle time, handler counts and queue latency of the io_context threads
+    /**
+     * @returns worker_pool_stats, empty if the bot runs on an external io_context
+     */
+    AEGIS_DECL worker_pool_stats get_worker_pool_stats() const;
+
+    /// Get the latency histograms
+    /**
+     * Empty unless metrics were enabled with create_bot_t::metrics. Histograms may also be
+     * added for your own timings.
+     * @returns Reference to the metrics_registry
+     */
+    metrics_registry & get_metrics() noexcept
+    {
+        return _metrics;
+    }
+
+    /// Write a snapshot of every latency histogram to a sink
+    /**
+     * @see prometheus_sink
+     * @param sink Sink to write to
+     */
+    void export_metrics(metrics_sink & sink) const
+    {
+        _metrics.collect(sink);
+    }
+
+    /// Get the guild loading totals and startup timing
+    /**
+     * @returns Counts of loaded guilds, members and channels, the time spent in each loading
+     * phase, and how long startup took
+     */
+    AEGIS_DECL ingest_stats get_ingest_stats() const noexcept;
+
+    /// Get the number of users evicted by the cache policy
+    uint64_t get_evicted_user_count() const noexcept
+    {
+        return _users_evicted.load(std::memory_order_relaxed);
+    }
+
     /// Passes through to Websocket++
     /**
      * @param duration Time until function should be run in milliseconds
@@ -544,15 +817,11 @@ public:
         return get_shard_mgr().get_websocket().set_timer(duration, std::move(callback));
     }
 
-    std::unordered_map<snowflake, std::unique_ptr<channel>> channels;
-    std::unordered_map<snowflake, std::unique_ptr<channel>> stale_channels; //<\todo do something with stales - clear them?
-    std::unordered_map<snowflake, std::unique_ptr<guild>> guilds;
-    std::unordered_map<snowflake, std::unique_ptr<guild>> stale_guilds; //<\todo do something with stales - clear them?
+    entity_cache<channel> channels;
+    entity_cache<guild> guilds;
 #if !defined(AEGIS_DISABLE_ALL_CACHE)
-    std::unordered_map<snowflake, std::unique_ptr<user>> users;
-    std::unordered_map<snowflake, std::unique_ptr<user>> stale_users; //<\todo do something with stales - clear them?
+    entity_cache<user> users;
 #endif
-    std::map<std::string, uint64_t> message_count;
 
     std::string self_presence;
     uint32_t force_shard_count = 0;
@@ -814,13 +1083,13 @@ public:
      */
     const std::string & get_token() const noexcept { return _token; }
 
-    /// Interrupt and end threads
+    /// Start another thread running the io_context
     /**
-     * @param count Amount of threads to shutdown
+     * @returns Number of running threads
      */
     AEGIS_DECL std::size_t add_run_thread() noexcept;
 
-    /// Interrupt and end threads
+    /// End threads once they finish the handler they are running
     /**
      * @param count Amount of threads to shutdown
      */
@@ -851,8 +1120,7 @@ public:
     template<typename T, typename V = std::result_of_t<T()>, typename = std::enable_if_t<!std::is_void<V>::value>>
     aegis::future<V> async(T f) noexcept
     {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        aegis::promise<V> pr(_io_context.get(), &_global_m);
+        aegis::promise<V> pr(_io_context.get());
         auto fut = pr.get_future();
 
         asio::post(*_io_context, [pr = std::move(pr), f = std::move(f)]() mutable
@@ -866,7 +1134,6 @@ public:
                 pr.set_exception(std::current_exception());
             }
         });
-        std::atomic_thread_fence(std::memory_order_release);
         return fut;
     }
 
@@ -890,8 +1157,7 @@ public:
     template<typename T, typename V = std::enable_if_t<std::is_void<std::result_of_t<T()>>::value>>
     aegis::future<V> async(T f) noexcept
     {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        aegis::promise<V> pr(_io_context.get(), &_global_m);
+        aegis::promise<V> pr(_io_context.get());
         auto fut = pr.get_future();
 
         asio::post(*_io_context, [pr = std::move(pr), f = std::move(f)]() mutable
@@ -906,70 +1172,47 @@ public:
                 pr.set_exception(std::current_exception());
             }
         });
-        std::atomic_thread_fence(std::memory_order_release);
         return fut;
     }
 
-    /// Get the internal guild mutex
-    shared_mutex & get_guild_mutex() { return _guild_m; }
-
-    /// Get the internal channel mutex
-    shared_mutex & get_channel_mutex() { return _channel_m; }
-
-    /// Get the internal user mutex
-    shared_mutex & get_user_mutex() { return _user_m; }
-
-    /// Get the guild map
+    /// Get the guild cache
     /**
-     * This will return the internal unordered_map of all the guilds currently tracked. Does not
-     * include stale items. You MUST lock the appropriate mutex BEFORE accessing it to prevent
-     * potential race conditions and possible crashes.
-     * 
+     * This will return the internal cache of all the guilds currently tracked. Does not
+     * include stale items. The cache is split into independently locked stripes and locks
+     * internally, so no external locking is needed. Iterate it with for_each, which holds
+     * each stripe's lock while visiting it.
+     *
      * Example:
      * @code{.cpp}
-     * std::shared_lock<aegis::shared_mutex> l(get_guild_mutex());
+     * get_guild_map().for_each([](aegis::snowflake id, aegis::guild & g) { ... });
      * @endcode
-     * 
-     * @returns std::unordered_map<snowflake, std::unique_ptr<guild>>
+     *
+     * @returns entity_cache<guild>
      */
-    std::unordered_map<snowflake, std::unique_ptr<guild>> & get_guild_map() { return guilds; };
+    entity_cache<guild> & get_guild_map() { return guilds; };
 
-    /// Get the channel map
+    /// Get the channel cache
     /**
-     * This will return the internal unordered_map of all the channels currently tracked. Does not
-     * include stale items. You MUST lock the appropriate mutex BEFORE accessing it to prevent
-     * potential race conditions and possible crashes.
-     *
-     * Example:
-     * @code{.cpp}
-     * std::shared_lock<aegis::shared_mutex> l(get_channel_mutex());
-     * @endcode
-     *
-     * @returns std::unordered_map<snowflake, std::unique_ptr<channel>>
+     * This will return the internal cache of all the channels currently tracked. Does not
+     * include stale items. Locks internally.
+     * @see get_guild_map
+     * @returns entity_cache<channel>
      */
-    std::unordered_map<snowflake, std::unique_ptr<channel>> & get_channel_map() { return channels; };
+    entity_cache<channel> & get_channel_map() { return channels; };
 
 #if !defined(AEGIS_DISABLE_ALL_CACHE)
-    /// Get the user map
+    /// Get the user cache
     /**
-     * This will return the internal unordered_map of all the users currently tracked. Does not
-     * include stale items. You MUST lock the appropriate mutex BEFORE accessing it to prevent
-     * potential race conditions and possible crashes.
-     *
-     * Example:
-     * @code{.cpp}
-     * std::shared_lock<aegis::shared_mutex> l(get_user_mutex());
-     * @endcode
-     *
-     * @returns std::unordered_map<snowflake, std::unique_ptr<user>>
+     * This will return the internal cache of all the users currently tracked. Does not
+     * include stale items. Locks internally.
+     * @see get_guild_map
+     * @returns entity_cache<user>
      */
-    std::unordered_map<snowflake, std::unique_ptr<user>> & get_user_map() { return users; };
+    entity_cache<user> & get_user_map() { return users; };
 #endif
 
 private:
 
-    AEGIS_DECL void _thread_track(thread_state * t_state);
-
 #pragma region event handlers
     //preprocessed object events
     typing_start_t i_typing_start;
@@ -1044,11 +1287,11 @@ private:
     raw_event_t i_webhooks_update_raw;
 
 
-    AEGIS_DECL void ws_presence_update(const json& result, shards::shard* _shard);
+    AEGIS_DECL void ws_presence_update(const std::string & payload, shards::shard* _shard);
     AEGIS_DECL void ws_typing_start(const json& result, shards::shard* _shard);
-    AEGIS_DECL void ws_message_create(const json& result, shards::shard* _shard);
+    AEGIS_DECL void ws_message_create(const std::string & payload, shards::shard* _shard);
     AEGIS_DECL void ws_message_update(const json& result, shards::shard* _shard);
-    AEGIS_DECL void ws_guild_create(const json& result, shards::shard* _shard);
+    AEGIS_DECL void ws_guild_create(const std::string & payload, shards::shard* _shard);
     AEGIS_DECL void ws_guild_update(const json& result, shards::shard* _shard);
     AEGIS_DECL void ws_guild_delete(const json& result, shards::shard* _shard);
     AEGIS_DECL void ws_message_reaction_add(const json& result, shards::shard* _shard);
@@ -1089,10 +1332,26 @@ private:
 
     friend class guild;
     friend class channel;
+    friend class ratelimit::ratelimit_mgr;
     //friend class shard;
 
 
-    AEGIS_DECL void on_message(websocketpp::connection_hdl hdl, std::string msg, shards::shard * _shard);
+    AEGIS_DECL void on_message(websocketpp::connection_hdl hdl, const char * data, std::size_t len, shards::shard * _shard);
+    /// Check whether a registered callback or the cache needs an event parsed
+    AEGIS_DECL bool _event_consumed(gateway::events::event_type type) const noexcept;
+    /// Get the strand an event is dispatched on, or nullptr if events are unordered
+    AEGIS_DECL asio::io_context::strand * _event_strand(const json & result, const std::string & cmd, shards::shard * _shard) noexcept;
+    /// Get the strand an event is dispatched on from its unparsed payload
+    AEGIS_DECL asio::io_context::strand * _event_strand(const char * data, std::size_t len, const std::string & cmd, shards::shard * _shard) noexcept;
+    /// Run an event handler on its strand, timing it and logging the payload if it throws
+    template<typename Payload, typename Handler>
+    void _dispatch_event(asio::io_context::strand * strand, gateway::events::event_type type, const std::string & cmd, shards::shard * _shard, Payload payload, Handler handler);
+    /// Get the histogram of an event on a shard, looking it up in family only on the first event
+    AEGIS_DECL latency_histogram & _event_histogram(histogram_family & family, std::atomic<latency_histogram *> shards::shard::event_histograms::* slot, gateway::events::event_type type, const std::string & cmd, shards::shard * _shard);
+    static std::string _payload_text(const json & payload) { return payload.dump(); }
+    static const std::string & _payload_text(const std::string & payload) noexcept { return payload; }
+    /// Get the strand events of a guild are dispatched on with event_order::per_guild
+    AEGIS_DECL asio::io_context::strand * _guild_strand(uint64_t guild_id) noexcept;
     AEGIS_DECL void on_connect(websocketpp::connection_hdl hdl, shards::shard * _shard);
     AEGIS_DECL void on_close(websocketpp::connection_hdl hdl, shards::shard * _shard);
     AEGIS_DECL void process_ready(const json & d, shards::shard * _shard);
@@ -1101,11 +1360,17 @@ private:
 
     AEGIS_DECL void remove_guild(snowflake guild_id) noexcept;
     AEGIS_DECL void remove_channel(snowflake channel_id) noexcept;
-    AEGIS_DECL void remove_guild_nolock(snowflake guild_id) noexcept;
-    AEGIS_DECL void remove_channel_nolock(snowflake channel_id) noexcept;
 
     AEGIS_DECL void remove_member(snowflake member_id) noexcept;
 
+#if !defined(AEGIS_DISABLE_ALL_CACHE)
+    /// Evict users according to the cache policy
+    AEGIS_DECL void _sweep_users() noexcept;
+
+    /// Detach a user from its guilds and retire it
+    AEGIS_DECL void _evict_user(snowflake user_id) noexcept;
+#endif
+
     std::chrono::steady_clock::time_point starttime;
 
     bool bulk_members_on_connect_ = true; //<\todo will eventually default to false
@@ -1126,6 +1391,50 @@ private:
     uint32_t _cluster_id = 0;
     uint32_t _max_clusters = 0;
 
+    // REST requests per second across all ratelimit buckets
+    uint32_t _global_ratelimit = 50;
+
+    // Ordering of dispatched gateway events. Ordered events are serialized on _event_strands
+    aegis::event_order _event_order = aegis::event_order::unordered;
+    uint32_t _event_strand_count = 64;
+    std::vector<std::unique_ptr<asio::io_context::strand>> _event_strands;
+
+    // What the caches hold and how users are evicted
+    aegis::cache_policy _cache_policy;
+    std::atomic<int64_t> _last_sweep{ 0 };
+    std::atomic<uint64_t> _users_evicted{ 0 };
+
+    // Guild loading totals and startup tracking
+    bool _bulk_ingest = false;
+    std::array<std::atomic<int64_t>, ingest_phase_count> _ingest_ns{};
+    std::atomic<uint64_t> _ingest_guilds{ 0 };
+    std::atomic<uint64_t> _ingest_members{ 0 };
+    std::atomic<uint64_t> _ingest_channels{ 0 };
+    std::atomic<int64_t> _startup_begin{ 0 }; /**< steady_clock nanoseconds of the first READY */
+    std::atomic<int64_t> _startup_ms{ 0 };
+    std::mutex _startup_m;
+    std::unordered_set<snowflake> _startup_guilds; /**< Guilds listed by READY not created yet */
+    std::atomic<std::size_t> _startup_pending{ 0 }; /**< Size of _startup_guilds */
+
+    // Latency histograms, the families are null while metrics are disabled
+    bool _metrics_enabled = false;
+    metrics_registry _metrics;
+    histogram_family * _parse_latency = nullptr;
+    histogram_family * _queue_latency = nullptr;
+    histogram_family * _handler_latency = nullptr;
+
+    /// Create the histogram families and hand them to the ratelimiter and worker pool
+    AEGIS_DECL void _setup_metrics();
+
+    /// Add the time since start to a guild loading phase
+    void _record_ingest(ingest_phase phase, std::chrono::steady_clock::time_point start) noexcept
+    {
+        _ingest_ns[static_cast<std::size_t>(phase)].fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+    }
+
+    /// Mark a guild listed by READY as created and finish startup timing with the last one
+    AEGIS_DECL void _startup_guild_created(snowflake guild_id) noexcept;
+
     bot_status _status = bot_status::uninitialized;
 
     std::shared_ptr<rest::rest_controller> _rest;
@@ -1134,12 +1443,15 @@ private:
 
     user * _self = nullptr;
 
-    std::unordered_map<std::string, std::function<void(const json &, shards::shard *)>> ws_handlers;
+    using ws_handler_t = void (core::*)(const json &, shards::shard *);
+    std::array<ws_handler_t, gateway::events::event_type_count> ws_handlers{}; /**< Indexed by gateway::events::event_type */
+    using ws_reader_handler_t = void (core::*)(const std::string &, shards::shard *);
+    std::array<ws_reader_handler_t, gateway::events::event_type_count> ws_reader_handlers{}; /**< Handlers that read the payload with json_reader, indexed by gateway::events::event_type */
+    std::array<std::atomic<uint64_t>, gateway::events::event_type_count> _event_count{};
+    std::atomic<uint64_t> _events_skipped{ 0 };
     spdlog::level::level_enum _loglevel = spdlog::level::level_enum::info;
     mutable shared_mutex _shard_m;
-    mutable shared_mutex _guild_m;
-    mutable shared_mutex _channel_m;
-    mutable shared_mutex _user_m;
+    mutable epoch_manager _epoch; /**< Frees removed entities once no event handler can still see them */
 
     bool file_logging = false;
     bool external_io_context = true;
@@ -1153,9 +1465,8 @@ private:
     work_ptr wrk = nullptr;
     std::condition_variable cv;
     std::chrono::hours _tz_bias = 0h;
-public:
-    std::vector<std::unique_ptr<thread_state>> threads;
-    std::recursive_mutex _global_m;
+    aegis::worker_pool_config _worker_config;
+    std::unique_ptr<aegis::worker_pool> _workers; /**< Threads running _io_context, null until started */
 };
 
 }
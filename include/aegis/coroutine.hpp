@@ -0,0 +1,264 @@
+//
+// coroutine.hpp
+// *************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#pragma once
+
+#include "aegis/config.hpp"
+#include "aegis/futures.hpp"
+
+#if defined(AEGIS_HAS_COROUTINES)
+
+#include <coroutine>
+
+namespace aegis
+{
+
+/// Awaiter suspending a coroutine until an aegis::future is ready
+/**
+ * The awaiter is the continuation of the future itself, so awaiting does not allocate.
+ * The coroutine resumes where the future completes, which for futures returned by the
+ * library is an io_context thread, or right away if the future was already ready.
+ */
+template <typename T>
+class future_awaiter final : public continuation_base<T>
+{
+public:
+    explicit future_awaiter(future<T> && fut) noexcept
+        : _future(std::move(fut))
+    {}
+
+    bool await_ready() const noexcept
+    {
+        return _future.available();
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+        _handle = handle;
+        // a result published since await_ready() resumes without suspending
+        return _future.attach(this);
+    }
+
+    T await_resume()
+    {
+        if (_state.available())
+            return std::move(_state).get();
+        return _future.get();
+    }
+
+private:
+    virtual void run_and_dispose(future_state<T>&& state) noexcept override
+    {
+        _state = std::move(state);
+        _handle.resume();
+    }
+
+    /// Dropped unrun, e.g. with its io_context destroyed. Resume with broken_promise rather than leak the frame
+    virtual void dispose() noexcept override
+    {
+        _state.set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+        _handle.resume();
+    }
+
+    future<T> _future;
+    future_state<T> _state;
+    std::coroutine_handle<> _handle;
+};
+
+/// Await an aegis::future
+/**
+ * Example:
+ * @code{.cpp}
+ * aegis::task<void> greet(aegis::channel & ch)
+ * {
+ *     auto msg = co_await ch.create_message("hello");
+ *     co_await ch.edit_message(msg.get_id(), "hello again");
+ * }
+ * @endcode
+ *
+ * @param fut Future to wait for, consumed
+ * @returns Awaiter producing the value of the future or throwing its exception
+ */
+template <typename T>
+inline future_awaiter<T> operator co_await(future<T> && fut) noexcept
+{
+    return future_awaiter<T>(std::move(fut));
+}
+
+/// Awaitable moving the rest of a coroutine onto an io_context thread
+/**
+ * @code{.cpp}
+ * co_await aegis::resume_on(bot.get_io_context());
+ * @endcode
+ */
+class resume_on
+{
+public:
+    explicit resume_on(asio::io_context & io_context) noexcept
+        : _io_context(io_context)
+    {}
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        asio::post(_io_context, [handle]
+        {
+            handle.resume();
+        });
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    asio::io_context & _io_context;
+};
+
+template <typename T = void>
+class task;
+
+namespace detail
+{
+
+/// Parts of the promise type of task<T> shared with task<void>
+template <typename T>
+class task_promise_base
+{
+public:
+    std::suspend_never initial_suspend() const noexcept
+    {
+        return {};
+    }
+
+    std::suspend_never final_suspend() const noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception() noexcept
+    {
+        _promise.set_exception(std::current_exception());
+    }
+
+protected:
+    promise<T> _promise{ nullptr };
+};
+
+/// Promise type of task<T>
+template <typename T>
+class task_promise : public task_promise_base<T>
+{
+public:
+    task<T> get_return_object() noexcept;
+
+    template <typename U = T>
+    void return_value(U && value)
+    {
+        this->_promise.set_value(std::forward<U>(value));
+    }
+};
+
+/// Promise type of task<void>
+template <>
+class task_promise<void> : public task_promise_base<void>
+{
+public:
+    task<void> get_return_object() noexcept;
+
+    void return_void() noexcept
+    {
+        this->_promise.set_value();
+    }
+};
+
+}
+
+/// Coroutine whose result is delivered through an aegis::future
+/**
+ * A task starts running as soon as it is called, on the calling thread, until its first
+ * co_await on something not yet ready. Its result can be awaited by another coroutine,
+ * taken as an aegis::future to chain with then() or when_all(), or waited on with get().
+ * Whoever awaits the task resumes on the thread that finishes it.
+ * @tparam T Type of the value returned with co_return
+ */
+template <typename T>
+class task
+{
+public:
+    using value_type = T;
+    using promise_type = detail::task_promise<T>;
+
+    task(task&&) noexcept = default;
+    task& operator=(task&&) noexcept = default;
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+
+    /// Whether the coroutine has finished
+    bool available() const noexcept
+    {
+        return _future.available();
+    }
+
+    /// Block until the coroutine finishes
+    /**
+     * @returns The value returned by the coroutine, or throws the exception it exited with
+     */
+    T get()
+    {
+        return _future.get();
+    }
+
+    /// Take the result as a future
+    future<T> get_future() && noexcept
+    {
+        return std::move(_future);
+    }
+
+    operator future<T>() && noexcept
+    {
+        return std::move(_future);
+    }
+
+    future_awaiter<T> operator co_await() && noexcept
+    {
+        return future_awaiter<T>(std::move(_future));
+    }
+
+private:
+    explicit task(future<T> && fut) noexcept
+        : _future(std::move(fut))
+    {}
+
+    future<T> _future;
+
+    friend class detail::task_promise<T>;
+};
+
+namespace detail
+{
+
+template <typename T>
+inline task<T> task_promise<T>::get_return_object() noexcept
+{
+    return task<T>(this->_promise.get_future());
+}
+
+inline task<void> task_promise<void>::get_return_object() noexcept
+{
+    return task<void>(this->_promise.get_future());
+}
+
+}
+
+}
+
+#endif // defined(AEGIS_HAS_COROUTINES)
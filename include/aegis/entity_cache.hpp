@@ -0,0 +1,230 @@
+//
+// entity_cache.hpp
+// ****************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#pragma once
+
+#include "aegis/config.hpp"
+#include "aegis/snowflake.hpp"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace aegis
+{
+
+#if (AEGIS_HAS_STD_SHARED_MUTEX == 1)
+using shared_mutex = std::shared_mutex;
+#else
+using shared_mutex = std::shared_timed_mutex;
+#endif
+
+/// Concurrent map of snowflake to owned entity, striped into independently locked partitions
+/**
+ * Each id maps to one of Stripes partitions, each with its own shared_mutex, so lookups and
+ * inserts of different entities rarely contend. Entities are heap allocated and never move,
+ * so a returned pointer stays valid until the entity is removed.
+ * @tparam T Entity type
+ * @tparam Stripes Number of partitions, must be a power of two
+ */
+template<typename T, std::size_t Stripes = 64>
+class entity_cache
+{
+    static_assert(Stripes && !(Stripes & (Stripes - 1)), "Stripes must be a power of two");
+
+public:
+    using map_type = std::unordered_map<snowflake, std::unique_ptr<T>>;
+
+    entity_cache() = default;
+    entity_cache(const entity_cache &) = delete;
+    entity_cache & operator=(const entity_cache &) = delete;
+
+    /// Find an entity
+    /**
+     * @param id Snowflake of the entity
+     * @returns Pointer to the entity or nullptr if not cached
+     */
+    T * find(snowflake id) const noexcept
+    {
+        auto & s = _stripe(id);
+        std::shared_lock<shared_mutex> l(s.m);
+        auto it = s.map.find(id);
+        if (it == s.map.end())
+            return nullptr;
+        return it->second.get();
+    }
+
+    /// Find an entity or create it if not cached
+    /**
+     * The lookup only takes a shared lock. The stripe is locked exclusively only when the
+     * entity has to be created.
+     * @param id Snowflake of the entity
+     * @param make Callable returning a std::unique_ptr<T> for the new entity
+     * @returns Pointer to the entity
+     */
+    template<typename Factory>
+    T * get_or_create(snowflake id, Factory && make)
+    {
+        auto & s = _stripe(id);
+        {
+            std::shared_lock<shared_mutex> l(s.m);
+            auto it = s.map.find(id);
+            if (it != s.map.end())
+                return it->second.get();
+        }
+        std::unique_lock<shared_mutex> l(s.m);
+        auto it = s.map.find(id);
+        if (it != s.map.end())
+            return it->second.get();
+        auto ptr = make();
+        auto raw = ptr.get();
+        s.map.emplace(id, std::move(ptr));
+        _size.fetch_add(1, std::memory_order_relaxed);
+        return raw;
+    }
+
+    /// Find or create many entities, locking each stripe once
+    /**
+     * Ids are grouped by stripe and each stripe is locked exclusively a single time for all
+     * of its ids, instead of once per id as with get_or_create.
+     * @param ids Snowflakes of the entities
+     * @param make Callable taking a snowflake and returning a std::unique_ptr<T> for it
+     * @param out Receives the entity of each id, in the order of ids
+     */
+    template<typename Factory>
+    void get_or_create_bulk(const std::vector<snowflake> & ids, Factory && make, std::vector<T *> & out)
+    {
+        out.assign(ids.size(), nullptr);
+
+        // counting sort of the id indices by stripe
+        std::array<uint32_t, Stripes + 1> start{};
+        std::vector<uint32_t> stripe_of(ids.size());
+        for (std::size_t i = 0; i < ids.size(); ++i)
+        {
+            stripe_of[i] = static_cast<uint32_t>(_stripe_index(ids[i]));
+            ++start[stripe_of[i] + 1];
+        }
+        for (std::size_t s = 0; s < Stripes; ++s)
+            start[s + 1] += start[s];
+        std::vector<uint32_t> order(ids.size());
+        {
+            auto pos = start;
+            for (std::size_t i = 0; i < ids.size(); ++i)
+                order[pos[stripe_of[i]]++] = static_cast<uint32_t>(i);
+        }
+
+        for (std::size_t s = 0; s < Stripes; ++s)
+        {
+            if (start[s] == start[s + 1])
+                continue;
+            auto & st = _stripes[s];
+            std::unique_lock<shared_mutex> l(st.m);
+            for (uint32_t n = start[s]; n < start[s + 1]; ++n)
+            {
+                const uint32_t i = order[n];
+                auto it = st.map.find(ids[i]);
+                if (it == st.map.end())
+                {
+                    it = st.map.emplace(ids[i], make(ids[i])).first;
+                    _size.fetch_add(1, std::memory_order_relaxed);
+                }
+                out[i] = it->second.get();
+            }
+        }
+    }
+
+    /// Remove an entity from the cache
+    /**
+     * @param id Snowflake of the entity
+     * @returns Ownership of the removed entity, or nullptr if it was not cached
+     */
+    std::unique_ptr<T> remove(snowflake id) noexcept
+    {
+        auto & s = _stripe(id);
+        std::unique_lock<shared_mutex> l(s.m);
+        auto it = s.map.find(id);
+        if (it == s.map.end())
+            return nullptr;
+        auto ptr = std::move(it->second);
+        s.map.erase(it);
+        _size.fetch_sub(1, std::memory_order_relaxed);
+        return ptr;
+    }
+
+    /// Visit every cached entity
+    /**
+     * Stripes are locked shared one at a time, so entities added or removed during the walk
+     * may or may not be seen. f must not call back into this cache.
+     * @param f Callable taking (snowflake, T &)
+     */
+    template<typename F>
+    void for_each(F && f) const
+    {
+        for (auto & s : _stripes)
+        {
+            std::shared_lock<shared_mutex> l(s.m);
+            for (auto & kv : s.map)
+                f(kv.first, *kv.second);
+        }
+    }
+
+    /// Number of cached entities
+    std::size_t size() const noexcept
+    {
+        return _size.load(std::memory_order_relaxed);
+    }
+
+    /// Total hashtable buckets over every partition
+    std::size_t bucket_count() const noexcept
+    {
+        std::size_t buckets = 0;
+        for (auto & s : _stripes)
+        {
+            std::shared_lock<shared_mutex> l(s.m);
+            buckets += s.map.bucket_count();
+        }
+        return buckets;
+    }
+
+    /// Number of partitions
+    static constexpr std::size_t stripe_count() noexcept
+    {
+        return Stripes;
+    }
+
+private:
+    struct stripe
+    {
+        mutable shared_mutex m;
+        map_type map;
+    };
+
+    static std::size_t _stripe_index(snowflake id) noexcept
+    {
+        // the low bits of a snowflake are worker/process/increment fields that cluster
+        // heavily, mix in the timestamp before picking a stripe
+        uint64_t h = static_cast<uint64_t>(static_cast<int64_t>(id));
+        h ^= h >> 22;
+        h *= 0x9E3779B97F4A7C15ull;
+        return (h >> 32) & (Stripes - 1);
+    }
+
+    stripe & _stripe(snowflake id) const noexcept
+    {
+        return _stripes[_stripe_index(id)];
+    }
+
+    mutable std::array<stripe, Stripes> _stripes;
+    std::atomic<std::size_t> _size{ 0 };
+};
+
+}
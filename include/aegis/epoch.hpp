@@ -0,0 +1,220 @@
+//
+// epoch.hpp
+// *********
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#pragma once
+
+#include "aegis/config.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace aegis
+{
+
+/// Counters of the stale entity reclaimer
+struct reclaim_stats
+{
+    uint64_t retired = 0; /**< Entities removed from the caches */
+    uint64_t reclaimed = 0; /**< Retired entities that have been freed */
+    uint64_t reclaimed_bytes = 0; /**< Object size of the freed entities */
+    uint64_t pending = 0; /**< Retired entities still waiting on a pinned epoch */
+    uint64_t pending_bytes = 0; /**< Object size of the entities still waiting */
+};
+
+/// Epoch based reclamation of entities removed from the caches
+/**
+ * Code that holds raw entity pointers pins the current epoch with an epoch_guard. Removed
+ * entities are retired tagged with the epoch at removal and are only freed once every
+ * guard that was pinned at or before that epoch has been released, so a pointer obtained
+ * under a guard stays valid until the guard goes out of scope.
+ *
+ * Every gateway event handler runs under a guard. Code outside a handler that keeps
+ * entity pointers, such as REST continuations, should hold its own guard.
+ */
+class epoch_manager
+{
+public:
+    /// Maximum number of guards that may be held at the same time
+    static constexpr std::size_t max_pins = 128;
+
+    epoch_manager() = default;
+    epoch_manager(const epoch_manager &) = delete;
+    epoch_manager & operator=(const epoch_manager &) = delete;
+
+    ~epoch_manager()
+    {
+        for (auto & r : _retired)
+            r.deleter(r.ptr);
+    }
+
+    /// Hand over a removed entity to be freed once no guard can still observe it
+    /**
+     * @param ptr Entity that is no longer reachable through any cache
+     */
+    template<typename T>
+    void retire(std::unique_ptr<T> ptr)
+    {
+        if (!ptr)
+            return;
+        std::lock_guard<std::mutex> l(_retire_m);
+        _retired.push_back({ _epoch.load(), ptr.get(), [](void * p) { delete static_cast<T *>(p); }, sizeof(T) });
+        ptr.release();
+        ++_stats.retired;
+        _pending.store(_retired.size(), std::memory_order_relaxed);
+    }
+
+    /// Advance the epoch and free every retired entity no guard can still observe
+    /**
+     * Returns immediately if another thread is already reclaiming.
+     */
+    void try_reclaim()
+    {
+        std::unique_lock<std::mutex> l(_retire_m, std::try_to_lock);
+        if (!l.owns_lock())
+            return;
+
+        _epoch.fetch_add(1);
+        uint64_t oldest = std::numeric_limits<uint64_t>::max();
+        for (auto & s : _slots)
+        {
+            uint64_t e = s.epoch.load();
+            if (e && e < oldest)
+                oldest = e;
+        }
+
+        std::vector<retired> freeable;
+        auto it = std::partition(_retired.begin(), _retired.end(), [oldest](const retired & r)
+        {
+            return r.epoch >= oldest;
+        });
+        freeable.assign(it, _retired.end());
+        _retired.erase(it, _retired.end());
+
+        for (auto & r : freeable)
+        {
+            ++_stats.reclaimed;
+            _stats.reclaimed_bytes += r.bytes;
+        }
+        _pending.store(_retired.size(), std::memory_order_relaxed);
+        l.unlock();
+
+        for (auto & r : freeable)
+            r.deleter(r.ptr);
+    }
+
+    /// Number of retired entities not yet freed
+    std::size_t pending() const noexcept
+    {
+        return _pending.load(std::memory_order_relaxed);
+    }
+
+    /// Get the reclamation counters
+    reclaim_stats get_stats() const
+    {
+        std::lock_guard<std::mutex> l(_retire_m);
+        reclaim_stats stats = _stats;
+        stats.pending = _retired.size();
+        for (auto & r : _retired)
+            stats.pending_bytes += r.bytes;
+        return stats;
+    }
+
+private:
+    friend class epoch_guard;
+
+    struct alignas(64) slot
+    {
+        std::atomic<uint64_t> epoch{ 0 };
+    };
+
+    struct retired
+    {
+        uint64_t epoch;
+        void * ptr;
+        void(*deleter)(void *);
+        std::size_t bytes;
+    };
+
+    std::size_t _pin() noexcept
+    {
+        std::size_t i = std::hash<std::thread::id>()(std::this_thread::get_id()) % max_pins;
+        while (true)
+        {
+            for (std::size_t n = 0; n < max_pins; ++n, i = (i + 1) % max_pins)
+            {
+                uint64_t free_slot = 0;
+                uint64_t e = _epoch.load();
+                if (!_slots[i].epoch.compare_exchange_strong(free_slot, e))
+                    continue;
+                // the reclaimer may have advanced and scanned between loading the epoch
+                // and publishing it, so republish until both agree
+                while (e != _epoch.load())
+                {
+                    e = _epoch.load();
+                    _slots[i].epoch.store(e);
+                }
+                return i;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    void _unpin(std::size_t i) noexcept
+    {
+        _slots[i].epoch.store(0, std::memory_order_release);
+    }
+
+    std::atomic<uint64_t> _epoch{ 1 };
+    std::array<slot, max_pins> _slots;
+    mutable std::mutex _retire_m;
+    std::vector<retired> _retired;
+    std::atomic<std::size_t> _pending{ 0 };
+    reclaim_stats _stats;
+};
+
+/// Pins the current epoch for its lifetime
+/**
+ * Entities reached through the caches while a guard is held are not freed before the
+ * guard is destroyed, even if they are removed in the meantime.
+ * @code{.cpp}
+ * aegis::epoch_guard g(bot.get_epoch());
+ * auto _guild = bot.find_guild(id);
+ * @endcode
+ */
+class epoch_guard
+{
+public:
+    explicit epoch_guard(epoch_manager & mgr) noexcept
+        : _mgr(mgr)
+        , _slot(mgr._pin())
+    {
+
+    }
+
+    ~epoch_guard()
+    {
+        _mgr._unpin(_slot);
+    }
+
+    epoch_guard(const epoch_guard &) = delete;
+    epoch_guard & operator=(const epoch_guard &) = delete;
+
+private:
+    epoch_manager & _mgr;
+    std::size_t _slot;
+};
+
+}
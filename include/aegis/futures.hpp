@@ -13,11 +13,17 @@
 #include "aegis/config.hpp"
 #include "aegis/fwd.hpp"
 #include "aegis/error.hpp"
+#include <atomic>
 #include <condition_variable>
+#include <future>
 #include <stdexcept>
 #include <type_traits>
 #include <memory>
 #include <functional>
+#include <iterator>
+#include <tuple>
+#include <utility>
+#include <vector>
 #include <cassert>
 #include <chrono>
 #include <thread>
@@ -43,6 +49,9 @@ class future;
 template <typename T>
 class shared_future;
 
+template <typename T>
+class future_awaiter;
+
 template <typename T, typename... A>
 future<T> make_ready_future(A&&... value);
 
@@ -113,6 +122,10 @@ add_future_t<T> call_future(Func&& func, Future&& fut) noexcept;
 }
 
 /// future_state<T>
+/**
+ * Holds the result of a future. It is not synchronized itself; a pending result is only
+ * read after the shared state of its promise has published it.
+ */
 template <typename T>
 struct future_state
 {
@@ -132,8 +145,8 @@ struct future_state
         future,
         result,
         exception,
-    };// _state = state::future;
-    std::atomic<state> _state;
+    };
+    state _state = state::future;
     union any
     {
         any() {}
@@ -141,136 +154,86 @@ struct future_state
         T value;
         std::exception_ptr ex;
     } _u;
-    asio::io_context * _io_context = nullptr;
-    std::recursive_mutex * _global_m = nullptr;
     future_state() noexcept {}
-    future_state(asio::io_context * _io_context, std::recursive_mutex * _global_m) noexcept 
-        : _state(state::future)
-        , _io_context(_io_context)
-        , _global_m(_global_m)
-    {}
     future_state(future_state&& x) noexcept
-        : _state(state::future)
-        , _io_context(x._io_context)
-        , _global_m(x._global_m)
-    {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        state _x = x._state.load(std::memory_order_acquire);
-        state _s = _state.load(std::memory_order_acquire);
-        switch (_x)
+        : _state(x._state)
+    {
+        switch (_state)
         {
-            case state::future:
-                break;
             case state::result:
                 new (&_u.value) T(std::move(x._u.value));
-                x._u.value.~T();
                 break;
             case state::exception:
                 new (&_u.ex) std::exception_ptr(std::move(x._u.ex));
-                x._u.ex.~exception_ptr();
-                break;
-            case state::invalid:
                 break;
             default:
-                abort();
+                break;
         }
-        _state.store(_x, std::memory_order_release);
-        x._state.store(state::invalid, std::memory_order_release);
-        std::atomic_thread_fence(std::memory_order_release);
+        x.reset();
+        x._state = state::invalid;
     }
     ~future_state() noexcept
     {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        switch (_state)
-        {
-            case state::invalid:
-                break;
-            case state::future:
-                break;
-            case state::result:
-                _u.value.~T();
-                break;
-            case state::exception:
-                _u.ex.~exception_ptr();
-                break;
-            default:
-                abort();
-        }
-        std::atomic_thread_fence(std::memory_order_release);
+        reset();
     }
     future_state& operator=(future_state&& x) noexcept
     {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        state _s = _state.load(std::memory_order_consume);
         if (this != &x)
         {
             this->~future_state();
             new (this) future_state(std::move(x));
         }
-        std::atomic_thread_fence(std::memory_order_release);
         return *this;
     }
     bool available() const noexcept
     {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        auto _s = _state.load(std::memory_order_consume);
-        std::atomic_thread_fence(std::memory_order_release);
-        return _s == state::result || _s == state::exception;
+        return _state == state::result || _state == state::exception;
     }
     bool failed() const noexcept
     {
         return _state == state::exception;
     }
-    void wait();
-    void set(const T& value) noexcept
+    void set(const T& value) noexcept(copy_noexcept)
     {
-        state _s = _state.load(std::memory_order_acquire);
-        assert(_s == state::future);
+        assert(_state == state::future);
         new (&_u.value) T(value);
-        _state.store(state::result, std::memory_order_release);
+        _state = state::result;
     }
     void set(T&& value) noexcept
     {
-        state _s = _state.load(std::memory_order_acquire);
-        assert(_s == state::future);
+        assert(_state == state::future);
         new (&_u.value) T(std::move(value));
-        _state.store(state::result, std::memory_order_release);
+        _state = state::result;
     }
     template <typename... A>
     void set(A&&... a)
     {
-        state _s = _state.load(std::memory_order_acquire);
-        assert(_s == state::future);
+        assert(_state == state::future);
         new (&_u.value) T(std::forward<A>(a)...);
-        _state.store(state::result, std::memory_order_release);
+        _state = state::result;
     }
     void set_exception(std::exception_ptr ex) noexcept
     {
-        state _s = _state.load(std::memory_order_acquire);
-        assert(_s == state::future);
-        new (&_u.ex) std::exception_ptr(ex);
-        _state.store(state::exception, std::memory_order_release);
+        assert(_state == state::future);
+        new (&_u.ex) std::exception_ptr(std::move(ex));
+        _state = state::exception;
     }
     std::exception_ptr get_exception() && noexcept
     {
-        state _s = _state.load(std::memory_order_acquire);
-        assert(_s == state::exception);
+        assert(_state == state::exception);
         auto ex = std::move(_u.ex);
         _u.ex.~exception_ptr();
-        _state.store(state::invalid, std::memory_order_release);
+        _state = state::invalid;
         return ex;
     }
     std::exception_ptr get_exception() const& noexcept
     {
-        state _s = _state.load(std::memory_order_consume);
-        assert(_s == state::exception);
+        assert(_state == state::exception);
         return _u.ex;
     }
     auto get_value() && noexcept
     {
-        state _s = _state.load(std::memory_order_acquire);
-        assert(_s == state::result);
-        _state.store(_s, std::memory_order_release);
+        assert(_state == state::result);
         return std::move(_u.value);
     }
     template<typename U = T>
@@ -281,23 +244,17 @@ struct future_state
     }
     T get() &&
     {
-        auto _s = _state.load(std::memory_order_acquire);
-        assert(_s != state::future);
-        if (_s == state::exception)
+        assert(available());
+        if (_state == state::exception)
         {
-            auto ex = std::move(_u.ex);
-            _u.ex.~exception_ptr();
-            _state.store(state::invalid, std::memory_order_release);
-            std::rethrow_exception(std::move(ex));
+            std::rethrow_exception(std::move(*this).get_exception());
         }
-        _state.store(_s, std::memory_order_release);
         return std::move(_u.value);
     }
     T get() const&
     {
-        state _s = _state.load(std::memory_order_consume);
-        assert(_s != state::future);
-        if (_s == state::exception)
+        assert(available());
+        if (_state == state::exception)
         {
             std::rethrow_exception(_u.ex);
         }
@@ -305,26 +262,31 @@ struct future_state
     }
     void ignore() noexcept
     {
-        state _s = _state.load(std::memory_order_acquire);
-        assert(_s != state::future);
-        this->~future_state();
-        _state.store(state::invalid, std::memory_order_release);
+        assert(available());
+        reset();
+        _state = state::invalid;
     }
     void forward_to(promise<T>& pr) noexcept
     {
-        state _s = _state.load(std::memory_order_acquire);
-        assert(_s != state::future);
-        if (_s == state::exception)
+        assert(available());
+        if (_state == state::exception)
         {
             pr.set_urgent_exception(std::move(_u.ex));
-            _u.ex.~exception_ptr();
         }
         else
         {
             pr.set_urgent_value(std::move(_u.value));
-            _u.value.~T();
         }
-        _state.store(state::invalid, std::memory_order_release);
+        reset();
+        _state = state::invalid;
+    }
+private:
+    void reset() noexcept
+    {
+        if (_state == state::result)
+            _u.value.~T();
+        else if (_state == state::exception)
+            _u.ex.~exception_ptr();
     }
 };
 
@@ -338,281 +300,266 @@ struct future_state<void>
     static_assert(std::is_nothrow_move_constructible<std::exception_ptr>::value,
                   "std::exception_ptr's move constructor must not throw");
     static constexpr bool copy_noexcept = true;
-    enum class state : uintptr_t
+    enum class state
     {
-        invalid = 0,
-        future = 1,
-        result = 2,
-        exception_min = 3
+        invalid,
+        future,
+        result,
+        exception,
     };
-    union any
-    {
-        any() { st = state::future; }
-        ~any() {}
-        std::atomic<state> st;
-        std::exception_ptr ex;
-    } _u;
-    std::recursive_mutex _m;
-    asio::io_context * _io_context = nullptr;
-    std::recursive_mutex * _global_m = nullptr;
+    state _state = state::future;
+    std::exception_ptr _ex;
     future_state() noexcept {}
-    future_state(asio::io_context * _io_context, std::recursive_mutex * _global_m) noexcept 
-        : _io_context(_io_context)
-        , _global_m(_global_m)
-    {}    future_state(future_state&& x) noexcept
-    {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        if (x._u.st < state::exception_min)
-        {
-            _u.st.store(x._u.st);
-        }
-        else
-        {
-            new (&_u.ex) std::exception_ptr(std::move(x._u.ex));
-            x._u.ex.~exception_ptr();
-        }
-        x._u.st.store(state::invalid);
-        std::atomic_thread_fence(std::memory_order_release);
-    }
-    ~future_state() noexcept
+    future_state(future_state&& x) noexcept
+        : _state(x._state)
+        , _ex(std::move(x._ex))
     {
-        if (_u.st >= state::exception_min)
-        {
-            _u.ex.~exception_ptr();
-        }
+        x._state = state::invalid;
     }
     future_state& operator=(future_state&& x) noexcept
     {
-        std::atomic_thread_fence(std::memory_order_acquire);
         if (this != &x)
         {
-            this->~future_state();
-            new (this) future_state(std::move(x));
+            _state = x._state;
+            _ex = std::move(x._ex);
+            x._state = state::invalid;
         }
-        std::atomic_thread_fence(std::memory_order_release);
         return *this;
     }
     bool available() const noexcept
     {
-        return _u.st == state::result || _u.st >= state::exception_min;
+        return _state == state::result || _state == state::exception;
     }
     bool failed() const noexcept
     {
-        return _u.st >= state::exception_min;
+        return _state == state::exception;
     }
-    void set()
+    void set() noexcept
     {
-        assert(_u.st == state::future);
-        _u.st.store(state::result, std::memory_order_release);
+        assert(_state == state::future);
+        _state = state::result;
     }
     void set_exception(std::exception_ptr ex) noexcept
     {
-        assert(_u.st == state::future);
-        new (&_u.ex) std::exception_ptr(ex);
-        assert(_u.st >= state::exception_min);
+        assert(_state == state::future);
+        _ex = std::move(ex);
+        _state = state::exception;
     }
     void get() &&
     {
-        assert(_u.st != state::future);
-        if (_u.st >= state::exception_min)
+        assert(available());
+        if (_state == state::exception)
         {
-            std::rethrow_exception(std::move(_u.ex));
+            std::rethrow_exception(std::move(*this).get_exception());
         }
     }
     void get() const&
     {
-        assert(_u.st != state::future);
-        if (_u.st >= state::exception_min)
+        assert(available());
+        if (_state == state::exception)
         {
-            std::rethrow_exception(_u.ex);
+            std::rethrow_exception(_ex);
         }
     }
     void ignore() noexcept
     {
         assert(available());
-        this->~future_state();
-        _u.st.store(state::invalid, std::memory_order_release);
+        _ex = nullptr;
+        _state = state::invalid;
     }
     std::exception_ptr get_exception() && noexcept
     {
-        assert(_u.st >= state::exception_min);
-        return std::move(_u.ex);
+        assert(_state == state::exception);
+        _state = state::invalid;
+        return std::move(_ex);
     }
     std::exception_ptr get_exception() const& noexcept
     {
-        assert(_u.st >= state::exception_min);
-        return _u.ex;
+        assert(_state == state::exception);
+        return _ex;
     }
     void get_value() const noexcept
     {
-        assert(_u.st == state::result);
+        assert(_state == state::result);
     }
     void forward_to(promise<void>& pr) noexcept;
 };
 
-/// task<T>
-class task
-{
-public:
-    virtual ~task() = default;
-    virtual void run() noexcept = 0;
-};
-
 /// continuation_base<T>
+/**
+ * Receives the result of a future. Continuations made by then() own themselves and are
+ * deleted once run, while coroutine awaiters live in their coroutine frame.
+ */
 template <typename T>
-class continuation_base : public task
+class continuation_base
 {
-protected:
-    future_state<T> _state;
-    using future_type = future<T>;
-    using promise_type = promise<T>;
 public:
-    continuation_base() = default;
-    explicit continuation_base(asio::io_context * _io_context, std::recursive_mutex * _global_m)
-        : _state(_io_context, _global_m) {}
-
-    explicit continuation_base(future_state<T>&& state) : _state(std::move(state)) {}
+    virtual ~continuation_base() = default;
+    /// Run with the result. The continuation must not be touched afterwards
+    virtual void run_and_dispose(future_state<T>&& state) noexcept = 0;
+    /// Release a continuation that will never run
+    virtual void dispose() noexcept = 0;
+};
 
-    void set_state(T&& state)
+/// continuation<Func, T>
+template <typename Func, typename T>
+struct continuation final : continuation_base<T>
+{
+    explicit continuation(Func&& func) : _func(std::move(func)) {}
+    virtual void run_and_dispose(future_state<T>&& state) noexcept override
     {
-        _state.set(std::move(state));
+        std::unique_ptr<continuation> self(this);
+        _func(std::move(state));
     }
-    void set_state(future_state<T>&& state)
+    virtual void dispose() noexcept override
     {
-        _state = std::move(state);
+        delete this;
     }
-    future_state<T>* state() noexcept
+    Func _func;
+};
+
+namespace detail
+{
+
+struct continuation_disposer
+{
+    template <typename C>
+    void operator()(C * c) const noexcept
     {
-        return &_state;
+        c->dispose();
     }
-
-    friend class promise<T>;
-    friend class future<T>;
 };
 
-/// continuation_base<void>
-template <>
-class continuation_base<void> : public task
+/// State shared by a promise and the future it was created with
+/**
+ * The whole handoff between the two sides is the _continuation slot:
+ *  - nullptr: no result and no continuation yet
+ *  - ready(): the result is published
+ *  - anything else: a continuation is waiting for the result
+ *
+ * The promise writes the result and then exchanges the slot to ready(), running whatever
+ * continuation it displaced. The future attaches its continuation with a single CAS from
+ * nullptr and, if that fails, knows the result is already published and runs it itself.
+ * No lock is taken on either side.
+ */
+template <typename T>
+class shared_state
 {
-protected:
-    future_state<void> _state;
-    using future_type = future<void>;
-    using promise_type = promise<void>;
 public:
-    continuation_base() = default;
-    explicit continuation_base(asio::io_context * _io_context, std::recursive_mutex * _global_m)
-        : _state(_io_context, _global_m) {}
-    explicit continuation_base(future_state<void>&& state) : _state(std::move(state)) {}
-    void set_state(future_state<void>&& state)
+    explicit shared_state(asio::io_context * _io_context) noexcept
+        : _io_context(_io_context)
+    {}
+    shared_state(const shared_state&) = delete;
+    shared_state& operator=(const shared_state&) = delete;
+    ~shared_state() noexcept
     {
-        _state = std::move(state);
+        auto c = _continuation.load(std::memory_order_acquire);
+        if (c && c != ready())
+            c->dispose();
     }
-    future_state<void>* state() noexcept
+
+    /// Whether the result has been published
+    bool available() const noexcept
     {
-        return &_state;
+        return _continuation.load(std::memory_order_acquire) == ready();
     }
 
-    friend class promise<void>;
-    friend class future<void>;
-};
+    /// Attach the continuation to run with the result
+    /**
+     * @returns false if the result was already published, in which case the caller still owns c
+     */
+    bool attach(continuation_base<T> * c) noexcept
+    {
+        continuation_base<T> * expected = nullptr;
+        return _continuation.compare_exchange_strong(expected, c, std::memory_order_acq_rel, std::memory_order_acquire);
+    }
 
-/// continuation<Func, T>
-template <typename Func, typename T>
-struct continuation final : continuation_base<T>
-{
-    continuation(Func&& func, future_state<T>&& state) : continuation_base<T>(std::move(state)), _func(std::move(func)) {}
-    continuation(Func&& func, asio::io_context * _io_context, std::recursive_mutex * _global_m)
-        : continuation_base<T>(_io_context, _global_m)
-        , _func(std::move(func))
-    {}
-    virtual void run() noexcept override
+    /// Publish the result and run or post the continuation waiting for it
+    /**
+     * @param self Reference keeping the state alive until a posted continuation runs
+     * @param urgent Run the continuation on this thread rather than posting it
+     */
+    static void publish(const std::shared_ptr<shared_state> & self, bool urgent) noexcept
     {
-        _func(std::move(this->_state));
+        auto c = self->_continuation.exchange(ready(), std::memory_order_acq_rel);
+        if (!c)
+            return;
+        if (urgent || !self->_io_context)
+        {
+            c->run_and_dispose(std::move(self->_result));
+            return;
+        }
+        std::unique_ptr<continuation_base<T>, continuation_disposer> task(c);
+        asio::post(*self->_io_context, [st = self, task = std::move(task)]() mutable
+        {
+            task.release()->run_and_dispose(std::move(st->_result));
+        });
     }
-    Func _func;
+
+    future_state<T> _result;
+    asio::io_context * _io_context = nullptr;
+
+private:
+    /// Marker stored in the continuation slot once the result is published
+    static continuation_base<T> * ready() noexcept
+    {
+        return &_ready;
+    }
+
+    struct ready_marker final : continuation_base<T>
+    {
+        virtual void run_and_dispose(future_state<T>&&) noexcept override {}
+        virtual void dispose() noexcept override {}
+    };
+    static ready_marker _ready;
+
+    std::atomic<continuation_base<T> *> _continuation{ nullptr };
 };
-using task_ptr = std::unique_ptr<task>;
 
+template <typename T>
+typename shared_state<T>::ready_marker shared_state<T>::_ready;
+
+}
 
 /// promise<T>
 template <typename T>
 class promise
 {
     enum class urgent { no, yes };
-    future<T>* _future = nullptr;
-    future_state<T> _local_state;
-    future_state<T>* _state;
-    std::unique_ptr<continuation_base<T>> _task;
-    std::recursive_mutex _m;
-    asio::io_context * _io_context = nullptr;
-    std::recursive_mutex * _global_m = nullptr;
+    std::shared_ptr<detail::shared_state<T>> _shared;
+    bool _set = false;
     static constexpr bool copy_noexcept = future_state<T>::copy_noexcept;
 public:
-    promise(asio::io_context * _io_context, std::recursive_mutex * _global_m) noexcept
-        : _local_state(future_state<T>(_io_context, _global_m))
-        , _state(&_local_state)
-        , _io_context(_io_context)
-        , _global_m(_global_m)
+    /// Create a promise whose continuations are posted to an io_context
+    /**
+     * @param _io_context Context continuations are posted to once a value is set
+     */
+    explicit promise(asio::io_context * _io_context)
+        : _shared(std::make_shared<detail::shared_state<T>>(_io_context))
+    {}
+
+    /// @deprecated The mutex is no longer used. Use promise(asio::io_context*)
+    promise(asio::io_context * _io_context, std::recursive_mutex *)
+        : promise(_io_context)
     {}
 
     promise(promise&& x) noexcept
-        : _local_state(future_state<T>(x._io_context, x._global_m))
-        , _io_context(x._io_context)
-        , _global_m(x._global_m)
-    {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        std::lock_guard<std::recursive_mutex> gl(*_global_m);
-        if (x._future)
-        {
-            std::unique_lock<std::recursive_mutex> l(_m, std::defer_lock);
-            std::unique_lock<std::recursive_mutex> l2(x._future->_m, std::defer_lock);
-            std::lock(l, l2);
-            if (!x._future)
-                goto NOTREALLYTHERE;
-            _future = x._future;
-            _future->_promise = this;
-            _state = x._state;
-            _task = std::move(x._task);
-            if (_state == &x._local_state)
-            {
-                _state = &_local_state;
-                _local_state = std::move(x._local_state);
-            }
-            x._future = nullptr;
-            x._state = nullptr;
-        }
-        else
-        {
-        NOTREALLYTHERE:;
-            std::lock_guard<std::recursive_mutex> l(_m);
-            _state = x._state;
-            _task = std::move(x._task);
-            if (_state == &x._local_state)
-            {
-                _state = &_local_state;
-                _local_state = std::move(x._local_state);
-            }
-            x._state = nullptr;
-        }
-        std::atomic_thread_fence(std::memory_order_release);
-    }
+        : _shared(std::move(x._shared))
+        , _set(x._set)
+    {}
     promise(const promise&) = delete;
     ~promise() noexcept
     {
-        std::unique_lock<std::recursive_mutex> l(_m, std::defer_lock);
-        std::unique_lock<std::recursive_mutex> l2(*_global_m, std::defer_lock);
-        std::lock(l, l2);
         abandoned();
     }
     promise& operator=(promise&& x) noexcept
     {
-        std::atomic_thread_fence(std::memory_order_acquire);
         if (this != &x)
         {
-            this->~promise();
-            new (this) promise(std::move(x));
+            abandoned();
+            _shared = std::move(x._shared);
+            _set = x._set;
         }
-        std::atomic_thread_fence(std::memory_order_release);
         return *this;
     }
     void operator=(const promise&) = delete;
@@ -622,9 +569,7 @@ public:
     template <typename... A>
     void set_value(A&&... a) noexcept
     {
-        assert(_state);
-        _state->set(std::forward<A>(a)...);
-        make_ready<urgent::no>();
+        do_set_value<urgent::no>(std::forward<A>(a)...);
     }
 
     void set_exception(std::exception_ptr ex) noexcept
@@ -640,24 +585,24 @@ public:
 private:
 
     template<urgent Urgent, typename... A>
-    void do_set_value(A... a) noexcept
+    void do_set_value(A&&... a) noexcept
     {
-        assert(_state);
-        _state->set(std::move(a)...);
+        assert(_shared && !_set);
+        _shared->_result.set(std::forward<A>(a)...);
         make_ready<Urgent>();
     }
 
     template<typename... A>
     void set_urgent_value(A&&... a) noexcept
     {
-        set_value(std::forward<A>(a)...);
+        do_set_value<urgent::yes>(std::forward<A>(a)...);
     }
 
     template<urgent Urgent>
     void do_set_exception(std::exception_ptr ex) noexcept
     {
-        assert(_state);
-        _state->set_exception(std::move(ex));
+        assert(_shared && !_set);
+        _shared->_result.set_exception(std::move(ex));
         make_ready<Urgent>();
     }
 
@@ -666,13 +611,6 @@ private:
         do_set_exception<urgent::yes>(std::move(ex));
     }
 private:
-    template <typename Func>
-    void schedule(Func&& func)
-    {
-        auto tws = std::make_unique<continuation<Func, T>>(std::move(func), _io_context, _global_m);
-        _state = &tws->_state;
-        _task = std::move(tws);
-    }
     template<urgent Urgent>
     void make_ready() noexcept;
     void abandoned() noexcept;
@@ -688,132 +626,71 @@ private:
 template <typename T>
 class future
 {
-    promise<T>* _promise;
+    std::shared_ptr<detail::shared_state<T>> _shared;
     future_state<T> _local_state;
-    mutable std::recursive_mutex _m;
-    asio::io_context * _io_context = nullptr;
-    std::recursive_mutex * _global_m = nullptr;
     static constexpr bool copy_noexcept = future_state<T>::copy_noexcept;
 private:
-    future(promise<T>* pr) noexcept
-        : _local_state(future_state<T>(pr->_io_context, pr->_global_m))
-    {
-        _io_context = pr->_io_context;
-        _global_m = pr->_global_m;
-        std::atomic_thread_fence(std::memory_order_acquire);
-        std::unique_lock<std::recursive_mutex> l(*_global_m, std::defer_lock);
-        std::unique_lock<std::recursive_mutex> l2(_m, std::defer_lock);
-        std::unique_lock<std::recursive_mutex> l3(pr->_m, std::defer_lock);
-        std::lock(l, l2, l3);
-
-        _promise = pr;
-        _promise->_future = this;
-        std::atomic_thread_fence(std::memory_order_release);
-    }
+    explicit future(std::shared_ptr<detail::shared_state<T>> st) noexcept
+        : _shared(std::move(st))
+    {}
     template <typename... A>
     future(ready_future_marker, A&&... a)
-        : _promise(nullptr)
-        , _local_state(future_state<T>(nullptr, nullptr))
     {
         _local_state.set(std::forward<A>(a)...);
     }
     future(exception_future_marker, std::exception_ptr ex) noexcept
-        : _promise(nullptr)
-        , _local_state(future_state<T>(nullptr, nullptr))
     {
         _local_state.set_exception(std::move(ex));
     }
-    explicit future(future_state<T>&& state, asio::io_context * _io_context, std::recursive_mutex * _global_m) noexcept
-        : _local_state(future_state<T>(_io_context, _global_m))
-        , _io_context(_io_context)
-        , _global_m(_global_m)
-    {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        _local_state = std::move(state);
-        _promise = nullptr;
-        std::atomic_thread_fence(std::memory_order_release);
-    }
+    explicit future(future_state<T>&& state) noexcept
+        : _local_state(std::move(state))
+    {}
+    /// Only valid once available() has returned true
     future_state<T> * state() noexcept
     {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        if (_promise)
-        {
-            std::unique_lock<std::recursive_mutex> l(_m, std::defer_lock);
-            std::unique_lock<std::recursive_mutex> l2(*_global_m, std::defer_lock);
-            std::lock(l, l2);
-            
-            //std::lock_guard<std::recursive_mutex> l(_promise->_m);
-            future_state<T> * _st = _promise->_state;
-            std::atomic_thread_fence(std::memory_order_release);
-            return _st;
-        }
-        else
-        {
-            future_state<T> * _st = &_local_state;
-            std::atomic_thread_fence(std::memory_order_release);
-            return _st;
-        }
+        return _shared ? &_shared->_result : &_local_state;
     }
     const future_state<T> * state() const noexcept
     {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        if (_promise)
-        {
-            std::unique_lock<std::recursive_mutex> l(_m, std::defer_lock);
-            std::unique_lock<std::recursive_mutex> l2(*_global_m, std::defer_lock);
-            std::lock(l, l2);
-
-            //std::lock_guard<std::recursive_mutex> l(_promise->_m);
-            const future_state<T> * _st = _promise->_state;
-            std::atomic_thread_fence(std::memory_order_release);
-            return _st;
-        }
-        else
-        {
-            const future_state<T> * _st = &_local_state;
-            std::atomic_thread_fence(std::memory_order_release);
-            return _st;
-        }
+        return _shared ? &_shared->_result : &_local_state;
+    }
+    asio::io_context * io_context() const noexcept
+    {
+        return _shared ? _shared->_io_context : nullptr;
+    }
+    /// Hand the continuation to the promise side
+    /**
+     * @returns false if the result was already published, in which case c stays with the caller
+     */
+    bool attach(continuation_base<T> * c) noexcept
+    {
+        assert(_shared);
+        // once attached the continuation may run and destroy this future, so leave it first
+        auto st = std::move(_shared);
+        if (st->attach(c))
+            return true;
+        _shared = std::move(st);
+        return false;
     }
     template <typename Func>
     void schedule(Func&& func)
     {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        future_state<T> * _st = state();
-        if (state()->available())
+        auto task = new continuation<Func, T>(std::move(func));
+        if (!attach(task))
         {
-            asio::post(*_io_context, [func = std::move(func), _state = std::move(*state())]() mutable
-            {
-                func(std::move(_state));
-            });
+            // the result was published after the caller checked available()
+            task->run_and_dispose(get_available_state());
         }
-        else
-        {
-            std::lock_guard<std::recursive_mutex> gl(*_global_m);
-            std::unique_lock<std::recursive_mutex> l(_m, std::defer_lock);
-            std::unique_lock<std::recursive_mutex> l2(_promise->_m, std::defer_lock);
-            std::lock(l, l2);
-            assert(_promise);
-            _promise->schedule(std::move(func));
-            _promise->_future = nullptr;
-            _promise = nullptr;
-        }
-        std::atomic_thread_fence(std::memory_order_release);
     }
     future_state<T> get_available_state() noexcept
     {
-        auto st = state();
-        if (_promise)
+        assert(available());
+        if (_shared)
         {
-            std::lock_guard<std::recursive_mutex> gl(*_global_m);
-            std::lock_guard<std::recursive_mutex> l(_promise->_m);
-            if (!_promise)
-                goto NOTREALLYTHERE;
-            _promise->_future = nullptr;
-            _promise = nullptr;
+            auto st = std::move(_shared);
+            return std::move(st->_result);
         }
-    NOTREALLYTHERE:;
-        return std::move(*st);
+        return std::move(_local_state);
     }
 
     future<T> rethrow_with_nested()
@@ -839,103 +716,33 @@ private:
 
     template<typename U>
     friend class shared_future;
+    template<typename U>
+    friend class future_awaiter;
 public:
     using value_type = T;
     using promise_type = promise<T>;
-    future(future&& x) noexcept
-        : _local_state(future_state<T>(x._io_context, x._global_m))
-        , _io_context(x._io_context)
-        , _global_m(x._global_m)
-    {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        std::unique_lock<std::recursive_mutex> l(_m, std::defer_lock);
-        std::unique_lock<std::recursive_mutex> l2(x._m, std::defer_lock);
-        std::lock(l, l2);
-
-        _promise = x._promise;
-        if (!_promise)
-        {
-            _local_state = std::move(x._local_state);
-        }
-        x._promise = nullptr;
-        if (_promise)
-        {
-            std::lock_guard<std::recursive_mutex> gl(*_global_m);
-            std::lock_guard<std::recursive_mutex> l(_promise->_m);
-            _promise->_future = this;
-        }
-        std::atomic_thread_fence(std::memory_order_release);
-    }
+    future(future&& x) noexcept = default;
     future(const future&) = delete;
-    future& operator=(future&& x) noexcept
-    {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        if (this != &x)
-        {
-            this->~future();
-            new (this) future(std::move(x));
-        }
-        std::atomic_thread_fence(std::memory_order_release);
-        return *this;
-    }
+    future& operator=(future&& x) noexcept = default;
     void operator=(const future&) = delete;
-    ~future()
-    {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        if (_promise)
-        {
-            std::lock_guard<std::recursive_mutex> l(*_global_m);
-            if (_promise)
-            {
-                std::lock_guard<std::recursive_mutex> l(_promise->_m);
-                _promise->_future = nullptr;
-            }
-        }
-        /*if (failed())
-        {
-        }*/
-        std::atomic_thread_fence(std::memory_order_release);
-    }
+    ~future() = default;
 
     T get()
     {
-        {
-            std::atomic_thread_fence(std::memory_order_acquire);
-            future_state<T> * _st = state();
-            std::atomic_thread_fence(std::memory_order_release);
-            if (!_st->available())
-            {
-                do_wait();
-            }
-        }
-
-        {
-            std::atomic_thread_fence(std::memory_order_acquire);
-
-            std::unique_lock<std::recursive_mutex> l(_m, std::defer_lock);
-            std::unique_lock<std::recursive_mutex> l2(*_global_m, std::defer_lock);
-            std::lock(l, l2);
-
-            future_state<T> _st(get_available_state());
-            std::atomic_thread_fence(std::memory_order_release);
-            return _st.get();
-        }
+        wait();
+        future_state<T> _st(get_available_state());
+        return std::move(_st).get();
     }
 
     std::exception_ptr get_exception()
     {
-        std::atomic_thread_fence(std::memory_order_acquire);
         future_state<T> _st(get_available_state());
-        std::atomic_thread_fence(std::memory_order_release);
-        return _st.get_exception();
+        return std::move(_st).get_exception();
     }
 
     void wait() const noexcept
     {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        const future_state<T> * _st = state();
-        std::atomic_thread_fence(std::memory_order_release);
-        if (!_st->available())
+        if (!available())
         {
             do_wait();
         }
@@ -943,40 +750,37 @@ public:
 private:
     void do_wait() const noexcept
     {
-        // fake wait
-        // maybe execute something in the asio queue?
-
+        // spin briefly for results that are nearly done, then back off to sleeping
+        for (int i = 0; i < 64; ++i)
+        {
+            if (available())
+                return;
+            std::this_thread::yield();
+        }
+        auto delay = std::chrono::microseconds(50);
         while (!available())
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        {
+            std::this_thread::sleep_for(delay);
+            if (delay < std::chrono::milliseconds(10))
+                delay *= 2;
+        }
     }
 
 public:
     bool available() const noexcept
     {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        const future_state<T> * _st = state();
-        assert(_st);
-        auto res = _st->available();
-        std::atomic_thread_fence(std::memory_order_release);
-        return res;
+        return _shared ? _shared->available() : _local_state.available();
     }
 
     bool failed() const noexcept
     {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        auto _st = state();
-        if (!_st)
-            return false;
-        bool f = _st->failed();
-        std::atomic_thread_fence(std::memory_order_release);
-        return f;
+        return available() && state()->failed();
     }
 
     template <typename Func, typename Result = result_of_t<Func, T>>
     add_future_t<Result> then(Func&& func) noexcept
     {
         using inner_type = remove_future_t<Result>;
-        std::atomic_thread_fence(std::memory_order_acquire);
         if (available())
         {
             if (failed())
@@ -988,13 +792,11 @@ public:
                 return detail::call_state<inner_type>(std::forward<Func>(func), get_available_state());
             }
         }
-        std::atomic_thread_fence(std::memory_order_release);
-        promise<inner_type> pr(_io_context, _global_m);
-        auto fut = pr.get_future();
         try
         {
+            promise<inner_type> pr(io_context());
+            auto fut = pr.get_future();
             this->schedule([pr = std::move(pr), func = std::forward<Func>(func)](future_state<T> && state) mutable {
-                std::atomic_thread_fence(std::memory_order_acquire);
                 if (state.failed())
                 {
                     pr.set_exception(std::move(state).get_exception());
@@ -1003,58 +805,57 @@ public:
                 {
                     detail::call_state<inner_type>(std::forward<Func>(func), std::move(state)).forward_to(std::move(pr));
                 }
-                std::atomic_thread_fence(std::memory_order_release);
             });
+            return fut;
         }
         catch (...)
         {
             abort();
         }
-        return fut;
     }
 
     template <typename Func, typename Result = std::result_of_t<Func(future)>>
     add_future_t<Result> then_wrapped(Func&& func) noexcept
     {
         using inner_type = remove_future_t<Result>;
-        std::atomic_thread_fence(std::memory_order_acquire);
         if (available())
         {
-            return detail::call_future<inner_type>(std::forward<Func>(func), future(get_available_state(), _io_context, _global_m));
+            return detail::call_future<inner_type>(std::forward<Func>(func), future(get_available_state()));
         }
-        std::atomic_thread_fence(std::memory_order_release);
-        promise<inner_type> pr(_io_context, _global_m);
-        auto fut = pr.get_future();
         try
         {
-            this->schedule([pr = std::move(pr), func = std::forward<Func>(func), this](auto&& state) mutable {
-                std::atomic_thread_fence(std::memory_order_acquire);
-                detail::call_future<inner_type>(std::forward<Func>(func), future(std::move(state), _io_context, _global_m)).forward_to(std::move(pr));
-                std::atomic_thread_fence(std::memory_order_release);
+            promise<inner_type> pr(io_context());
+            auto fut = pr.get_future();
+            this->schedule([pr = std::move(pr), func = std::forward<Func>(func)](future_state<T> && state) mutable {
+                detail::call_future<inner_type>(std::forward<Func>(func), future(std::move(state))).forward_to(std::move(pr));
             });
+            return fut;
         }
         catch (...)
         {
             abort();
         }
-        return fut;
     }
 
     void forward_to(promise<T>&& pr) noexcept
     {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        if (state()->available())
+        if (available())
         {
-            state()->forward_to(pr);
+            get_available_state().forward_to(pr);
         }
         else
         {
-            std::lock_guard<std::recursive_mutex> gl(*_global_m);
-            _promise->_future = nullptr;
-            *_promise = std::move(pr);
-            _promise = nullptr;
+            try
+            {
+                this->schedule([pr = std::move(pr)](future_state<T> && state) mutable {
+                    state.forward_to(pr);
+                });
+            }
+            catch (...)
+            {
+                abort();
+            }
         }
-        std::atomic_thread_fence(std::memory_order_release);
     }
 
     template <typename Func>
@@ -1139,7 +940,7 @@ public:
 
     void ignore_ready_future() noexcept
     {
-        state()->ignore();
+        get_available_state().ignore();
     }
 
 private:
@@ -1157,8 +958,8 @@ private:
 template <typename T>
 inline future<T> promise<T>::get_future() noexcept
 {
-    assert(!_future && _state && !_task);
-    return future<T>(this);
+    assert(_shared);
+    return future<T>(_shared);
 }
 
 /// promise<T>::make_ready()
@@ -1166,40 +967,18 @@ template <typename T>
 template<typename promise<T>::urgent Urgent>
 inline void promise<T>::make_ready() noexcept
 {
-    if (_task)
-    {
-        _state = nullptr;
-        if (Urgent == urgent::yes)
-        {
-            _task->run();
-        }
-        else
-        {
-            asio::post(*_io_context, [_task = std::move(_task)]
-            {
-                _task->run();
-            });
-        }
-    }
+    _set = true;
+    detail::shared_state<T>::publish(_shared, Urgent == urgent::yes);
 }
 
 /// promise<T>::abandoned()
 template <typename T>
 inline void promise<T>::abandoned() noexcept
 {
-    std::atomic_thread_fence(std::memory_order_acquire);
-    if (_future)
-    {
-        std::lock_guard<std::recursive_mutex> l(_future->_m);
-        assert(_state);
-        assert(_state->available() || !_task);
-        _future->_local_state = std::move(*_state);
-        _future->_promise = nullptr;
-    }
-    else if (_state && _state->failed())
-    {
-    }
-    std::atomic_thread_fence(std::memory_order_release);
+    // fail rather than leave the future waiting forever on a promise that can no longer be set.
+    // A waiting continuation holds no reference, so this cannot depend on use_count()
+    if (_shared && !_set)
+        do_set_exception<urgent::no>(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
 }
 
 /// make_ready_future<T, ...A>()
@@ -1315,18 +1094,16 @@ inline add_future_t<T> call_future(Func&& func, Future&& fut) noexcept
 /// future_state<void>::forward_to()
 inline void future_state<void>::forward_to(promise<void>& pr) noexcept
 {
-    std::atomic_thread_fence(std::memory_order_acquire);
     assert(available());
-    if (_u.st == state::exception_min)
+    if (_state == state::exception)
     {
-        pr.set_urgent_exception(std::move(_u.ex));
+        pr.set_urgent_exception(std::move(_ex));
     }
     else
     {
         pr.set_urgent_value();
     }
-    _u.st = state::invalid;
-    std::atomic_thread_fence(std::memory_order_release);
+    _state = state::invalid;
 }
 
 /// make_exception_future()
@@ -1336,4 +1113,219 @@ inline future<T> make_exception_future(aegis::error ec)
     return aegis::make_exception_future<T>(std::make_exception_ptr(aegis::exception(make_error_code(ec))));
 }
 
+
+/// Result of when_any()
+template <typename Sequence>
+struct when_any_result
+{
+    std::size_t index; /**< Position of the first future to complete, or -1 if there were none */
+    Sequence futures; /**< All futures, the one at index is ready and the rest may still be pending */
+};
+
+namespace detail
+{
+
+/// Shared by the continuations of one when_all() or when_any() over a range
+template <typename T, typename Result>
+struct when_range_state
+{
+    explicit when_range_state(std::size_t count)
+        : remaining(count)
+    {
+        promises.reserve(count);
+        futures.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            promises.emplace_back(nullptr);
+            futures.push_back(promises.back().get_future());
+        }
+    }
+
+    std::vector<promise<T>> promises;
+    std::vector<future<T>> futures;
+    std::atomic<std::size_t> remaining;
+    std::atomic<bool> fired{ false };
+    promise<Result> pr{ nullptr };
+};
+
+/// Shared by the continuations of one variadic when_all() or when_any()
+template <typename Result, typename... T>
+struct when_pack_state
+{
+    when_pack_state()
+        : when_pack_state(std::index_sequence_for<T...>{})
+    {}
+
+    template <std::size_t... I>
+    explicit when_pack_state(std::index_sequence<I...>)
+        : promises(promise<T>(nullptr)...)
+        , futures(std::get<I>(promises).get_future()...)
+    {}
+
+    std::tuple<promise<T>...> promises;
+    std::tuple<future<T>...> futures;
+    std::atomic<std::size_t> remaining{ sizeof...(T) };
+    std::atomic<bool> fired{ false };
+    promise<Result> pr{ nullptr };
+};
+
+/// Complete a when_all() once the last input has arrived
+template <typename State>
+inline void when_all_arrive(State & st) noexcept
+{
+    if (st.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        st.pr.set_value(std::move(st.futures));
+}
+
+/// Complete a when_any() with the first input to arrive
+template <typename Result, typename State>
+inline void when_any_arrive(State & st, std::size_t index) noexcept
+{
+    if (!st.fired.exchange(true, std::memory_order_acq_rel))
+        st.pr.set_value(Result{ index, std::move(st.futures) });
+}
+
+/// Forward input I into its slot and report it through Arrive
+template <std::size_t I, typename State, typename Future, typename Arrive>
+inline void when_attach(const std::shared_ptr<State> & st, Future&& fut, Arrive arrive) noexcept
+{
+    using value_type = typename std::decay_t<Future>::value_type;
+    fut.then_wrapped([st, arrive](future<value_type> f) mutable
+    {
+        f.forward_to(std::move(std::get<I>(st->promises)));
+        arrive(*st, I);
+    });
+}
+
+template <typename State, typename... Futures, std::size_t... I, typename Arrive>
+inline void when_attach_all(const std::shared_ptr<State> & st, std::index_sequence<I...>, Arrive arrive, Futures&&... futs) noexcept
+{
+    int expand[] = { 0, (when_attach<I>(st, std::forward<Futures>(futs), arrive), 0)... };
+    (void)expand;
+}
+
+template<typename T>
+struct is_future_pack : std::true_type {};
+
+template<typename T, typename... Rest>
+struct is_future_pack<std::tuple<T, Rest...>>
+    : std::integral_constant<bool, is_future<std::decay_t<T>>::value && is_future_pack<std::tuple<Rest...>>::value> {};
+
+}
+
+/// Wait for every future in a range without blocking a thread
+/**
+ * The inputs are moved from. The returned future becomes ready once all of them are, with
+ * each input's result in the same position, so failures can be checked one by one.
+ *
+ * Example:
+ * @code{.cpp}
+ * std::vector<aegis::future<aegis::gateway::objects::message>> sends;
+ * for (auto & content : lines)
+ *     sends.push_back(channel.create_message(content));
+ * aegis::when_all(sends.begin(), sends.end()).then([](auto results) {
+ *     for (auto & r : results)
+ *         if (r.failed()) ...
+ * });
+ * @endcode
+ *
+ * @param begin First future
+ * @param end Past the last future
+ * @returns future of a vector holding every input future, all of them ready
+ */
+template <typename FutureIterator, typename T = typename std::iterator_traits<FutureIterator>::value_type::value_type>
+inline future<std::vector<future<T>>> when_all(FutureIterator begin, FutureIterator end)
+{
+    using result_type = std::vector<future<T>>;
+    const std::size_t count = static_cast<std::size_t>(std::distance(begin, end));
+    if (count == 0)
+        return make_ready_future<result_type>(result_type());
+
+    auto st = std::make_shared<detail::when_range_state<T, result_type>>(count);
+    auto fut = st->pr.get_future();
+    for (std::size_t i = 0; i < count; ++i, ++begin)
+    {
+        std::move(*begin).then_wrapped([st, i](future<T> f)
+        {
+            f.forward_to(std::move(st->promises[i]));
+            detail::when_all_arrive(*st);
+        });
+    }
+    return fut;
+}
+
+/// Wait for every future passed without blocking a thread
+/**
+ * @see when_all(FutureIterator, FutureIterator)
+ * @param futs Futures to wait for, moved from
+ * @returns future of a tuple holding every input future, all of them ready
+ */
+template <typename... Futures, typename = std::enable_if_t<detail::is_future_pack<std::tuple<Futures...>>::value>>
+inline future<std::tuple<std::decay_t<Futures>...>> when_all(Futures&&... futs)
+{
+    using result_type = std::tuple<std::decay_t<Futures>...>;
+    auto st = std::make_shared<detail::when_pack_state<result_type, typename std::decay_t<Futures>::value_type...>>();
+    auto fut = st->pr.get_future();
+    detail::when_attach_all(st, std::index_sequence_for<Futures...>{}, [](auto & s, std::size_t)
+    {
+        detail::when_all_arrive(s);
+    }, std::forward<Futures>(futs)...);
+    return fut;
+}
+
+/// when_all() of nothing, ready at once
+inline future<std::tuple<>> when_all()
+{
+    return make_ready_future<std::tuple<>>(std::tuple<>());
+}
+
+/// Wait for the first future in a range to complete without blocking a thread
+/**
+ * The inputs are moved from. The futures that had not completed yet are handed back in the
+ * result and can still be waited on or chained.
+ * @param begin First future
+ * @param end Past the last future
+ * @returns future of the index of the first completed future and all of the futures
+ */
+template <typename FutureIterator, typename T = typename std::iterator_traits<FutureIterator>::value_type::value_type>
+inline future<when_any_result<std::vector<future<T>>>> when_any(FutureIterator begin, FutureIterator end)
+{
+    using result_type = when_any_result<std::vector<future<T>>>;
+    const std::size_t count = static_cast<std::size_t>(std::distance(begin, end));
+    if (count == 0)
+        return make_ready_future<result_type>(result_type{ static_cast<std::size_t>(-1), {} });
+
+    auto st = std::make_shared<detail::when_range_state<T, result_type>>(count);
+    auto fut = st->pr.get_future();
+    for (std::size_t i = 0; i < count; ++i, ++begin)
+    {
+        std::move(*begin).then_wrapped([st, i](future<T> f)
+        {
+            f.forward_to(std::move(st->promises[i]));
+            detail::when_any_arrive<result_type>(*st, i);
+        });
+    }
+    return fut;
+}
+
+/// Wait for the first of the futures passed to complete without blocking a thread
+/**
+ * @see when_any(FutureIterator, FutureIterator)
+ * @param futs Futures to wait for, moved from
+ * @returns future of the index of the first completed future and a tuple of all of the futures
+ */
+template <typename... Futures, typename = std::enable_if_t<detail::is_future_pack<std::tuple<Futures...>>::value>>
+inline future<when_any_result<std::tuple<std::decay_t<Futures>...>>> when_any(Futures&&... futs)
+{
+    using result_type = when_any_result<std::tuple<std::decay_t<Futures>...>>;
+    static_assert(sizeof...(Futures) > 0, "when_any needs at least one future");
+    auto st = std::make_shared<detail::when_pack_state<result_type, typename std::decay_t<Futures>::value_type...>>();
+    auto fut = st->pr.get_future();
+    detail::when_attach_all(st, std::index_sequence_for<Futures...>{}, [](auto & s, std::size_t index)
+    {
+        detail::when_any_arrive<result_type>(s, index);
+    }, std::forward<Futures>(futs)...);
+    return fut;
+}
+
 }
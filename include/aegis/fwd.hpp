@@ -35,11 +35,14 @@ class guild;
 class user;
 class shard;
 
+class latency_histogram;
+
 namespace gateway
 {
 namespace objects
 {
 struct user;
+struct member;
 class message;
 class messages;
 struct channel;
@@ -0,0 +1,342 @@
+//
+// event_type.hpp
+// **************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#pragma once
+
+#include "aegis/config.hpp"
+#include "aegis/json_reader.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+namespace aegis
+{
+
+namespace gateway
+{
+
+namespace events
+{
+
+/// Gateway dispatch events handled by the library
+/**
+ * Values are contiguous so they can index flat handler and counter tables.
+ * @see get_event_type
+ */
+enum class event_type : uint8_t
+{
+    PRESENCE_UPDATE = 0,
+    TYPING_START,
+    MESSAGE_CREATE,
+    MESSAGE_UPDATE,
+    MESSAGE_DELETE,
+    GUILD_CREATE,
+    GUILD_UPDATE,
+    GUILD_DELETE,
+    MESSAGE_REACTION_ADD,
+    MESSAGE_REACTION_REMOVE,
+    MESSAGE_REACTION_REMOVE_ALL,
+    MESSAGE_DELETE_BULK,
+    USER_UPDATE,
+    RESUMED,
+    READY,
+    CHANNEL_CREATE,
+    CHANNEL_UPDATE,
+    CHANNEL_DELETE,
+    CHANNEL_PINS_UPDATE,
+    GUILD_BAN_ADD,
+    GUILD_BAN_REMOVE,
+    GUILD_EMOJIS_UPDATE,
+    GUILD_INTEGRATIONS_UPDATE,
+    GUILD_MEMBER_ADD,
+    GUILD_MEMBER_REMOVE,
+    GUILD_MEMBER_UPDATE,
+    GUILD_MEMBERS_CHUNK,
+    GUILD_ROLE_CREATE,
+    GUILD_ROLE_UPDATE,
+    GUILD_ROLE_DELETE,
+    VOICE_STATE_UPDATE,
+    VOICE_SERVER_UPDATE,
+    WEBHOOKS_UPDATE,
+    UNKNOWN /**< Any event the library has no handler for. Must remain last */
+};
+
+/// Number of known event types, excluding event_type::UNKNOWN
+constexpr std::size_t event_type_count = static_cast<std::size_t>(event_type::UNKNOWN);
+
+namespace detail
+{
+
+constexpr const char * event_names[] = {
+    "PRESENCE_UPDATE",
+    "TYPING_START",
+    "MESSAGE_CREATE",
+    "MESSAGE_UPDATE",
+    "MESSAGE_DELETE",
+    "GUILD_CREATE",
+    "GUILD_UPDATE",
+    "GUILD_DELETE",
+    "MESSAGE_REACTION_ADD",
+    "MESSAGE_REACTION_REMOVE",
+    "MESSAGE_REACTION_REMOVE_ALL",
+    "MESSAGE_DELETE_BULK",
+    "USER_UPDATE",
+    "RESUMED",
+    "READY",
+    "CHANNEL_CREATE",
+    "CHANNEL_UPDATE",
+    "CHANNEL_DELETE",
+    "CHANNEL_PINS_UPDATE",
+    "GUILD_BAN_ADD",
+    "GUILD_BAN_REMOVE",
+    "GUILD_EMOJIS_UPDATE",
+    "GUILD_INTEGRATIONS_UPDATE",
+    "GUILD_MEMBER_ADD",
+    "GUILD_MEMBER_REMOVE",
+    "GUILD_MEMBER_UPDATE",
+    "GUILD_MEMBERS_CHUNK",
+    "GUILD_ROLE_CREATE",
+    "GUILD_ROLE_UPDATE",
+    "GUILD_ROLE_DELETE",
+    "VOICE_STATE_UPDATE",
+    "VOICE_SERVER_UPDATE",
+    "WEBHOOKS_UPDATE",
+    "UNKNOWN"
+};
+
+static_assert(sizeof(event_names) / sizeof(event_names[0]) == event_type_count + 1, "event_names must match event_type");
+
+/// 32-bit FNV-1a
+constexpr uint32_t fnv1a(const char * str, std::size_t len) noexcept
+{
+    uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < len; ++i)
+        hash = (hash ^ static_cast<uint8_t>(str[i])) * 16777619u;
+    return hash;
+}
+
+constexpr uint32_t fnv1a(const char * str) noexcept
+{
+    std::size_t len = 0;
+    while (str[len])
+        ++len;
+    return fnv1a(str, len);
+}
+
+}
+
+/// Get the name of an event type as sent by the gateway
+/**
+ * @param type Event type
+ * @returns Event name, "UNKNOWN" for event_type::UNKNOWN
+ */
+constexpr const char * get_event_name(event_type type) noexcept
+{
+    return detail::event_names[static_cast<std::size_t>(type) > event_type_count ? event_type_count : static_cast<std::size_t>(type)];
+}
+
+/// Map a gateway event name to its event type
+/**
+ * Hashes the name once and switches on the hash. Every case label is evaluated at
+ * compile time, so two known names hashing alike fails to compile. The name is
+ * compared once against the match to reject unknown names that happen to collide.
+ * @param str Event name, the `t` field of a dispatch
+ * @param len Length of str
+ * @returns Matching event_type or event_type::UNKNOWN
+ */
+inline event_type get_event_type(const char * str, std::size_t len) noexcept
+{
+    event_type type = event_type::UNKNOWN;
+
+#define AEGIS_EVENT_CASE(name) case detail::fnv1a(#name): type = event_type::name; break
+    switch (detail::fnv1a(str, len))
+    {
+        AEGIS_EVENT_CASE(PRESENCE_UPDATE);
+        AEGIS_EVENT_CASE(TYPING_START);
+        AEGIS_EVENT_CASE(MESSAGE_CREATE);
+        AEGIS_EVENT_CASE(MESSAGE_UPDATE);
+        AEGIS_EVENT_CASE(MESSAGE_DELETE);
+        AEGIS_EVENT_CASE(GUILD_CREATE);
+        AEGIS_EVENT_CASE(GUILD_UPDATE);
+        AEGIS_EVENT_CASE(GUILD_DELETE);
+        AEGIS_EVENT_CASE(MESSAGE_REACTION_ADD);
+        AEGIS_EVENT_CASE(MESSAGE_REACTION_REMOVE);
+        AEGIS_EVENT_CASE(MESSAGE_REACTION_REMOVE_ALL);
+        AEGIS_EVENT_CASE(MESSAGE_DELETE_BULK);
+        AEGIS_EVENT_CASE(USER_UPDATE);
+        AEGIS_EVENT_CASE(RESUMED);
+        AEGIS_EVENT_CASE(READY);
+        AEGIS_EVENT_CASE(CHANNEL_CREATE);
+        AEGIS_EVENT_CASE(CHANNEL_UPDATE);
+        AEGIS_EVENT_CASE(CHANNEL_DELETE);
+        AEGIS_EVENT_CASE(CHANNEL_PINS_UPDATE);
+        AEGIS_EVENT_CASE(GUILD_BAN_ADD);
+        AEGIS_EVENT_CASE(GUILD_BAN_REMOVE);
+        AEGIS_EVENT_CASE(GUILD_EMOJIS_UPDATE);
+        AEGIS_EVENT_CASE(GUILD_INTEGRATIONS_UPDATE);
+        AEGIS_EVENT_CASE(GUILD_MEMBER_ADD);
+        AEGIS_EVENT_CASE(GUILD_MEMBER_REMOVE);
+        AEGIS_EVENT_CASE(GUILD_MEMBER_UPDATE);
+        AEGIS_EVENT_CASE(GUILD_MEMBERS_CHUNK);
+        AEGIS_EVENT_CASE(GUILD_ROLE_CREATE);
+        AEGIS_EVENT_CASE(GUILD_ROLE_UPDATE);
+        AEGIS_EVENT_CASE(GUILD_ROLE_DELETE);
+        AEGIS_EVENT_CASE(VOICE_STATE_UPDATE);
+        AEGIS_EVENT_CASE(VOICE_SERVER_UPDATE);
+        AEGIS_EVENT_CASE(WEBHOOKS_UPDATE);
+        default:
+            return event_type::UNKNOWN;
+    }
+#undef AEGIS_EVENT_CASE
+
+    const char * name = get_event_name(type);
+    if (std::strlen(name) != len || std::memcmp(name, str, len) != 0)
+        return event_type::UNKNOWN;
+    return type;
+}
+
+/// Map a gateway event name to its event type
+/**
+ * @param name Event name, the `t` field of a dispatch
+ * @returns Matching event_type or event_type::UNKNOWN
+ */
+inline event_type get_event_type(const std::string & name) noexcept
+{
+    return get_event_type(name.data(), name.size());
+}
+
+/// Envelope fields of a gateway payload
+struct dispatch_header
+{
+    int32_t op = -1; /**< Opcode, -1 if absent */
+    int64_t s = -1; /**< Sequence number, -1 if absent or null */
+    std::string t; /**< Event name, empty if absent or null */
+};
+
+/// Read op, s and t of a gateway payload without parsing it into a json object
+/**
+ * Only the top level of the payload is walked and `d` is skipped over unparsed. Scanning
+ * stops as soon as all three fields have been seen, which with Discord's field order is
+ * before `d` is reached.
+ * @param payload Complete gateway payload
+ * @param len Length of the payload
+ * @param hdr Receives the envelope fields
+ * @returns false if the payload is malformed, in which case it must be parsed in full
+ */
+inline bool scan_dispatch(const char * payload, std::size_t len, dispatch_header & hdr) noexcept
+{
+    try
+    {
+        json_reader r(payload, len);
+        std::string key;
+        int found = 0;
+
+        r.begin_object();
+        while (found < 3 && r.next_key(key))
+        {
+            if (key == "op")
+            {
+                hdr.op = static_cast<int32_t>(r.read_int());
+                ++found;
+            }
+            else if (key == "s")
+            {
+                hdr.s = r.is_null() ? -1 : r.read_int();
+                ++found;
+            }
+            else if (key == "t")
+            {
+                r.read_string(hdr.t);
+                ++found;
+            }
+            else
+                r.skip();
+        }
+        return true;
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+/// Read op, s and t of a gateway payload without parsing it into a json object
+/**
+ * @param payload Complete gateway payload
+ * @param hdr Receives the envelope fields
+ * @returns false if the payload is malformed, in which case it must be parsed in full
+ */
+inline bool scan_dispatch(const std::string & payload, dispatch_header & hdr) noexcept
+{
+    return scan_dispatch(payload.data(), payload.size(), hdr);
+}
+
+/// Move a reader over a gateway payload to the start of its `d` object
+/**
+ * @param r Reader at the start of the payload
+ * @returns false if the payload has no `d` or it is null
+ */
+inline bool seek_dispatch_data(json_reader & r)
+{
+    std::string key;
+    r.begin_object();
+    while (r.next_key(key))
+    {
+        if (key == "d")
+            return !r.is_null();
+        r.skip();
+    }
+    return false;
+}
+
+/// Read the guild a dispatch belongs to without parsing it into a json object
+/**
+ * @param payload Complete gateway payload
+ * @param len Length of the payload
+ * @param guild_event Whether the event is a GUILD_ event, which may carry the guild as `d.id`
+ * @returns `d.guild_id`, else `d.id` of a guild event, else 0
+ */
+inline uint64_t scan_guild_id(const char * payload, std::size_t len, bool guild_event) noexcept
+{
+    try
+    {
+        json_reader r(payload, len);
+        if (!seek_dispatch_data(r) || !r.is_object())
+            return 0;
+
+        std::string key;
+        uint64_t id = 0;
+        r.begin_object();
+        while (r.next_key(key))
+        {
+            if (key == "guild_id")
+            {
+                const uint64_t guild_id = static_cast<uint64_t>(r.read_snowflake());
+                if (guild_id)
+                    return guild_id;
+            }
+            else if (guild_event && key == "id")
+                id = static_cast<uint64_t>(r.read_snowflake());
+            else
+                r.skip();
+        }
+        return id;
+    }
+    catch (...)
+    {
+        return 0;
+    }
+}
+
+}
+
+}
+
+}
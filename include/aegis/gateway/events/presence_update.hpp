@@ -16,6 +16,7 @@
 #include "aegis/gateway/objects/activity.hpp"
 #include "aegis/gateway/objects/user.hpp"
 #include "aegis/gateway/objects/role.hpp"
+#include "aegis/json_reader.hpp"
 
 namespace aegis
 {
@@ -36,8 +37,62 @@ struct presence_update
     std::vector<objects::role> roles; /**<\todo Needs documentation */
     snowflake guild_id; /**<\todo Needs documentation */
     objects::presence::user_status status = objects::presence::Online; /**<\todo Needs documentation */
+    std::string nick; /**< Nickname of the member in the guild, empty if none */
 };
 
+/// \cond TEMPLATES
+/// Fill a presence_update from the `d` object of a PRESENCE_UPDATE dispatch
+inline void from_reader(json_reader & r, presence_update & m)
+{
+    std::string key;
+    std::string value;
+    r.begin_object();
+    while (r.next_key(key))
+    {
+        if (key == "user")
+        {
+            if (!r.is_null())
+                from_reader(r, m.user);
+        }
+        else if (key == "guild_id")
+            m.guild_id = r.read_snowflake();
+        else if (key == "status")
+        {
+            r.read_string(value);
+            if (value == "idle")
+                m.status = objects::presence::Idle;
+            else if (value == "dnd")
+                m.status = objects::presence::DoNotDisturb;
+            else if (value == "online")
+                m.status = objects::presence::Online;
+            else
+                m.status = objects::presence::Offline;
+        }
+        else if (key == "nick")
+            r.read_string(m.nick);
+        else if (key == "game")
+        {
+            if (!r.is_null())
+                m.game = r.read_json();
+        }
+        else if (key == "roles")
+        {
+            if (r.is_null())
+                continue;
+            r.begin_array();
+            while (r.next_element())
+            {
+                objects::role _role;
+                _role.id = _role.role_id = r.read_snowflake();
+                m.roles.push_back(std::move(_role));
+            }
+        }
+        else
+            r.skip();
+    }
+}
+/// \endcond
+
 }
 
 }
@@ -33,6 +33,7 @@ namespace objects
 /// \cond TEMPLATES
 void from_json(const nlohmann::json& j, guild& m);
 void to_json(nlohmann::json& j, const guild& m);
+void from_reader(json_reader & r, guild & m);
 /// \endcond
 
 /**\todo Needs documentation
@@ -41,7 +42,8 @@ struct guild
 {
     guild(const std::string & _json, aegis::core * bot) noexcept
     {
-        from_json(nlohmann::json::parse(_json), *this);
+        json_reader r(_json);
+        from_reader(r, *this);
     }
 
     guild(const nlohmann::json & _json, aegis::core * bot) noexcept
@@ -156,6 +158,107 @@ inline void from_json(const nlohmann::json& j, guild& m)
             m.features.push_back(_feature);
 }
 
+inline void from_reader(json_reader & r, guild & m)
+{
+    std::string key;
+    m.unavailable = false;
+    r.begin_object();
+    while (r.next_key(key))
+    {
+        if (key == "id")
+            m.id = m.guild_id = r.read_snowflake();
+        else if (key == "name")
+            r.read_string(m.name);
+        else if (key == "icon")
+            r.read_string(m.icon);
+        else if (key == "splash")
+            r.read_string(m.splash);
+        else if (key == "owner_id")
+            m.owner_id = r.read_snowflake();
+        else if (key == "region")
+            r.read_string(m.region);
+        else if (key == "afk_channel_id")
+            m.afk_channel_id = r.read_snowflake();
+        else if (key == "afk_timeout")
+            m.afk_timeout = static_cast<int32_t>(r.read_int());
+        else if (key == "embed_enabled")
+            m.embed_enabled = r.read_bool();
+        else if (key == "embed_channel_id")
+            m.embed_channel_id = r.read_snowflake();
+        else if (key == "verification_level")
+            m.verification_level = static_cast<int8_t>(r.read_int());
+        else if (key == "default_message_notifications")
+            m.default_message_notifications = static_cast<int8_t>(r.read_int());
+        else if (key == "mfa_level")
+            m.mfa_level = static_cast<int8_t>(r.read_int());
+        else if (key == "joined_at")
+            r.read_string(m.joined_at);
+        else if (key == "large")
+            m.large = r.read_bool();
+        else if (key == "unavailable")
+            m.unavailable = r.read_bool();
+        else if (key == "member_count")
+            m.member_count = static_cast<int32_t>(r.read_int());
+        else if (r.is_null())
+            continue;
+        else if (key == "roles")
+        {
+            r.begin_array();
+            while (r.next_element())
+            {
+                m.roles.emplace_back();
+                from_reader(r, m.roles.back());
+            }
+        }
+        else if (key == "members")
+        {
+            r.begin_array();
+            while (r.next_element())
+            {
+                m.members.emplace_back();
+                from_reader(r, m.members.back());
+            }
+        }
+        else if (key == "features")
+        {
+            r.begin_array();
+            while (r.next_element())
+                m.features.push_back(r.read_string());
+        }
+        else if (key == "presences")
+        {
+            // presence objects carry no fields yet
+            r.begin_array();
+            while (r.next_element())
+            {
+                r.skip();
+                m.presences.emplace_back();
+            }
+        }
+        // less frequent and deeply nested, parsed per element
+        else if (key == "channels")
+        {
+            r.begin_array();
+            while (r.next_element())
+                m.channels.push_back(r.read_json());
+        }
+        else if (key == "emojis")
+        {
+            r.begin_array();
+            while (r.next_element())
+                m.emojis.push_back(r.read_json());
+        }
+        else if (key == "voice_states")
+        {
+            r.begin_array();
+            while (r.next_element())
+                m.voice_states.push_back(r.read_json());
+        }
+        else
+            r.skip();
+    }
+}
+
 inline void to_json(nlohmann::json& j, const guild& m)
 {
 
@@ -54,6 +54,40 @@ inline void from_json(const nlohmann::json& j, guild_member& m)
     if (j.count("mute"))
         m.mute = j["mute"];
 }
+
+inline void from_reader(json_reader & r, guild_member & m)
+{
+    std::string key;
+    r.begin_object();
+    while (r.next_key(key))
+    {
+        if (key == "user")
+        {
+            if (!r.is_null())
+                from_reader(r, m._user);
+        }
+        else if (key == "nick")
+            r.read_string(m.nick);
+        else if (key == "guild_id")
+            m.guild_id = r.read_snowflake();
+        else if (key == "roles")
+        {
+            if (r.is_null())
+                continue;
+            r.begin_array();
+            while (r.next_element())
+                m.roles.emplace_back(r.read_snowflake());
+        }
+        else if (key == "joined_at")
+            r.read_string(m.joined_at);
+        else if (key == "deaf")
+            m.deaf = r.read_bool();
+        else if (key == "mute")
+            m.mute = r.read_bool();
+        else
+            r.skip();
+    }
+}
 /// \endcond
 
 }
@@ -13,6 +13,7 @@
 #include "aegis/guild.hpp"
 #include "aegis/core.hpp"
 #include "aegis/gateway/objects/message.hpp"
+#include "aegis/gateway/objects/member.hpp"
 #include <nlohmann/json.hpp>
 #include "aegis/futures.hpp"
 
@@ -198,8 +199,8 @@ AEGIS_DECL void from_json(const nlohmann::json& j, objects::message& m)
     if (j.count("mentions") && !j["mentions"].is_null())
         for (const auto & _mention : j["mentions"])
             m.mentions.push_back(_mention["id"]);
-    if (j.count("roles") && !j["roles"].is_null())
-        for (const auto & _mention_role : j["roles"])
+    if (j.count("mention_roles") && !j["mention_roles"].is_null())
+        for (const auto & _mention_role : j["mention_roles"])
             m.mention_roles.push_back(_mention_role);
     if (j.count("attachments") && !j["attachments"].is_null())
         for (const auto & _attachment : j["attachments"])
@@ -212,6 +213,105 @@ AEGIS_DECL void from_json(const nlohmann::json& j, objects::message& m)
             m.reactions.push_back(_reaction);
 }
 
+AEGIS_DECL void from_reader(json_reader & r, objects::message & m)
+{
+    lib::optional<objects::member> member;
+    from_reader(r, m, member);
+}
+
+AEGIS_DECL void from_reader(json_reader & r, objects::message & m, lib::optional<objects::member> & member)
+{
+    std::string key;
+    r.begin_object();
+    while (r.next_key(key))
+    {
+        if (key == "id")
+            m._message_id = r.read_snowflake();
+        else if (key == "channel_id")
+            m._channel_id = r.read_snowflake();
+        else if (key == "guild_id")
+            m._guild_id = r.read_snowflake();
+        else if (key == "author")
+        {
+            if (r.is_null())
+                continue;
+            from_reader(r, m.author);
+            m._author_id = m.author.id;
+        }
+        else if (key == "content")
+            r.read_string(m._content);
+        else if (key == "timestamp")
+            r.read_string(m.timestamp);
+        else if (key == "edited_timestamp")
+            r.read_string(m.edited_timestamp);
+        else if (key == "tts")
+            m.tts = r.read_bool();
+        else if (key == "mention_everyone")
+            m.mention_everyone = r.read_bool();
+        else if (key == "pinned")
+            m.pinned = r.read_bool();
+        else if (key == "type")
+            m.type = static_cast<message_type>(r.read_int());
+        else if (key == "nonce")
+        {
+            // nonces are not always numeric
+            if (r.is_string())
+            {
+                std::string nonce = r.read_string();
+                m.nonce = std::strtoll(nonce.c_str(), nullptr, 10);
+            }
+            else
+                m.nonce = r.read_int();
+        }
+        else if (key == "webhook_id")
+            r.read_string(m.webhook_id);
+        else if (r.is_null())
+            continue;
+        else if (key == "mentions")
+        {
+            r.begin_array();
+            while (r.next_element())
+            {
+                objects::user _mention;
+                from_reader(r, _mention);
+                m.mentions.push_back(_mention.id);
+            }
+        }
+        else if (key == "mention_roles")
+        {
+            r.begin_array();
+            while (r.next_element())
+                m.mention_roles.emplace_back(r.read_snowflake());
+        }
+        else if (key == "member")
+        {
+            member.emplace();
+            from_reader(r, *member);
+        }
+        // rarely present, parsed per element
+        else if (key == "attachments")
+        {
+            r.begin_array();
+            while (r.next_element())
+                m.attachments.push_back(r.read_json());
+        }
+        else if (key == "embeds")
+        {
+            r.begin_array();
+            while (r.next_element())
+                m.embeds.push_back(r.read_json());
+        }
+        else if (key == "reactions")
+        {
+            r.begin_array();
+            while (r.next_element())
+                m.reactions.push_back(r.read_json());
+        }
+        else
+            r.skip();
+    }
+}
+
 AEGIS_DECL void to_json(nlohmann::json& j, const objects::message& m)
 {
     j["id"] = m._message_id;
@@ -229,7 +329,7 @@ AEGIS_DECL void to_json(nlohmann::json& j, const objects::message& m)
     for (const auto & _mention : m.mentions)
         j["mentions"].push_back(_mention);
     for (const auto & _mention_role : m.mention_roles)
-        j["roles"].push_back(_mention_role);
+        j["mention_roles"].push_back(_mention_role);
     for (const auto & _attachment : m.attachments)
         j["attachments"].push_back(_attachment);
     for (const auto & _embed : m.embeds)
@@ -29,6 +29,7 @@ struct member;
 /// \cond TEMPLATES
 void from_json(const nlohmann::json& j, member& m);
 void to_json(nlohmann::json& j, const member& m);
+void from_reader(json_reader & r, member & m);
 /// \endcond
 
 /**\todo Needs documentation
@@ -37,7 +38,8 @@ struct member
 {
     member(const std::string & _json, aegis::core * bot) noexcept
     {
-        from_json(nlohmann::json::parse(_json), *this);
+        json_reader r(_json);
+        from_reader(r, *this);
     }
 
     member(const nlohmann::json & _json, aegis::core * bot) noexcept
@@ -77,7 +79,17 @@ inline void from_json(const nlohmann::json& j, member& m)
 {
     if (j.count("roles") && !j["roles"].is_null())
         for (const auto & _role : j["roles"])
-            m.roles.push_back(_role);
+        {
+            // members list their roles by id, same as from_reader
+            if (_role.is_string())
+            {
+                objects::role r;
+                r.id = r.role_id = _role;
+                m.roles.push_back(std::move(r));
+            }
+            else
+                m.roles.push_back(_role);
+        }
     if (j.count("nick") && !j["nick"].is_null())
         m.nick = j["nick"].get<std::string>();
     if (j.count("joined_at") && !j["joined_at"].is_null())
@@ -90,6 +102,45 @@ inline void from_json(const nlohmann::json& j, member& m)
         m._user = j["user"].get<objects::user>();
 }
 
+inline void from_reader(json_reader & r, member & m)
+{
+    std::string key;
+    r.begin_object();
+    while (r.next_key(key))
+    {
+        if (key == "roles")
+        {
+            if (r.is_null())
+                continue;
+            r.begin_array();
+            while (r.next_element())
+            {
+                objects::role _role;
+                _role.id = _role.role_id = r.read_snowflake();
+                m.roles.push_back(std::move(_role));
+            }
+        }
+        else if (key == "nick")
+            r.read_string(m.nick);
+        else if (key == "joined_at")
+            r.read_string(m.joined_at);
+        else if (key == "mute")
+            m.mute = r.read_bool();
+        else if (key == "deaf")
+            m.deaf = r.read_bool();
+        else if (key == "user")
+        {
+            if (r.is_null())
+                continue;
+            objects::user _user;
+            from_reader(r, _user);
+            m._user = std::move(_user);
+        }
+        else
+            r.skip();
+    }
+}
+
 inline void to_json(nlohmann::json& j, const member& m)
 {
     for (const auto & i : m.roles)
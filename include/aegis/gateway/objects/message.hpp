@@ -37,6 +37,9 @@ class message;
 AEGIS_DECL void from_json(const nlohmann::json& j, objects::message& m);
 
 AEGIS_DECL void to_json(nlohmann::json& j, const objects::message& m);
+AEGIS_DECL void from_reader(json_reader & r, objects::message & m);
+// member receives the author's guild member object of a gateway message if it has one
+AEGIS_DECL void from_reader(json_reader & r, objects::message & m, lib::optional<objects::member> & member);
 /// \endcond
 
 /// Type of message
@@ -76,7 +79,8 @@ public:
     message(const std::string & _json, aegis::core * _core) noexcept
         : _core(_core)
     {
-        from_json(nlohmann::json::parse(_json), *this);
+        json_reader r(_json);
+        from_reader(r, *this);
         populate_self();
     }
 
@@ -360,6 +364,8 @@ public:
 
 private:
     friend AEGIS_DECL void from_json(const nlohmann::json& j, objects::message& m);
+    friend AEGIS_DECL void from_reader(json_reader & r, objects::message & m);
+    friend AEGIS_DECL void from_reader(json_reader & r, objects::message & m, lib::optional<objects::member> & member);
     friend AEGIS_DECL void to_json(nlohmann::json& j, const objects::message& m);
     friend class aegis::core;
 
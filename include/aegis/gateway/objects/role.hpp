@@ -12,6 +12,7 @@
 #include "aegis/config.hpp"
 #include "aegis/snowflake.hpp"
 #include "aegis/permission.hpp"
+#include "aegis/json_reader.hpp"
 #include <nlohmann/json.hpp>
 
 namespace aegis
@@ -86,6 +87,33 @@ inline void from_json(const nlohmann::json& j, role& m)
         m.mentionable = j["mentionable"];
 }
 
+inline void from_reader(json_reader & r, role & m)
+{
+    std::string key;
+    r.begin_object();
+    while (r.next_key(key))
+    {
+        if (key == "color")
+            m.color = static_cast<uint32_t>(r.read_int());
+        else if (key == "id")
+            m.id = m.role_id = r.read_snowflake();
+        else if (key == "name")
+            r.read_string(m.name);
+        else if (key == "permissions")
+            m._permission = r.read_int();
+        else if (key == "position")
+            m.position = static_cast<uint16_t>(r.read_int());
+        else if (key == "hoist")
+            m.hoist = r.read_bool();
+        else if (key == "managed")
+            m.managed = r.read_bool();
+        else if (key == "mentionable")
+            m.mentionable = r.read_bool();
+        else
+            r.skip();
+    }
+}
+
 inline void to_json(nlohmann::json& j, const role& m)
 {
     j["color"] = m.color;
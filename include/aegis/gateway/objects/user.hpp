@@ -11,6 +11,7 @@
 
 #include "aegis/config.hpp"
 #include "aegis/snowflake.hpp"
+#include "aegis/json_reader.hpp"
 #include <nlohmann/json.hpp>
 
 namespace aegis
@@ -69,6 +70,7 @@ struct user
     std::string avatar; /**< Hash of user's avatar */
 private:
     friend void from_json(const nlohmann::json& j, user& m);
+    friend void from_reader(json_reader & r, user & m);
     friend void to_json(nlohmann::json& j, const user& m);
     bool _is_bot = false;
     bool mfa_enabled = false;
@@ -94,6 +96,33 @@ inline void from_json(const nlohmann::json& j, user& m)
     if (j.count("verified") && !j["verified"].is_null())
         m.verified = j["verified"];
 }
+
+inline void from_reader(json_reader & r, user & m)
+{
+    std::string key;
+    r.begin_object();
+    while (r.next_key(key))
+    {
+        if (key == "id")
+            m.id = r.read_snowflake();
+        else if (key == "guild_id")
+            m.guild_id = r.read_snowflake();
+        else if (key == "username")
+            r.read_string(m.username);
+        else if (key == "discriminator")
+            r.read_string(m.discriminator);
+        else if (key == "avatar")
+            r.read_string(m.avatar);
+        else if (key == "bot")
+            m._is_bot = r.read_bool();
+        else if (key == "mfa_enabled")
+            m.mfa_enabled = r.read_bool();
+        else if (key == "verified")
+            m.verified = r.read_bool();
+        else
+            r.skip();
+    }
+}
 /// \endcond
 
 /// \cond TEMPLATES
@@ -25,6 +25,9 @@
 #include <asio.hpp>
 #include <shared_mutex>
 #include "aegis/futures.hpp"
+#include "aegis/cache_stats.hpp"
+#include "aegis/object_pool.hpp"
+#include "aegis/json_reader.hpp"
 
 namespace aegis
 {
@@ -178,6 +181,8 @@ public:
     guild(guild &&) = delete;
     guild & operator=(const guild &) = delete;
 
+    AEGIS_POOLED_ENTITY(guild)
+
     int32_t shard_id; /*< shard that receives this guild's messages */
     snowflake guild_id; /*< snowflake of this guild */
 
@@ -266,6 +271,8 @@ public:
 
     /// Get guild permissions for member in channel
     /**
+     * Results are cached per member and channel until a role, member or channel update
+     * invalidates them.
      * @param _member Pointer to member object
      * @param _channel Pointer to channel object
      * @returns Permission object of channel
@@ -294,6 +301,7 @@ public:
 
     /// Get base guild permissions for member
     /**
+     * Results are cached per member until a role or member update invalidates them.
      * @param _member Reference to member object
      */
     AEGIS_DECL int64_t base_permissions(const user & _member) const noexcept;
@@ -854,6 +862,13 @@ private:
     std::unordered_map<snowflake, gateway::objects::role> roles; /**< Map of snowflakes to role objects */
     std::unordered_map<snowflake, gateway::objects::emoji> emojis; /**< Map of snowflakes to emoji objects */
     std::unordered_map<snowflake, gateway::objects::voice_state> voice_states; /**< Map of user snowflakes to voice_state objects */
+
+    /// Guards the permission cache. Never held while taking another lock
+    mutable shared_mutex _perm_m;
+    /// Bumped on every invalidation so results computed across one are not stored
+    mutable uint64_t _perm_gen = 0;
+    mutable std::unordered_map<snowflake, int64_t> _base_perms; /**< Member snowflake to base permissions */
+    mutable std::unordered_map<snowflake, std::unordered_map<snowflake, int64_t>> _channel_perms; /**< Channel snowflake to member snowflake to permissions */
 #endif
 
 #if !defined(AEGIS_DISABLE_ALL_CACHE)
@@ -872,10 +887,28 @@ private:
     AEGIS_DECL void _remove_role(snowflake role_id) noexcept;
 
     AEGIS_DECL void _load_voicestate(const json & obj) noexcept;
+
+    /// Compute base permissions bypassing the permission cache
+    AEGIS_DECL int64_t _compute_base_permissions(const user & _member) const noexcept;
+
+    /// Drop every cached permission of this guild
+    AEGIS_DECL void _invalidate_permissions() const noexcept;
+
+    /// Drop the cached permissions of a member
+    AEGIS_DECL void _invalidate_member_permissions(snowflake member_id) const noexcept;
+
+    /// Drop the cached permissions of a channel
+    AEGIS_DECL void _invalidate_channel_permissions(snowflake channel_id) const noexcept;
+
+    /// Add this guild and the roles, emojis, voice states, members and permissions it holds to stats
+    AEGIS_DECL void _memory_usage(cache_memory_stats & stats) const noexcept;
 #endif
 
     AEGIS_DECL void _load(const json & obj, shards::shard * _shard);
 
+    /// Load a guild object straight from the payload without building a DOM of it
+    AEGIS_DECL void _load(json_reader & r, shards::shard * _shard);
+
     /// non-locking version for internal use
     AEGIS_DECL user * _find_member(snowflake member_id) const noexcept;
     
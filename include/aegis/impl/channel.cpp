@@ -60,6 +60,15 @@ AEGIS_DECL permission channel::perms() const noexcept
     return permission(_guild->get_permissions(_guild->self(), this));
 }
 
+AEGIS_DECL void channel::_memory_usage(cache_memory_stats & stats) const noexcept
+{
+    std::shared_lock<shared_mutex> l(_m);
+
+    stats.channels.count++;
+    stats.channels.bytes += sizeof(channel) + detail::string_bytes(name) + detail::string_bytes(topic);
+    detail::add_hashtable(overrides, stats.overwrites);
+}
+
 AEGIS_DECL void channel::_load_with_guild(guild & _guild, const json & obj, shards::shard * _shard)
 {
     std::unique_lock<shared_mutex> l(_m);
@@ -10,12 +10,14 @@
 #include "aegis/config.hpp"
 #include "aegis/core.hpp"
 #include <string>
+#include <fstream>
 #include <asio/streambuf.hpp>
 #include <asio/connect.hpp>
 #include "aegis/shards/shard.hpp"
 #include "aegis/guild.hpp"
 #include "aegis/channel.hpp"
 #include "aegis/user.hpp"
+#include "aegis/avatar_hash.hpp"
 
 #include <nlohmann/json.hpp>
 #include <spdlog/sinks/stdout_color_sinks.h>
@@ -97,8 +99,9 @@ AEGIS_DECL void core::setup_context()
     _io_context = std::make_shared<asio::io_context>();
 
     wrk = std::make_unique<asio_exec>(asio::make_work_guard(*_io_context));
-    for (std::size_t i = 0; i < thread_count; ++i)
-        add_run_thread();
+    if (!_worker_config._min_threads)
+        _worker_config._min_threads = thread_count;
+    _workers = std::make_unique<worker_pool>(*_io_context, _worker_config, log);
 }
 
 AEGIS_DECL void core::setup_shard_mgr()
@@ -113,7 +116,19 @@ AEGIS_DECL void core::setup_shard_mgr()
         std::bind(&aegis::rest::rest_controller::execute,
                   _rest.get(),
                   std::placeholders::_1),
+        [this](rest::request_params params, std::function<void(rest::rest_reply)> cb)
+        {
+            _rest->async_execute(std::move(params), std::move(cb));
+        },
         get_io_context(), this);
+    _ratelimit->set_global_rate(_global_ratelimit);
+
+    if (_metrics_enabled)
+        _setup_metrics();
+
+    if (_event_order != event_order::unordered)
+        for (uint32_t i = 0; i < _event_strand_count; ++i)
+            _event_strands.emplace_back(std::make_unique<asio::io_context::strand>(get_io_context()));
 
     setup_callbacks();
 }
@@ -133,6 +148,15 @@ AEGIS_DECL core::core(create_bot_t bot_config)
     _loglevel = bot_config._log_level;
     _cluster_id = bot_config._cluster_id;
     _max_clusters = bot_config._max_clusters;
+    _global_ratelimit = bot_config._global_ratelimit;
+    _event_order = bot_config._event_order;
+    _event_strand_count = bot_config._event_strands ? bot_config._event_strands : 1;
+    _cache_policy = bot_config._cache_policy;
+    // per_shard promises every event of a shard runs in order, which loading guilds on
+    // their own strands would break
+    _bulk_ingest = bot_config._bulk_ingest && _event_order != event_order::per_shard;
+    _worker_config = bot_config._worker_pool;
+    _metrics_enabled = bot_config._metrics;
 
     if (bot_config._log)
         log = bot_config._log;
@@ -210,18 +234,62 @@ AEGIS_DECL core::~core()
     if (!external_io_context)
         if (_io_context)
             _io_context->stop();
-    for (auto & t : threads)
-        t->thd.join();
+    if (_workers)
+        _workers->stop();
     _shard_mgr.reset();
 }
 
+AEGIS_DECL ingest_stats core::get_ingest_stats() const noexcept
+{
+    ingest_stats stats;
+    stats.guilds = _ingest_guilds.load(std::memory_order_relaxed);
+    stats.members = _ingest_members.load(std::memory_order_relaxed);
+    stats.channels = _ingest_channels.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < ingest_phase_count; ++i)
+        stats.phase_time[i] = std::chrono::nanoseconds(_ingest_ns[i].load(std::memory_order_relaxed));
+    stats.startup_pending = _startup_pending.load(std::memory_order_relaxed);
+    stats.startup = std::chrono::milliseconds(_startup_ms.load(std::memory_order_relaxed));
+    return stats;
+}
+
+AEGIS_DECL void core::_startup_guild_created(snowflake guild_id) noexcept
+{
+    if (_startup_pending.load(std::memory_order_relaxed) == 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> l(_startup_m);
+        if (!_startup_guilds.erase(guild_id))
+            return;
+        _startup_pending.store(_startup_guilds.size(), std::memory_order_relaxed);
+        if (!_startup_guilds.empty())
+            return;
+    }
+
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    const int64_t ms = (now - _startup_begin.load()) / 1000000;
+    _startup_ms.store(ms);
+
+    auto stats = get_ingest_stats();
+    auto phase_ms = [&stats](ingest_phase p)
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(stats.time(p)).count();
+    };
+    log->info("Startup: {} guilds, {} members, {} channels loaded in {}ms (thread time: read {}ms, roles {}ms, users {}ms, members {}ms, channels {}ms, presences {}ms, emojis {}ms, voice states {}ms)"
+              , stats.guilds, stats.members, stats.channels, ms
+              , phase_ms(ingest_phase::read), phase_ms(ingest_phase::roles), phase_ms(ingest_phase::member_create), phase_ms(ingest_phase::member_load)
+              , phase_ms(ingest_phase::channels), phase_ms(ingest_phase::presences), phase_ms(ingest_phase::emojis)
+              , phase_ms(ingest_phase::voice_states));
+}
+
 #if !defined(AEGIS_DISABLE_ALL_CACHE)
 AEGIS_DECL int64_t core::get_member_count() const noexcept
 {
-    std::shared_lock<shared_mutex> l(_guild_m);
     int64_t count = 0;
-    for (auto & kv : guilds)
-        count += kv.second->get_member_count();
+    guilds.for_each([&count](snowflake, guild & g)
+    {
+        count += g.get_member_count();
+    });
     return count;
 }
 
@@ -230,6 +298,54 @@ AEGIS_DECL int64_t core::get_user_count() const noexcept
     return users.size();
 }
 
+AEGIS_DECL cache_memory_stats core::get_cache_memory_stats() const
+{
+    cache_memory_stats stats;
+    epoch_guard pin(_epoch);
+
+    // the cache tables themselves. objects are counted by their own _memory_usage
+    auto add_table = [](const auto & cache, cache_usage & usage)
+    {
+        const std::size_t buckets = cache.bucket_count();
+        usage.buckets += buckets;
+        usage.bytes += buckets * sizeof(void *)
+            + cache.size() * (sizeof(typename std::decay<decltype(cache)>::type::map_type::value_type) + sizeof(void *) + sizeof(std::size_t));
+    };
+    add_table(users, stats.users);
+    add_table(guilds, stats.guilds);
+    add_table(channels, stats.channels);
+
+    // collect first so no entity lock is taken while a cache partition is locked
+    std::vector<user *> user_list;
+    std::vector<guild *> guild_list;
+    std::vector<channel *> channel_list;
+    user_list.reserve(users.size());
+    guild_list.reserve(guilds.size());
+    channel_list.reserve(channels.size());
+    users.for_each([&user_list](snowflake, user & u) { user_list.push_back(&u); });
+    guilds.for_each([&guild_list](snowflake, guild & g) { guild_list.push_back(&g); });
+    channels.for_each([&channel_list](snowflake, channel & c) { channel_list.push_back(&c); });
+
+    for (auto u : user_list)
+    {
+        std::shared_lock<shared_mutex> l(u->mtx());
+        u->_memory_usage(stats);
+    }
+    for (auto g : guild_list)
+        g->_memory_usage(stats);
+    for (auto c : channel_list)
+        c->_memory_usage(stats);
+
+    stats.strings.count = string_pool::global().size();
+    stats.strings.bytes = string_pool::global().bytes();
+
+    auto reclaim = _epoch.get_stats();
+    stats.stale.count = reclaim.pending;
+    stats.stale.bytes = reclaim.pending_bytes;
+
+    return stats;
+}
+
 AEGIS_DECL int64_t core::get_channel_count() const noexcept
 {
     return channels.size();
@@ -242,33 +358,130 @@ AEGIS_DECL int64_t core::get_guild_count() const noexcept
 
 AEGIS_DECL user * core::find_user(snowflake id) const noexcept
 {
-    std::shared_lock<shared_mutex> l(_user_m);
-    auto it = users.find(id);
-    if (it == users.end())
-        return nullptr;
-    return it->second.get();
+    auto _user = users.find(id);
+    if (_user)
+        _user->_touch();
+    return _user;
 }
 
 AEGIS_DECL user* core::find_user_nolock(snowflake id) const noexcept
 {
-    auto it = users.find(id);
-    if (it == users.end())
-        return nullptr;
-    return it->second.get();
+    return users.find(id);
 }
 
 AEGIS_DECL user * core::user_create(snowflake id) noexcept
 {
-    std::unique_lock<shared_mutex> l(_user_m);
-    auto it = users.find(id);
-    if (it == users.end())
+    auto _user = users.get_or_create(id, [id]
     {
-        auto g = std::make_unique<user>(id);
-        auto ptr = g.get();
-        users.emplace(id, std::move(g));
-        return ptr;
+        return std::make_unique<user>(id);
+    });
+    _user->_touch();
+    return _user;
+}
+
+AEGIS_DECL void core::user_create_bulk(const std::vector<snowflake> & ids, std::vector<user *> & out)
+{
+    users.get_or_create_bulk(ids, [](snowflake id)
+    {
+        return std::make_unique<user>(id);
+    }, out);
+    for (auto _user : out)
+        _user->_touch();
+}
+
+AEGIS_DECL void core::_sweep_users() noexcept
+{
+    struct candidate
+    {
+        int64_t last_seen;
+        snowflake id;
+        std::size_t bytes;
+    };
+
+    epoch_guard pin(_epoch);
+    const snowflake self_id = _self ? _self->get_id() : snowflake(int64_t(0));
+    const int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    const int64_t ttl = std::chrono::duration_cast<std::chrono::milliseconds>(_cache_policy._ttl).count();
+
+    // collect first so no user lock is taken while a cache partition is locked
+    std::vector<user *> user_list;
+    user_list.reserve(users.size());
+    users.for_each([&user_list](snowflake, user & u)
+    {
+        user_list.push_back(&u);
+    });
+
+    std::vector<candidate> candidates;
+    candidates.reserve(user_list.size());
+    std::size_t total_bytes = 0;
+    for (auto u : user_list)
+    {
+        std::shared_lock<shared_mutex> l(u->mtx());
+        std::size_t bytes = u->_approx_bytes();
+        total_bytes += bytes;
+        if (u->get_id() != self_id)
+            candidates.push_back({ u->_last_seen.load(std::memory_order_relaxed), u->get_id(), bytes });
     }
-    return it->second.get();
+
+    std::size_t count = users.size();
+    std::vector<candidate> survivors;
+    survivors.reserve(candidates.size());
+    for (auto & c : candidates)
+    {
+        if (_cache_policy._eviction == cache_eviction::ttl && now - c.last_seen > ttl)
+        {
+            _evict_user(c.id);
+            total_bytes -= std::min(total_bytes, c.bytes);
+            --count;
+        }
+        else
+            survivors.push_back(c);
+    }
+
+    const bool over_users = _cache_policy._max_users && count > _cache_policy._max_users;
+    const bool over_bytes = _cache_policy._max_bytes && total_bytes > _cache_policy._max_bytes;
+    if (!over_users && !over_bytes)
+        return;
+
+    std::sort(survivors.begin(), survivors.end(), [](const candidate & a, const candidate & b)
+    {
+        return a.last_seen < b.last_seen;
+    });
+    for (auto & c : survivors)
+    {
+        if ((!_cache_policy._max_users || count <= _cache_policy._max_users)
+            && (!_cache_policy._max_bytes || total_bytes <= _cache_policy._max_bytes))
+            break;
+        _evict_user(c.id);
+        total_bytes -= std::min(total_bytes, c.bytes);
+        --count;
+    }
+}
+
+AEGIS_DECL void core::_evict_user(snowflake user_id) noexcept
+{
+    auto _user = users.find(user_id);
+    if (!_user)
+        return;
+
+    // flag first so a guild loading this user concurrently no longer adds it, then
+    // detach it from every guild it was already added to
+    _user->_evicted = true;
+    std::vector<snowflake> guild_ids;
+    {
+        std::shared_lock<shared_mutex> l(_user->mtx());
+        for (auto & gi : _user->guilds)
+            guild_ids.push_back(gi.id);
+    }
+    for (auto & guild_id : guild_ids)
+    {
+        auto _guild = find_guild(guild_id);
+        if (_guild)
+            _guild->_remove_member(user_id);
+    }
+
+    _epoch.retire(users.remove(user_id));
+    _users_evicted.fetch_add(1, std::memory_order_relaxed);
 }
 #endif
 
@@ -350,128 +563,84 @@ AEGIS_DECL aegis::rest::rest_reply core::call(rest::request_params && params)
 
 AEGIS_DECL channel * core::find_channel(snowflake id) const noexcept
 {
-    std::shared_lock<shared_mutex> l(_channel_m);
-    auto it = channels.find(id);
-    if (it == channels.end())
-        return nullptr;
-    return it->second.get();
+    return channels.find(id);
 }
 
 AEGIS_DECL channel* core::find_channel_nolock(snowflake id) const noexcept
 {
-    auto it = channels.find(id);
-    if (it == channels.end())
-        return nullptr;
-    return it->second.get();
+    return channels.find(id);
 }
 
 AEGIS_DECL channel * core::channel_create(snowflake id) noexcept
 {
-    std::unique_lock<shared_mutex> l(_channel_m);
-    auto it = channels.find(id);
-    if (it == channels.end())
+    return channels.get_or_create(id, [&]
     {
-        auto g = std::make_unique<channel>(id, 0, this, *_io_context, *_ratelimit);
-        auto ptr = g.get();
-        channels.emplace(id, std::move(g));
-        return ptr;
-    }
-    return it->second.get();
+        return std::make_unique<channel>(id, 0, this, *_io_context, *_ratelimit);
+    });
 }
 
 AEGIS_DECL guild * core::find_guild(snowflake id) const noexcept
 {
-    std::shared_lock<shared_mutex> l(_guild_m);
-    auto it = guilds.find(id);
-    if (it == guilds.end())
-        return nullptr;
-    return it->second.get();
+    return guilds.find(id);
 }
 
 AEGIS_DECL guild* core::find_guild_nolock(snowflake id) const noexcept
 {
-    auto it = guilds.find(id);
-    if (it == guilds.end())
-        return nullptr;
-    return it->second.get();
+    return guilds.find(id);
 }
 
 AEGIS_DECL guild * core::guild_create(snowflake id, shards::shard * _shard) noexcept
 {
-    std::unique_lock<shared_mutex> l(_guild_m);
-    auto it = guilds.find(id);
-    if (it == guilds.end())
+    return guilds.get_or_create(id, [&]
     {
-        auto g = std::make_unique<guild>(_shard->get_id(), id, this, *_io_context);
-        auto ptr = g.get();
-        guilds.emplace(id, std::move(g));
-        return ptr;
-    }
-    return it->second.get();
+        return std::make_unique<guild>(_shard->get_id(), id, this, *_io_context);
+    });
 }
 
 AEGIS_DECL void core::remove_guild(snowflake guild_id) noexcept
 {
-    std::unique_lock<shared_mutex> l(_guild_m);
-    auto it = guilds.find(guild_id);
-    if (it == guilds.end())
+    auto g = guilds.remove(guild_id);
+    if (!g)
     {
         AEGIS_DEBUG(log, "Unable to remove guild [{}] (does not exist)", guild_id);
         return;
     }
-    stale_guilds.emplace(it->first, std::move(it->second));
-    guilds.erase(it);
-}
 
-AEGIS_DECL void core::remove_guild_nolock(snowflake guild_id) noexcept
-{
-    auto it = guilds.find(guild_id);
-    if (it == guilds.end())
+    // channels keep a raw pointer to their guild, retire them along with it
+    std::vector<snowflake> channel_ids;
     {
-        AEGIS_DEBUG(log, "Unable to remove guild [{}] (does not exist)", guild_id);
-        return;
+        std::shared_lock<shared_mutex> l(g->mtx());
+        channel_ids.reserve(g->channels.size());
+        for (auto & kv : g->channels)
+            channel_ids.push_back(kv.first);
     }
-    stale_guilds.emplace(it->first, std::move(it->second));
-    guilds.erase(it);
-}
+    for (auto & id : channel_ids)
+        _epoch.retire(channels.remove(id));
 
-AEGIS_DECL void core::remove_channel(snowflake channel_id) noexcept
-{
-    std::unique_lock<shared_mutex> l(_channel_m);
-    auto it = channels.find(channel_id);
-    if (it == channels.end())
-    {
-        AEGIS_DEBUG(log, "Unable to remove channel [{}] (does not exist)", channel_id);
-        return;
-    }
-    stale_channels.emplace(it->first, std::move(it->second));
-    channels.erase(it);
+    _epoch.retire(std::move(g));
 }
 
-AEGIS_DECL void core::remove_channel_nolock(snowflake channel_id) noexcept
+AEGIS_DECL void core::remove_channel(snowflake channel_id) noexcept
 {
-    auto it = channels.find(channel_id);
-    if (it == channels.end())
+    auto c = channels.remove(channel_id);
+    if (!c)
     {
         AEGIS_DEBUG(log, "Unable to remove channel [{}] (does not exist)", channel_id);
         return;
     }
-    stale_channels.emplace(it->first, std::move(it->second));
-    channels.erase(it);
+    _epoch.retire(std::move(c));
 }
 
 #if !defined(AEGIS_DISABLE_ALL_CACHE)
 AEGIS_DECL void core::remove_member(snowflake user_id) noexcept
 {
-    std::unique_lock<shared_mutex> l(_user_m);
-    auto it = users.find(user_id);
-    if (it == users.end())
+    auto u = users.remove(user_id);
+    if (!u)
     {
         AEGIS_DEBUG(log, "Unable to remove member [{}] (does not exist)", user_id);
         return;
     }
-    stale_users.emplace(it->first, std::move(it->second));
-    users.erase(it);
+    _epoch.retire(std::move(u));
 }
 #endif
 
@@ -591,7 +760,7 @@ AEGIS_DECL void core::load_config()
 
 AEGIS_DECL void core::setup_callbacks() noexcept
 {
-    _shard_mgr->set_on_message(std::bind(&core::on_message, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    _shard_mgr->set_on_message(std::bind(&core::on_message, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
     _shard_mgr->set_on_connect(std::bind(&core::on_connect, this, std::placeholders::_1, std::placeholders::_2));
     _shard_mgr->set_on_close(std::bind(&core::on_close, this, std::placeholders::_1, std::placeholders::_2));
 }
@@ -629,39 +798,40 @@ AEGIS_DECL void core::setup_gateway()
 				std::cout << "Unknown error: " << ret;
 		}
 
-		ws_handlers.emplace("PRESENCE_UPDATE", std::bind(&core::ws_presence_update, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("TYPING_START", std::bind(&core::ws_typing_start, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("MESSAGE_CREATE", std::bind(&core::ws_message_create, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("MESSAGE_UPDATE", std::bind(&core::ws_message_update, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("MESSAGE_DELETE", std::bind(&core::ws_message_delete, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("GUILD_CREATE", std::bind(&core::ws_guild_create, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("GUILD_UPDATE", std::bind(&core::ws_guild_update, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("GUILD_DELETE", std::bind(&core::ws_guild_delete, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("MESSAGE_REACTION_ADD", std::bind(&core::ws_message_reaction_add, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("MESSAGE_REACTION_REMOVE", std::bind(&core::ws_message_reaction_remove, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("MESSAGE_REACTION_REMOVE_ALL", std::bind(&core::ws_message_reaction_remove_all, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("MESSAGE_DELETE_BULK", std::bind(&core::ws_message_delete_bulk, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("USER_UPDATE", std::bind(&core::ws_user_update, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("RESUMED", std::bind(&core::ws_resumed, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("READY", std::bind(&core::ws_ready, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("CHANNEL_CREATE", std::bind(&core::ws_channel_create, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("CHANNEL_UPDATE", std::bind(&core::ws_channel_update, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("CHANNEL_DELETE", std::bind(&core::ws_channel_delete, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("CHANNEL_PINS_UPDATE", std::bind(&core::ws_channel_pins_update, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("GUILD_BAN_ADD", std::bind(&core::ws_guild_ban_add, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("GUILD_BAN_REMOVE", std::bind(&core::ws_guild_ban_remove, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("GUILD_EMOJIS_UPDATE", std::bind(&core::ws_guild_emojis_update, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("GUILD_INTEGRATIONS_UPDATE", std::bind(&core::ws_guild_integrations_update, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("GUILD_MEMBER_ADD", std::bind(&core::ws_guild_member_add, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("GUILD_MEMBER_REMOVE", std::bind(&core::ws_guild_member_remove, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("GUILD_MEMBER_UPDATE", std::bind(&core::ws_guild_member_update, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("GUILD_MEMBERS_CHUNK", std::bind(&core::ws_guild_members_chunk, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("GUILD_ROLE_CREATE", std::bind(&core::ws_guild_role_create, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("GUILD_ROLE_UPDATE", std::bind(&core::ws_guild_role_update, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("GUILD_ROLE_DELETE", std::bind(&core::ws_guild_role_delete, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("VOICE_STATE_UPDATE", std::bind(&core::ws_voice_state_update, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("VOICE_SERVER_UPDATE", std::bind(&core::ws_voice_server_update, this, std::placeholders::_1, std::placeholders::_2));
-		ws_handlers.emplace("WEBHOOKS_UPDATE", std::bind(&core::ws_webhooks_update, this, std::placeholders::_1, std::placeholders::_2));
+		using gateway::events::event_type;
+		ws_reader_handlers[static_cast<std::size_t>(event_type::PRESENCE_UPDATE)] = &core::ws_presence_update;
+		ws_handlers[static_cast<std::size_t>(event_type::TYPING_START)] = &core::ws_typing_start;
+		ws_reader_handlers[static_cast<std::size_t>(event_type::MESSAGE_CREATE)] = &core::ws_message_create;
+		ws_handlers[static_cast<std::size_t>(event_type::MESSAGE_UPDATE)] = &core::ws_message_update;
+		ws_handlers[static_cast<std::size_t>(event_type::MESSAGE_DELETE)] = &core::ws_message_delete;
+		ws_reader_handlers[static_cast<std::size_t>(event_type::GUILD_CREATE)] = &core::ws_guild_create;
+		ws_handlers[static_cast<std::size_t>(event_type::GUILD_UPDATE)] = &core::ws_guild_update;
+		ws_handlers[static_cast<std::size_t>(event_type::GUILD_DELETE)] = &core::ws_guild_delete;
+		ws_handlers[static_cast<std::size_t>(event_type::MESSAGE_REACTION_ADD)] = &core::ws_message_reaction_add;
+		ws_handlers[static_cast<std::size_t>(event_type::MESSAGE_REACTION_REMOVE)] = &core::ws_message_reaction_remove;
+		ws_handlers[static_cast<std::size_t>(event_type::MESSAGE_REACTION_REMOVE_ALL)] = &core::ws_message_reaction_remove_all;
+		ws_handlers[static_cast<std::size_t>(event_type::MESSAGE_DELETE_BULK)] = &core::ws_message_delete_bulk;
+		ws_handlers[static_cast<std::size_t>(event_type::USER_UPDATE)] = &core::ws_user_update;
+		ws_handlers[static_cast<std::size_t>(event_type::RESUMED)] = &core::ws_resumed;
+		ws_handlers[static_cast<std::size_t>(event_type::READY)] = &core::ws_ready;
+		ws_handlers[static_cast<std::size_t>(event_type::CHANNEL_CREATE)] = &core::ws_channel_create;
+		ws_handlers[static_cast<std::size_t>(event_type::CHANNEL_UPDATE)] = &core::ws_channel_update;
+		ws_handlers[static_cast<std::size_t>(event_type::CHANNEL_DELETE)] = &core::ws_channel_delete;
+		ws_handlers[static_cast<std::size_t>(event_type::CHANNEL_PINS_UPDATE)] = &core::ws_channel_pins_update;
+		ws_handlers[static_cast<std::size_t>(event_type::GUILD_BAN_ADD)] = &core::ws_guild_ban_add;
+		ws_handlers[static_cast<std::size_t>(event_type::GUILD_BAN_REMOVE)] = &core::ws_guild_ban_remove;
+		ws_handlers[static_cast<std::size_t>(event_type::GUILD_EMOJIS_UPDATE)] = &core::ws_guild_emojis_update;
+		ws_handlers[static_cast<std::size_t>(event_type::GUILD_INTEGRATIONS_UPDATE)] = &core::ws_guild_integrations_update;
+		ws_handlers[static_cast<std::size_t>(event_type::GUILD_MEMBER_ADD)] = &core::ws_guild_member_add;
+		ws_handlers[static_cast<std::size_t>(event_type::GUILD_MEMBER_REMOVE)] = &core::ws_guild_member_remove;
+		ws_handlers[static_cast<std::size_t>(event_type::GUILD_MEMBER_UPDATE)] = &core::ws_guild_member_update;
+		ws_handlers[static_cast<std::size_t>(event_type::GUILD_MEMBERS_CHUNK)] = &core::ws_guild_members_chunk;
+		ws_handlers[static_cast<std::size_t>(event_type::GUILD_ROLE_CREATE)] = &core::ws_guild_role_create;
+		ws_handlers[static_cast<std::size_t>(event_type::GUILD_ROLE_UPDATE)] = &core::ws_guild_role_update;
+		ws_handlers[static_cast<std::size_t>(event_type::GUILD_ROLE_DELETE)] = &core::ws_guild_role_delete;
+		ws_handlers[static_cast<std::size_t>(event_type::VOICE_STATE_UPDATE)] = &core::ws_voice_state_update;
+		ws_handlers[static_cast<std::size_t>(event_type::VOICE_SERVER_UPDATE)] = &core::ws_voice_server_update;
+		ws_handlers[static_cast<std::size_t>(event_type::WEBHOOKS_UPDATE)] = &core::ws_webhooks_update;
 
 		if (force_shard_count)
 		{
@@ -709,7 +879,7 @@ AEGIS_DECL void core::process_ready(const json & d, shards::shard * _shard)
         _self = user_create(user_id);
         _self->_member_id = user_id;
         _self->_is_bot = true;
-        _self->_name = username;
+        _self->_name = string_pool::global().intern(username);
         _self->_discriminator = discriminator;
         _self->_status = aegis::gateway::objects::presence::Online;
     }
@@ -719,6 +889,16 @@ AEGIS_DECL void core::process_ready(const json & d, shards::shard * _shard)
     user_id = userdata["id"];
 #endif
 
+    // every guild of the READY is pending until it has been loaded, here or by its GUILD_CREATE
+    {
+        int64_t none = 0;
+        _startup_begin.compare_exchange_strong(none, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+        std::lock_guard<std::mutex> l(_startup_m);
+        for (auto & guildobj : guilds)
+            _startup_guilds.emplace(guildobj["id"].get<snowflake>());
+        _startup_pending.store(_startup_guilds.size(), std::memory_order_relaxed);
+    }
+
     for (auto & guildobj : guilds)
     {
         snowflake id = guildobj["id"];
@@ -729,16 +909,47 @@ AEGIS_DECL void core::process_ready(const json & d, shards::shard * _shard)
 
         guild * _guild = guild_create(id, _shard);
 
-        if (!unavailable)
+        if (unavailable)
+            continue;
+
+        // guild::_load takes the guild lock itself
+        auto load = [this, _guild, _shard, id, total = guilds.size()](const json & obj)
         {
-            std::unique_lock<shared_mutex> l(_guild->mtx());
-            _guild->_load(guildobj, _shard);
+            _guild->_load(obj, _shard);
             AEGIS_DEBUG(log, "Shard#{} : CREATED Guild: {} [T:{}] [{}]"
                       , _shard->get_id()
-                      , _guild->guild_id
-                      , guilds.size()
-                      , guildobj["name"].get<std::string>());
+                      , id
+                      , total
+                      , obj["name"].get<std::string>());
+            _startup_guild_created(id);
+        };
+
+        if (!_bulk_ingest)
+        {
+            load(guildobj);
+            continue;
         }
+
+        auto task = [this, load, obj = std::make_shared<json>(guildobj), id]()
+        {
+            epoch_guard pin(_epoch);
+            try
+            {
+                load(*obj);
+            }
+            catch (std::exception & e)
+            {
+                log->error("Failed to load guild {} from READY: {}", id, e.what());
+            }
+            catch (...)
+            {
+                log->error("Failed to load guild {} from READY: Unknown error", id);
+            }
+        };
+        if (auto strand = _guild_strand(id))
+            asio::post(*strand, std::move(task));
+        else
+            asio::post(*_io_context, std::move(task));
     }
 }
 
@@ -795,20 +1006,126 @@ AEGIS_DECL channel * core::dm_channel_create(const json & obj, shards::shard * _
     return nullptr;
 }
 
-AEGIS_DECL void core::on_message(websocketpp::connection_hdl hdl, std::string msg, shards::shard * _shard)
+template<typename Payload, typename Handler>
+void core::_dispatch_event(asio::io_context::strand * strand, gateway::events::event_type type, const std::string & cmd, shards::shard * _shard, Payload payload, Handler handler)
+{
+    std::chrono::steady_clock::time_point q_t;
+    if (_queue_latency)
+        q_t = std::chrono::steady_clock::now();
+    auto task = [=, res = std::move(payload)]()
+    {
+        if (get_state() == aegis::bot_status::shutdown)
+            return;
+
+        // times the event even when it ran inside a worker's wait for work
+        worker_pool::handler_scope timing;
+
+        try
+        {
+            epoch_guard pin(_epoch);
+            std::chrono::steady_clock::time_point h_t;
+            if (_queue_latency)
+            {
+                h_t = std::chrono::steady_clock::now();
+                _event_histogram(*_queue_latency, &shards::shard::event_histograms::queue, type, cmd, _shard).record(h_t - q_t);
+            }
+#if defined(AEGIS_PROFILING)
+            auto s_t = std::chrono::steady_clock::now();
+            (this->*handler)(res, _shard);
+            if (message_end)
+                message_end(s_t, cmd);
+#else
+            (this->*handler)(res, _shard);
+#endif
+            if (_handler_latency)
+                _event_histogram(*_handler_latency, &shards::shard::event_histograms::handler, type, cmd, _shard).record(std::chrono::steady_clock::now() - h_t);
+        }
+        catch (std::exception& e)
+        {
+            log->error("Failed to process object: {0}", e.what());
+            log->error(_payload_text(res));
+            debug_trace(_shard);
+        }
+        catch (...)
+        {
+            log->error("Failed to process object: Unknown error");
+            log->error(_payload_text(res));
+
+            debug_trace(_shard);
+        }
+
+        if (_epoch.pending())
+            _epoch.try_reclaim();
+
+#if !defined(AEGIS_DISABLE_ALL_CACHE)
+        if (_cache_policy.evicts())
+        {
+            const int64_t now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            int64_t last = _last_sweep.load(std::memory_order_relaxed);
+            if (now - last >= _cache_policy._sweep_interval.count()
+                && _last_sweep.compare_exchange_strong(last, now))
+                _sweep_users();
+        }
+#endif
+    };
+    if (strand)
+        asio::post(*strand, std::move(task));
+    else
+        asio::post(*_io_context, std::move(task));
+}
+
+AEGIS_DECL void core::on_message(websocketpp::connection_hdl hdl, const char * data, std::size_t len, shards::shard * _shard)
 {
 #if defined(AEGIS_PROFILING)
     auto s_t = std::chrono::steady_clock::now();
 #endif
     try
     {
-        json result = json::parse(msg);
-
 #if defined(AEGIS_EVENTS)
         if (websocket_event)
-            websocket_event(msg, *_shard);
+            websocket_event(std::string(data, len), *_shard);
 #endif
 
+        // read the envelope first so dispatches nothing consumes are never parsed
+        gateway::events::dispatch_header hdr;
+        if (gateway::events::scan_dispatch(data, len, hdr) && hdr.op == 0 && !hdr.t.empty())
+        {
+            const auto type = gateway::events::get_event_type(hdr.t);
+            if (!_event_consumed(type))
+            {
+                if (hdr.s >= 0)
+                    _shard->set_sequence(hdr.s);
+                _shard->lastwsevent = std::chrono::steady_clock::now();
+                if (type != gateway::events::event_type::UNKNOWN)
+                    _event_count[static_cast<std::size_t>(type)].fetch_add(1, std::memory_order_relaxed);
+                _events_skipped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            // the busiest and largest dispatches are read straight from the payload
+            const auto reader = (type != gateway::events::event_type::UNKNOWN) ? ws_reader_handlers[static_cast<std::size_t>(type)] : nullptr;
+            if (reader)
+            {
+                if (hdr.s >= 0)
+                    _shard->set_sequence(hdr.s);
+                _shard->lastwsevent = std::chrono::steady_clock::now();
+
+                if ((wsdbg && log->level() == spdlog::level::level_enum::trace)
+                    && type == gateway::events::event_type::MESSAGE_CREATE)
+                    AEGIS_TRACE(log, "Shard#{}: {}", _shard->get_id(), fmt::string_view(data, len));
+
+                _event_count[static_cast<std::size_t>(type)].fetch_add(1, std::memory_order_relaxed);
+                _dispatch_event(_event_strand(data, len, hdr.t, _shard), type, hdr.t, _shard, std::string(data, len), reader);
+                return;
+            }
+        }
+
+        std::chrono::steady_clock::time_point p_t;
+        if (_parse_latency)
+            p_t = std::chrono::steady_clock::now();
+
+        json result = json::parse(data, data + len);
+
         if (!result.is_null())
         {
             if (!result["s"].is_null())
@@ -817,6 +1134,10 @@ AEGIS_DECL void core::on_message(websocketpp::connection_hdl hdl, std::string ms
             if (!result["t"].is_null())
             {
                 const std::string & cmd = result["t"];
+                const auto type = gateway::events::get_event_type(cmd);
+
+                if (_parse_latency)
+                    _event_histogram(*_parse_latency, &shards::shard::event_histograms::parse, type, cmd, _shard).record(std::chrono::steady_clock::now() - p_t);
 
 #if defined(AEGIS_PROFILING)
                 if (js_end)
@@ -827,7 +1148,7 @@ AEGIS_DECL void core::on_message(websocketpp::connection_hdl hdl, std::string ms
                     && ((result["t"] != "GUILD_CREATE"
                            && result["t"] != "PRESENCE_UPDATE"
                            && result["t"] != "GUILD_MEMBERS_CHUNK")))
-                    AEGIS_TRACE(log, "Shard#{}: {}", _shard->get_id(), msg);
+                    AEGIS_TRACE(log, "Shard#{}: {}", _shard->get_id(), fmt::string_view(data, len));
 
                 int64_t t_time = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
 
@@ -839,41 +1160,12 @@ AEGIS_DECL void core::on_message(websocketpp::connection_hdl hdl, std::string ms
 #endif
                 //log->info("Shard#{}: {}", _shard->get_id(), cmd);
 
-                const auto it = ws_handlers.find(cmd);
-                if (it != ws_handlers.end())
+                const auto handler = (type != gateway::events::event_type::UNKNOWN) ? ws_handlers[static_cast<std::size_t>(type)] : nullptr;
+                if (handler)
                 {
                     //message id found
-                    ++message_count[cmd];
-                    asio::post(*_io_context, [=, res = std::move(result)]()
-                    {
-                        if (get_state() == aegis::bot_status::shutdown)
-                            return;
-
-                        try
-                        {
-#if defined(AEGIS_PROFILING)
-                            auto s_t = std::chrono::steady_clock::now();
-                            (it->second)(res, _shard);
-                            if (message_end)
-                                message_end(s_t, cmd);
-#else
-                            (it->second)(res, _shard);
-#endif
-                        }
-                        catch (std::exception& e)
-                        {
-                            log->error("Failed to process object: {0}", e.what());
-                            log->error(res.dump());
-                            debug_trace(_shard);
-                        }
-                        catch (...)
-                        {
-                            log->error("Failed to process object: Unknown error");
-                            log->error(res.dump());
-
-                            debug_trace(_shard);
-                        }
-                    });
+                    _event_count[static_cast<std::size_t>(type)].fetch_add(1, std::memory_order_relaxed);
+                    _dispatch_event(_event_strand(result, cmd, _shard), type, cmd, _shard, std::move(result), handler);
                 }
                 else
                 {
@@ -999,14 +1291,14 @@ AEGIS_DECL void core::on_message(websocketpp::connection_hdl hdl, std::string ms
     catch (std::exception& e)
     {
         log->error("Failed to process object: {0}", e.what());
-        log->error(msg);
+        log->error(std::string(data, len));
 
         debug_trace(_shard);
     }
     catch (...)
     {
         log->error("Failed to process object: Unknown error");
-        log->error(msg);
+        log->error(std::string(data, len));
 
         debug_trace(_shard);
     }
@@ -1045,6 +1337,104 @@ AEGIS_DECL void core::keep_alive(const asio::error_code & ec, const std::chrono:
     }
 }
 
+AEGIS_DECL bool core::_event_consumed(gateway::events::event_type type) const noexcept
+{
+    using gateway::events::event_type;
+    switch (type)
+    {
+        // events that only feed callbacks
+        case event_type::MESSAGE_DELETE:
+            return i_message_delete || i_message_delete_raw;
+        case event_type::MESSAGE_DELETE_BULK:
+            return i_message_delete_bulk || i_message_delete_bulk_raw;
+        case event_type::MESSAGE_REACTION_ADD:
+            return i_message_reaction_add || i_message_reaction_add_raw;
+        case event_type::MESSAGE_REACTION_REMOVE:
+            return i_message_reaction_remove || i_message_reaction_remove_raw;
+        case event_type::MESSAGE_REACTION_REMOVE_ALL:
+            return i_message_reaction_remove_all || i_message_reaction_remove_all_raw;
+        case event_type::CHANNEL_PINS_UPDATE:
+            return i_channel_pins_update || i_channel_pins_update_raw;
+        case event_type::GUILD_BAN_ADD:
+            return i_guild_ban_add || i_guild_ban_add_raw;
+        case event_type::GUILD_BAN_REMOVE:
+            return i_guild_ban_remove || i_guild_ban_remove_raw;
+        case event_type::GUILD_INTEGRATIONS_UPDATE:
+            return i_guild_integrations_update || i_guild_integrations_update_raw;
+        case event_type::VOICE_SERVER_UPDATE:
+            return i_voice_server_update || i_voice_server_update_raw;
+        case event_type::WEBHOOKS_UPDATE:
+            return i_webhooks_update || i_webhooks_update_raw;
+        // events that also fill the cache when the policy asks for it
+#if defined(AEGIS_DISABLE_ALL_CACHE)
+        case event_type::TYPING_START:
+            return i_typing_start || i_typing_start_raw;
+        case event_type::MESSAGE_UPDATE:
+            return i_message_update || i_message_update_raw;
+        case event_type::PRESENCE_UPDATE:
+            return i_presence_update || i_presence_update_raw;
+#else
+        case event_type::TYPING_START:
+            return _cache_policy._event_users || i_typing_start || i_typing_start_raw;
+        case event_type::MESSAGE_UPDATE:
+            return _cache_policy._event_users || i_message_update || i_message_update_raw;
+        case event_type::PRESENCE_UPDATE:
+            return _cache_policy._presences || i_presence_update || i_presence_update_raw;
+#endif
+        case event_type::UNKNOWN:
+            return false;
+        // everything else updates the cache or internal state
+        default:
+            return true;
+    }
+}
+
+AEGIS_DECL asio::io_context::strand * core::_event_strand(const json & result, const std::string & cmd, shards::shard * _shard) noexcept
+{
+    if (_event_strands.empty())
+        return nullptr;
+
+    uint64_t key = _shard->get_id();
+    if (_event_order == event_order::per_guild)
+    {
+        const auto d = result.find("d");
+        if (d != result.end() && d->is_object())
+        {
+            auto id = d->find("guild_id");
+            if ((id == d->end() || id->is_null()) && cmd.compare(0, 6, "GUILD_") == 0)
+                id = d->find("id");
+            if (id != d->end() && id->is_string())
+            {
+                uint64_t guild_id = std::strtoull(id->get_ref<const std::string &>().c_str(), nullptr, 10);
+                return _guild_strand(guild_id);
+            }
+        }
+    }
+    return _event_strands[key % _event_strands.size()].get();
+}
+
+AEGIS_DECL asio::io_context::strand * core::_event_strand(const char * data, std::size_t len, const std::string & cmd, shards::shard * _shard) noexcept
+{
+    if (_event_strands.empty())
+        return nullptr;
+
+    if (_event_order == event_order::per_guild)
+    {
+        const uint64_t guild_id = gateway::events::scan_guild_id(data, len, cmd.compare(0, 6, "GUILD_") == 0);
+        if (guild_id)
+            return _guild_strand(guild_id);
+    }
+    return _event_strands[_shard->get_id() % _event_strands.size()].get();
+}
+
+AEGIS_DECL asio::io_context::strand * core::_guild_strand(uint64_t guild_id) noexcept
+{
+    if (_event_strands.empty())
+        return nullptr;
+    // snowflake low bits are mostly worker/increment, mix in the timestamp
+    return _event_strands[(guild_id ^ (guild_id >> 22)) % _event_strands.size()].get();
+}
+
 AEGIS_DECL void core::on_connect(websocketpp::connection_hdl hdl, shards::shard * _shard)
 {
     try
@@ -1155,42 +1545,67 @@ AEGIS_DECL uint64_t core::get_shard_u_transfer() const noexcept
     return count;
 }
 
-AEGIS_DECL void core::_thread_track(thread_state * t_state)
+AEGIS_DECL std::size_t core::add_run_thread() noexcept
 {
     try
     {
-//        while (t_state->active)
-        t_state->fn();
+        if (!_workers)
+        {
+            // running on an external io_context, start an empty pool to add to
+            auto config = _worker_config;
+            config._min_threads = 0;
+            config._max_threads = 0;
+            _workers = std::make_unique<worker_pool>(*_io_context, config, log);
+            if (_metrics_enabled)
+                _setup_metrics();
+        }
+        return _workers->add_thread();
     }
     catch (std::exception & e)
     {
-        log->critical("Scheduler thread exit due to exception: {}", e.what());
+        log->error("Unable to start thread: {}", e.what());
+        return _workers ? _workers->size() : 0;
     }
-    catch (int)
-    {
-    }
-    t_state->active = false;
 }
 
-AEGIS_DECL std::size_t core::add_run_thread() noexcept
+AEGIS_DECL void core::reduce_threads(std::size_t count) noexcept
 {
-    std::unique_ptr<thread_state> t = std::make_unique<thread_state>();
-    t->active = true;
-    t->start_time = std::chrono::steady_clock::now();
-    t->fn = std::bind(static_cast<asio::io_context::count_type(asio::io_context::*)()>(&asio::io_context::run),
-                      _io_context.get());
-    t->thd = std::thread(std::bind(&core::_thread_track, this, t.get()));
-    threads.emplace_back(std::move(t));
-    return threads.size();
+    if (_workers)
+        _workers->remove_threads(count);
 }
 
-AEGIS_DECL void core::reduce_threads(std::size_t count) noexcept
+AEGIS_DECL worker_pool_stats core::get_worker_pool_stats() const
 {
-    for (uint32_t i = 0; i < count; ++i)
-        asio::post(*_io_context, []
-        {
-            throw 1;
-        });
+    if (!_workers)
+        return {};
+    return _workers->get_stats();
+}
+
+AEGIS_DECL latency_histogram & core::_event_histogram(histogram_family & family, std::atomic<latency_histogram *> shards::shard::event_histograms::* slot, gateway::events::event_type type, const std::string & cmd, shards::shard * _shard)
+{
+    if (type == gateway::events::event_type::UNKNOWN)
+        return family.get(cmd, _shard->get_id());
+
+    // families are never removed, so the histogram outlives the cached pointer
+    auto & cached = _shard->_event_histograms[static_cast<std::size_t>(type)].*slot;
+    latency_histogram * histogram = cached.load(std::memory_order_acquire);
+    if (histogram == nullptr)
+    {
+        histogram = &family.get(cmd, _shard->get_id());
+        cached.store(histogram, std::memory_order_release);
+    }
+    return *histogram;
+}
+
+AEGIS_DECL void core::_setup_metrics()
+{
+    _parse_latency = &_metrics.histogram("aegis_gateway_parse_seconds", "Time to parse a gateway event", { "event", "shard" });
+    _queue_latency = &_metrics.histogram("aegis_event_queue_seconds", "Time from an event being posted to its handler starting", { "event", "shard" });
+    _handler_latency = &_metrics.histogram("aegis_event_handler_seconds", "Time spent in a gateway event handler", { "event", "shard" });
+    if (_ratelimit)
+        _ratelimit->set_metrics(&_metrics);
+    if (_workers)
+        _workers->set_lag_histogram(&_metrics.histogram("aegis_event_loop_lag_seconds", "Wait of a probe posted to the io_context every scale interval", {}).get());
 }
 
 AEGIS_DECL void core::on_close(websocketpp::connection_hdl hdl, shards::shard * _shard)
@@ -1204,61 +1619,56 @@ AEGIS_DECL void core::reset_shard(shards::shard * _shard)
     _shard->do_reset();
 }
 
-AEGIS_DECL void core::ws_presence_update(const json & result, shards::shard * _shard)
+AEGIS_DECL void core::ws_presence_update(const std::string & payload, shards::shard * _shard)
 {
     _shard->counters.presence_changes++;
 
-#if !defined(AEGIS_DISABLE_ALL_CACHE)
-    json user = result["d"]["user"];
-    snowflake guild_id = result["d"]["guild_id"];
-    snowflake member_id = user["id"];
-    auto _member = user_create(member_id);
-    auto  _guild = find_guild(guild_id);
-    if (_guild == nullptr)
-    {
-        log->warn("Shard#{}: member without guild M:{} G:{} null:{}", _shard->get_id(), member_id, guild_id, _member == nullptr);
+    json_reader r(payload);
+    if (!gateway::events::seek_dispatch_data(r))
         return;
-    }    
-    {
-        std::unique_lock<shared_mutex> l(_member->mtx(), std::defer_lock);
-        std::unique_lock<shared_mutex> l2(_guild->mtx(), std::defer_lock);
-        std::lock(l, l2);
-        _member->_load_nolock(_guild, result["d"], _shard, true, false);
-    }
-
-    using user_status = aegis::gateway::objects::presence::user_status;
-
-    const std::string & sts = result["d"]["status"];
-
-    if (sts == "idle")
-        _member->_status = user_status::Idle;
-    else if (sts == "dnd")
-        _member->_status = user_status::DoNotDisturb;
-    else if (sts == "online")
-        _member->_status = user_status::Online;
-    else
-        _member->_status = user_status::Offline;
-
-    //TODO: this is where rich presence might be stored if it's relevant to do so
-    //_member->rich_presence = result["d"]["game"]; //activity object
-#endif
 
     gateway::events::presence_update obj{*_shard};
+    gateway::events::from_reader(r, obj);
 
-    const json & j = result["d"];
+#if !defined(AEGIS_DISABLE_ALL_CACHE)
+    if (_cache_policy._presences)
+    {
+        snowflake guild_id = obj.guild_id;
+        snowflake member_id = obj.user.id;
+        auto _member = user_create(member_id);
+        auto  _guild = find_guild(guild_id);
+        if (_guild == nullptr)
+        {
+            log->warn("Shard#{}: member without guild M:{} G:{} null:{}", _shard->get_id(), member_id, guild_id, _member == nullptr);
+            return;
+        }    
+        {
+            std::unique_lock<shared_mutex> l(_member->mtx(), std::defer_lock);
+            std::unique_lock<shared_mutex> l2(_guild->mtx(), std::defer_lock);
+            std::lock(l, l2);
 
-    obj.user = j["user"];
-    obj.guild_id = j["guild_id"];
+            gateway::objects::member member;
+            member._user = obj.user;
+            member.nick = obj.nick;
+            member.roles = obj.roles;
+            // presences carry no voice state, keep the one already known
+            if (auto g_info = _member->_find_guild_info(guild_id))
+            {
+                member.deaf = g_info->deaf;
+                member.mute = g_info->mute;
+            }
+            _member->_load_nolock(_guild, member, _shard, true, false);
+        }
 
-    if (j.count("game") && !j["game"].is_null())
-        obj.game = j["game"];
+        _member->_status = obj.status;
 
-    if (j.count("roles") && !j["roles"].is_null())
-        for (const auto & _role : j["roles"])
-            obj.roles.push_back(_role);
+        //TODO: this is where rich presence might be stored if it's relevant to do so
+        //_member->rich_presence = result["d"]["game"]; //activity object
+    }
+#endif
 
     if (i_presence_update_raw)
-        i_presence_update_raw(result, _shard);
+        i_presence_update_raw(json::parse(payload), _shard);
 
     if (i_presence_update)
         i_presence_update(obj);
@@ -1279,68 +1689,69 @@ AEGIS_DECL void core::ws_typing_start(const json & result, shards::shard * _shar
 }
 
 
-AEGIS_DECL void core::ws_message_create(const json & result, shards::shard * _shard)
+AEGIS_DECL void core::ws_message_create(const std::string & payload, shards::shard * _shard)
 {
     _shard->counters.messages++;
 
-    snowflake c_id = result["d"]["channel_id"];
+    json_reader r(payload);
+    if (!gateway::events::seek_dispatch_data(r))
+        return;
+
+    gateway::objects::message msg;
+    lib::optional<gateway::objects::member> member;
+    gateway::objects::from_reader(r, msg, member);
+    msg._core = this;
+
+    snowflake c_id = msg.get_channel_id();
     auto c = find_channel(c_id);
     //assert(c != nullptr);
     if (c == nullptr)
     {
-        log->warn("Shard#{} - channel == nullptr - {} {} {}", _shard->get_id(), c_id, result["d"]["author"]["id"].get<std::string>(), result["d"]["content"].get<std::string>());
+        log->warn("Shard#{} - channel == nullptr - {} {} {}", _shard->get_id(), c_id, msg.get_author_id(), msg.get_content());
     }
     else if (c->get_guild_id() == 0)//DM
     {
-        auto m = find_user(result["d"]["author"]["id"]);
-        gateway::events::message_create obj{ *_shard, std::ref(*m), std::ref(*c) };
-
-        obj.msg = result["d"];
-        obj.msg._core = this;
+        auto m = find_user(msg.get_author_id());
+        gateway::events::message_create obj{ *_shard, std::ref(*m), std::ref(*c), std::move(msg) };
 
         if (i_message_create_dm_raw)
-            i_message_create_dm_raw(result, _shard);
+            i_message_create_dm_raw(json::parse(payload), _shard);
 
         if (i_message_create_dm)
             i_message_create_dm(obj);
     }
     else
     {
-        if (!result["d"].count("webhook_id"))
+        if (!msg.is_webhook())
         {
             auto g = &c->get_guild();
-            auto m = find_user(result["d"]["author"]["id"]);
+            auto m = find_user(msg.get_author_id());
             if (m == nullptr)
             {
-                if (result["d"].count("member") && !result["d"]["member"].is_null())
+                if (member)
                 {
-                    gateway::objects::member u = result["d"]["member"];
-                    u._user = result["d"]["author"].get<gateway::objects::user>();
-                    int64_t author_id = u._user->id;
-                    m = user_create(author_id);
-                    m->_load_nolock(g, u, _shard);
+                    member->_user = msg.author;
+                    m = user_create(msg.get_author_id());
+                    m->_load_nolock(g, *member, _shard);
                 }
             }
 
             //user was previously created via presence update, but presence update only contains id
-            gateway::events::message_create obj{ *_shard, lib::nullopt, std::ref(*c) };
-            
-            obj.msg = result["d"];
-            obj.msg._core = this;
-
             if (m)
             {
-                if (m->get_username().empty() && result["d"].count("member") && !result["d"]["member"].is_null())
+                if (m->get_username().empty() && member)
                 {
-                    gateway::objects::member u = result["d"]["member"];
-                    u._user = result["d"]["author"].get<gateway::objects::user>();
-                    m->_load_nolock(g, u, _shard);
+                    member->_user = msg.author;
+                    m->_load_nolock(g, *member, _shard);
                 }
-                obj.user = std::ref(*m);
             }
 
+            gateway::events::message_create obj{ *_shard, lib::nullopt, std::ref(*c), std::move(msg) };
+            if (m)
+                obj.user = std::ref(*m);
+
             if (i_message_create_raw)
-                i_message_create_raw(result, _shard);
+                i_message_create_raw(json::parse(payload), _shard);
 
             if (i_message_create)
                 i_message_create(obj);
@@ -1389,9 +1800,14 @@ AEGIS_DECL void core::ws_message_update(const json & result, shards::shard * _sh
         i_message_update(obj);
 }
 
-AEGIS_DECL void core::ws_guild_create(const json & result, shards::shard * _shard)
+AEGIS_DECL void core::ws_guild_create(const std::string & payload, shards::shard * _shard)
 {
-    snowflake guild_id = result["d"]["id"];
+    snowflake guild_id = gateway::events::scan_guild_id(payload.data(), payload.size(), true);
+
+    json_reader r(payload);
+    if (!gateway::events::seek_dispatch_data(r))
+        return;
+    const char * d = r.position();
 
     auto _guild = guild_create(guild_id, _shard);
     if (_guild->unavailable && _guild->get_owner())
@@ -1399,7 +1815,8 @@ AEGIS_DECL void core::ws_guild_create(const json & result, shards::shard * _shar
         //outage
     }
 
-    _guild->_load(result["d"], _shard);
+    _guild->_load(r, _shard);
+    _startup_guild_created(guild_id);
 
     if (bulk_members_on_connect())
     {
@@ -1411,14 +1828,17 @@ AEGIS_DECL void core::ws_guild_create(const json & result, shards::shard * _shar
         _shard->send(chunk.dump());
     }
 
-    gateway::events::guild_create obj{ *_shard };
-    obj.guild = result["d"];
-
     if (i_guild_create_raw)
-        i_guild_create_raw(result, _shard);
+        i_guild_create_raw(json::parse(payload), _shard);
 
     if (i_guild_create)
+    {
+        // only build the event object for a callback, it copies every member of the guild
+        json_reader gr(d, static_cast<std::size_t>(payload.data() + payload.size() - d));
+        gateway::events::guild_create obj{ *_shard };
+        gateway::objects::from_reader(gr, obj.guild);
         i_guild_create(obj);
+    }
 }
 
 AEGIS_DECL void core::ws_guild_update(const json & result, shards::shard * _shard)
@@ -1487,11 +1907,10 @@ AEGIS_DECL void core::ws_guild_delete(const json & result, shards::shard * _shar
         if (i_guild_delete)
             i_guild_delete(obj);
 
-        std::unique_lock<shared_mutex> l(_guild_m);
         //kicked or left
         //websocket_o.set_timer(5000, [this, id, _shard](const asio::error_code & ec)
         //{
-        remove_guild_nolock(guild_id);
+        remove_guild(guild_id);
         //guilds.erase(guild_id);
         //});
     }
@@ -1535,9 +1954,9 @@ AEGIS_DECL void core::ws_user_update(const json & result, shards::shard * _shard
 
     const json & user = result["d"];
     if (user.count("username") && !user["username"].is_null())
-        _member->_name = user["username"].get<std::string>();
+        _member->_name = string_pool::global().intern(user["username"].get<std::string>());
     if (user.count("avatar") && !user["avatar"].is_null())
-        _member->_avatar = user["avatar"].get<std::string>();
+        _member->_avatar = avatar_hash(user["avatar"].get<std::string>());
     if (user.count("discriminator") && !user["discriminator"].is_null())
         _member->_discriminator = static_cast<uint16_t>(std::stoi(user["discriminator"].get<std::string>()));
     if (user.count("mfa_enabled") && !user["mfa_enabled"].is_null())
@@ -1567,9 +1986,11 @@ AEGIS_DECL void core::ws_voice_state_update(const json & result, shards::shard *
 
     snowflake guild_id = result["d"]["guild_id"];
 
-    auto _guild = guild_create(guild_id, _shard);
-    
-    _guild->_load_voicestate(result["d"]);
+    if (_cache_policy._voice_states)
+    {
+        auto _guild = guild_create(guild_id, _shard);
+        _guild->_load_voicestate(result["d"]);
+    }
 
     if (j.count("guild_id") && !j["guild_id"].is_null())
         obj.guild_id = j["guild_id"];
@@ -1665,11 +2086,13 @@ AEGIS_DECL void core::ws_channel_create(const json & result, shards::shard * _sh
             return;
         auto _channel = channel_create(channel_id);
         std::unique_lock<shared_mutex> l(_channel->mtx(), std::defer_lock);
-        std::unique_lock<shared_mutex> l2(_channel_m, std::defer_lock);
-        std::unique_lock<shared_mutex> l3(_guild->mtx(), std::defer_lock);
-        std::lock(l, l2, l3);
+        std::unique_lock<shared_mutex> l2(_guild->mtx(), std::defer_lock);
+        std::lock(l, l2);
         _channel->_load_with_guild_nolock(*_guild, result["d"], _shard);
         _guild->channels.emplace(channel_id, _channel);
+#if !defined(AEGIS_DISABLE_ALL_CACHE)
+        _guild->_invalidate_channel_permissions(channel_id);
+#endif
         _channel->guild_id = guild_id;
         _channel->_guild = _guild;
     }
@@ -1717,10 +2140,13 @@ AEGIS_DECL void core::ws_channel_update(const json & result, shards::shard * _sh
             return;
         auto _channel = channel_create(channel_id);
         std::unique_lock<shared_mutex> l(_channel->mtx(), std::defer_lock);
-        std::unique_lock<shared_mutex> l2(_channel_m, std::defer_lock);
+        std::unique_lock<shared_mutex> l2(_guild->mtx(), std::defer_lock);
         std::lock(l, l2);
         _channel->_load_with_guild_nolock(*_guild, result["d"], _shard);
         _guild->channels.emplace(channel_id, _channel);
+#if !defined(AEGIS_DISABLE_ALL_CACHE)
+        _guild->_invalidate_channel_permissions(channel_id);
+#endif
     }
     else
     {
@@ -1755,11 +2181,9 @@ AEGIS_DECL void core::ws_channel_delete(const json & result, shards::shard * _sh
         auto _channel = find_channel(channel_id);
         if (_channel == nullptr)//TODO: errors
             return;
-        std::unique_lock<shared_mutex> l(_channel->mtx(), std::defer_lock);
-        std::unique_lock<shared_mutex> l2(_channel_m, std::defer_lock);
-        std::lock(l, l2);
+        std::unique_lock<shared_mutex> l(_channel->mtx());
         _guild->_remove_channel(channel_id);
-        remove_channel_nolock(channel_id);
+        remove_channel(channel_id);
     }
 
     gateway::events::channel_delete obj{ *_shard };
@@ -1875,10 +2299,8 @@ AEGIS_DECL void core::ws_guild_member_remove(const json & result, shards::shard
     snowflake guild_id = result["d"]["guild_id"];
 
     {
-        std::unique_lock<shared_mutex> l(_guild_m);
-
         auto _member = find_user(member_id);
-        auto _guild = find_guild_nolock(guild_id);
+        auto _guild = find_guild(guild_id);
 
         if (_guild != nullptr)
         {
@@ -1976,34 +2398,56 @@ AEGIS_DECL void core::ws_guild_members_chunk(const json & result, shards::shard
     auto & members = result["d"]["members"];
     if (!members.empty())
     {
+        using clock = std::chrono::steady_clock;
+
+        // resolve every user of the chunk in one pass over the user cache
+        auto t = clock::now();
+        std::vector<snowflake> member_ids;
+        member_ids.reserve(members.size());
         for (auto & _member : members)
+            member_ids.push_back(_member["user"]["id"]);
+        std::vector<user *> member_ptrs;
+        user_create_bulk(member_ids, member_ptrs);
+        _record_ingest(ingest_phase::member_create, t);
+
+        // then load them all under a single guild lock. guild before member is the order
+        // guild::_load uses as well
+        t = clock::now();
         {
-            snowflake member_id = _member["user"]["id"];
-
-            auto _member_ptr = user_create(member_id);
-
-            std::unique_lock<shared_mutex> l(_member_ptr->mtx(), std::defer_lock);
-            std::unique_lock<shared_mutex> l2(_guild->mtx(), std::defer_lock);
-            std::lock(l, l2);
-            _member_ptr->_load_nolock(_guild, _member, _shard, true, false);
+            std::unique_lock<shared_mutex> l(_guild->mtx());
+            _guild->members.reserve(_guild->members.size() + member_ptrs.size());
+            std::size_t idx = 0;
+            for (auto & _member : members)
+            {
+                auto _member_ptr = member_ptrs[idx++];
+                std::unique_lock<shared_mutex> ml(_member_ptr->mtx());
+                _member_ptr->_load_nolock(_guild, _member, _shard, true, false);
+            }
         }
+        _record_ingest(ingest_phase::member_load, t);
+        _ingest_members.fetch_add(members.size(), std::memory_order_relaxed);
     }
 #endif
 
+    if (i_guild_members_chunk_raw)
+        i_guild_members_chunk_raw(result, _shard);
+
+    if (!i_guild_members_chunk)
+        return;
+
     gateway::events::guild_members_chunk obj{ *_shard };
 
     const json & j = result["d"];
 
     obj.guild_id = j["guild_id"];
     if (j.count("members") && !j["members"].is_null())
+    {
+        obj.members.reserve(j["members"].size());
         for (const auto & i : j["members"])
             obj.members.push_back(i);
+    }
 
-    if (i_guild_members_chunk_raw)
-        i_guild_members_chunk_raw(result, _shard);
-
-    if (i_guild_members_chunk)
-        i_guild_members_chunk(obj);
+    i_guild_members_chunk(obj);
 }
 
 AEGIS_DECL void core::ws_guild_role_create(const json & result, shards::shard * _shard)
@@ -2012,7 +2456,8 @@ AEGIS_DECL void core::ws_guild_role_create(const json & result, shards::shard *
     snowflake guild_id = result["d"]["guild_id"];
 
     auto _guild = find_guild(guild_id);
-    _guild->_load_role(result["d"]["role"]);
+    if (_guild && _cache_policy._roles)
+        _guild->_load_role(result["d"]["role"]);
 #endif
 
     gateway::events::guild_role_create obj{ *_shard };
@@ -2035,7 +2480,8 @@ AEGIS_DECL void core::ws_guild_role_update(const json & result, shards::shard *
     snowflake guild_id = result["d"]["guild_id"];
 
     auto _guild = find_guild(guild_id);
-    _guild->_load_role(result["d"]["role"]);
+    if (_guild && _cache_policy._roles)
+        _guild->_load_role(result["d"]["role"]);
 #endif
 
     gateway::events::guild_role_update obj{ *_shard };
@@ -2224,11 +2670,10 @@ AEGIS_DECL aegis::future<gateway::objects::message> core::create_message(snowfla
     guild* _guild = nullptr;
     if (perform_lookup)
     {
-        auto it = channels.find(channel_id);
-        if (it == channels.end())
+        _channel = find_channel(channel_id);
+        if (_channel == nullptr)
             return aegis::make_exception_future<gateway::objects::message>(error::channel_not_found);
-        _channel = it->second.get();
-        _guild = &it->second->get_guild();
+        _guild = &_channel->get_guild();
         if (_guild != nullptr)//probably a DM
             if (!_channel->perms().can_send_messages())
                 return aegis::make_exception_future<gateway::objects::message>(error::no_permission);
@@ -2251,11 +2696,10 @@ AEGIS_DECL aegis::future<gateway::objects::message> core::create_message_embed(s
     guild* _guild = nullptr;
     if (perform_lookup)
     {
-        auto it = channels.find(channel_id);
-        if (it == channels.end())
+        _channel = find_channel(channel_id);
+        if (_channel == nullptr)
             return aegis::make_exception_future<gateway::objects::message>(error::channel_not_found);
-        _channel = it->second.get();
-        _guild = &it->second->get_guild();
+        _guild = &_channel->get_guild();
         if (_guild != nullptr)//probably a DM
             if (!_channel->perms().can_send_messages())
                 return aegis::make_exception_future<gateway::objects::message>(error::no_permission);
@@ -55,11 +55,15 @@ AEGIS_DECL user * guild::self() const
 AEGIS_DECL void guild::_add_member(user * _member) noexcept
 {
     std::unique_lock<shared_mutex> l(_m);
+    if (_member->_evicted.load())
+        return;
     members.emplace(_member->_member_id, _member);
 }
 
 AEGIS_DECL void guild::_add_member_nolock(user * _member) noexcept
 {
+    if (_member->_evicted.load())
+        return;
     members.emplace(_member->_member_id, _member);
 }
 
@@ -74,6 +78,7 @@ AEGIS_DECL void guild::_remove_member(snowflake member_id) noexcept
     }
     _member->second->leave(guild_id);
     members.erase(member_id);
+    _invalidate_member_permissions(member_id);
 }
 
 AEGIS_DECL bool guild::member_has_role(snowflake member_id, snowflake role_id) const noexcept
@@ -82,16 +87,11 @@ AEGIS_DECL bool guild::member_has_role(snowflake member_id, snowflake role_id) c
     auto _member = find_member(member_id);
     if (_member == nullptr)
         return false;
-    auto & gi = _member->get_guild_info(guild_id);
-    auto it = std::find_if(std::begin(gi.roles), std::end(gi.roles), [&](const snowflake & id)
-    {
-        if (id == role_id)
-            return true;
+    std::shared_lock<shared_mutex> ml(_member->_m);
+    auto gi = _member->_find_guild_info(guild_id);
+    if (gi == nullptr)
         return false;
-    });
-    if (it != std::end(gi.roles))
-        return true;
-    return false;
+    return std::find(std::begin(gi->roles), std::end(gi->roles), role_id) != std::end(gi->roles);
 }
 
 AEGIS_DECL void guild::_load_emoji(const json & obj) noexcept
@@ -139,6 +139,7 @@ AEGIS_DECL void guild::_load_role(const json & obj) noexcept
     snowflake role_id = obj["id"];
     auto & _role = roles[role_id];
     _role = obj;
+    _invalidate_permissions();
 }
 
 AEGIS_DECL const snowflake guild::get_owner() const noexcept
@@ -220,12 +221,109 @@ AEGIS_DECL permission guild::get_permissions(const user * _member, const channel
     if (_member == nullptr || _channel == nullptr)
         return 0;
 
-    int64_t _base_permissions = base_permissions(_member);
+    snowflake member_id = _member->get_id();
+    snowflake channel_id = _channel->get_id();
+    uint64_t gen;
+    {
+        std::shared_lock<shared_mutex> l(_perm_m);
+        auto c = _channel_perms.find(channel_id);
+        if (c != _channel_perms.end())
+        {
+            auto m = c->second.find(member_id);
+            if (m != c->second.end())
+                return m->second;
+        }
+        gen = _perm_gen;
+    }
+
+    int64_t perms = compute_overwrites(base_permissions(*_member), *_member, *_channel);
 
-    return compute_overwrites(_base_permissions, *_member, *_channel);
+    std::unique_lock<shared_mutex> l(_perm_m);
+    if (gen == _perm_gen)
+        _channel_perms[channel_id][member_id] = perms;
+    return perms;
 }
 
 AEGIS_DECL int64_t guild::base_permissions(const user & _member) const noexcept
+{
+    uint64_t gen;
+    {
+        std::shared_lock<shared_mutex> l(_perm_m);
+        auto it = _base_perms.find(_member._member_id);
+        if (it != _base_perms.end())
+            return it->second;
+        gen = _perm_gen;
+    }
+
+    int64_t perms = _compute_base_permissions(_member);
+
+    std::unique_lock<shared_mutex> l(_perm_m);
+    if (gen == _perm_gen)
+        _base_perms[_member._member_id] = perms;
+    return perms;
+}
+
+AEGIS_DECL void guild::_invalidate_permissions() const noexcept
+{
+    std::unique_lock<shared_mutex> l(_perm_m);
+    ++_perm_gen;
+    _base_perms.clear();
+    _channel_perms.clear();
+}
+
+AEGIS_DECL void guild::_invalidate_member_permissions(snowflake member_id) const noexcept
+{
+    std::unique_lock<shared_mutex> l(_perm_m);
+    ++_perm_gen;
+    _base_perms.erase(member_id);
+    for (auto & c : _channel_perms)
+        c.second.erase(member_id);
+}
+
+AEGIS_DECL void guild::_invalidate_channel_permissions(snowflake channel_id) const noexcept
+{
+    std::unique_lock<shared_mutex> l(_perm_m);
+    ++_perm_gen;
+    _channel_perms.erase(channel_id);
+}
+
+AEGIS_DECL void guild::_memory_usage(cache_memory_stats & stats) const noexcept
+{
+    std::shared_lock<shared_mutex> l(_m);
+
+    stats.guilds.count++;
+    stats.guilds.bytes += sizeof(guild) + detail::string_bytes(name) + detail::string_bytes(icon)
+        + detail::string_bytes(splash) + detail::string_bytes(region) + detail::string_bytes(joined_at);
+    // the channel map only holds pointers, the channels are accounted by the channel cache
+    cache_usage channel_map;
+    detail::add_hashtable(channels, channel_map);
+    stats.guilds.bytes += channel_map.bytes;
+
+    detail::add_hashtable(members, stats.members);
+
+    detail::add_hashtable(roles, stats.roles);
+    for (auto & r : roles)
+        stats.roles.bytes += detail::string_bytes(r.second.name);
+
+    detail::add_hashtable(emojis, stats.emojis);
+    for (auto & e : emojis)
+        stats.emojis.bytes += detail::string_bytes(e.second.name) + detail::vector_bytes(e.second.roles);
+
+    detail::add_hashtable(voice_states, stats.voice_states);
+    for (auto & v : voice_states)
+        stats.voice_states.bytes += detail::string_bytes(v.second.session_id);
+
+    std::shared_lock<shared_mutex> pl(_perm_m);
+    detail::add_hashtable(_base_perms, stats.permissions);
+    for (auto & c : _channel_perms)
+        detail::add_hashtable(c.second, stats.permissions);
+    cache_usage channel_perms;
+    detail::add_hashtable(_channel_perms, channel_perms);
+    stats.permissions.bytes += channel_perms.bytes;
+    stats.permissions.buckets += channel_perms.buckets;
+}
+
+AEGIS_DECL int64_t guild::_compute_base_permissions(const user & _member) const noexcept
 {
     try
     {
@@ -235,11 +333,16 @@ AEGIS_DECL int64_t guild::base_permissions(const user & _member) const noexcept
         auto & role_everyone = get_role(guild_id);
         int64_t permissions = role_everyone._permission.get_allow_perms();
 
-        auto g = _member.get_guild_info_nocreate(guild_id);
-        if (g == nullptr)
-            return 0;
+        small_vector<snowflake, 4> member_roles;
+        {
+            std::shared_lock<shared_mutex> ml(_member._m);
+            auto g = _member._find_guild_info(guild_id);
+            if (g == nullptr)
+                return 0;
+            member_roles = g->roles;
+        }
 
-        for (auto & rl : g->roles)
+        for (auto & rl : member_roles)
             permissions |= get_role(rl)._permission.get_allow_perms();
 
         if (permissions & 0x8)//admin
@@ -284,14 +387,19 @@ AEGIS_DECL int64_t guild::compute_overwrites(const int64_t _base_permissions, co
         auto & overwrites = _channel.overrides;
         int64_t allow = 0;
         int64_t deny = 0;
-        auto g = _member.get_guild_info_nocreate(guild_id);
-        if (g == nullptr)
+        small_vector<snowflake, 4> member_roles;
         {
-            //could not find guild cache within member - use base permissions
-            _bot->log->warn("Member does not have guild info struct : m:[{}] g:[{}]", _member.get_id(), guild_id);
-            return 0;
+            std::shared_lock<shared_mutex> ml(_member._m);
+            auto g = _member._find_guild_info(guild_id);
+            if (g == nullptr)
+            {
+                //could not find guild cache within member - use base permissions
+                _bot->log->warn("Member does not have guild info struct : m:[{}] g:[{}]", _member.get_id(), guild_id);
+                return 0;
+            }
+            member_roles = g->roles;
         }
-        for (auto & rl : g->roles)
+        for (auto & rl : member_roles)
         {
             if (rl == guild_id)
                 continue;
@@ -341,19 +449,16 @@ AEGIS_DECL void guild::_remove_role(snowflake role_id) noexcept
     {
         for (auto & kv : members)
         {
-            auto g = kv.second->get_guild_info(guild_id);
-            for (auto & rl : g.roles)
-            {
-                if (rl == role_id)
-                {
-                    auto it = std::find(g.roles.begin(), g.roles.end(), role_id);
-                    if (it != g.roles.end())
-                        g.roles.erase(it);
-                    break;
-                }
-            }
+            std::unique_lock<shared_mutex> ml(kv.second->_m);
+            auto g = kv.second->_find_guild_info(guild_id);
+            if (g == nullptr)
+                continue;
+            auto it = std::find(g->roles.begin(), g->roles.end(), role_id);
+            if (it != g->roles.end())
+                g->roles.erase(it);
         }
         roles.erase(role_id);
+        _invalidate_permissions();
     }
     catch (std::out_of_range &)
     {
@@ -374,8 +479,10 @@ AEGIS_DECL void guild::_load(const json & obj, shards::shard * _shard)
 
     shard_id = _shard->get_id();
     is_init = false;
+    _invalidate_permissions();
 
     core & bot = get_bot();
+    using clock = std::chrono::steady_clock;
     try
     {
         json voice_states;
@@ -406,26 +513,42 @@ AEGIS_DECL void guild::_load(const json & obj, shards::shard * _shard)
         {
             const json & roles = obj["roles"];
 
-            for (auto & role : roles)
-            {
-                _load_role(role);
-            }
+            auto t = clock::now();
+            if (bot.get_cache_policy()._roles)
+                for (auto & role : roles)
+                {
+                    _load_role(role);
+                }
+            bot._record_ingest(ingest_phase::roles, t);
         }
 
         if (obj.count("members"))
         {
             const json & members = obj["members"];
+#if !defined(AEGIS_DISABLE_ENTITY_POOL)
+            object_pool<user>::instance().reserve(members.size());
+#endif
 
+            // create every user of the list in one pass over the user cache
+            auto t = clock::now();
+            std::vector<snowflake> member_ids;
+            member_ids.reserve(members.size());
+            for (auto & member : members)
+                member_ids.push_back(member["user"]["id"]);
+            std::vector<user *> member_ptrs;
+            bot.user_create_bulk(member_ids, member_ptrs);
+            bot._record_ingest(ingest_phase::member_create, t);
+
+            t = clock::now();
+            std::size_t idx = 0;
             for (auto & member : members)
             {
-                const json & obj = member["user"];
-                snowflake member_id = obj["id"];
-                auto _member = bot.user_create(member_id);
+                auto _member = member_ptrs[idx++];
                 _member->_load(this, member, _shard, false);
-                this->members.emplace(member_id, _member);
 
                 {
-                    auto & g_info = _member->_join(guild_id);
+                    std::unique_lock<shared_mutex> ml(_member->_m);
+                    auto & g_info = _member->_join_nolock(guild_id);
 
 
                     if (member.count("deaf") && !member["deaf"].is_null()) g_info.deaf = member["deaf"];
@@ -447,15 +570,23 @@ AEGIS_DECL void guild::_load(const json & obj, shards::shard * _shard)
                     }
 
                     if (member.count("nick") && !member["nick"].is_null())
-                        g_info.nickname = member["nick"].get<std::string>();
+                        g_info.nickname = string_pool::global().intern(member["nick"].get<std::string>());
                 }
 
+                _add_member_nolock(_member);
+
             }
+            bot._record_ingest(ingest_phase::member_load, t);
+            bot._ingest_members.fetch_add(members.size(), std::memory_order_relaxed);
         }
 
         if (obj.count("channels"))
         {
             const json & channels = obj["channels"];
+#if !defined(AEGIS_DISABLE_ENTITY_POOL)
+            object_pool<channel>::instance().reserve(channels.size());
+#endif
+            auto t = clock::now();
 
             for (auto & channel_obj : channels)
             {
@@ -466,26 +597,32 @@ AEGIS_DECL void guild::_load(const json & obj, shards::shard * _shard)
                 _channel->_guild = this;
                 this->channels.emplace(channel_id, _channel);
             }
+            bot._record_ingest(ingest_phase::channels, t);
+            bot._ingest_channels.fetch_add(channels.size(), std::memory_order_relaxed);
         }
 
-        if (obj.count("presences"))
+        if (obj.count("presences") && bot.get_cache_policy()._presences)
         {
             const json & presences = obj["presences"];
 
+            auto t = clock::now();
             for (auto & presence : presences)
             {
                 _load_presence(presence);
             }
+            bot._record_ingest(ingest_phase::presences, t);
         }
 
-        if (obj.count("emojis"))
+        if (obj.count("emojis") && bot.get_cache_policy()._emojis)
         {
             const json & emojis = obj["emojis"];
 
+            auto t = clock::now();
             for (auto & emoji : emojis)
             {
                 _load_emoji(emoji);
             }
+            bot._record_ingest(ingest_phase::emojis, t);
         }
 
         if (obj.count("features"))
@@ -501,11 +638,18 @@ AEGIS_DECL void guild::_load(const json & obj, shards::shard * _shard)
         }
         */
 
-        for (auto & voicestate : voice_states)
+        if (bot.get_cache_policy()._voice_states)
         {
-            _load_voicestate(voicestate);
+            auto t = clock::now();
+            for (auto & voicestate : voice_states)
+            {
+                _load_voicestate(voicestate);
+            }
+            bot._record_ingest(ingest_phase::voice_states, t);
         }
 
+        bot._ingest_guilds.fetch_add(1, std::memory_order_relaxed);
+
 
 
     }
@@ -520,6 +664,209 @@ AEGIS_DECL void guild::_load(const json & obj, shards::shard * _shard)
         std::rethrow_exception(std::current_exception());
     }
 }
+AEGIS_DECL void guild::_load(json_reader & r, shards::shard * _shard)
+{
+    std::unique_lock<shared_mutex> l(_m);
+
+    shard_id = _shard->get_id();
+    is_init = false;
+    _invalidate_permissions();
+
+    core & bot = get_bot();
+    using clock = std::chrono::steady_clock;
+    try
+    {
+        // members and presences are read straight into objects, the short lists into
+        // one small json value per element
+        std::vector<json> role_objs;
+        std::vector<gateway::objects::member> member_objs;
+        std::vector<json> channel_objs;
+        std::vector<std::pair<snowflake, gateway::objects::presence::user_status>> presence_objs;
+        std::vector<json> emoji_objs;
+        std::vector<json> voice_states;
+        bool has_members = false;
+
+        auto t = clock::now();
+        std::string key;
+        std::string value;
+        unavailable = false;
+        r.begin_object();
+        while (r.next_key(key))
+        {
+            if (r.is_null())
+                continue;
+            if (key == "name") r.read_string(name);
+            else if (key == "icon") r.read_string(icon);
+            else if (key == "splash") r.read_string(splash);
+            else if (key == "owner_id") owner_id = r.read_snowflake();
+            else if (key == "region") r.read_string(region);
+            else if (key == "afk_channel_id") afk_channel_id = r.read_snowflake();
+            else if (key == "afk_timeout") afk_timeout = static_cast<uint32_t>(r.read_int());//in seconds
+            else if (key == "embed_enabled") embed_enabled = r.read_bool();
+            else if (key == "verification_level") verification_level = static_cast<uint32_t>(r.read_int());
+            else if (key == "default_message_notifications") default_message_notifications = static_cast<uint32_t>(r.read_int());
+            else if (key == "mfa_level") mfa_level = static_cast<uint32_t>(r.read_int());
+            else if (key == "joined_at") r.read_string(joined_at);
+            else if (key == "large") large = r.read_bool();
+            else if (key == "unavailable") unavailable = r.read_bool();
+            else if (key == "member_count") member_count = static_cast<uint32_t>(r.read_int());
+            else if (key == "roles" && bot.get_cache_policy()._roles)
+            {
+                r.begin_array();
+                while (r.next_element())
+                    role_objs.push_back(r.read_json());
+            }
+            else if (key == "members")
+            {
+                has_members = true;
+                r.begin_array();
+                while (r.next_element())
+                {
+                    member_objs.emplace_back();
+                    gateway::objects::from_reader(r, member_objs.back());
+                }
+            }
+            else if (key == "channels")
+            {
+                r.begin_array();
+                while (r.next_element())
+                    channel_objs.push_back(r.read_json());
+            }
+            else if (key == "presences" && bot.get_cache_policy()._presences)
+            {
+                r.begin_array();
+                while (r.next_element())
+                {
+                    snowflake user_id;
+                    auto status = gateway::objects::presence::Offline;
+                    r.begin_object();
+                    while (r.next_key(key))
+                    {
+                        if (key == "user")
+                        {
+                            if (r.is_null())
+                                continue;
+                            r.begin_object();
+                            while (r.next_key(key))
+                                if (key == "id")
+                                    user_id = r.read_snowflake();
+                                else
+                                    r.skip();
+                        }
+                        else if (key == "status")
+                        {
+                            r.read_string(value);
+                            if (value == "idle")
+                                status = gateway::objects::presence::Idle;
+                            else if (value == "dnd")
+                                status = gateway::objects::presence::DoNotDisturb;
+                            else if (value == "online")
+                                status = gateway::objects::presence::Online;
+                        }
+                        else
+                            r.skip();
+                    }
+                    presence_objs.emplace_back(user_id, status);
+                }
+            }
+            else if (key == "emojis" && bot.get_cache_policy()._emojis)
+            {
+                r.begin_array();
+                while (r.next_element())
+                    emoji_objs.push_back(r.read_json());
+            }
+            else if (key == "voice_states" && bot.get_cache_policy()._voice_states)
+            {
+                r.begin_array();
+                while (r.next_element())
+                    voice_states.push_back(r.read_json());
+            }
+            else
+                r.skip();
+        }
+        bot._record_ingest(ingest_phase::read, t);
+
+        t = clock::now();
+        for (auto & role : role_objs)
+            _load_role(role);
+        bot._record_ingest(ingest_phase::roles, t);
+
+        if (has_members)
+        {
+#if !defined(AEGIS_DISABLE_ENTITY_POOL)
+            object_pool<user>::instance().reserve(member_objs.size());
+#endif
+
+            // create every user of the list in one pass over the user cache
+            t = clock::now();
+            std::vector<snowflake> member_ids;
+            member_ids.reserve(member_objs.size());
+            for (auto & member : member_objs)
+                member_ids.push_back(member.has_user() ? member._user->id : snowflake());
+            std::vector<user *> member_ptrs;
+            bot.user_create_bulk(member_ids, member_ptrs);
+            bot._record_ingest(ingest_phase::member_create, t);
+
+            t = clock::now();
+            for (std::size_t idx = 0; idx < member_objs.size(); ++idx)
+            {
+                auto _member = member_ptrs[idx];
+                std::unique_lock<shared_mutex> ml(_member->_m);
+                _member->_load_nolock(this, member_objs[idx], _shard, true, false);
+            }
+            bot._record_ingest(ingest_phase::member_load, t);
+            bot._ingest_members.fetch_add(member_objs.size(), std::memory_order_relaxed);
+        }
+
+        if (!channel_objs.empty())
+        {
+#if !defined(AEGIS_DISABLE_ENTITY_POOL)
+            object_pool<channel>::instance().reserve(channel_objs.size());
+#endif
+            t = clock::now();
+            for (auto & channel_obj : channel_objs)
+            {
+                snowflake channel_id = channel_obj["id"];
+                auto _channel = bot.channel_create(channel_id);
+                _channel->_load_with_guild(*this, channel_obj, _shard);
+                _channel->guild_id = guild_id;
+                _channel->_guild = this;
+                this->channels.emplace(channel_id, _channel);
+            }
+            bot._record_ingest(ingest_phase::channels, t);
+            bot._ingest_channels.fetch_add(channel_objs.size(), std::memory_order_relaxed);
+        }
+
+        t = clock::now();
+        for (auto & presence : presence_objs)
+            if (auto _member = _find_member(presence.first))
+                _member->_status = presence.second;
+        bot._record_ingest(ingest_phase::presences, t);
+
+        t = clock::now();
+        for (auto & emoji : emoji_objs)
+            _load_emoji(emoji);
+        bot._record_ingest(ingest_phase::emojis, t);
+
+        t = clock::now();
+        for (auto & voicestate : voice_states)
+            _load_voicestate(voicestate);
+        bot._record_ingest(ingest_phase::voice_states, t);
+
+        bot._ingest_guilds.fetch_add(1, std::memory_order_relaxed);
+    }
+    catch (std::exception&e)
+    {
+        spdlog::get("aegis")->error("Shard#{} : Error processing guild[{}] {}", _shard->get_id(), guild_id, (std::string)e.what());
+        std::rethrow_exception(std::current_exception());
+    }
+    catch (...)
+    {
+        spdlog::get("aegis")->error("Shard#{} : Error processing guild[{}]", _shard->get_id(), guild_id);
+        std::rethrow_exception(std::current_exception());
+    }
+}
+
 #else
 AEGIS_DECL void guild::_load(const json & obj, shards::shard * _shard) noexcept
 {
@@ -535,6 +882,9 @@ AEGIS_DECL void guild::_load(const json & obj, shards::shard * _shard) noexcept
         if (obj.count("channels"))
         {
             const json & channels = obj["channels"];
+#if !defined(AEGIS_DISABLE_ENTITY_POOL)
+            object_pool<channel>::instance().reserve(channels.size());
+#endif
 
             for (auto & channel_obj : channels)
             {
@@ -552,6 +902,50 @@ AEGIS_DECL void guild::_load(const json & obj, shards::shard * _shard) noexcept
         spdlog::get("aegis")->error("Shard#{} : Error processing guild[{}] {}", _shard->get_id(), g_id, (std::string)e.what());
     }
 }
+
+AEGIS_DECL void guild::_load(json_reader & r, shards::shard * _shard)
+{
+    std::unique_lock<shared_mutex> l(_m);
+
+    shard_id = _shard->get_id();
+
+    core & bot = get_bot();
+    try
+    {
+        std::string key;
+        r.begin_object();
+        while (r.next_key(key))
+        {
+            if (key != "channels" || r.is_null())
+            {
+                r.skip();
+                continue;
+            }
+            // one small json value per channel
+            std::vector<json> channel_objs;
+            r.begin_array();
+            while (r.next_element())
+                channel_objs.push_back(r.read_json());
+#if !defined(AEGIS_DISABLE_ENTITY_POOL)
+            object_pool<channel>::instance().reserve(channel_objs.size());
+#endif
+
+            for (auto & channel_obj : channel_objs)
+            {
+                snowflake channel_id = channel_obj["id"];
+                auto _channel = bot.channel_create(channel_id);
+                _channel->_load_with_guild(*this, channel_obj, _shard);
+                _channel->guild_id = guild_id;
+                _channel->_guild = this;
+                this->channels.emplace(channel_id, _channel);
+            }
+        }
+    }
+    catch (std::exception&e)
+    {
+        spdlog::get("aegis")->error("Shard#{} : Error processing guild[{}] {}", _shard->get_id(), guild_id, (std::string)e.what());
+    }
+}
 #endif
 
 AEGIS_DECL void guild::_remove_channel(snowflake channel_id) noexcept
@@ -564,6 +958,9 @@ AEGIS_DECL void guild::_remove_channel(snowflake channel_id) noexcept
         return;
     }
     channels.erase(it);
+#if !defined(AEGIS_DISABLE_ALL_CACHE)
+    _invalidate_channel_permissions(channel_id);
+#endif
 }
 
 AEGIS_DECL channel * guild::get_channel(snowflake id) const noexcept
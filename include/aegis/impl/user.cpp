@@ -13,6 +13,7 @@
 #include "aegis/core.hpp"
 #include "aegis/guild.hpp"
 #include "aegis/error.hpp"
+#include "aegis/gateway/objects/member.hpp"
 #include <string>
 #include <queue>
 #include <mutex>
@@ -25,7 +26,7 @@ AEGIS_DECL std::string user::get_full_name() const noexcept
 {
     std::shared_lock<shared_mutex> l(_m);
 
-    return fmt::format("{}#{:0=4}", std::string(_name), _discriminator);
+    return fmt::format("{}#{:0=4}", _name.str(), _discriminator);
 }
 
 AEGIS_DECL void user::_load(guild * _guild, const json & obj, shards::shard * _shard, bool self_add)
@@ -41,8 +42,14 @@ AEGIS_DECL void user::_load_nolock(guild * _guild, const json & obj, shards::sha
 
     try
     {
-        if (user.count("username") && !user["username"].is_null()) _name = user["username"].get<std::string>();
-        if (user.count("avatar") && !user["avatar"].is_null()) _avatar = user["avatar"].get<std::string>();
+        // guild_info lives inline in guilds, so a join from another thread can move it.
+        // Hold the lock from the join until every field has been written
+        std::unique_lock<shared_mutex> l(_m, std::defer_lock);
+        if (_guild != nullptr && self_add && guild_lock)
+            l.lock();
+
+        if (user.count("username") && !user["username"].is_null()) _name = string_pool::global().intern(user["username"].get<std::string>());
+        if (user.count("avatar") && !user["avatar"].is_null()) _avatar = avatar_hash(user["avatar"].get<std::string>());
         if (user.count("discriminator") && !user["discriminator"].is_null()) _discriminator = static_cast<uint16_t>(std::stoi(user["discriminator"].get<std::string>()));
         if (user.count("bot"))
             _is_bot = user["bot"].is_null() ? false : true;
@@ -52,18 +59,9 @@ AEGIS_DECL void user::_load_nolock(guild * _guild, const json & obj, shards::sha
 
         if (self_add)
         {
-            guild_info * g_info = nullptr;
-            if (guild_lock)
-            {
-                _guild->_add_member(this);
-                g_info = &_join(_guild->guild_id);
-
-            }
-            else
-            {
-                _guild->_add_member_nolock(this);
-                g_info = &_join_nolock(_guild->guild_id);
-            }
+            // join before adding to the guild so an eviction that reads our guild list
+            // after a guild has added us always finds that guild
+            guild_info * g_info = &_join_nolock(_guild->guild_id);
 
             if (obj.count("deaf") && !obj["deaf"].is_null()) g_info->deaf = obj["deaf"];
             if (obj.count("mute") && !obj["mute"].is_null()) g_info->mute = obj["mute"];
@@ -89,9 +87,19 @@ AEGIS_DECL void user::_load_nolock(guild * _guild, const json & obj, shards::sha
             }
 
             if (obj.count("nick") && !obj["nick"].is_null())
-                g_info->nickname = obj["nick"].get<std::string>();
+                g_info->nickname = string_pool::global().intern(obj["nick"].get<std::string>());
             else
                 g_info->nickname.reset();
+
+            if (guild_lock)
+            {
+                l.unlock();
+                _guild->_add_member(this);
+            }
+            else
+                _guild->_add_member_nolock(this);
+
+            _guild->_invalidate_member_permissions(_member_id);
         }
     }
     catch (std::exception & e)
@@ -103,69 +111,111 @@ AEGIS_DECL void user::_load_nolock(guild * _guild, const json & obj, shards::sha
     }
 }
 
-AEGIS_DECL user::guild_info & user::get_guild_info(snowflake guild_id) noexcept
+AEGIS_DECL void user::_load_nolock(guild * _guild, const gateway::objects::member & obj, shards::shard * _shard, bool self_add, bool guild_lock)
 {
-    std::unique_lock<shared_mutex> l(_m);
+    if (obj.has_user())
+        _member_id = obj._user->id;
 
-    auto g = std::find_if(std::begin(guilds), std::end(guilds), [&guild_id](const std::unique_ptr<guild_info> & gi)
+    try
     {
-        if (gi->id == guild_id)
-            return true;
-        return false;
-    });
-    if (g == guilds.end())
+        // same locking as the json overload
+        std::unique_lock<shared_mutex> l(_m, std::defer_lock);
+        if (_guild != nullptr && self_add && guild_lock)
+            l.lock();
+
+        if (obj.has_user())
+        {
+            const auto & u = obj._user.value();
+            if (!u.username.empty()) _name = string_pool::global().intern(u.username);
+            if (!u.avatar.empty()) _avatar = avatar_hash(u.avatar);
+            if (!u.discriminator.empty()) _discriminator = static_cast<uint16_t>(std::stoi(u.discriminator));
+            if (u.is_bot()) _is_bot = true;
+        }
+
+        if (_guild == nullptr || !self_add)
+            return;
+
+        guild_info * g_info = &_join_nolock(_guild->guild_id);
+
+        g_info->deaf = obj.deaf;
+        g_info->mute = obj.mute;
+        if (!obj.joined_at.empty())
+            g_info->joined_at = utility::from_iso8601(obj.joined_at).time_since_epoch().count();
+
+        g_info->roles.clear();
+        g_info->roles.emplace_back(_guild->guild_id);//default everyone role
+        for (auto & r : obj.roles)
+            g_info->roles.emplace_back(r.id);
+
+        if (!obj.nick.empty())
+            g_info->nickname = string_pool::global().intern(obj.nick);
+        else
+            g_info->nickname.reset();
+
+        if (guild_lock)
+        {
+            l.unlock();
+            _guild->_add_member(this);
+        }
+        else
+            _guild->_add_member_nolock(this);
+
+        _guild->_invalidate_member_permissions(_member_id);
+    }
+    catch (std::exception & e)
     {
-#if defined(AEGIS_CXX17)
-        return *guilds.emplace_back(std::make_unique<guild_info>(guild_id));
-#else
-        return **guilds.insert(guilds.end(), std::make_unique<guild_info>(guild_id));
-#endif
+        if (_guild != nullptr)
+            spdlog::get("aegis")->error("Shard#{} : Error processing member[{}] of guild[{}] {}", _shard->get_id(), _member_id, _guild->get_id(), e.what());
+        else
+            throw exception(fmt::format("Shard#{} : Error processing member[{}] {}", _shard->get_id(), _member_id, e.what()), make_error_code(error::member_error));
     }
-    return **g;
+}
+
+AEGIS_DECL user::guild_info user::get_guild_info(snowflake guild_id)
+{
+    std::unique_lock<shared_mutex> l(_m);
+    return _join_nolock(guild_id);
 }
 
 AEGIS_DECL user::guild_info & user::get_guild_info_nolock(snowflake guild_id) noexcept
 {
-    auto g = std::find_if(std::begin(guilds), std::end(guilds), [&guild_id](const std::unique_ptr<guild_info> & gi)
-    {
-        if (gi->id == guild_id)
-            return true;
-        return false;
-    });
-    if (g == guilds.end())
-    {
-#if defined(AEGIS_CXX17)
-        return *guilds.emplace_back(std::make_unique<guild_info>(guild_id));
-#else
-        return **guilds.insert(guilds.end(), std::make_unique<guild_info>(guild_id));
-#endif
-    }
-    return **g;
+    return _join_nolock(guild_id);
 }
 
-AEGIS_DECL user::guild_info * user::get_guild_info_nocreate(snowflake guild_id) const noexcept
+AEGIS_DECL lib::optional<user::guild_info> user::get_guild_info_nocreate(snowflake guild_id) const
 {
-    std::unique_lock<shared_mutex> l(_m);
+    std::shared_lock<shared_mutex> l(_m);
+    auto g = _find_guild_info(guild_id);
+    if (g == nullptr)
+        return {};
+    return *g;
+}
 
-    auto g = std::find_if(std::begin(guilds), std::end(guilds), [&guild_id](const std::unique_ptr<guild_info> & gi)
+AEGIS_DECL user::guild_info * user::_find_guild_info(snowflake guild_id) const noexcept
+{
+    auto g = std::lower_bound(guilds.begin(), guilds.end(), guild_id, [](const guild_info & gi, snowflake id)
     {
-        if (gi->id == guild_id)
-            return true;
-        return false;
+        return gi.id < id;
     });
-    if (g == guilds.end())
-    {
+    if (g == guilds.end() || g->id != guild_id)
         return nullptr;
-    }
-    return (*g).get();
+    return const_cast<guild_info *>(g);
 }
 
 AEGIS_DECL std::string user::get_name(snowflake guild_id) noexcept
 {
-    std::unique_lock<shared_mutex> l(_m);
+    std::shared_lock<shared_mutex> l(_m);
+
+    auto g = _find_guild_info(guild_id);
+    return g ? g->nickname.str() : "";
+}
+
+AEGIS_DECL interned_string user::get_name_nocopy(snowflake guild_id) const noexcept
+{
+    std::shared_lock<shared_mutex> l(_m);
 
-    const auto & def = get_guild_info_nolock(guild_id).nickname;
-    return def.has_value() ? def.value() : "";
+    auto g = _find_guild_info(guild_id);
+    return g ? g->nickname : interned_string();
 }
 
 AEGIS_DECL user::guild_info & user::_join(snowflake guild_id)
@@ -176,21 +226,43 @@ AEGIS_DECL user::guild_info & user::_join(snowflake guild_id)
 
 AEGIS_DECL user::guild_info & user::_join_nolock(snowflake guild_id)
 {
-    auto g = std::find_if(std::begin(guilds), std::end(guilds), [&guild_id](const std::unique_ptr<guild_info> & gi)
+    auto g = std::lower_bound(guilds.begin(), guilds.end(), guild_id, [](const guild_info & gi, snowflake id)
     {
-        if (gi->id == guild_id)
-            return true;
-        return false;
+        return gi.id < id;
     });
-    if (g == guilds.end())
-    {
-#if defined(AEGIS_CXX17)
-        return *guilds.emplace_back(std::make_unique<guild_info>(guild_id));
-#else
-        return **guilds.insert(guilds.end(), std::make_unique<guild_info>(guild_id));
-#endif
-    }
-    return **g;
+    if (g == guilds.end() || g->id != guild_id)
+        g = guilds.emplace(g, guild_id);
+    return *g;
+}
+
+AEGIS_DECL std::size_t user::_approx_bytes() const noexcept
+{
+    cache_memory_stats stats;
+    _memory_usage(stats);
+    return static_cast<std::size_t>(stats.users.bytes + stats.guild_info.bytes);
+}
+
+AEGIS_DECL void user::_memory_usage(cache_memory_stats & stats) const noexcept
+{
+    stats.users.count++;
+    // username and non standard avatar strings are accounted by the string pool
+    stats.users.bytes += sizeof(user);
+
+    // inline guild_info entries are part of sizeof(user), only heap storage is counted here
+    stats.guild_info.count += guilds.size();
+    if (!guilds.is_inline())
+        stats.guild_info.bytes += guilds.capacity() * sizeof(guild_info);
+    for (auto & g : guilds)
+        if (!g.roles.is_inline())
+            stats.guild_info.bytes += g.roles.capacity() * sizeof(snowflake);
+}
+
+AEGIS_DECL void user::leave(snowflake guild_id)
+{
+    std::unique_lock<shared_mutex> l(_m);
+    auto g = _find_guild_info(guild_id);
+    if (g != nullptr)
+        guilds.erase(g);
 }
 
 AEGIS_DECL void user::_load_data(gateway::objects::user mbr)
@@ -198,9 +270,9 @@ AEGIS_DECL void user::_load_data(gateway::objects::user mbr)
     std::unique_lock<shared_mutex> l(_m);
 
     if (!mbr.avatar.empty())
-        _avatar = mbr.avatar;
+        _avatar = avatar_hash(mbr.avatar);
     if (!mbr.username.empty())
-        _name = mbr.username;
+        _name = string_pool::global().intern(mbr.username);
     if (!mbr.avatar.empty())
         _discriminator = static_cast<uint16_t>(std::stoi(mbr.discriminator));
 
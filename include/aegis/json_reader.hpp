@@ -0,0 +1,411 @@
+//
+// json_reader.hpp
+// ***************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#pragma once
+
+#include "aegis/config.hpp"
+#include "aegis/error.hpp"
+#include <nlohmann/json.hpp>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace aegis
+{
+
+/// Forward-only pull parser over a JSON document
+/**
+ * Objects are read straight from the byte stream without building a nlohmann::json DOM.
+ * Callers walk the document in order, reading the values they want and skipping the rest:
+ * @code
+ * r.begin_object();
+ * while (r.next_key(key))
+ *     if (key == "id") id = r.read_snowflake();
+ *     else r.skip();
+ * @endcode
+ * Every read_* function accepts null and returns an empty value for it. Malformed input
+ * throws aegis::exception.
+ */
+class json_reader
+{
+public:
+    json_reader(const char * data, std::size_t len) noexcept
+        : _p(data)
+        , _end(data + len)
+    {
+
+    }
+
+    explicit json_reader(const std::string & doc) noexcept
+        : json_reader(doc.data(), doc.size())
+    {
+
+    }
+
+    /// The reader points into the document, which must outlive it
+    explicit json_reader(std::string && doc) = delete;
+
+    /// Consume the next value if it is null
+    /**
+     * @returns true if a null was consumed
+     */
+    bool is_null() noexcept
+    {
+        _skip_ws();
+        if (_end - _p >= 4 && std::memcmp(_p, "null", 4) == 0)
+        {
+            _p += 4;
+            return true;
+        }
+        return false;
+    }
+
+    /// Check whether the next value is an object without consuming it
+    bool is_object() noexcept
+    {
+        return _peek() == '{';
+    }
+
+    /// Check whether the next value is an array without consuming it
+    bool is_array() noexcept
+    {
+        return _peek() == '[';
+    }
+
+    /// Check whether the next value is a string without consuming it
+    bool is_string() noexcept
+    {
+        return _peek() == '"';
+    }
+
+    /// Enter an object. Follow with next_key() until it returns false
+    void begin_object()
+    {
+        _expect('{');
+    }
+
+    /// Advance to the next key of the current object
+    /**
+     * @param key Receives the key. The caller must then read or skip its value
+     * @returns false once the end of the object has been consumed
+     */
+    bool next_key(std::string & key)
+    {
+        if (_peek() == ',')
+            ++_p;
+        if (_peek() == '}')
+        {
+            ++_p;
+            return false;
+        }
+        read_string(key);
+        _expect(':');
+        return true;
+    }
+
+    /// Enter an array. Follow with next_element() until it returns false
+    void begin_array()
+    {
+        _expect('[');
+    }
+
+    /// Advance to the next element of the current array
+    /**
+     * @returns false once the end of the array has been consumed. Otherwise the caller must read or skip the element
+     */
+    bool next_element()
+    {
+        if (_peek() == ',')
+            ++_p;
+        if (_peek() == ']')
+        {
+            ++_p;
+            return false;
+        }
+        return true;
+    }
+
+    /// Read a string value
+    /**
+     * @param out Receives the unescaped string, or is cleared for null
+     */
+    void read_string(std::string & out)
+    {
+        out.clear();
+        if (is_null())
+            return;
+        _expect('"');
+        while (true)
+        {
+            const char * start = _p;
+            while (_p < _end && *_p != '"' && *_p != '\\')
+                ++_p;
+            out.append(start, _p);
+            if (_p >= _end)
+                _fail("unterminated string");
+            if (*_p++ == '"')
+                return;
+            _read_escape(out);
+        }
+    }
+
+    std::string read_string()
+    {
+        std::string out;
+        read_string(out);
+        return out;
+    }
+
+    /// Read a snowflake sent as either a string or a number
+    /**
+     * @returns Snowflake value or 0 for null
+     */
+    int64_t read_snowflake()
+    {
+        if (is_null())
+            return 0;
+        if (_peek() != '"')
+            return read_int();
+        ++_p;
+        int64_t v = 0;
+        while (_p < _end && *_p >= '0' && *_p <= '9')
+            v = v * 10 + (*_p++ - '0');
+        if (_p >= _end || *_p != '"')
+            _fail("invalid snowflake");
+        ++_p;
+        return v;
+    }
+
+    /// Read an integer. Numbers with a fraction or exponent are truncated
+    /**
+     * @returns Value or 0 for null
+     */
+    int64_t read_int()
+    {
+        if (is_null())
+            return 0;
+        _skip_ws();
+        const char * start = _p;
+        bool neg = (_p < _end && *_p == '-');
+        if (neg)
+            ++_p;
+        if (_p >= _end || *_p < '0' || *_p > '9')
+            _fail("expected number");
+        int64_t v = 0;
+        while (_p < _end && *_p >= '0' && *_p <= '9')
+            v = v * 10 + (*_p++ - '0');
+        if (_p < _end && (*_p == '.' || *_p == 'e' || *_p == 'E'))
+        {
+            char * num_end = nullptr;
+            double d = std::strtod(start, &num_end);
+            _p = num_end;
+            return static_cast<int64_t>(d);
+        }
+        return neg ? -v : v;
+    }
+
+    /// Read a boolean
+    /**
+     * @returns Value or false for null
+     */
+    bool read_bool()
+    {
+        if (is_null())
+            return false;
+        _skip_ws();
+        if (_end - _p >= 4 && std::memcmp(_p, "true", 4) == 0)
+        {
+            _p += 4;
+            return true;
+        }
+        if (_end - _p >= 5 && std::memcmp(_p, "false", 5) == 0)
+        {
+            _p += 5;
+            return false;
+        }
+        _fail("expected boolean");
+        return false;
+    }
+
+    /// Parse the next value into a nlohmann::json
+    /**
+     * For rarely sent or deeply nested fields that are not worth reading by hand.
+     * @returns Parsed value
+     */
+    nlohmann::json read_json()
+    {
+        _skip_ws();
+        const char * start = _p;
+        skip();
+        return nlohmann::json::parse(start, _p);
+    }
+
+    /// Skip the next value, including any nested objects or arrays
+    void skip()
+    {
+        switch (_peek())
+        {
+            case '"':
+                _skip_string();
+                return;
+            case '{':
+            case '[':
+            {
+                std::size_t depth = 0;
+                while (_p < _end)
+                {
+                    if (*_p == '"')
+                    {
+                        _skip_string();
+                        continue;
+                    }
+                    if (*_p == '{' || *_p == '[')
+                        ++depth;
+                    else if ((*_p == '}' || *_p == ']') && --depth == 0)
+                    {
+                        ++_p;
+                        return;
+                    }
+                    ++_p;
+                }
+                _fail("unterminated container");
+                return;
+            }
+            default:
+                while (_p < _end && *_p != ',' && *_p != '}' && *_p != ']'
+                       && *_p != ' ' && *_p != '\t' && *_p != '\n' && *_p != '\r')
+                    ++_p;
+                return;
+        }
+    }
+
+    /// Current position in the document
+    const char * position() const noexcept
+    {
+        return _p;
+    }
+
+private:
+    void _skip_ws() noexcept
+    {
+        while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r'))
+            ++_p;
+    }
+
+    char _peek() noexcept
+    {
+        _skip_ws();
+        return (_p < _end) ? *_p : '\0';
+    }
+
+    void _expect(char c)
+    {
+        if (_peek() != c)
+            _fail(std::string("expected '") + c + "'");
+        ++_p;
+    }
+
+    void _skip_string()
+    {
+        for (++_p; _p < _end; ++_p)
+        {
+            if (*_p == '\\')
+                ++_p;
+            else if (*_p == '"')
+            {
+                ++_p;
+                return;
+            }
+        }
+        _fail("unterminated string");
+    }
+
+    uint32_t _read_hex4()
+    {
+        if (_end - _p < 4)
+            _fail("truncated escape");
+        uint32_t cp = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            char c = *_p++;
+            cp <<= 4;
+            if (c >= '0' && c <= '9')
+                cp |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                cp |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                cp |= c - 'A' + 10;
+            else
+                _fail("invalid escape");
+        }
+        return cp;
+    }
+
+    /// Decode the escape following a backslash
+    void _read_escape(std::string & out)
+    {
+        if (_p >= _end)
+            _fail("truncated escape");
+        switch (*_p++)
+        {
+            case '"': out += '"'; return;
+            case '\\': out += '\\'; return;
+            case '/': out += '/'; return;
+            case 'b': out += '\b'; return;
+            case 'f': out += '\f'; return;
+            case 'n': out += '\n'; return;
+            case 'r': out += '\r'; return;
+            case 't': out += '\t'; return;
+            case 'u':
+            {
+                uint32_t cp = _read_hex4();
+                if (cp >= 0xD800 && cp <= 0xDBFF && _end - _p >= 6 && _p[0] == '\\' && _p[1] == 'u')
+                {
+                    _p += 2;
+                    uint32_t low = _read_hex4();
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                if (cp < 0x80)
+                    out += static_cast<char>(cp);
+                else if (cp < 0x800)
+                {
+                    out += static_cast<char>(0xC0 | (cp >> 6));
+                    out += static_cast<char>(0x80 | (cp & 0x3F));
+                }
+                else if (cp < 0x10000)
+                {
+                    out += static_cast<char>(0xE0 | (cp >> 12));
+                    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (cp & 0x3F));
+                }
+                else
+                {
+                    out += static_cast<char>(0xF0 | (cp >> 18));
+                    out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (cp & 0x3F));
+                }
+                return;
+            }
+            default:
+                _fail("invalid escape");
+        }
+    }
+
+    [[noreturn]] void _fail(const std::string & what) const
+    {
+        throw aegis::exception("json_reader: " + what, make_error_code(error::general));
+    }
+
+    const char * _p;
+    const char * _end;
+};
+
+}
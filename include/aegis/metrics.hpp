@@ -0,0 +1,549 @@
+//
+// metrics.hpp
+// ***********
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#pragma once
+
+#include "aegis/config.hpp"
+#include <spdlog/fmt/fmt.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace aegis
+{
+
+#if (AEGIS_HAS_STD_SHARED_MUTEX == 1)
+using shared_mutex = std::shared_mutex;
+#else
+using shared_mutex = std::shared_timed_mutex;
+#endif
+
+namespace detail
+{
+
+/// Index of the highest set bit of a non zero value
+inline uint32_t log2_floor(uint64_t v) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - static_cast<uint32_t>(__builtin_clzll(v));
+#else
+    uint32_t r = 0;
+    for (uint32_t s = 32; s > 0; s >>= 1)
+    {
+        if (v >> s)
+        {
+            v >>= s;
+            r += s;
+        }
+    }
+    return r;
+#endif
+}
+
+}
+
+/// Point in time copy of a latency_histogram
+/**
+ * All values are in microseconds.
+ */
+struct histogram_snapshot
+{
+    std::vector<uint64_t> counts; /**< Samples per bucket */
+    uint64_t count = 0; /**< Total samples */
+    uint64_t sum = 0; /**< Sum of all samples */
+    uint64_t max = 0; /**< Largest sample */
+
+    /// Value at or below which a fraction of the samples fall
+    /**
+     * @param q Quantile from 0 to 1, e.g. 0.99
+     * @returns Highest value of the bucket holding that sample, within 1/16 of the real value
+     */
+    std::chrono::microseconds percentile(double q) const noexcept;
+
+    /// Average sample
+    std::chrono::microseconds mean() const noexcept
+    {
+        return std::chrono::microseconds(count ? sum / count : 0);
+    }
+
+    /// Number of samples at or below a value
+    /**
+     * Samples are only known to the resolution of their bucket, so buckets straddling the
+     * value are counted when their upper edge is at most one bucket width past it.
+     * @param us Value in microseconds
+     * @returns Sample count
+     */
+    uint64_t count_at_or_below(uint64_t us) const noexcept;
+};
+
+/// Lock-free histogram of durations with log-linear buckets
+/**
+ * Every power of two range of microseconds is split into 16 buckets, so any recorded value
+ * is known to within about 6% from 1us up to about 12 days. Recording is a few relaxed atomic
+ * increments and never blocks, so one histogram can be shared by every thread.
+ */
+class latency_histogram
+{
+public:
+    static constexpr uint32_t sub_bits = 4;
+    static constexpr uint32_t sub_count = 1u << sub_bits;
+    static constexpr uint32_t max_exponent = 39; /**< Values from 2^40us on share the last bucket */
+    static constexpr std::size_t bucket_count = (max_exponent - sub_bits + 2) * sub_count;
+
+    latency_histogram() noexcept = default;
+    latency_histogram(const latency_histogram &) = delete;
+    latency_histogram & operator=(const latency_histogram &) = delete;
+
+    /// Record a duration
+    template<typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> d) noexcept
+    {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        record_us(us > 0 ? static_cast<uint64_t>(us) : 0);
+    }
+
+    /// Record a value in microseconds
+    void record_us(uint64_t us) noexcept
+    {
+        _counts[bucket_index(us)].fetch_add(1, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(us, std::memory_order_relaxed);
+        uint64_t prev = _max.load(std::memory_order_relaxed);
+        while (us > prev && !_max.compare_exchange_weak(prev, us, std::memory_order_relaxed))
+            ;
+    }
+
+    /// Number of samples recorded
+    uint64_t count() const noexcept
+    {
+        return _count.load(std::memory_order_relaxed);
+    }
+
+    /// Copy the current counts
+    /**
+     * Samples recorded while copying may be partly included, the count is taken from the
+     * buckets so it always matches them.
+     */
+    histogram_snapshot snapshot() const
+    {
+        histogram_snapshot s;
+        s.counts.resize(bucket_count);
+        for (std::size_t i = 0; i < bucket_count; ++i)
+        {
+            s.counts[i] = _counts[i].load(std::memory_order_relaxed);
+            s.count += s.counts[i];
+        }
+        s.sum = _sum.load(std::memory_order_relaxed);
+        s.max = _max.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    /// Bucket a value in microseconds is counted in
+    static std::size_t bucket_index(uint64_t us) noexcept
+    {
+        if (us < sub_count)
+            return static_cast<std::size_t>(us);
+        uint32_t msb = detail::log2_floor(us);
+        if (msb > max_exponent)
+            return bucket_count - 1;
+        uint32_t shift = msb - sub_bits;
+        return static_cast<std::size_t>((shift + 1) * sub_count + ((us >> shift) - sub_count));
+    }
+
+    /// Smallest value counted in a bucket
+    static uint64_t bucket_lower(std::size_t index) noexcept
+    {
+        if (index < sub_count)
+            return index;
+        uint64_t shift = index / sub_count - 1;
+        return (sub_count + index % sub_count) << shift;
+    }
+
+    /// Largest value counted in a bucket
+    static uint64_t bucket_upper(std::size_t index) noexcept
+    {
+        if (index < sub_count)
+            return index;
+        if (index == bucket_count - 1)
+            return UINT64_MAX;
+        uint64_t shift = index / sub_count - 1;
+        return bucket_lower(index) + (uint64_t(1) << shift) - 1;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, bucket_count> _counts{};
+    std::atomic<uint64_t> _count{ 0 };
+    std::atomic<uint64_t> _sum{ 0 };
+    std::atomic<uint64_t> _max{ 0 };
+};
+
+inline std::chrono::microseconds histogram_snapshot::percentile(double q) const noexcept
+{
+    if (!count)
+        return std::chrono::microseconds(0);
+    q = std::min(std::max(q, 0.0), 1.0);
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * static_cast<double>(count) + 0.5));
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < counts.size(); ++i)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+            return std::chrono::microseconds(std::min(latency_histogram::bucket_upper(i), max));
+    }
+    return std::chrono::microseconds(max);
+}
+
+inline uint64_t histogram_snapshot::count_at_or_below(uint64_t us) const noexcept
+{
+    uint64_t total = 0;
+    std::size_t last = std::min(latency_histogram::bucket_index(us), counts.size() - 1);
+    for (std::size_t i = 0; i <= last && i < counts.size(); ++i)
+        total += counts[i];
+    return total;
+}
+
+/// Histograms of one metric, one per combination of label values
+/**
+ * Looking up a combination that exists takes a shared lock and builds no strings on the heap,
+ * the first lookup of a combination creates its histogram. Histograms are never removed so
+ * references stay valid for the life of the family.
+ */
+class histogram_family
+{
+public:
+    /// One histogram and the label values it was created for
+    struct series
+    {
+        std::vector<std::string> values;
+        latency_histogram histogram;
+    };
+
+    /**
+     * @param name Metric name, e.g. aegis_event_handler_seconds
+     * @param help Description of the metric
+     * @param labels Label names, every lookup passes one value per label in this order
+     */
+    histogram_family(std::string name, std::string help, std::vector<std::string> labels)
+        : _name(std::move(name))
+        , _help(std::move(help))
+        , _labels(std::move(labels))
+    {
+    }
+
+    histogram_family(const histogram_family &) = delete;
+    histogram_family & operator=(const histogram_family &) = delete;
+
+    /// Get the histogram of a combination of label values
+    /**
+     * @param values One string or integer per label
+     * @returns Reference to the histogram, created on first use
+     */
+    template<typename... Values>
+    latency_histogram & get(const Values &... values)
+    {
+        assert(sizeof...(Values) == _labels.size());
+        static thread_local std::string key;
+        key.clear();
+        int expand[] = { 0, (_append(key, values), 0)... };
+        (void)expand;
+        {
+            std::shared_lock<shared_mutex> l(_m);
+            auto it = _series.find(key);
+            if (it != _series.end())
+                return it->second->histogram;
+        }
+        std::unique_lock<shared_mutex> l(_m);
+        auto & s = _series[key];
+        if (!s)
+        {
+            s = std::make_unique<series>();
+            std::size_t start = 0;
+            for (std::size_t i = 0; i < key.size(); ++i)
+            {
+                if (key[i] == separator)
+                {
+                    s->values.emplace_back(key, start, i - start);
+                    start = i + 1;
+                }
+            }
+        }
+        return s->histogram;
+    }
+
+    /// Call a function with every series, ordered by label values
+    void for_each(const std::function<void(const series &)> & fn) const
+    {
+        std::vector<const series *> sorted;
+        {
+            std::shared_lock<shared_mutex> l(_m);
+            sorted.reserve(_series.size());
+            for (auto & s : _series)
+                sorted.push_back(s.second.get());
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const series * a, const series * b)
+        {
+            return a->values < b->values;
+        });
+        for (auto s : sorted)
+            fn(*s);
+    }
+
+    const std::string & get_name() const noexcept { return _name; }
+    const std::string & get_help() const noexcept { return _help; }
+    const std::vector<std::string> & get_labels() const noexcept { return _labels; }
+
+private:
+    static constexpr char separator = '\x1f';
+
+    static void _append(std::string & key, const std::string & value)
+    {
+        key += value;
+        key += separator;
+    }
+
+    static void _append(std::string & key, const char * value)
+    {
+        key += value;
+        key += separator;
+    }
+
+    template<typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
+    static void _append(std::string & key, T value)
+    {
+        fmt::format_int str(value);
+        key.append(str.data(), str.size());
+        key += separator;
+    }
+
+    std::string _name;
+    std::string _help;
+    std::vector<std::string> _labels;
+    mutable shared_mutex _m;
+    std::unordered_map<std::string, std::unique_ptr<series>> _series;
+};
+
+/// Receiver of metric exports
+/**
+ * @see metrics_registry::collect
+ * @see prometheus_sink
+ */
+class metrics_sink
+{
+public:
+    virtual ~metrics_sink() = default;
+
+    /// Called before the first metric of an export
+    virtual void begin() {}
+
+    /// Start a metric
+    virtual void begin_family(const histogram_family & family) = 0;
+
+    /// One series of the current metric
+    /**
+     * @param labels Label names of the metric
+     * @param values Label values of this series
+     * @param snapshot Copy of the histogram
+     */
+    virtual void write(const std::vector<std::string> & labels, const std::vector<std::string> & values, const histogram_snapshot & snapshot) = 0;
+
+    /// Called once every metric has been written
+    virtual void end() {}
+};
+
+/// Sink writing metrics in the Prometheus text exposition format
+/**
+ * Histograms are written with fixed bucket bounds from 50us to 60s. The bounds are matched
+ * to the finer internal buckets, so counts are accurate to about 6% of the bound.
+ * Example:
+ * @code{.cpp}
+ * aegis::prometheus_sink sink([](const std::string & text)
+ * {
+ *     std::ofstream("/var/lib/node_exporter/aegis.prom") << text;
+ * });
+ * bot.export_metrics(sink);
+ * @endcode
+ */
+class prometheus_sink : public metrics_sink
+{
+public:
+    /**
+     * @param out Called with the complete text after each export
+     */
+    explicit prometheus_sink(std::function<void(const std::string &)> out = nullptr)
+        : _out(std::move(out))
+    {
+    }
+
+    /// Set the bucket bounds written for every histogram
+    /**
+     * @param bounds Upper bounds in seconds, ascending. +Inf is always added
+     */
+    void set_bounds(std::vector<double> bounds)
+    {
+        _bounds = std::move(bounds);
+    }
+
+    /// Text of the last export
+    const std::string & str() const noexcept
+    {
+        return _text;
+    }
+
+    void begin() override
+    {
+        _text.clear();
+    }
+
+    void begin_family(const histogram_family & family) override
+    {
+        _name = family.get_name();
+        _text += fmt::format("# HELP {} {}\n# TYPE {} histogram\n", _name, family.get_help(), _name);
+    }
+
+    void write(const std::vector<std::string> & labels, const std::vector<std::string> & values, const histogram_snapshot & snapshot) override
+    {
+        std::string lbl;
+        for (std::size_t i = 0; i < labels.size() && i < values.size(); ++i)
+        {
+            lbl += labels[i];
+            lbl += "=\"";
+            _escape(lbl, values[i]);
+            lbl += "\",";
+        }
+        for (auto bound : _bounds)
+        {
+            auto us = static_cast<uint64_t>(bound * 1000000.0 + 0.5);
+            _text += fmt::format("{}_bucket{{{}le=\"{}\"}} {}\n", _name, lbl, bound, snapshot.count_at_or_below(us));
+        }
+        _text += fmt::format("{}_bucket{{{}le=\"+Inf\"}} {}\n", _name, lbl, snapshot.count);
+        if (!lbl.empty())
+        {
+            lbl.pop_back();
+            lbl = '{' + lbl + '}';
+        }
+        _text += fmt::format("{}_sum{} {}\n", _name, lbl, static_cast<double>(snapshot.sum) / 1000000.0);
+        _text += fmt::format("{}_count{} {}\n", _name, lbl, snapshot.count);
+    }
+
+    void end() override
+    {
+        if (_out)
+            _out(_text);
+    }
+
+private:
+    static void _escape(std::string & out, const std::string & value)
+    {
+        for (char c : value)
+        {
+            if (c == '\\' || c == '"')
+            {
+                out += '\\';
+                out += c;
+            }
+            else if (c == '\n')
+                out += "\\n";
+            else
+                out += c;
+        }
+    }
+
+    std::function<void(const std::string &)> _out;
+    std::vector<double> _bounds{ 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+                                 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60 };
+    std::string _text;
+    std::string _name;
+};
+
+/// Named histogram families
+/**
+ * @see core::get_metrics
+ */
+class metrics_registry
+{
+public:
+    metrics_registry() = default;
+    metrics_registry(const metrics_registry &) = delete;
+    metrics_registry & operator=(const metrics_registry &) = delete;
+
+    /// Get or create a histogram family
+    /**
+     * @param name Metric name
+     * @param help Description, used when the family is created
+     * @param labels Label names, used when the family is created
+     * @returns Reference to the family, valid for the life of the registry
+     */
+    histogram_family & histogram(const std::string & name, const std::string & help, std::vector<std::string> labels)
+    {
+        std::lock_guard<std::mutex> l(_m);
+        auto & f = _families[name];
+        if (!f)
+            f = std::make_unique<histogram_family>(name, help, std::move(labels));
+        return *f;
+    }
+
+    /// Find a histogram family
+    /**
+     * @param name Metric name
+     * @returns Pointer to the family or nullptr if none was created
+     */
+    histogram_family * find(const std::string & name) const
+    {
+        std::lock_guard<std::mutex> l(_m);
+        auto it = _families.find(name);
+        return it != _families.end() ? it->second.get() : nullptr;
+    }
+
+    /// Write a snapshot of every histogram to a sink, ordered by name
+    void collect(metrics_sink & sink) const
+    {
+        std::vector<const histogram_family *> families;
+        {
+            std::lock_guard<std::mutex> l(_m);
+            for (auto & f : _families)
+                families.push_back(f.second.get());
+        }
+        sink.begin();
+        for (auto f : families)
+        {
+            sink.begin_family(*f);
+            f->for_each([&](const histogram_family::series & s)
+            {
+                sink.write(f->get_labels(), s.values, s.histogram.snapshot());
+            });
+        }
+        sink.end();
+    }
+
+    /// Every histogram in the Prometheus text format
+    std::string to_prometheus() const
+    {
+        prometheus_sink sink;
+        collect(sink);
+        return sink.str();
+    }
+
+private:
+    mutable std::mutex _m;
+    std::map<std::string, std::unique_ptr<histogram_family>> _families;
+};
+
+}
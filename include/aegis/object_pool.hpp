@@ -0,0 +1,263 @@
+//
+// object_pool.hpp
+// ***************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#pragma once
+
+#include "aegis/config.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace aegis
+{
+
+/// Counters of an object_pool
+struct pool_stats
+{
+    uint64_t slabs = 0; /**< Slabs allocated */
+    uint64_t capacity = 0; /**< Slots over all slabs */
+    uint64_t in_use = 0; /**< Slots currently holding an object */
+    uint64_t bytes = 0; /**< Bytes held by all slabs */
+};
+
+/// Fixed size slab allocator for one entity type
+/**
+ * Storage is taken from the system SlabSize objects at a time and freed slots are kept on
+ * a free list for reuse, so creating and removing entities does not allocate per object
+ * and keeps entities of the same type packed together. Slabs are never returned to the
+ * system.
+ *
+ * Each thread keeps up to 2 * BatchSize free slots of its own and moves BatchSize at a time
+ * to and from the shared free list, so ingest threads creating and reclaiming entities
+ * rarely take the pool mutex.
+ *
+ * Entity types route their class operator new and delete through the pool of their type.
+ * Define AEGIS_DISABLE_ENTITY_POOL to use the global allocator instead, for example when
+ * running under a memory checker.
+ * @tparam T Object type
+ * @tparam SlabSize Number of objects per slab
+ * @tparam BatchSize Number of slots moved between a thread cache and the shared free list
+ */
+template<typename T, std::size_t SlabSize = 256, std::size_t BatchSize = 32>
+class object_pool
+{
+    static_assert(SlabSize > 0, "object_pool needs at least one object per slab");
+    static_assert(BatchSize > 0, "object_pool needs to move at least one object per batch");
+
+public:
+    object_pool() = default;
+
+    /// Free every slab. Objects still allocated from the pool are left dangling
+    ~object_pool()
+    {
+        for (auto slab : _slabs)
+            ::operator delete(slab);
+    }
+
+    object_pool(const object_pool &) = delete;
+    object_pool & operator=(const object_pool &) = delete;
+
+    /// Pool shared by all objects of type T
+    static object_pool & instance() noexcept
+    {
+        // never destroyed so objects freed during static destruction can still be returned
+        static object_pool * pool = new object_pool;
+        return *pool;
+    }
+
+    /// Get storage for one T
+    /**
+     * @returns Uninitialized storage suitably aligned for T
+     */
+    void * allocate()
+    {
+        auto & c = _cache();
+        if (this != &instance() || c.closed)
+        {
+            // thread caches only serve instance()
+            std::lock_guard<std::mutex> l(_m);
+            return _take(1);
+        }
+        if (!c.head)
+        {
+            std::lock_guard<std::mutex> l(_m);
+            c.head = _take(BatchSize);
+            c.count = BatchSize;
+        }
+        node * n = c.head;
+        c.head = n->next;
+        --c.count;
+        return n;
+    }
+
+    /// Return storage obtained from allocate()
+    void deallocate(void * p) noexcept
+    {
+        if (!p)
+            return;
+        node * n = static_cast<node *>(p);
+        auto & c = _cache();
+        if (this != &instance() || c.closed)
+        {
+            n->next = nullptr;
+            _give(n, n, 1);
+            return;
+        }
+        n->next = c.head;
+        c.head = n;
+        if (++c.count >= 2 * BatchSize)
+            _flush(c, BatchSize);
+    }
+
+    /// Make sure count more objects can be allocated without taking new slabs one at a time
+    /**
+     * Used ahead of bulk loads such as GUILD_CREATE so their storage comes from a few
+     * contiguous slabs.
+     * @param count Number of objects about to be created
+     */
+    void reserve(std::size_t count)
+    {
+        std::lock_guard<std::mutex> l(_m);
+        if (count > _free_count)
+            _grow(count - _free_count);
+    }
+
+    /// Get the pool counters
+    /**
+     * in_use also counts the free slots held in thread caches, up to 2 * BatchSize per thread.
+     */
+    pool_stats get_stats() const
+    {
+        std::lock_guard<std::mutex> l(_m);
+        pool_stats stats;
+        stats.slabs = _slabs.size();
+        stats.capacity = _capacity;
+        stats.in_use = _in_use;
+        stats.bytes = _capacity * sizeof(node);
+        return stats;
+    }
+
+private:
+    union node
+    {
+        node * next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    /// Free slots owned by one thread
+    struct thread_cache
+    {
+        node * head = nullptr;
+        std::size_t count = 0;
+        bool closed = false; /**< Set once the thread exits, later frees go to the shared list */
+
+        ~thread_cache()
+        {
+            // hand everything back when the thread exits
+            if (count)
+                instance()._flush(*this, count);
+            closed = true;
+        }
+    };
+
+    static thread_cache & _cache() noexcept
+    {
+        static thread_local thread_cache cache;
+        return cache;
+    }
+
+    /// Unlink count slots from the shared free list. requires the caller to hold _m
+    node * _take(std::size_t count)
+    {
+        if (_free_count < count)
+            _grow(count - _free_count);
+        node * head = _free;
+        node * tail = head;
+        for (std::size_t i = 1; i < count; ++i)
+            tail = tail->next;
+        _free = tail->next;
+        tail->next = nullptr;
+        _free_count -= count;
+        _in_use += count;
+        return head;
+    }
+
+    /// Link a chain of count slots onto the shared free list
+    void _give(node * head, node * tail, std::size_t count) noexcept
+    {
+        std::lock_guard<std::mutex> l(_m);
+        tail->next = _free;
+        _free = head;
+        _free_count += count;
+        _in_use -= count;
+    }
+
+    /// Move count slots from a thread cache to the shared free list
+    void _flush(thread_cache & c, std::size_t count) noexcept
+    {
+        node * head = c.head;
+        node * tail = head;
+        for (std::size_t i = 1; i < count; ++i)
+            tail = tail->next;
+        c.head = tail->next;
+        c.count -= count;
+        _give(head, tail, count);
+    }
+
+    /// requires the caller to hold _m
+    void _grow(std::size_t count)
+    {
+        const std::size_t slots = ((count + SlabSize - 1) / SlabSize) * SlabSize;
+        // make room first so push_back can not throw after the slab is taken, doubling so
+        // the list is not reallocated for every slab
+        if (_slabs.size() == _slabs.capacity())
+            _slabs.reserve(_slabs.empty() ? 16 : _slabs.size() * 2);
+        node * slab = static_cast<node *>(::operator new(slots * sizeof(node)));
+        _slabs.push_back(slab);
+        // thread the new slots onto the free list in address order
+        for (std::size_t i = slots; i > 0; --i)
+        {
+            slab[i - 1].next = _free;
+            _free = &slab[i - 1];
+        }
+        _capacity += slots;
+        _free_count += slots;
+    }
+
+    mutable std::mutex _m;
+    node * _free = nullptr;
+    std::vector<node *> _slabs;
+    std::size_t _capacity = 0;
+    std::size_t _free_count = 0; /**< Slots on _free */
+    std::size_t _in_use = 0; /**< Slots handed to threads, cached or holding an object */
+};
+
+}
+
+#if defined(AEGIS_DISABLE_ENTITY_POOL)
+# define AEGIS_POOLED_ENTITY(type)
+#else
+/// Route class allocation of an entity type through its object_pool
+# define AEGIS_POOLED_ENTITY(type) \
+    static void * operator new(std::size_t size) \
+    { \
+        if (size != sizeof(type)) \
+            return ::operator new(size); \
+        return ::aegis::object_pool<type>::instance().allocate(); \
+    } \
+    static void operator delete(void * p, std::size_t size) noexcept \
+    { \
+        if (size != sizeof(type)) \
+            return ::operator delete(p); \
+        ::aegis::object_pool<type>::instance().deallocate(p); \
+    }
+#endif
@@ -16,13 +16,19 @@
 #include <future>
 #include <chrono>
 #include <queue>
+#include <deque>
 #include <atomic>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <asio/steady_timer.hpp>
 #include <spdlog/spdlog.h>
 
 namespace aegis
 {
 
 using rest_call = std::function<rest::rest_reply(rest::request_params)>;
+using async_rest_call = std::function<void(rest::request_params, std::function<void(rest::rest_reply)>)>;
 
 namespace ratelimit
 {
@@ -40,6 +46,126 @@ enum bucket_type
     Emoji = 2
 };
 
+/// Queue and wait-time metrics of a single bucket
+struct bucket_stats
+{
+    std::size_t queue_depth = 0; /**< Requests currently waiting to be sent */
+    std::size_t max_queue_depth = 0; /**< Highest queue depth seen */
+    uint64_t requests = 0; /**< Requests sent, including retries */
+    uint64_t ratelimited = 0; /**< Replies that were 429 */
+    std::chrono::steady_clock::duration total_wait = std::chrono::steady_clock::duration::zero(); /**< Summed time requests spent queued */
+    std::chrono::steady_clock::duration max_wait = std::chrono::steady_clock::duration::zero(); /**< Longest time a request spent queued */
+};
+
+/// Token bucket shared by every ratelimit bucket to stay under the global request limit
+/**
+ * Tokens refill continuously at the configured rate up to a burst of one second's worth.
+ * A global 429 pauses token issue until the time Discord states, which holds back
+ * every bucket without any of them sending a request that would be rejected.
+ */
+class global_bucket
+{
+public:
+    /**
+     * @param rate Requests per second permitted across all buckets
+     */
+    explicit global_bucket(uint32_t rate = 50) noexcept
+        : _rate(rate ? rate : 1)
+        , _tokens(static_cast<double>(_rate))
+        , _last(steady_clock::now())
+        , _paused_until(0)
+    {
+
+    }
+
+    /// Take a token for one request
+    /**
+     * @returns Zero if a token was taken, otherwise how long to wait before trying again
+     */
+    milliseconds acquire() noexcept
+    {
+        std::lock_guard<std::mutex> l(_m);
+        auto now = steady_clock::now();
+
+        auto paused = _paused_until.load(std::memory_order_relaxed) - duration_cast<milliseconds>(now.time_since_epoch()).count();
+        if (paused > 0)
+        {
+            ++_throttled;
+            return milliseconds(paused);
+        }
+
+        _tokens += duration_cast<duration<double>>(now - _last).count() * _rate;
+        if (_tokens > _rate)
+            _tokens = _rate;
+        _last = now;
+
+        if (_tokens >= 1.0)
+        {
+            _tokens -= 1.0;
+            return milliseconds(0);
+        }
+
+        ++_throttled;
+        return milliseconds(static_cast<int64_t>((1.0 - _tokens) * 1000 / _rate) + 1);
+    }
+
+    /// Stop issuing tokens after a global 429
+    /**
+     * @param retry_after Time Discord asked to wait before sending any request
+     */
+    void pause(milliseconds retry_after) noexcept
+    {
+        auto until = duration_cast<milliseconds>(steady_clock::now().time_since_epoch() + retry_after).count();
+        auto current = _paused_until.load(std::memory_order_relaxed);
+        while (current < until && !_paused_until.compare_exchange_weak(current, until, std::memory_order_relaxed));
+        ++_global_hits;
+    }
+
+    /// Check if globally ratelimited
+    /**
+     * @returns true if a global 429 is still in effect
+     */
+    bool is_paused() const noexcept
+    {
+        return _paused_until.load(std::memory_order_relaxed) > duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    /// Set the number of requests per second permitted across all buckets
+    void set_rate(uint32_t rate) noexcept
+    {
+        std::lock_guard<std::mutex> l(_m);
+        _rate = rate ? rate : 1;
+        if (_tokens > _rate)
+            _tokens = _rate;
+    }
+
+    uint32_t get_rate() const noexcept
+    {
+        return _rate;
+    }
+
+    /// Number of times a request had to wait for a global token or pause
+    uint64_t throttled() const noexcept
+    {
+        return _throttled;
+    }
+
+    /// Number of global 429 replies received
+    uint64_t global_hits() const noexcept
+    {
+        return _global_hits;
+    }
+
+private:
+    std::mutex _m;
+    std::atomic<uint32_t> _rate;
+    double _tokens;
+    steady_clock::time_point _last;
+    std::atomic<int64_t> _paused_until; /**< steady_clock time in ms until which no request may be sent */
+    std::atomic<uint64_t> _throttled{ 0 };
+    std::atomic<uint64_t> _global_hits{ 0 };
+};
+
 /// Buckets store ratelimit data per major parameter
 /**
  * Bucket class for tracking the ratelimits per snowflake per major parameter.
@@ -52,13 +178,15 @@ public:
     /**
      * Construct a bucket object for tracking ratelimits per major parameter of the REST API (guild/channel/emoji)
      */
-    bucket(rest_call & call, asio::io_context & _io_context, std::atomic<int64_t> & global_limit)
+    bucket(rest_call & call, async_rest_call & async_call, asio::io_context & _io_context, global_bucket & global)
         : limit(0)
         , remaining(1)
         , reset(0)
         , _call(call)
+        , _async_call(async_call)
         , _io_context(_io_context)
-        , _global_limit(global_limit)
+        , _global(global)
+        , _timer(_io_context)
     {
 
     }
@@ -73,7 +201,7 @@ public:
      */
     bool is_global() const noexcept
     {
-        return _global_limit > 0;
+        return _global.is_paused();
     }
 
 
@@ -95,38 +223,193 @@ public:
         return true;
     }
 
+    /// Perform a request through the bucket's queue and wait for the reply
+    /**
+     * Shares the queue with perform_async, so blocking and queued requests stay in order and
+     * see the same ratelimit state. Blocks the calling thread, which must not be one running
+     * the io_context or the reply may never arrive.
+     * @param params Request to perform
+     * @returns Reply of the request
+     */
     rest::rest_reply perform(rest::request_params params)
     {
-        std::lock_guard<std::mutex> lock(m);
-        while (!can_perform())
+        auto pr = std::make_shared<std::promise<rest::rest_reply>>();
+        auto fut = pr->get_future();
+        perform_async(std::move(params), [pr](rest::rest_reply reply)
+        {
+            pr->set_value(std::move(reply));
+        });
+        return fut.get();
+    }
+
+    /// Queue a request without blocking the calling thread
+    /**
+     * Requests are sent one at a time in the order they were queued. When the bucket is
+     * exhausted, waiting on the global limit, or after a 429, the queue is drained again by a
+     * steady_timer instead of sleeping. A 429 is retried up to max_retries times with increasing
+     * backoff, ahead of anything queued after it.
+     * @param params Request to perform
+     * @param cb Called on an io_context thread with the reply
+     */
+    void perform_async(rest::request_params params, std::function<void(rest::rest_reply)> cb)
+    {
+        {
+            std::lock_guard<std::mutex> l(_queue_m);
+            _queue.push_back({ std::move(params), std::move(cb), std::chrono::steady_clock::now(), 0 });
+            _stats.queue_depth = _queue.size();
+            if (_stats.queue_depth > _stats.max_queue_depth)
+                _stats.max_queue_depth = _stats.queue_depth;
+        }
+        _drain();
+    }
+
+    /// Get a snapshot of this bucket's queue and wait-time metrics
+    /**
+     * @returns bucket_stats
+     */
+    bucket_stats get_stats() const
+    {
+        std::lock_guard<std::mutex> l(_queue_m);
+        return _stats;
+    }
+
+    /// Get the number of requests waiting to be sent
+    /**
+     * @returns Queue depth
+     */
+    std::size_t queue_depth() const
+    {
+        std::lock_guard<std::mutex> l(_queue_m);
+        return _queue.size();
+    }
+
+    bool ignore_rates = false;
+    std::mutex m;
+    rest_call & _call;
+    int32_t reset_bypass = 0;
+    int32_t max_retries = 3; /**< Times a request is resent after a 429 before its reply is returned as-is */
+
+private:
+    struct queued_request
+    {
+        rest::request_params params;
+        std::function<void(rest::rest_reply)> cb;
+        std::chrono::steady_clock::time_point queued_at;
+        int32_t attempts;
+        std::chrono::steady_clock::duration waited = std::chrono::steady_clock::duration::zero();
+    };
+
+    /// Send the next queued request if none is in flight and the bucket permits it
+    void _drain()
+    {
+        std::unique_lock<std::mutex> l(_queue_m);
+        if (_in_flight || _timer_armed || _queue.empty())
+            return;
+
+        if (!can_perform())
         {
-            //TODO: find a better solution - wrap asio execution handling, poll ratelimit object to track ordering and execution
-            // not an ideal scenario, but by current design rescheduling a message that would be ratelimited
-            // would cause out of order messages
             auto waitfor = milliseconds((reset.load(std::memory_order_relaxed)
-                                         - std::chrono::duration_cast<milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count())/* + _time_delay*/);
-            spdlog::get("aegis")->debug("Ratelimit almost hit: {}({}) - waiting {}ms", rest::rest_controller::get_method(params.method), params.path, waitfor.count());
-            std::this_thread::sleep_for(waitfor);
+                                         - std::chrono::duration_cast<milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count()));
+            spdlog::get("aegis")->debug("Ratelimit almost hit: {}({}) - waiting {}ms", rest::rest_controller::get_method(_queue.front().params.method), _queue.front().params.path, waitfor.count());
+            _arm(waitfor);
+            return;
         }
-        rest::rest_reply reply(_call(params));
+
+        auto global_wait = _global.acquire();
+        if (global_wait.count() > 0)
+        {
+            _arm(global_wait);
+            return;
+        }
+
+        auto entry = std::move(_queue.front());
+        _queue.pop_front();
+        _in_flight = true;
+
+        auto waited = std::chrono::steady_clock::now() - entry.queued_at;
+        _stats.queue_depth = _queue.size();
+        ++_stats.requests;
+        _stats.total_wait += waited;
+        if (waited > _stats.max_wait)
+            _stats.max_wait = waited;
+        entry.waited += waited;
+        l.unlock();
+
+        if (limit.load(std::memory_order_relaxed) != 0)
+            remaining.fetch_sub(1, std::memory_order_relaxed);
+
         auto _now = std::chrono::duration_cast<milliseconds>(std::chrono::system_clock::now().time_since_epoch());
-        if (reply.reply_code == 429)
+        auto req = entry.params;
+        _async_call(std::move(req), [this, entry = std::move(entry), _now](rest::rest_reply reply) mutable
         {
-            if (reset_bypass)
+            _update(reply, _now);
+            if (reply.reply_code == 429)
             {
-                spdlog::get("aegis")->warn("Ratelimit hit - retrying in {}ms...", reset_bypass);
-                std::this_thread::sleep_for(milliseconds(reset_bypass));
+                if (entry.attempts < max_retries)
+                {
+                    auto waitfor = _retry_delay(reply, entry.attempts);
+                    spdlog::get("aegis")->warn("Ratelimit hit{} - retrying in {}ms...", reply.global ? " (global)" : "", waitfor.count());
+
+                    // retry ahead of everything queued after it to keep route ordering
+                    std::lock_guard<std::mutex> l(_queue_m);
+                    ++_stats.ratelimited;
+                    ++entry.attempts;
+                    entry.queued_at = std::chrono::steady_clock::now();
+                    _queue.push_front(std::move(entry));
+                    _stats.queue_depth = _queue.size();
+                    _in_flight = false;
+                    _arm(waitfor);
+                    return;
+                }
+                spdlog::get("aegis")->error("Ratelimit hit {} times. Giving up: {}({})", entry.attempts + 1, rest::rest_controller::get_method(entry.params.method), entry.params.path);
+                std::lock_guard<std::mutex> l(_queue_m);
+                ++_stats.ratelimited;
             }
-            else
+            reply.queue_time = entry.waited;
+            entry.cb(std::move(reply));
             {
-                spdlog::get("aegis")->warn("Ratelimit hit - retrying in {}s...", reply.retry / 1000);
-                std::this_thread::sleep_for(milliseconds(reply.retry));
+                std::lock_guard<std::mutex> l(_queue_m);
+                _in_flight = false;
             }
-            reply = _call(params);
-            if (reply.reply_code == 429)
-                spdlog::get("aegis")->error("Ratelimit hit twice. Giving up.");
-        }
+            _drain();
+        });
+    }
+
+    /// Drain the queue again after waitfor. Caller must hold _queue_m
+    void _arm(milliseconds waitfor)
+    {
+        _timer_armed = true;
+        _timer.expires_after(waitfor);
+        _timer.async_wait([this](const asio::error_code & ec)
+        {
+            {
+                std::lock_guard<std::mutex> l(_queue_m);
+                _timer_armed = false;
+            }
+            if (ec != asio::error::operation_aborted)
+                _drain();
+        });
+    }
+
+    /// Time to wait before resending a request that got a 429
+    /**
+     * Uses the stated Retry-After, doubling a minimum wait on every further attempt so a route
+     * that keeps failing backs off even when Discord reports no retry time. A global 429 also
+     * pauses the global bucket so every other bucket holds back until it expires.
+     */
+    milliseconds _retry_delay(const rest::rest_reply & reply, int32_t attempt) noexcept
+    {
+        auto waitfor = milliseconds(reset_bypass ? reset_bypass : reply.retry);
+        auto backoff = milliseconds(250) * (int64_t(1) << std::min(attempt, 6));
+        if (waitfor < backoff)
+            waitfor = backoff;
+        if (reply.global)
+            _global.pause(waitfor);
+        return waitfor;
+    }
 
+    void _update(const rest::rest_reply & reply, milliseconds _now)
+    {
         limit.store(reply.limit, std::memory_order_relaxed);
         remaining.store(reply.remaining, std::memory_order_relaxed);
         auto http_date = std::chrono::duration_cast<milliseconds>(reply.date.time_since_epoch());
@@ -137,19 +420,20 @@ public:
             reset.store(reply.reset*1000, std::memory_order_relaxed);
             _time_delay = (http_date - _now).count();
         }
-        return reply;
     }
 
-    bool ignore_rates = false;
-    std::mutex m;
-    rest_call & _call;
-    std::queue<std::tuple<std::string, std::string, std::string, std::function<void(rest::rest_reply)>>> _queue;
-    int32_t reset_bypass = 0;
+    async_rest_call & _async_call;
 
-private:
     asio::io_context & _io_context;
-    std::atomic<int64_t> & _global_limit;
+    global_bucket & _global;
     std::atomic<int64_t> _time_delay;
+
+    mutable std::mutex _queue_m;
+    std::deque<queued_request> _queue;
+    asio::steady_timer _timer;
+    bool _timer_armed = false;
+    bool _in_flight = false;
+    bucket_stats _stats;
 };
 
 }
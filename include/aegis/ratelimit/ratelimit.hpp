@@ -14,6 +14,7 @@
 #include "aegis/snowflake.hpp"
 #include "aegis/ratelimit/bucket.hpp"
 #include "aegis/futures.hpp"
+#include "aegis/metrics.hpp"
 #include "aegis/core.hpp"
 
 #include <chrono>
@@ -24,6 +25,10 @@
 #include <atomic>
 #include <mutex>
 #include <type_traits>
+#include <algorithm>
+#include <shared_mutex>
+#include <unordered_set>
+#include <vector>
 namespace aegis
 {
 
@@ -46,8 +51,28 @@ public:
      * @param call Function pointer to the REST API function
      */
     explicit ratelimit_mgr(rest_call call, asio::io_context & _io, core * _b)
-        : global_limit(0)
-        , _call(call)
+        : _call(call)
+        , _io_context(_io)
+        , _bot(_b)
+    {
+        // no async REST function given, run the blocking one on the io_context instead
+        _async_call = [this](rest::request_params params, std::function<void(rest::rest_reply)> cb)
+        {
+            asio::post(_io_context, [this, params = std::move(params), cb = std::move(cb)]()
+            {
+                cb(_call(params));
+            });
+        };
+    }
+
+    /// Construct a ratelimit_mgr object for managing the bucket factories
+    /**
+     * @param call Function pointer to the REST API function
+     * @param async_call Function pointer to the non-blocking REST API function
+     */
+    ratelimit_mgr(rest_call call, async_rest_call async_call, asio::io_context & _io, core * _b)
+        : _call(call)
+        , _async_call(async_call)
         , _io_context(_io)
         , _bot(_b)
     {
@@ -64,77 +89,341 @@ public:
      */
     bool is_global() const noexcept
     {
-        return global_limit > 0;
+        return global.is_paused();
+    }
+
+    /// Set the number of requests per second permitted across all buckets
+    /**
+     * Discord allows 50 requests per second per bot token unless it has been granted more.
+     * @param rate Requests per second
+     */
+    void set_global_rate(uint32_t rate) noexcept
+    {
+        global.set_rate(rate);
+    }
+
+    /// Get the global request limiter shared by every bucket
+    /**
+     * @returns Reference to the global_bucket
+     */
+    global_bucket & get_global() noexcept
+    {
+        return global;
+    }
+
+    /// Set how many times a request is resent after a 429
+    /**
+     * Applies to buckets created after this call.
+     * @param count Retry count
+     */
+    void set_max_retries(int32_t count) noexcept
+    {
+        _max_retries = count;
     }
 
     /// Get a bucket object
     /**
      * @see bucket
-     * @param id Snowflake of bucket object
+     * @param path Key of the bucket object
      * @returns Reference to a bucket object
      */
     bucket & get_bucket(const std::string & path) noexcept
     {
         // look for existing bucket
-        auto bkt = _buckets.find(path);
-        if (bkt != _buckets.end())
-            return *bkt->second;// found
+        {
+            std::shared_lock<shared_mutex> l(_bucket_m);
+            auto bkt = _buckets.find(path);
+            if (bkt != _buckets.end())
+                return *bkt->second;// found
+        }
+
+        // create new bucket and return
+        std::unique_lock<shared_mutex> l(_bucket_m);
+        auto & bkt = _buckets[path];
+        if (!bkt)
+        {
+            bkt = std::make_shared<bucket>(_call, _async_call, _io_context, global);
+            bkt->max_retries = _max_retries;
+        }
+        return *bkt;
+    }
+
+    /// Get the bucket a request is ratelimited under
+    /**
+     * Requests are grouped by route and major parameter. Once Discord has reported the
+     * X-RateLimit-Bucket hash of a route, every route sharing that hash shares one bucket
+     * per major parameter.
+     * @see get_route
+     * @param params Request to look up
+     * @param route Set to the route of the request
+     * @returns Reference to a bucket object
+     */
+    bucket & get_bucket(const rest::request_params & params, std::string & route) noexcept
+    {
+        std::string major;
+        route = get_route(params.method, params.path, major);
+
+        std::string key;
+        {
+            std::shared_lock<shared_mutex> l(_bucket_m);
+            auto hash = _route_hashes.find(route);
+            if (hash != _route_hashes.end())
+                key = hash->second + ':' + major;
+        }
+        if (key.empty())
+            key = route + ':' + major;
+
+        return get_bucket(key);
+    }
+
+    /// Normalize a request path to its ratelimit route
+    /**
+     * Snowflakes other than the major parameter (channel, guild or webhook id) are replaced
+     * with a placeholder so e.g. every message in a channel shares one route.
+     * Example: DELETE /channels/123/messages/456 -> "DELETE /channels/{id}/messages/{}" with major "123"
+     * @param method HTTP method of the request
+     * @param path Request path
+     * @param major Set to the major parameter of the path
+     * @returns Route string
+     */
+    static std::string get_route(rest::RequestMethod method, const std::string & path, std::string & major)
+    {
+        std::string route = rest::rest_controller::get_method(method);
+        route += ' ';
+        major.clear();
+
+        auto is_snowflake = [](const std::string & seg)
+        {
+            return !seg.empty() && std::all_of(seg.begin(), seg.end(), [](char c) { return c >= '0' && c <= '9'; });
+        };
+
+        std::string first;
+        std::string prev;
+        std::size_t index = 0;
+        std::size_t start = (!path.empty() && path[0] == '/') ? 1 : 0;
+        const std::size_t end = std::min(path.find('?'), path.size());
+
+        while (start <= end)
+        {
+            std::size_t next = std::min(path.find('/', start), end);
+            std::string seg = path.substr(start, next - start);
+            start = next + 1;
 
-    // create new bucket and return
-        return *_buckets.emplace(path, std::make_unique<bucket>(_call, _io_context, global_limit)).first->second;
+            if (index == 0)
+                first = seg;
+
+            if (index == 1 && (first == "channels" || first == "guilds" || first == "webhooks"))
+            {
+                major = seg;
+                route += "/{id}";
+            }
+            else if (index == 2 && first == "webhooks")
+            {
+                // webhook token is part of the major parameter
+                major += '/' + seg;
+                route += "/{token}";
+            }
+            else if (prev == "reactions")
+            {
+                // emoji and user segments all share the reaction bucket
+                route += "/_";
+                break;
+            }
+            else if (prev == "invites")
+                route += "/{code}";
+            else if (is_snowflake(seg))
+                route += "/{}";
+            else
+            {
+                route += '/';
+                route += seg;
+            }
+
+            prev = std::move(seg);
+            ++index;
+            if (next == end)
+                break;
+        }
+
+        return route;
+    }
+
+    /// Get queue and wait-time metrics of every bucket
+    /**
+     * A bucket known under both its route and its hash is listed once.
+     * @returns Map of bucket key to bucket_stats
+     */
+    std::unordered_map<std::string, bucket_stats> get_bucket_stats() const
+    {
+        std::shared_lock<shared_mutex> l(_bucket_m);
+        std::unordered_map<std::string, bucket_stats> stats;
+        std::unordered_set<const bucket *> seen;
+        for (auto & bkt : _buckets)
+            if (seen.insert(bkt.second.get()).second)
+                stats.emplace(bkt.first, bkt.second->get_stats());
+        return stats;
+    }
+
+    /// Get the X-RateLimit-Bucket hashes learned so far
+    /**
+     * @returns Map of route to bucket hash
+     */
+    std::unordered_map<std::string, std::string> get_route_hashes() const
+    {
+        std::shared_lock<shared_mutex> l(_bucket_m);
+        return _route_hashes;
     }
 
     template<typename ResultType, typename V = std::enable_if_t<!std::is_same<ResultType, rest::rest_reply>::value>>
     aegis::future<ResultType> post_task(rest::request_params params) noexcept
     {
-        return _bot->async([=]() -> ResultType
-        {
-            auto & bkt = get_bucket(params.path);
-            auto res = bkt.perform(params);
-            if (res.reply_code < rest::ok || res.reply_code >= rest::multiple_choices)//error
-                throw aegis::exception(fmt::format("REST Reply Code: {}", static_cast<int>(res.reply_code)), bad_request);
-            return res.content.empty() ? ResultType(_bot) : ResultType(res.content, _bot);
-        });
+        std::string route;
+        auto & bkt = get_bucket(params, route);
+        return _post_task<ResultType>(bkt, std::move(route), std::move(params));
     }
 
     aegis::future<rest::rest_reply> post_task(rest::request_params params) noexcept
     {
-        return _bot->async([=]() -> rest::rest_reply
-        {
-            auto & bkt = get_bucket(params.path);
-            return bkt.perform(params);
-        });
+        std::string route;
+        auto & bkt = get_bucket(params, route);
+        return _post_reply(bkt, std::move(route), std::move(params));
     }
 
     template<typename ResultType, typename V = std::enable_if_t<!std::is_same<ResultType, rest::rest_reply>::value>>
     aegis::future<ResultType> post_task(std::string _bucket, rest::request_params params) noexcept
     {
-        return _bot->async([=]() -> ResultType
+        std::string major;
+        auto route = get_route(params.method, params.path, major);
+        return _post_task<ResultType>(get_bucket(_bucket), std::move(route), std::move(params), false);
+    }
+
+    aegis::future<rest::rest_reply> post_task(std::string _bucket, rest::request_params params) noexcept
+    {
+        std::string major;
+        auto route = get_route(params.method, params.path, major);
+        return _post_reply(get_bucket(_bucket), std::move(route), std::move(params), false);
+    }
+
+    /// Record request latency and ratelimit wait time into a registry
+    /**
+     * Adds aegis_rest_request_seconds labelled by bucket and status, and
+     * aegis_ratelimit_wait_seconds labelled by bucket. The bucket label is the
+     * X-RateLimit-Bucket hash Discord reported, or the route when it reported none.
+     * Call before any request is made.
+     * @param registry Registry to record into, nullptr to stop recording
+     */
+    void set_metrics(metrics_registry * registry)
+    {
+        if (!registry)
+        {
+            _rest_latency = nullptr;
+            _ratelimit_wait = nullptr;
+            return;
+        }
+        _rest_latency = &registry->histogram("aegis_rest_request_seconds", "Time from sending a REST request to its reply", { "bucket", "status" });
+        _ratelimit_wait = &registry->histogram("aegis_ratelimit_wait_seconds", "Time a REST request waited in its ratelimit bucket before being sent", { "bucket" });
+    }
+
+private:
+    template<typename ResultType>
+    aegis::future<ResultType> _post_task(bucket & bkt, std::string route, rest::request_params params, bool learn = true) noexcept
+    {
+        auto pr = std::make_shared<aegis::promise<ResultType>>(&_io_context);
+        auto fut = pr->get_future();
+
+        bkt.perform_async(std::move(params), [this, pr, route = std::move(route), learn, _bot = _bot](rest::rest_reply res)
         {
-            auto & bkt = get_bucket(_bucket);
-            auto res = bkt.perform(params);
+            if (learn)
+                _learn_bucket(route, res.bucket);
+            _observe(route, res);
             if (res.reply_code < rest::ok || res.reply_code >= rest::multiple_choices)//error
-                throw aegis::exception(fmt::format("REST Reply Code: {}", static_cast<int>(res.reply_code)), bad_request);
-            return res.content.empty() ? ResultType(_bot) : ResultType(res.content, _bot);
+            {
+                pr->set_exception(std::make_exception_ptr(aegis::exception(fmt::format("REST Reply Code: {}", static_cast<int>(res.reply_code)), bad_request)));
+                return;
+            }
+            try
+            {
+                pr->set_value(res.content.empty() ? ResultType(_bot) : ResultType(res.content, _bot));
+            }
+            catch (std::exception &)
+            {
+                pr->set_exception(std::current_exception());
+            }
         });
+        return fut;
     }
 
-    aegis::future<rest::rest_reply> post_task(std::string _bucket, rest::request_params params) noexcept
+    aegis::future<rest::rest_reply> _post_reply(bucket & bkt, std::string route, rest::request_params params, bool learn = true) noexcept
     {
-        return _bot->async([=]() -> rest::rest_reply
+        auto pr = std::make_shared<aegis::promise<rest::rest_reply>>(&_io_context);
+        auto fut = pr->get_future();
+
+        bkt.perform_async(std::move(params), [this, pr, route = std::move(route), learn](rest::rest_reply res)
         {
-            auto & bkt = get_bucket(_bucket);
-            return bkt.perform(params);
+            if (learn)
+                _learn_bucket(route, res.bucket);
+            _observe(route, res);
+            pr->set_value(std::move(res));
         });
+        return fut;
+    }
+
+    /// Record the bucket hash Discord reported for a route
+    void _learn_bucket(const std::string & route, const std::string & hash)
+    {
+        if (route.empty() || hash.empty())
+            return;
+        {
+            std::shared_lock<shared_mutex> l(_bucket_m);
+            auto it = _route_hashes.find(route);
+            if (it != _route_hashes.end() && it->second == hash)
+                return;
+        }
+        std::unique_lock<shared_mutex> l(_bucket_m);
+        _route_hashes[route] = hash;
+
+        // requests already queued under route:major keep draining the same bucket, so point
+        // hash:major at it rather than let a second bucket spend the same limit in parallel
+        std::vector<std::pair<std::string, std::shared_ptr<bucket>>> aliases;
+        for (auto & bkt : _buckets)
+        {
+            auto sep = bkt.first.rfind(':');
+            if (sep == std::string::npos || bkt.first.compare(0, sep, route) != 0 || sep != route.size())
+                continue;
+            aliases.emplace_back(hash + bkt.first.substr(sep), bkt.second);
+        }
+        for (auto & a : aliases)
+            _buckets.emplace(std::move(a.first), std::move(a.second));
+    }
+
+    /// Record a finished request when metrics are enabled
+    void _observe(const std::string & route, const rest::rest_reply & res) noexcept
+    {
+        if (!_rest_latency)
+            return;
+        try
+        {
+            const auto & label = res.bucket.empty() ? route : res.bucket;
+            _rest_latency->get(label, static_cast<int32_t>(res.reply_code)).record(res.execution_time);
+            _ratelimit_wait->get(label).record(res.queue_time);
+        }
+        catch (...)
+        {
+        }
     }
 
-private:
     friend class bucket;
 
-    std::atomic<int64_t> global_limit; /**< Timestamp in seconds when global ratelimit expires */
+    global_bucket global; /**< Global request limit shared by every bucket */
 
-    std::unordered_map<std::string, std::unique_ptr<bucket>> _buckets;
+    mutable shared_mutex _bucket_m; /**< Guards _buckets and _route_hashes */
+    std::unordered_map<std::string, std::shared_ptr<bucket>> _buckets; /**< A bucket is shared by its route and hash keys once the hash is learned */
+    std::unordered_map<std::string, std::string> _route_hashes; /**< Route to X-RateLimit-Bucket hash */
+    int32_t _max_retries = 3;
+    histogram_family * _rest_latency = nullptr;
+    histogram_family * _ratelimit_wait = nullptr;
     rest_call _call;
+    async_rest_call _async_call;
     asio::io_context & _io_context;
     core * _bot;
 };
@@ -0,0 +1,307 @@
+//
+// connection_pool.hpp
+// *******************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#pragma once
+
+#include "aegis/config.hpp"
+#include "aegis/fwd.hpp"
+
+#ifdef WIN32
+# include "aegis/push.hpp"
+#endif
+#include <asio/ip/basic_resolver.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/connect.hpp>
+#include <asio/streambuf.hpp>
+#include <asio/ssl.hpp>
+#include <asio/read.hpp>
+#include <asio/read_until.hpp>
+#include <asio/write.hpp>
+#include <asio/post.hpp>
+#ifdef WIN32
+# include "aegis/pop.hpp"
+#endif
+
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <unordered_map>
+#include <functional>
+#include <atomic>
+
+namespace aegis
+{
+
+namespace rest
+{
+
+/// Minimal HTTP/1.1 response as read from a pooled connection
+struct http_response
+{
+    /// Get a reply header
+    /**
+     * @param key Case-insensitive header name
+     * @returns Header value or an empty string if not present
+     */
+    AEGIS_DECL const std::string & get_header(const std::string & key) const noexcept;
+
+    /// Get the HTTP status code
+    uint16_t get_status_code() const noexcept
+    {
+        return status;
+    }
+
+    /// Get the reply body
+    const std::string & get_body() const noexcept
+    {
+        return body;
+    }
+
+    uint16_t status = 0; /**< HTTP status code */
+    std::map<std::string, std::string> headers; /**< Reply headers keyed by lowercase name */
+    std::string body; /**< Reply body with any transfer encoding removed */
+    bool keep_alive = true; /**< Whether the server permits reusing the connection */
+};
+
+/// Reuse statistics for a single pooled connection
+struct connection_stats
+{
+    std::string host; /**< Remote host */
+    std::string port; /**< Remote port */
+    uint64_t requests = 0; /**< Requests served over this connection */
+    bool session_resumed = false; /**< Whether the TLS handshake resumed a cached session */
+    bool busy = false; /**< Whether a request is currently in flight */
+    std::chrono::steady_clock::time_point created; /**< Time the connection was established */
+    std::chrono::steady_clock::time_point last_used; /**< Time the last request completed */
+};
+
+/// Aggregate statistics for the connection pool
+struct pool_stats
+{
+    uint64_t connections_opened = 0; /**< TCP+TLS connections established */
+    uint64_t sessions_resumed = 0; /**< TLS handshakes that resumed a cached session */
+    uint64_t requests = 0; /**< Requests performed through the pool */
+    uint64_t reused_requests = 0; /**< Requests that did not need a new connection */
+    uint64_t retries = 0; /**< Requests resent after a kept-alive connection was found closed */
+    uint64_t queued = 0; /**< Requests that waited for a connection because their host was at its limit */
+    std::vector<connection_stats> connections; /**< Per-connection stats of currently pooled connections */
+};
+
+/// Persistent HTTP/1.1 TLS connection
+/**
+ * Must be owned by a std::shared_ptr. Every pending async operation holds a reference,
+ * so a connection outlives its pool until its handlers have run.
+ */
+class rest_connection : public std::enable_shared_from_this<rest_connection>
+{
+public:
+    using socket_type = asio::ssl::stream<asio::ip::tcp::socket>;
+    using connect_handler = std::function<void(const asio::error_code & ec)>;
+    using perform_handler = std::function<void(const asio::error_code & ec, http_response response)>;
+
+    AEGIS_DECL rest_connection(asio::io_context & _io, asio::ssl::context & _ctx, const std::string & host, const std::string & port);
+
+    rest_connection(const rest_connection &) = delete;
+    rest_connection & operator=(const rest_connection &) = delete;
+
+    /// Connect and perform the TLS handshake
+    /**
+     * @param r Resolved endpoints of the remote host
+     * @throws asio::system_error
+     */
+    AEGIS_DECL void connect(const asio::ip::tcp::resolver::results_type & r);
+
+    /// Send a serialized request and read the full response
+    /**
+     * @param request Complete HTTP/1.1 request including headers and body
+     * @returns http_response
+     * @throws asio::system_error
+     */
+    AEGIS_DECL http_response perform(const std::string & request);
+
+    /// Connect and perform the TLS handshake without blocking
+    /**
+     * @param r Resolved endpoints of the remote host
+     * @param handler Called with the result once the handshake completes
+     */
+    AEGIS_DECL void async_connect(const asio::ip::tcp::resolver::results_type & r, connect_handler handler);
+
+    /// Send a serialized request and read the full response without blocking
+    /**
+     * Only one request may be in flight on a connection at a time.
+     * @param request Complete HTTP/1.1 request including headers and body
+     * @param handler Called with the response once it has been fully read
+     */
+    AEGIS_DECL void async_perform(std::shared_ptr<const std::string> request, perform_handler handler);
+
+    /// Close the underlying socket
+    AEGIS_DECL void close() noexcept;
+
+    bool is_open() const noexcept
+    {
+        return _open;
+    }
+
+    const connection_stats & get_stats() const noexcept
+    {
+        return _stats;
+    }
+
+    socket_type & get_socket() noexcept
+    {
+        return _socket;
+    }
+
+private:
+    friend class connection_pool;
+
+    AEGIS_DECL void _parse_head(http_response & response);
+    AEGIS_DECL void _read_body(http_response & response);
+    AEGIS_DECL void _async_read_body();
+    AEGIS_DECL void _async_read_chunk();
+    AEGIS_DECL void _async_read_trailer();
+    AEGIS_DECL void _complete(const asio::error_code & ec);
+
+    /// Close the socket and never call the pending handler. For a pool that is going away
+    AEGIS_DECL void _abandon() noexcept;
+
+    socket_type _socket;
+    asio::streambuf _buffer;
+    connection_stats _stats;
+    bool _open = false;
+    bool _response_started = false;
+    http_response _response;
+    perform_handler _handler;
+    std::atomic<bool> _abandoned{ false };
+};
+
+/// Pool of persistent HTTP/1.1 TLS connections keyed by host and port
+/**
+ * All connections share one SSL context. The most recent TLS session of each
+ * host is kept so new connections to that host can resume it instead of
+ * performing a full handshake. Concurrent requests to the same host are spread
+ * across multiple connections, each carrying one request at a time. Once a host
+ * has set_max_connections() connections busy, further requests wait for one of
+ * them to be released.
+ */
+class connection_pool
+{
+public:
+    using perform_handler = rest_connection::perform_handler;
+
+    AEGIS_DECL explicit connection_pool(asio::io_context & _io);
+
+    AEGIS_DECL ~connection_pool();
+
+    connection_pool(const connection_pool &) = delete;
+    connection_pool & operator=(const connection_pool &) = delete;
+
+    /// Perform a request on a pooled connection
+    /**
+     * A request that fails on a reused connection before any reply is read is
+     * retried once on a fresh connection, as the server may have closed it while idle.
+     * @param host Remote host
+     * @param port Remote port
+     * @param r Resolved endpoints of the remote host
+     * @param request Complete HTTP/1.1 request including headers and body
+     * @returns http_response
+     * @throws asio::system_error
+     */
+    AEGIS_DECL http_response perform(const std::string & host, const std::string & port, const asio::ip::tcp::resolver::results_type & r, const std::string & request);
+
+    /// Perform a request on a pooled connection without blocking
+    /**
+     * Follows the same reuse and retry rules as perform().
+     * @param host Remote host
+     * @param port Remote port
+     * @param r Resolved endpoints of the remote host
+     * @param request Complete HTTP/1.1 request including headers and body
+     * @param handler Called with the response, or an error code if the request failed
+     */
+    AEGIS_DECL void async_perform(const std::string & host, const std::string & port, const asio::ip::tcp::resolver::results_type & r, std::shared_ptr<const std::string> request, perform_handler handler);
+
+    /// Get a snapshot of pool and per-connection statistics
+    AEGIS_DECL pool_stats get_stats() const;
+
+    /// Close all idle connections and discard cached TLS sessions
+    AEGIS_DECL void clear() noexcept;
+
+    /// Set the maximum number of idle connections kept per host
+    void set_max_idle(std::size_t count) noexcept
+    {
+        _max_idle = count;
+    }
+
+    /// Set the maximum number of connections opened per host, 0 for no limit
+    void set_max_connections(std::size_t count) noexcept
+    {
+        _max_connections = count;
+    }
+
+    /// Set how long an idle connection is kept before it is closed
+    void set_idle_timeout(std::chrono::steady_clock::duration timeout) noexcept
+    {
+        _idle_timeout = timeout;
+    }
+
+    asio::ssl::context & get_ssl_context() noexcept
+    {
+        return _ssl_ctx;
+    }
+
+private:
+    /// Request waiting for a connection. Called with an error if the pool is destroyed first
+    using waiter = std::function<void(const asio::error_code & ec)>;
+
+    /// Take an idle connection for host:port or create a new unconnected one
+    /**
+     * Must be called with _m held.
+     * @returns nullptr if every connection to the host is busy and no more may be opened
+     */
+    AEGIS_DECL rest_connection * _take_nolock(const std::string & key, const std::string & host, const std::string & port, bool & reused);
+
+    /// Take an idle connection for host:port or create and connect a new one
+    AEGIS_DECL rest_connection * _acquire(const std::string & key, const std::string & host, const std::string & port, const asio::ip::tcp::resolver::results_type & r, bool & reused);
+
+    AEGIS_DECL void _async_perform(const std::string & key, const std::string & host, const std::string & port, const asio::ip::tcp::resolver::results_type & r, std::shared_ptr<const std::string> request, perform_handler handler, int attempt);
+
+    /// Return a connection to the pool, closing it if it can not be reused, and start the next queued request
+    AEGIS_DECL void _release(const std::string & key, rest_connection * conn, bool reusable) noexcept;
+
+    /// Return a connection to the pool. Must be called with _m held
+    /**
+     * @returns false if the connection is not in the pool
+     */
+    AEGIS_DECL bool _release_nolock(const std::string & key, rest_connection * conn, bool reusable) noexcept;
+
+    asio::io_context & _io_context;
+    asio::ssl::context _ssl_ctx;
+    mutable std::mutex _m;
+    std::unordered_map<std::string, std::vector<std::shared_ptr<rest_connection>>> _connections;
+    std::unordered_map<std::string, SSL_SESSION *> _sessions;
+    std::unordered_map<std::string, std::deque<waiter>> _waiting; /**< Async requests waiting for a connection, per host */
+    std::condition_variable _released; /**< Signalled whenever a connection is released, for blocking requests */
+    std::size_t _max_idle = 8;
+    std::size_t _max_connections = 16;
+    std::chrono::steady_clock::duration _idle_timeout = std::chrono::seconds(30);
+    pool_stats _stats;
+};
+
+}
+
+}
+
+#if defined(AEGIS_HEADER_ONLY)
+#include "aegis/rest/impl/connection_pool.cpp"
+#endif
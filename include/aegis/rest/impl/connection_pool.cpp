@@ -0,0 +1,694 @@
+//
+// connection_pool.cpp
+// *******************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#include "aegis/rest/connection_pool.hpp"
+#include <algorithm>
+#include <istream>
+#include <cctype>
+
+namespace aegis
+{
+
+namespace rest
+{
+
+AEGIS_DECL const std::string & http_response::get_header(const std::string & key) const noexcept
+{
+    static const std::string empty;
+    std::string lower(key);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    auto it = headers.find(lower);
+    if (it == headers.end())
+        return empty;
+    return it->second;
+}
+
+AEGIS_DECL rest_connection::rest_connection(asio::io_context & _io, asio::ssl::context & _ctx, const std::string & host, const std::string & port)
+    : _socket(_io, _ctx)
+{
+    _stats.host = host;
+    _stats.port = port;
+}
+
+AEGIS_DECL void rest_connection::connect(const asio::ip::tcp::resolver::results_type & r)
+{
+    SSL_set_tlsext_host_name(_socket.native_handle(), _stats.host.data());
+
+    asio::connect(_socket.lowest_layer(), r);
+    _socket.lowest_layer().set_option(asio::ip::tcp::no_delay(true));
+    _socket.handshake(asio::ssl::stream_base::client);
+
+    _stats.session_resumed = (SSL_session_reused(_socket.native_handle()) != 0);
+    _stats.created = _stats.last_used = std::chrono::steady_clock::now();
+    _open = true;
+}
+
+AEGIS_DECL http_response rest_connection::perform(const std::string & request)
+{
+    _response_started = false;
+
+    asio::write(_socket, asio::buffer(request));
+
+    http_response response;
+
+    asio::read_until(_socket, _buffer, "\r\n\r\n");
+    _response_started = true;
+
+    _parse_head(response);
+    _read_body(response);
+
+    ++_stats.requests;
+    _stats.last_used = std::chrono::steady_clock::now();
+
+    return response;
+}
+
+AEGIS_DECL void rest_connection::async_connect(const asio::ip::tcp::resolver::results_type & r, connect_handler handler)
+{
+    SSL_set_tlsext_host_name(_socket.native_handle(), _stats.host.data());
+
+    asio::async_connect(_socket.lowest_layer(), r, [this, self = shared_from_this(), handler](const asio::error_code & ec, const asio::ip::tcp::endpoint &)
+    {
+        if (_abandoned)
+            return;
+        if (ec)
+        {
+            handler(ec);
+            return;
+        }
+
+        asio::error_code opt_ec;
+        _socket.lowest_layer().set_option(asio::ip::tcp::no_delay(true), opt_ec);
+
+        _socket.async_handshake(asio::ssl::stream_base::client, [this, self, handler](const asio::error_code & ec)
+        {
+            if (_abandoned)
+                return;
+            if (!ec)
+            {
+                _stats.session_resumed = (SSL_session_reused(_socket.native_handle()) != 0);
+                _stats.created = _stats.last_used = std::chrono::steady_clock::now();
+                _open = true;
+            }
+            handler(ec);
+        });
+    });
+}
+
+AEGIS_DECL void rest_connection::async_perform(std::shared_ptr<const std::string> request, perform_handler handler)
+{
+    _response_started = false;
+    _response = http_response();
+    _handler = std::move(handler);
+
+    asio::async_write(_socket, asio::buffer(*request), [this, self = shared_from_this(), request](const asio::error_code & ec, std::size_t)
+    {
+        if (ec)
+            return _complete(ec);
+
+        asio::async_read_until(_socket, _buffer, "\r\n\r\n", [this, self](const asio::error_code & ec, std::size_t)
+        {
+            if (ec)
+                return _complete(ec);
+
+            _response_started = true;
+            try
+            {
+                _parse_head(_response);
+            }
+            catch (std::exception &)
+            {
+                return _complete(make_error_code(asio::error::invalid_argument));
+            }
+            _async_read_body();
+        });
+    });
+}
+
+AEGIS_DECL void rest_connection::_async_read_body()
+{
+    if ((_response.status >= 100 && _response.status < 200) || _response.status == 204 || _response.status == 304)
+        return _complete(asio::error_code());
+
+    if (_response.get_header("transfer-encoding").find("chunked") != std::string::npos)
+        return _async_read_chunk();
+
+    const std::string & content_length = _response.get_header("content-length");
+    if (!content_length.empty())
+    {
+        std::size_t length = 0;
+        try
+        {
+            length = std::stoul(content_length);
+        }
+        catch (std::exception &)
+        {
+            return _complete(make_error_code(asio::error::invalid_argument));
+        }
+
+        auto take = [this, length]()
+        {
+            auto data = _buffer.data();
+            _response.body.assign(asio::buffers_begin(data), asio::buffers_begin(data) + length);
+            _buffer.consume(length);
+            _complete(asio::error_code());
+        };
+
+        if (_buffer.size() >= length)
+            return take();
+
+        asio::async_read(_socket, _buffer, asio::transfer_exactly(length - _buffer.size()), [this, self = shared_from_this(), take](const asio::error_code & ec, std::size_t)
+        {
+            if (ec)
+                return _complete(ec);
+            take();
+        });
+        return;
+    }
+
+    // no framing, body runs until the server closes the connection
+    asio::async_read(_socket, _buffer, asio::transfer_all(), [this, self = shared_from_this()](const asio::error_code & ec, std::size_t)
+    {
+        if (ec != asio::error::eof && ec != asio::ssl::error::stream_truncated)
+            return _complete(ec);
+        auto data = _buffer.data();
+        _response.body.assign(asio::buffers_begin(data), asio::buffers_end(data));
+        _buffer.consume(_buffer.size());
+        _response.keep_alive = false;
+        _complete(asio::error_code());
+    });
+}
+
+AEGIS_DECL void rest_connection::_async_read_chunk()
+{
+    asio::async_read_until(_socket, _buffer, "\r\n", [this, self = shared_from_this()](const asio::error_code & ec, std::size_t)
+    {
+        if (ec)
+            return _complete(ec);
+
+        std::istream is(&_buffer);
+        std::string line;
+        std::getline(is, line);
+
+        std::size_t chunk = 0;
+        try
+        {
+            chunk = std::stoul(line, nullptr, 16);
+        }
+        catch (std::exception &)
+        {
+            return _complete(make_error_code(asio::error::invalid_argument));
+        }
+
+        if (chunk == 0)
+            return _async_read_trailer();
+
+        auto take = [this, chunk]()
+        {
+            auto data = _buffer.data();
+            _response.body.append(asio::buffers_begin(data), asio::buffers_begin(data) + chunk);
+            _buffer.consume(chunk + 2);
+            _async_read_chunk();
+        };
+
+        if (_buffer.size() >= chunk + 2)
+            return take();
+
+        asio::async_read(_socket, _buffer, asio::transfer_exactly(chunk + 2 - _buffer.size()), [this, self, take](const asio::error_code & ec, std::size_t)
+        {
+            if (ec)
+                return _complete(ec);
+            take();
+        });
+    });
+}
+
+AEGIS_DECL void rest_connection::_async_read_trailer()
+{
+    asio::async_read_until(_socket, _buffer, "\r\n", [this, self = shared_from_this()](const asio::error_code & ec, std::size_t)
+    {
+        if (ec)
+            return _complete(ec);
+
+        std::istream is(&_buffer);
+        std::string line;
+        std::getline(is, line);
+        if (line.empty() || line == "\r")
+            return _complete(asio::error_code());
+        _async_read_trailer();
+    });
+}
+
+AEGIS_DECL void rest_connection::_complete(const asio::error_code & ec)
+{
+    if (_abandoned)
+    {
+        _handler = nullptr;
+        return;
+    }
+    if (!ec)
+    {
+        ++_stats.requests;
+        _stats.last_used = std::chrono::steady_clock::now();
+    }
+    // the handler may hand this connection back to the pool, which drops the pool's reference
+    auto handler = std::move(_handler);
+    _handler = nullptr;
+    handler(ec, std::move(_response));
+}
+
+AEGIS_DECL void rest_connection::_parse_head(http_response & response)
+{
+    std::istream is(&_buffer);
+    std::string line;
+
+    // status line
+    std::getline(is, line);
+    if (line.size() < 12 || line.compare(0, 5, "HTTP/") != 0)
+        throw asio::system_error(make_error_code(asio::error::invalid_argument));
+    bool http10 = (line.compare(0, 8, "HTTP/1.0") == 0);
+    response.status = static_cast<uint16_t>(std::stoul(line.substr(9, 3)));
+
+    // headers
+    while (std::getline(is, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            break;
+        auto pos = line.find(':');
+        if (pos == std::string::npos)
+            continue;
+        std::string key = line.substr(0, pos);
+        std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        auto start = line.find_first_not_of(' ', pos + 1);
+        std::string value = (start == std::string::npos) ? std::string() : line.substr(start);
+        auto it = response.headers.find(key);
+        if (it != response.headers.end())
+            it->second += ", " + value;
+        else
+            response.headers.emplace(std::move(key), std::move(value));
+    }
+
+    const std::string & connection = response.get_header("connection");
+    if (http10)
+        response.keep_alive = (connection.find("keep-alive") != std::string::npos);
+    else
+        response.keep_alive = (connection.find("close") == std::string::npos);
+}
+
+AEGIS_DECL void rest_connection::_read_body(http_response & response)
+{
+    if ((response.status >= 100 && response.status < 200) || response.status == 204 || response.status == 304)
+        return;
+
+    std::istream is(&_buffer);
+    std::string line;
+
+    if (response.get_header("transfer-encoding").find("chunked") != std::string::npos)
+    {
+        while (true)
+        {
+            asio::read_until(_socket, _buffer, "\r\n");
+            std::getline(is, line);
+            std::size_t chunk = std::stoul(line, nullptr, 16);
+            if (chunk == 0)
+            {
+                // discard any trailers up to the terminating empty line
+                while (!line.empty() && line != "\r")
+                {
+                    asio::read_until(_socket, _buffer, "\r\n");
+                    std::getline(is, line);
+                }
+                break;
+            }
+            if (_buffer.size() < chunk + 2)
+                asio::read(_socket, _buffer, asio::transfer_exactly(chunk + 2 - _buffer.size()));
+            auto data = _buffer.data();
+            response.body.append(asio::buffers_begin(data), asio::buffers_begin(data) + chunk);
+            _buffer.consume(chunk + 2);
+        }
+        return;
+    }
+
+    const std::string & content_length = response.get_header("content-length");
+    if (!content_length.empty())
+    {
+        std::size_t length = std::stoul(content_length);
+        if (_buffer.size() < length)
+            asio::read(_socket, _buffer, asio::transfer_exactly(length - _buffer.size()));
+        auto data = _buffer.data();
+        response.body.assign(asio::buffers_begin(data), asio::buffers_begin(data) + length);
+        _buffer.consume(length);
+        return;
+    }
+
+    // no framing, body runs until the server closes the connection
+    asio::error_code ec;
+    while (asio::read(_socket, _buffer, asio::transfer_at_least(1), ec))
+        ;
+    if (ec != asio::error::eof && ec != asio::ssl::error::stream_truncated)
+        throw asio::system_error(ec);
+    auto data = _buffer.data();
+    response.body.assign(asio::buffers_begin(data), asio::buffers_end(data));
+    _buffer.consume(_buffer.size());
+    response.keep_alive = false;
+}
+
+AEGIS_DECL void rest_connection::_abandon() noexcept
+{
+    _abandoned = true;
+    // the socket is not thread safe, close it from the io_context running its operations
+    try
+    {
+        asio::post(_socket.get_executor(), [this, self = shared_from_this()]()
+        {
+            asio::error_code ec;
+            _socket.lowest_layer().close(ec);
+            _open = false;
+        });
+    }
+    catch (...)
+    {
+    }
+}
+
+AEGIS_DECL void rest_connection::close() noexcept
+{
+    // mark the session as cleanly shut down so OpenSSL keeps it resumable
+    if (_open)
+        SSL_set_shutdown(_socket.native_handle(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    asio::error_code ec;
+    _socket.lowest_layer().shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+    _socket.lowest_layer().close(ec);
+    _open = false;
+}
+
+AEGIS_DECL connection_pool::connection_pool(asio::io_context & _io)
+    : _io_context(_io)
+    , _ssl_ctx(asio::ssl::context::tlsv12)
+{
+    _ssl_ctx.set_options(
+        asio::ssl::context::default_workarounds
+        | asio::ssl::context::no_sslv2
+        | asio::ssl::context::no_sslv3);
+    SSL_CTX_set_session_cache_mode(_ssl_ctx.native_handle(), SSL_SESS_CACHE_CLIENT);
+}
+
+AEGIS_DECL connection_pool::~connection_pool()
+{
+    std::unordered_map<std::string, std::deque<waiter>> waiting;
+    {
+        std::lock_guard<std::mutex> l(_m);
+        waiting.swap(_waiting);
+    }
+    for (auto & list : waiting)
+        for (auto & w : list.second)
+            w(make_error_code(asio::error::operation_aborted));
+
+    {
+        // requests in flight finish with operation_aborted and keep their connection
+        // alive until then, but must no longer call back into the pool
+        std::lock_guard<std::mutex> l(_m);
+        for (auto & list : _connections)
+            for (auto & c : list.second)
+                if (c->_stats.busy)
+                    c->_abandon();
+    }
+
+    clear();
+}
+
+AEGIS_DECL http_response connection_pool::perform(const std::string & host, const std::string & port, const asio::ip::tcp::resolver::results_type & r, const std::string & request)
+{
+    const std::string key = host + ':' + port;
+
+    for (int attempt = 0; ; ++attempt)
+    {
+        bool reused = false;
+        rest_connection * conn = _acquire(key, host, port, r, reused);
+        try
+        {
+            http_response response = conn->perform(request);
+            {
+                std::lock_guard<std::mutex> l(_m);
+                ++_stats.requests;
+                if (reused)
+                    ++_stats.reused_requests;
+            }
+            _release(key, conn, response.keep_alive);
+            return response;
+        }
+        catch (...)
+        {
+            bool retry = reused && !conn->_response_started && attempt == 0;
+            _release(key, conn, false);
+            if (!retry)
+                throw;
+            std::lock_guard<std::mutex> l(_m);
+            ++_stats.retries;
+        }
+    }
+}
+
+AEGIS_DECL void connection_pool::async_perform(const std::string & host, const std::string & port, const asio::ip::tcp::resolver::results_type & r, std::shared_ptr<const std::string> request, perform_handler handler)
+{
+    _async_perform(host + ':' + port, host, port, r, std::move(request), std::move(handler), 0);
+}
+
+AEGIS_DECL void connection_pool::_async_perform(const std::string & key, const std::string & host, const std::string & port, const asio::ip::tcp::resolver::results_type & r, std::shared_ptr<const std::string> request, perform_handler handler, int attempt)
+{
+    bool reused = false;
+    rest_connection * conn = nullptr;
+    {
+        std::lock_guard<std::mutex> l(_m);
+        conn = _take_nolock(key, host, port, reused);
+        if (conn == nullptr)
+        {
+            // host is at its limit, run again once a connection is released
+            ++_stats.queued;
+            _waiting[key].emplace_back([this, key, host, port, r, request, handler, attempt](const asio::error_code & ec)
+            {
+                if (ec)
+                    return handler(ec, http_response());
+                _async_perform(key, host, port, r, request, handler, attempt);
+            });
+            return;
+        }
+    }
+
+    auto perform = [this, key, host, port, r, request, handler, attempt, conn, reused]()
+    {
+        conn->async_perform(request, [this, key, host, port, r, request, handler, attempt, conn, reused](const asio::error_code & ec, http_response response)
+        {
+            if (!ec)
+            {
+                {
+                    std::lock_guard<std::mutex> l(_m);
+                    ++_stats.requests;
+                    if (reused)
+                        ++_stats.reused_requests;
+                }
+                _release(key, conn, response.keep_alive);
+                handler(ec, std::move(response));
+                return;
+            }
+
+            bool retry = reused && !conn->_response_started && attempt == 0;
+            _release(key, conn, false);
+            if (!retry)
+            {
+                handler(ec, http_response());
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> l(_m);
+                ++_stats.retries;
+            }
+            _async_perform(key, host, port, r, request, handler, attempt + 1);
+        });
+    };
+
+    if (reused)
+        return perform();
+
+    conn->async_connect(r, [this, key, conn, handler, perform](const asio::error_code & ec)
+    {
+        if (ec)
+        {
+            _release(key, conn, false);
+            handler(ec, http_response());
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> l(_m);
+            ++_stats.connections_opened;
+            if (conn->_stats.session_resumed)
+                ++_stats.sessions_resumed;
+        }
+        perform();
+    });
+}
+
+AEGIS_DECL rest_connection * connection_pool::_take_nolock(const std::string & key, const std::string & host, const std::string & port, bool & reused)
+{
+    auto & list = _connections[key];
+    auto now = std::chrono::steady_clock::now();
+
+    for (auto it = list.begin(); it != list.end();)
+    {
+        auto & c = *it;
+        if (c->_stats.busy)
+        {
+            ++it;
+            continue;
+        }
+        if (!c->is_open() || (now - c->_stats.last_used) > _idle_timeout)
+        {
+            c->close();
+            it = list.erase(it);
+            continue;
+        }
+        c->_stats.busy = true;
+        reused = true;
+        return c.get();
+    }
+
+    if (_max_connections != 0 && list.size() >= _max_connections)
+        return nullptr;
+
+    list.emplace_back(std::make_shared<rest_connection>(_io_context, _ssl_ctx, host, port));
+    rest_connection * conn = list.back().get();
+    conn->_stats.busy = true;
+
+    auto session = _sessions.find(key);
+    if (session != _sessions.end())
+        SSL_set_session(conn->_socket.native_handle(), session->second);
+
+    return conn;
+}
+
+AEGIS_DECL rest_connection * connection_pool::_acquire(const std::string & key, const std::string & host, const std::string & port, const asio::ip::tcp::resolver::results_type & r, bool & reused)
+{
+    rest_connection * conn = nullptr;
+    {
+        std::unique_lock<std::mutex> l(_m);
+        if ((conn = _take_nolock(key, host, port, reused)) == nullptr)
+        {
+            ++_stats.queued;
+            _released.wait(l, [&] { return (conn = _take_nolock(key, host, port, reused)) != nullptr; });
+        }
+    }
+    if (reused)
+        return conn;
+
+    try
+    {
+        conn->connect(r);
+    }
+    catch (...)
+    {
+        _release(key, conn, false);
+        throw;
+    }
+
+    std::lock_guard<std::mutex> l(_m);
+    ++_stats.connections_opened;
+    if (conn->_stats.session_resumed)
+        ++_stats.sessions_resumed;
+    return conn;
+}
+
+AEGIS_DECL void connection_pool::_release(const std::string & key, rest_connection * conn, bool reusable) noexcept
+{
+    waiter next;
+    {
+        std::lock_guard<std::mutex> l(_m);
+        if (!_release_nolock(key, conn, reusable))
+            return;
+
+        auto waiting = _waiting.find(key);
+        if (waiting != _waiting.end() && !waiting->second.empty())
+        {
+            next = std::move(waiting->second.front());
+            waiting->second.pop_front();
+        }
+    }
+    _released.notify_all();
+
+    // a slot is free now. Start the next queued request outside of this handler
+    if (next)
+        asio::post(_io_context, [next = std::move(next)]() { next(asio::error_code()); });
+}
+
+AEGIS_DECL bool connection_pool::_release_nolock(const std::string & key, rest_connection * conn, bool reusable) noexcept
+{
+    auto & list = _connections[key];
+    auto it = std::find_if(list.begin(), list.end(), [conn](const std::shared_ptr<rest_connection> & c) { return c.get() == conn; });
+    if (it == list.end())
+        return false;
+
+    if (conn->is_open())
+    {
+        // keep the latest session for future handshakes to this host
+        SSL_SESSION * session = SSL_get1_session(conn->_socket.native_handle());
+        if (session != nullptr)
+        {
+            auto & cached = _sessions[key];
+            if (cached != nullptr)
+                SSL_SESSION_free(cached);
+            cached = session;
+        }
+    }
+
+    conn->_stats.busy = false;
+
+    std::size_t idle = std::count_if(list.begin(), list.end(), [](const std::shared_ptr<rest_connection> & c) { return !c->_stats.busy; });
+    if (!reusable || !conn->is_open() || idle > _max_idle)
+    {
+        conn->close();
+        list.erase(it);
+    }
+    return true;
+}
+
+AEGIS_DECL pool_stats connection_pool::get_stats() const
+{
+    std::lock_guard<std::mutex> l(_m);
+    pool_stats stats = _stats;
+    for (auto & list : _connections)
+        for (auto & c : list.second)
+            stats.connections.push_back(c->_stats);
+    return stats;
+}
+
+AEGIS_DECL void connection_pool::clear() noexcept
+{
+    std::lock_guard<std::mutex> l(_m);
+    for (auto & list : _connections)
+    {
+        for (auto it = list.second.begin(); it != list.second.end();)
+        {
+            if ((*it)->_stats.busy)
+            {
+                ++it;
+                continue;
+            }
+            (*it)->close();
+            it = list.second.erase(it);
+        }
+    }
+    for (auto & session : _sessions)
+        SSL_SESSION_free(session.second);
+    _sessions.clear();
+}
+
+}
+
+}
@@ -18,6 +18,7 @@ namespace rest
 AEGIS_DECL rest_controller::rest_controller(const std::string & token, asio::io_context * _io_context)
     : _token(token)
     , _io_context(_io_context)
+    , _pool(*_io_context)
 {
 
 }
@@ -26,6 +27,7 @@ AEGIS_DECL rest_controller::rest_controller(const std::string & token, const std
     : _token(token)
     , _prefix(prefix)
     , _io_context(_io_context)
+    , _pool(*_io_context)
 {
 
 }
@@ -35,6 +37,7 @@ AEGIS_DECL rest_controller::rest_controller(const std::string & token, const std
     , _prefix(prefix)
     , _host(host)
     , _io_context(_io_context)
+    , _pool(*_io_context)
 {
 
 }
@@ -44,107 +47,174 @@ AEGIS_DECL rest_reply rest_controller::execute(rest::request_params && params)
     if (_host.empty() && params.host.empty())
         throw aegis::exception("REST host not set");
 
-    websocketpp::http::parser::response hresponse;
-
-    int32_t limit = 0;
-    int32_t remaining = 0;
-    int64_t reset = 0;
-    int32_t retry = 0;
-    std::chrono::system_clock::time_point http_date;
-    bool global = false;
+    http_response hresponse;
 
     auto start_time = std::chrono::steady_clock::now();
- 
+
     try
     {
-        asio::ip::basic_resolver<asio::ip::tcp>::results_type r;
-
         const std::string & tar_host = params.host.empty() ? _host : params.host;
 
-        //TODO: make cache expire?
-        auto it = _resolver_cache.find(tar_host);
-        if (it == _resolver_cache.end())
-        {
-            asio::ip::tcp::resolver resolver(*_io_context);
-            r = resolver.resolve(tar_host, params.port);
-            _resolver_cache.emplace(tar_host, r);
-        }
-        else
-            r = it->second;
+        auto r = _resolve(tar_host, params.port);
 
-        asio::ssl::context ctx(asio::ssl::context::tlsv12);
+        hresponse = _pool.perform(tar_host, params.port, r, _build_request(params, tar_host));
+    }
+    catch (std::exception& e)
+    {
+        std::cout << "Exception: " << e.what() << "\n";
+    }
 
-        ctx.set_options(
-            asio::ssl::context::default_workarounds
-            | asio::ssl::context::no_sslv2
-            | asio::ssl::context::no_sslv3);
+    return _make_reply(hresponse, start_time);
+}
 
-        asio::ssl::stream<asio::ip::tcp::socket> socket(*_io_context, ctx);
-        SSL_set_tlsext_host_name(socket.native_handle(), tar_host.data());
+AEGIS_DECL void rest_controller::async_execute(rest::request_params && params, rest_handler handler)
+{
+    if (_host.empty() && params.host.empty())
+    {
+        handler(rest_reply("REST host not set", http_code::unknown));
+        return;
+    }
 
-        asio::connect(socket.lowest_layer(), r);
+    auto start_time = std::chrono::steady_clock::now();
 
-        asio::error_code handshake_ec;
-        socket.handshake(asio::ssl::stream_base::client, handshake_ec);
+    const std::string tar_host = params.host.empty() ? _host : params.host;
+    const std::string port = params.port;
 
-        asio::streambuf request;
-        std::ostream request_stream(&request);
-        request_stream << get_method(params.method) << " " << _prefix << params.path << params._path_ex << " HTTP/1.0\r\n";
-        request_stream << "Host: " << tar_host << "\r\n";
-        request_stream << "Accept: */*\r\n";
-        request_stream << "Authorization: Bot " << _token << "\r\n";
-        request_stream << "User-Agent: DiscordBot (https://github.com/zeroxs/aegis.cpp, " << AEGIS_VERSION_LONG << ")\r\n";
+    std::shared_ptr<const std::string> request;
+    try
+    {
+        request = std::make_shared<const std::string>(_build_request(params, tar_host));
+    }
+    catch (std::exception & e)
+    {
+        std::cout << "Exception: " << e.what() << "\n";
+        handler(_make_reply(http_response(), start_time));
+        return;
+    }
 
-        if (params.file.has_value())
+    auto perform = [this, tar_host, port, request, start_time, handler](const asio::ip::tcp::resolver::results_type & r)
+    {
+        _pool.async_perform(tar_host, port, r, request, [this, start_time, handler](const asio::error_code & ec, http_response hresponse)
         {
-            auto & file = params.file.value();
-            std::string boundary{ utility::random_string(20) };
-            std::stringstream ss;
+            if (ec)
+                std::cout << "Exception: " << ec.message() << "\n";
+            handler(_make_reply(hresponse, start_time));
+        });
+    };
+
+    asio::ip::tcp::resolver::results_type r;
+    bool cached = false;
+    {
+        std::lock_guard<std::mutex> l(_resolver_m);
+        auto it = _resolver_cache.find(tar_host);
+        if (it != _resolver_cache.end())
+        {
+            r = it->second;
+            cached = true;
+        }
+    }
 
-            request_stream << "Content-Type: multipart/form-data; boundary=" << boundary << "\r\n";
+    if (cached)
+    {
+        perform(r);
+        return;
+    }
 
-            ss << "--" << boundary << "\r\n";
-            ss << R"(Content-Disposition: form-data; name="file"; filename=")" << utility::escape_quotes(file.name) << "\"\r\n";
-            request_stream << "Connection: close\r\n";
-            if (!file.content_type.empty())
-            {
-                ss << "Content-Type: " << file.content_type << "\r\n\r\n";
-            }
-            else
-            {
-                ss << "Content-Type: " << utility::guess_mime_type(file.name) << "\r\n\r\n";
-            }
-            ss.write(file.data.data(), file.data.size());
-            ss << "\r\n";
+    auto resolver = std::make_shared<asio::ip::tcp::resolver>(*_io_context);
+    resolver->async_resolve(tar_host, port, [this, resolver, tar_host, perform, handler, start_time](const asio::error_code & ec, asio::ip::tcp::resolver::results_type r)
+    {
+        if (ec)
+        {
+            std::cout << "Exception: " << ec.message() << "\n";
+            handler(_make_reply(http_response(), start_time));
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> l(_resolver_m);
+            _resolver_cache.emplace(tar_host, r);
+        }
+        perform(r);
+    });
+}
 
-            ss << "--" << boundary << "--";
+AEGIS_DECL asio::ip::tcp::resolver::results_type rest_controller::_resolve(const std::string & host, const std::string & port)
+{
+    //TODO: make cache expire?
+    {
+        std::lock_guard<std::mutex> l(_resolver_m);
+        auto it = _resolver_cache.find(host);
+        if (it != _resolver_cache.end())
+            return it->second;
+    }
 
-            request_stream << "Content-Length: " << ss.str().length() << "\r\n\r\n";
-            request_stream << ss.str();
-        }
-        else if (!params.body.empty() || params.method == Post || params.method == Put || params.method == Patch)
+    asio::ip::tcp::resolver resolver(*_io_context);
+    auto r = resolver.resolve(host, port);
+
+    std::lock_guard<std::mutex> l(_resolver_m);
+    _resolver_cache.emplace(host, r);
+    return r;
+}
+
+AEGIS_DECL std::string rest_controller::_build_request(const rest::request_params & params, const std::string & tar_host) const
+{
+    std::stringstream request_stream;
+    request_stream << get_method(params.method) << " " << _prefix << params.path << params._path_ex << " HTTP/1.1\r\n";
+    request_stream << "Host: " << tar_host << "\r\n";
+    request_stream << "Accept: */*\r\n";
+    request_stream << "Authorization: Bot " << _token << "\r\n";
+    request_stream << "User-Agent: DiscordBot (https://github.com/zeroxs/aegis.cpp, " << AEGIS_VERSION_LONG << ")\r\n";
+
+    if (params.file.has_value())
+    {
+        auto & file = params.file.value();
+        std::string boundary{ utility::random_string(20) };
+        std::stringstream ss;
+
+        request_stream << "Content-Type: multipart/form-data; boundary=" << boundary << "\r\n";
+
+        ss << "--" << boundary << "\r\n";
+        ss << R"(Content-Disposition: form-data; name="file"; filename=")" << utility::escape_quotes(file.name) << "\"\r\n";
+        request_stream << "Connection: keep-alive\r\n";
+        if (!file.content_type.empty())
         {
-            request_stream << "Content-Length: " << params.body.size() << "\r\n";
-            request_stream << "Connection: close\r\n";
-            request_stream << "Content-Type: application/json\r\n\r\n";
-            request_stream << params.body;
+            ss << "Content-Type: " << file.content_type << "\r\n\r\n";
         }
         else
-            request_stream << "Connection: close\r\n\r\n";
+        {
+            ss << "Content-Type: " << utility::guess_mime_type(file.name) << "\r\n\r\n";
+        }
+        ss.write(file.data.data(), file.data.size());
+        ss << "\r\n";
 
-        asio::write(socket, request);
-        asio::streambuf response;
-        asio::read_until(socket, response, "\r\n");
-        std::stringstream response_content;
-        response_content << &response;
+        ss << "--" << boundary << "--";
 
-        asio::error_code error;
-        while (asio::read(socket, response, asio::transfer_at_least(1), error))
-            response_content << &response;
+        request_stream << "Content-Length: " << ss.str().length() << "\r\n\r\n";
+        request_stream << ss.str();
+    }
+    else if (!params.body.empty() || params.method == Post || params.method == Put || params.method == Patch)
+    {
+        request_stream << "Content-Length: " << params.body.size() << "\r\n";
+        request_stream << "Connection: keep-alive\r\n";
+        request_stream << "Content-Type: application/json\r\n\r\n";
+        request_stream << params.body;
+    }
+    else
+        request_stream << "Connection: keep-alive\r\n\r\n";
 
-        std::istringstream istrm(response_content.str());
-        hresponse.consume(istrm);
+    return request_stream.str();
+}
+
+AEGIS_DECL rest_reply rest_controller::_make_reply(const http_response & hresponse, std::chrono::steady_clock::time_point start_time) const
+{
+    int32_t limit = 0;
+    int32_t remaining = 0;
+    int64_t reset = 0;
+    int32_t retry = 0;
+    std::chrono::system_clock::time_point http_date;
+    bool global = false;
 
+    try
+    {
         auto test = hresponse.get_header("X-RateLimit-Limit");
         if (!test.empty())
             limit = std::stoul(test);
@@ -158,26 +228,26 @@ AEGIS_DECL rest_reply rest_controller::execute(rest::request_params && params)
         if (!test.empty())
             retry = std::stoul(test);
 
-        http_date = utility::from_http_date(hresponse.get_header("Date")) - _tz_bias;
+        if (!hresponse.get_header("Date").empty())
+            http_date = utility::from_http_date(hresponse.get_header("Date")) - _tz_bias;
 
         global = !(hresponse.get_header("X-RateLimit-Global").empty());
-
-#if defined(AEGIS_PROFILING)
-        if (rest_end)
-            rest_end(start_time, static_cast<uint16_t>(hresponse.get_status_code()));
-#endif
-
-        if (error != asio::error::eof && error != asio::ssl::error::stream_truncated)
-            throw asio::system_error(error);
     }
     catch (std::exception& e)
     {
         std::cout << "Exception: " << e.what() << "\n";
     }
 
-    return { static_cast<http_code>(hresponse.get_status_code()),
+#if defined(AEGIS_PROFILING)
+    if (rest_end && hresponse.get_status_code() != 0)
+        rest_end(start_time, static_cast<uint16_t>(hresponse.get_status_code()));
+#endif
+
+    rest_reply reply{ static_cast<http_code>(hresponse.get_status_code()),
         global, limit, remaining, reset, retry, hresponse.get_body(), http_date,
         std::chrono::steady_clock::now() - start_time };
+    reply.bucket = hresponse.get_header("X-RateLimit-Bucket");
+    return reply;
 }
 
 AEGIS_DECL rest_reply rest_controller::execute2(rest::request_params && params)
@@ -198,42 +268,14 @@ AEGIS_DECL rest_reply rest_controller::execute2(rest::request_params && params)
     
     try
     {
-        asio::ip::basic_resolver<asio::ip::tcp>::results_type r;
-
         const std::string & tar_host = params.host.empty() ? _host : params.host;
 
-        //TODO: make cache expire?
-        auto it = _resolver_cache.find(tar_host);
-        if (it == _resolver_cache.end())
-        {
-            asio::ip::tcp::resolver resolver(*_io_context);
-            r = resolver.resolve(tar_host, params.port);
-            _resolver_cache.emplace(tar_host, r);
-        }
-        else
-            r = it->second;
-
+        auto r = _resolve(tar_host, params.port);
 
         if (params.port == "443")
         {
-            asio::ssl::context ctx(asio::ssl::context::tlsv12);
-
-            ctx.set_options(
-                asio::ssl::context::default_workarounds
-                | asio::ssl::context::no_sslv2
-                | asio::ssl::context::no_sslv3);
-
-            asio::ssl::stream<asio::ip::tcp::socket> socket(*_io_context, ctx);
-            SSL_set_tlsext_host_name(socket.native_handle(), tar_host.data());
-
-            asio::connect(socket.lowest_layer(), r);
-
-            asio::error_code handshake_ec;
-            socket.handshake(asio::ssl::stream_base::client, handshake_ec);
-
-            asio::streambuf request;
-            std::ostream request_stream(&request);
-            request_stream << get_method(params.method) << " " << (!params.path.empty() ? params.path : "/") << " HTTP/1.0\r\n";
+            std::stringstream request_stream;
+            request_stream << get_method(params.method) << " " << (!params.path.empty() ? params.path : "/") << " HTTP/1.1\r\n";
             request_stream << "Host: " << tar_host << "\r\n";
             request_stream << "Accept: */*\r\n";
             for (auto & h : params.headers)
@@ -241,33 +283,21 @@ AEGIS_DECL rest_reply rest_controller::execute2(rest::request_params && params)
 
             if (!params.body.empty() || params.method == Post || params.method == Put || params.method == Patch)
             {
-                request_stream << "Connection: close\r\n";
+                request_stream << "Connection: keep-alive\r\n";
                 request_stream << "Content-Length: " << params.body.size() << "\r\n";
                 request_stream << "Content-Type: application/json\r\n\r\n";
                 request_stream << params.body;
             }
             else
-                request_stream << "Connection: close\r\n\r\n";
+                request_stream << "Connection: keep-alive\r\n\r\n";
 
-            asio::write(socket, request);
-            asio::streambuf response;
-            asio::read_until(socket, response, "\r\n");
-            std::stringstream response_content;
-            response_content << &response;
+            http_response reply = _pool.perform(tar_host, params.port, r, request_stream.str());
 
-            asio::error_code error;
-            while (asio::read(socket, response, asio::transfer_at_least(1), error))
-                response_content << &response;
+            http_date = utility::from_http_date(reply.get_header("Date"));
 
-            std::istringstream istrm(response_content.str());
-            hresponse.consume(istrm);
-
-            http_date = utility::from_http_date(hresponse.get_header("Date"));
-
-            if (error != asio::error::eof && error != asio::ssl::error::stream_truncated)
-                throw asio::system_error(error);
-
-            //TODO: return reply headers
+            return { static_cast<http_code>(reply.get_status_code()),
+                global, limit, remaining, reset, retry, reply.get_body(), http_date,
+                std::chrono::steady_clock::now() - start_time };
         }
         else
         {
@@ -30,10 +30,12 @@
 #endif
 
 #include "aegis/rest/rest_reply.hpp"
+#include "aegis/rest/connection_pool.hpp"
 
 #include <string>
 #include <map>
 #include <functional>
+#include <mutex>
 
 namespace aegis
 {
@@ -73,6 +75,9 @@ struct request_params
 class rest_controller
 {
 public:
+    /// Completion handler type for async_execute
+    using rest_handler = std::function<void(rest_reply reply)>;
+
     AEGIS_DECL rest_controller(const std::string & token, asio::io_context * _io_context);
     AEGIS_DECL rest_controller(const std::string & token, const std::string & prefix, asio::io_context * _io_context);
     AEGIS_DECL rest_controller(const std::string & token, const std::string & prefix, const std::string & host, asio::io_context * _io_context);
@@ -102,6 +107,17 @@ public:
      */
     AEGIS_DECL rest_reply execute2(rest::request_params && params);
 
+    /// Performs an HTTP request using the params provided without blocking the calling thread
+    /**
+     * Name resolution, connecting and reading the reply are all driven by the io_context.
+     * Errors are reported through the reply the same way execute() reports them.
+     * @see rest::rest_reply
+     * @see rest::request_params
+     * @param params A struct of HTTP parameters to perform the request
+     * @param handler Called on an io_context thread with the reply
+     */
+    AEGIS_DECL void async_execute(rest::request_params && params, rest_handler handler);
+
     static std::string get_method(RequestMethod method) noexcept
     {
         switch (method)
@@ -125,6 +141,15 @@ public:
         _prefix = prefix;
     }
 
+    /// Get the pool of persistent connections used for REST requests
+    /**
+     * @returns connection_pool
+     */
+    connection_pool & get_connection_pool() noexcept
+    {
+        return _pool;
+    }
+
     std::chrono::hours tz_bias()
     {
         return _tz_bias;
@@ -137,14 +162,25 @@ public:
 
 private:
     friend aegis::core;
+
+    /// Resolve a host, caching the result
+    AEGIS_DECL asio::ip::tcp::resolver::results_type _resolve(const std::string & host, const std::string & port);
+
+    /// Serialize a Discord API request
+    AEGIS_DECL std::string _build_request(const rest::request_params & params, const std::string & tar_host) const;
+
+    /// Convert a raw HTTP response to a rest_reply, parsing ratelimit headers
+    AEGIS_DECL rest_reply _make_reply(const http_response & hresponse, std::chrono::steady_clock::time_point start_time) const;
     std::string _token;
     std::string _prefix;
     std::string _host;
     std::unordered_map<std::string, asio::ip::basic_resolver<asio::ip::tcp>::results_type> _resolver_cache;
+    std::mutex _resolver_m;
 
     using rest_end_t = std::function<void(std::chrono::steady_clock::time_point, uint16_t)>;
     rest_end_t rest_end;
     asio::io_context * _io_context = nullptr;
+    connection_pool _pool;
     std::chrono::hours _tz_bias = 0h;
 };
 
@@ -173,6 +173,8 @@ public:
     //bool permissions = true; /**< Whether the call had proper permissions */
     std::chrono::system_clock::time_point date; /**< Current time from the remote server */
     std::chrono::steady_clock::duration execution_time; /**< Time it took to perform the request */
+    std::chrono::steady_clock::duration queue_time = std::chrono::steady_clock::duration::zero(); /**< Time the request waited in its ratelimit bucket, over every attempt */
+    std::string bucket; /**< X-RateLimit-Bucket hash identifying the ratelimit this request counts against */
     //TODO: std::map<std::string, std::string> headers; /**< Reply headers */
 };
 
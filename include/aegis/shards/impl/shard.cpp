@@ -88,8 +88,7 @@ AEGIS_DECL void shard::_reset()
     delayedauth.cancel();
     keepalivetimer.cancel();
     write_timer.cancel();
-    ws_buffer.str("");
-    zlib_ctx.reset();
+    _zlib.end();
     _trace.clear();
 }
 
@@ -128,7 +127,7 @@ AEGIS_DECL void shard::set_connected()
     if (!state_valid())
         return;
     using namespace std::chrono_literals;
-    if (zlib_ctx)
+    if (_zlib.is_init())
     {
         //already has an existing context
         throw aegis::exception("set_connected() zlib context already exists");
@@ -138,8 +137,7 @@ AEGIS_DECL void shard::set_connected()
         //error
         throw aegis::exception("set_connected() connection = nullptr");
     }
-    ws_buffer.str("");
-    zlib_ctx = std::make_unique<zstr::istream>(ws_buffer);
+    _zlib.init();
     write_timer.cancel();
     write_timer.expires_after(600ms);
     write_timer.async_wait(asio::bind_executor(*_connection->get_strand(), std::bind(&shard::process_writes, this, std::placeholders::_1)));
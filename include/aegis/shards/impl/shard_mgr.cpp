@@ -138,66 +138,55 @@ AEGIS_DECL void shard_mgr::_on_message(websocketpp::connection_hdl hdl, message_
 
     _shard->lastwsevent = std::chrono::steady_clock::now();
 
-    std::string payload;
-
     try
     {
         //zlib detection and decoding
-        _shard->ws_buffer.clear();
-        _shard->ws_buffer.str("");
-        _shard->ws_buffer << msg->get_payload();
-
         const std::string & pld = msg->get_payload();
-        if (std::strcmp((pld.data() + pld.size() - 4), "\x00\x00\xff\xff"))
+
+        //DEBUG
+        if (!_shard->_zlib.is_init())
         {
-            log->error("Shard#{}: zlib-stream incomplete", _shard->get_id());
+            log->error("Shard#{}: zlib failure. Context null.", _shard->get_id());
+            close(*_shard, 1001, "", aegis::shard_status::reconnecting);
             return;
         }
 
-        try
+        const auto res = _shard->_zlib.feed(pld.data(), pld.size());
+        if (res == zlib_stream::result::partial)
         {
-            std::stringstream ss;
-            std::string s;
-            //DEBUG
-            if (_shard->zlib_ctx == nullptr)
-            {
-                log->error("Shard#{}: zlib failure. Context null.", _shard->get_id());
-                close(*_shard, 1001, "", aegis::shard_status::reconnecting);
-                return;
-            }
-            _shard->zlib_ctx->clear();
-            while (getline(*_shard->zlib_ctx, s))
-                ss << s;
-            ss << '\0';
-            payload = ss.str();
-            _shard->transfer_bytes_u += payload.size();
+            // held until a payload ends with the Z_SYNC_FLUSH suffix
+            AEGIS_TRACE(log, "Shard#{}: zlib-stream incomplete, {} bytes pending", _shard->get_id(), _shard->_zlib.pending());
+            return;
         }
-        catch (std::exception & e)
+        if (res == zlib_stream::result::error)
         {
-            log->error("Shard#{}: zlib failure. Context invalid. {}", _shard->get_id(), e.what());
+            log->error("Shard#{}: zlib failure. Context invalid. {}", _shard->get_id(), _shard->_zlib.error());
             close(*_shard, 1001, "", aegis::shard_status::reconnecting);
             return;
         }
+        _shard->transfer_bytes_u += _shard->_zlib.size();
     }
     catch (std::exception& e)
     {
         log->error("Failed to process object: {0}", e.what());
-        log->error(payload);
+        log->error(std::string(_shard->_zlib.data(), _shard->_zlib.size()));
 
         debug_trace(_shard);
+        return;
     }
     catch (...)
     {
         log->error("Failed to process object: Unknown error");
         debug_trace(_shard);
+        return;
     }
 
 #if defined(AEGIS_DEBUG_HISTORY)
-    _shard->debug_messages.emplace_back(std::tuple<std::chrono::steady_clock::time_point, std::string>{ std::chrono::steady_clock::now(), payload });
+    _shard->debug_messages.emplace_back(std::tuple<std::chrono::steady_clock::time_point, std::string>{ std::chrono::steady_clock::now(), std::string(_shard->_zlib.data(), _shard->_zlib.size()) });
 #endif
 
     if (i_on_message)
-        i_on_message(hdl, std::move(payload), _shard);
+        i_on_message(hdl, _shard->_zlib.data(), _shard->_zlib.size(), _shard);
 }
 
 AEGIS_DECL void shard_mgr::_on_connect(websocketpp::connection_hdl hdl, shard * _shard)
@@ -0,0 +1,130 @@
+//
+// zlib_stream.cpp
+// ***************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#include "aegis/shards/zlib_stream.hpp"
+#include "aegis/error.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace aegis
+{
+
+namespace shards
+{
+
+AEGIS_DECL zlib_stream::~zlib_stream()
+{
+    end();
+}
+
+AEGIS_DECL void zlib_stream::init()
+{
+    if (_init)
+        throw aegis::exception("zlib_stream::init() context already exists");
+    _ctx.zalloc = Z_NULL;
+    _ctx.zfree = Z_NULL;
+    _ctx.opaque = Z_NULL;
+    _ctx.next_in = Z_NULL;
+    _ctx.avail_in = 0;
+    if (inflateInit(&_ctx) != Z_OK)
+        throw aegis::exception("zlib_stream::init() failed to initialize zlib context");
+    _init = true;
+    _size = 0;
+}
+
+AEGIS_DECL void zlib_stream::end() noexcept
+{
+    if (_init)
+    {
+        inflateEnd(&_ctx);
+        _init = false;
+    }
+    _size = 0;
+    _pending.clear();
+}
+
+AEGIS_DECL zlib_stream::result zlib_stream::feed(const char * payload, std::size_t len) noexcept
+{
+    const auto has_suffix = [](const char * p, std::size_t l)
+    {
+        return l >= 4 && std::memcmp(p + l - 4, "\x00\x00\xff\xff", 4) == 0;
+    };
+
+    if (_pending.empty() && has_suffix(payload, len))
+        return inflate(payload, len) ? result::inflated : result::error;
+
+    try
+    {
+        _pending.append(payload, len);
+    }
+    catch (...)
+    {
+        return result::error;
+    }
+    _size = 0;
+    if (!has_suffix(_pending.data(), _pending.size()))
+        return result::partial;
+
+    // clear() keeps the capacity for the next split message
+    const bool ok = inflate(_pending.data(), _pending.size());
+    _pending.clear();
+    return ok ? result::inflated : result::error;
+}
+
+AEGIS_DECL bool zlib_stream::inflate(const char * frame, std::size_t len) noexcept
+{
+    _size = 0;
+    if (!_init)
+        return false;
+
+    try
+    {
+        _ctx.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(frame));
+        _ctx.avail_in = static_cast<uInt>(len);
+
+        // only ever grow, so the buffer stays at its high-water size
+        if (_buffer.size() < len * 4)
+            _buffer.resize(std::max<std::size_t>(len * 4, 4096));
+
+        std::size_t used = 0;
+        while (true)
+        {
+            _ctx.next_out = reinterpret_cast<Bytef *>(&_buffer[used]);
+            _ctx.avail_out = static_cast<uInt>(_buffer.size() - used);
+
+            int ret = ::inflate(&_ctx, Z_SYNC_FLUSH);
+            used = _buffer.size() - _ctx.avail_out;
+
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+                return false;
+
+            // output space exhausted, grow and continue flushing
+            if (_ctx.avail_out == 0)
+            {
+                _buffer.resize(_buffer.size() * 2);
+                continue;
+            }
+
+            if (_ctx.avail_in == 0 || ret != Z_OK)
+                break;
+        }
+
+        _size = used;
+        return true;
+    }
+    catch (...)
+    {
+        // out of memory growing the buffer
+        return false;
+    }
+}
+
+}
+
+}
@@ -27,10 +27,13 @@
 
 #include <memory>
 #include <map>
+#include <array>
+#include <atomic>
 #include <string>
 #include <chrono>
 #include <stdint.h>
-#include "aegis/zstr/zstr.hpp"
+#include "aegis/shards/zlib_stream.hpp"
+#include "aegis/gateway/events/event_type.hpp"
 #include "aegis/gateway/objects/presence.hpp"
 #include "aegis/gateway/objects/activity.hpp"
 
@@ -52,6 +55,9 @@ public:
     /// Constructs a shard object for connecting to the websocket gateway and tracking timers
     AEGIS_DECL shard(asio::io_context & _io, websocketpp::client<websocketpp::config::asio_tls_client> & _ws, int32_t id);
 
+    shard(const shard &) = delete;
+    shard & operator=(const shard &) = delete;
+
     /// Resets connection, heartbeat, and timer related objects to allow reconnection
     AEGIS_DECL void do_reset(shard_status _status = shard_status::closed) noexcept;
 
@@ -257,8 +263,8 @@ private:
 
     websocketpp::client<websocketpp::config::asio_tls_client> & _websocket;
 
-    std::stringstream ws_buffer;
-    std::unique_ptr<zstr::istream> zlib_ctx;
+    /// zlib-stream inflate context. Lives for the duration of a gateway connection
+    zlib_stream _zlib;
 
     // Websocket++ socket connection
     websocketpp::connection_hdl hdl;
@@ -266,6 +272,17 @@ private:
     std::shared_ptr<asio::io_context::strand> _strand;
 
     heartbeat_status _heartbeat_status = heartbeat_status::normal;
+
+    /// Latency histograms of one event type on this shard, looked up by core on first use
+    struct event_histograms
+    {
+        std::atomic<latency_histogram *> parse{ nullptr };
+        std::atomic<latency_histogram *> queue{ nullptr };
+        std::atomic<latency_histogram *> handler{ nullptr };
+    };
+
+    /// Indexed by gateway::events::event_type
+    std::array<event_histograms, gateway::events::event_type_count> _event_histograms;
 };
 
 }
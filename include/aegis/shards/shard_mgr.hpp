@@ -149,7 +149,11 @@ public:
     AEGIS_DECL void start();
 
     /// Websocket on_message handler type
-    using t_on_message = std::function<void(websocketpp::connection_hdl hdl, std::string msg, shard * _shard)>;
+    /**
+     * data refers to the shard's decompression buffer, is not null terminated and is only
+     * valid for the duration of the call
+     */
+    using t_on_message = std::function<void(websocketpp::connection_hdl hdl, const char * data, std::size_t len, shard * _shard)>;
     /// Websocket on_connect handler type
     using t_on_connect = std::function<void(websocketpp::connection_hdl hdl, shard * _shard)>;
     /// Websocket on_close handler type
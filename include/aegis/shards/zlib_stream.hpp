@@ -0,0 +1,123 @@
+//
+// zlib_stream.hpp
+// ***************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#pragma once
+
+#include "aegis/config.hpp"
+#include <cstddef>
+#include <string>
+#include <zlib.h>
+
+namespace aegis
+{
+
+namespace shards
+{
+
+/// Inflate context of one zlib-stream gateway connection
+/**
+ * The output buffer is kept at the largest size any frame has needed and is only grown,
+ * never shrunk or cleared between frames, so a small frame after a large one does not
+ * touch more memory than it inflates to. The inflated length is tracked separately in
+ * size().
+ *
+ * A message may arrive split over several websocket payloads. Payloads are held back
+ * until one ends with the Z_SYNC_FLUSH suffix and the message is inflated as a whole.
+ */
+class zlib_stream
+{
+public:
+    /// Outcome of feed()
+    enum class result
+    {
+        partial, /**< Payload held back until the rest of the message arrives */
+        inflated, /**< A complete message was inflated into data() */
+        error /**< The stream is broken and the connection must be restarted */
+    };
+
+    zlib_stream() noexcept = default;
+    AEGIS_DECL ~zlib_stream();
+    zlib_stream(const zlib_stream &) = delete;
+    zlib_stream & operator=(const zlib_stream &) = delete;
+
+    /// Start a new stream. Throws aegis::exception if one is already running or zlib fails
+    AEGIS_DECL void init();
+
+    /// End the stream and drop the inflated and held back data. Buffers keep their size
+    AEGIS_DECL void end() noexcept;
+
+    /// Whether init() has been called since the last end()
+    bool is_init() const noexcept
+    {
+        return _init;
+    }
+
+    /// Feed one websocket payload of the stream
+    /**
+     * @param payload Compressed payload
+     * @param len Length of the payload
+     * @returns Whether a message was inflated, is still incomplete or failed
+     */
+    AEGIS_DECL result feed(const char * payload, std::size_t len) noexcept;
+
+    /// Number of bytes held back waiting for the Z_SYNC_FLUSH suffix
+    std::size_t pending() const noexcept
+    {
+        return _pending.size();
+    }
+
+    /// Inflate a complete frame
+    /**
+     * Caller must verify the frame ends with the Z_SYNC_FLUSH suffix. The inflated data is
+     * available from data() and size() until the next frame is inflated.
+     * @param frame Compressed frame
+     * @param len Length of the frame
+     * @returns true if the frame was inflated successfully
+     */
+    AEGIS_DECL bool inflate(const char * frame, std::size_t len) noexcept;
+
+    /// Inflated data of the last frame. Not null terminated
+    const char * data() const noexcept
+    {
+        return _buffer.data();
+    }
+
+    /// Length of the inflated data of the last frame
+    std::size_t size() const noexcept
+    {
+        return _size;
+    }
+
+    /// Size of the output buffer, the largest inflated frame so far rounded up
+    std::size_t capacity() const noexcept
+    {
+        return _buffer.size();
+    }
+
+    /// zlib message of the last failure, empty if there is none
+    const char * error() const noexcept
+    {
+        return (_init && _ctx.msg) ? _ctx.msg : "";
+    }
+
+private:
+    z_stream _ctx;
+    bool _init = false;
+    std::string _buffer;
+    std::size_t _size = 0;
+    std::string _pending;
+};
+
+}
+
+}
+
+#if defined(AEGIS_HEADER_ONLY)
+#include "aegis/shards/impl/zlib_stream.cpp"
+#endif
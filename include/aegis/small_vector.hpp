@@ -0,0 +1,242 @@
+//
+// small_vector.hpp
+// ****************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#pragma once
+
+#include "aegis/config.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace aegis
+{
+
+/// Contiguous vector that stores up to N elements inline before allocating
+/**
+ * Drop-in for the subset of std::vector used by the caches. Iterators and references
+ * are invalidated by any insertion or removal, including while still inline.
+ * @tparam T Element type
+ * @tparam N Number of elements stored without a heap allocation
+ */
+template<typename T, std::size_t N>
+class small_vector
+{
+    static_assert(N > 0, "small_vector needs at least one inline element");
+
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using iterator = T *;
+    using const_iterator = const T *;
+    using reference = T &;
+    using const_reference = const T &;
+
+    small_vector() noexcept = default;
+
+    small_vector(std::initializer_list<T> init)
+    {
+        reserve(init.size());
+        for (auto & v : init)
+            emplace_back(v);
+    }
+
+    small_vector(const small_vector & other)
+    {
+        reserve(other._size);
+        for (auto & v : other)
+            emplace_back(v);
+    }
+
+    small_vector(small_vector && other) noexcept
+    {
+        _take(std::move(other));
+    }
+
+    small_vector & operator=(const small_vector & other)
+    {
+        if (this != &other)
+        {
+            clear();
+            reserve(other._size);
+            for (auto & v : other)
+                emplace_back(v);
+        }
+        return *this;
+    }
+
+    small_vector & operator=(small_vector && other) noexcept
+    {
+        if (this != &other)
+        {
+            _release();
+            _take(std::move(other));
+        }
+        return *this;
+    }
+
+    ~small_vector()
+    {
+        _release();
+    }
+
+    iterator begin() noexcept { return _data; }
+    iterator end() noexcept { return _data + _size; }
+    const_iterator begin() const noexcept { return _data; }
+    const_iterator end() const noexcept { return _data + _size; }
+    const_iterator cbegin() const noexcept { return _data; }
+    const_iterator cend() const noexcept { return _data + _size; }
+
+    T * data() noexcept { return _data; }
+    const T * data() const noexcept { return _data; }
+
+    size_type size() const noexcept { return _size; }
+    size_type capacity() const noexcept { return _capacity; }
+    bool empty() const noexcept { return _size == 0; }
+
+    /// Whether the elements are still stored inline
+    bool is_inline() const noexcept { return _data == _inline_data(); }
+
+    T & operator[](size_type i) noexcept { return _data[i]; }
+    const T & operator[](size_type i) const noexcept { return _data[i]; }
+    T & front() noexcept { return _data[0]; }
+    const T & front() const noexcept { return _data[0]; }
+    T & back() noexcept { return _data[_size - 1]; }
+    const T & back() const noexcept { return _data[_size - 1]; }
+
+    void reserve(size_type cap)
+    {
+        if (cap <= _capacity)
+            return;
+        T * mem = static_cast<T *>(::operator new(cap * sizeof(T)));
+        for (size_type i = 0; i < _size; ++i)
+        {
+            ::new (static_cast<void *>(mem + i)) T(std::move(_data[i]));
+            _data[i].~T();
+        }
+        if (!is_inline())
+            ::operator delete(_data);
+        _data = mem;
+        _capacity = static_cast<uint32_t>(cap);
+    }
+
+    template<typename... Args>
+    T & emplace_back(Args &&... args)
+    {
+        if (_size == _capacity)
+        {
+            // args may refer into this vector, build the element before reallocating
+            T tmp(std::forward<Args>(args)...);
+            reserve(_capacity * 2);
+            ::new (static_cast<void *>(_data + _size)) T(std::move(tmp));
+            return _data[_size++];
+        }
+        ::new (static_cast<void *>(_data + _size)) T(std::forward<Args>(args)...);
+        return _data[_size++];
+    }
+
+    void push_back(const T & v) { emplace_back(v); }
+    void push_back(T && v) { emplace_back(std::move(v)); }
+
+    void pop_back() noexcept
+    {
+        _data[--_size].~T();
+    }
+
+    /// Construct an element in place before pos
+    /**
+     * @returns Iterator to the new element
+     */
+    template<typename... Args>
+    iterator emplace(const_iterator pos, Args &&... args)
+    {
+        size_type idx = static_cast<size_type>(pos - _data);
+        if (idx == _size)
+        {
+            emplace_back(std::forward<Args>(args)...);
+            return _data + idx;
+        }
+        T tmp(std::forward<Args>(args)...);
+        if (_size == _capacity)
+            reserve(_capacity * 2);
+        emplace_back(std::move(back()));
+        std::move_backward(_data + idx, _data + _size - 2, _data + _size - 1);
+        _data[idx] = std::move(tmp);
+        return _data + idx;
+    }
+
+    iterator insert(const_iterator pos, const T & v) { return emplace(pos, v); }
+    iterator insert(const_iterator pos, T && v) { return emplace(pos, std::move(v)); }
+
+    /// Remove the element at pos
+    /**
+     * @returns Iterator to the element that followed it
+     */
+    iterator erase(const_iterator pos) noexcept
+    {
+        iterator it = _data + (pos - _data);
+        std::move(it + 1, end(), it);
+        pop_back();
+        return it;
+    }
+
+    void clear() noexcept
+    {
+        for (size_type i = 0; i < _size; ++i)
+            _data[i].~T();
+        _size = 0;
+    }
+
+private:
+    T * _inline_data() noexcept { return reinterpret_cast<T *>(&_inline); }
+    const T * _inline_data() const noexcept { return reinterpret_cast<const T *>(&_inline); }
+
+    void _release() noexcept
+    {
+        clear();
+        if (!is_inline())
+            ::operator delete(_data);
+        _data = _inline_data();
+        _capacity = N;
+    }
+
+    void _take(small_vector && other) noexcept
+    {
+        if (other.is_inline())
+        {
+            _data = _inline_data();
+            _capacity = N;
+            for (uint32_t i = 0; i < other._size; ++i)
+                ::new (static_cast<void *>(_data + i)) T(std::move(other._data[i]));
+            _size = other._size;
+            other.clear();
+        }
+        else
+        {
+            _data = other._data;
+            _size = other._size;
+            _capacity = other._capacity;
+            other._data = other._inline_data();
+            other._size = 0;
+            other._capacity = N;
+        }
+    }
+
+    typename std::aligned_storage<sizeof(T) * N, alignof(T)>::type _inline;
+    T * _data = _inline_data();
+    uint32_t _size = 0;
+    uint32_t _capacity = N;
+};
+
+}
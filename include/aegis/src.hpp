@@ -41,8 +41,10 @@
 #include <aegis/impl/snowflake.cpp>
 
 #include <aegis/shards/impl/shard.cpp>
+#include <aegis/shards/impl/zlib_stream.cpp>
 #include <aegis/shards/impl/shard_mgr.cpp>
 
 #include <aegis/rest/impl/rest_controller.cpp>
+#include <aegis/rest/impl/connection_pool.cpp>
 
 #include <aegis/gateway/objects/impl/message.cpp>
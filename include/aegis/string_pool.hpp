@@ -0,0 +1,260 @@
+//
+// string_pool.hpp
+// ***************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#pragma once
+
+#include "aegis/config.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+namespace aegis
+{
+
+class string_pool;
+
+/// Reference counted handle to a string stored once in a string_pool
+/**
+ * Equal strings interned in the same pool share storage, so a handle costs one pointer
+ * regardless of the length of the string. A default constructed handle is empty. Copying
+ * a handle does not lock the pool.
+ */
+class interned_string
+{
+public:
+    interned_string() noexcept = default;
+
+    interned_string(const interned_string & other) noexcept;
+    interned_string & operator=(const interned_string & other) noexcept;
+
+    interned_string(interned_string && other) noexcept
+        : _entry(other._entry)
+    {
+        other._entry = nullptr;
+    }
+
+    interned_string & operator=(interned_string && other) noexcept
+    {
+        if (this != &other)
+        {
+            _release();
+            _entry = other._entry;
+            other._entry = nullptr;
+        }
+        return *this;
+    }
+
+    ~interned_string()
+    {
+        _release();
+    }
+
+    /// Whether this handle refers to no string
+    bool empty() const noexcept
+    {
+        return _entry == nullptr;
+    }
+
+    /// Get the string, or an empty string for an empty handle
+    const std::string & str() const noexcept;
+
+    operator const std::string &() const noexcept
+    {
+        return str();
+    }
+
+    /// Drop the reference held by this handle
+    void reset() noexcept
+    {
+        _release();
+    }
+
+private:
+    friend class string_pool;
+
+    struct entry
+    {
+        entry(string_pool * _pool, std::size_t _stripe) noexcept
+            : pool(_pool)
+            , stripe(_stripe)
+        {
+
+        }
+
+        string_pool * pool;
+        std::size_t stripe; /**< Index of the stripe of pool holding this entry */
+        const std::string * value = nullptr;
+        std::atomic<uint32_t> refs{ 0 };
+    };
+
+    explicit interned_string(entry * e) noexcept
+        : _entry(e)
+    {
+
+    }
+
+    inline void _release() noexcept;
+
+    entry * _entry = nullptr;
+};
+
+/// Deduplicating store of immutable strings
+/**
+ * Strings are kept for as long as an interned_string refers to them. A pool must outlive
+ * every handle it has returned; the global pool is never destroyed.
+ * The pool is striped by string hash like entity_cache, so threads interning different
+ * strings rarely wait on each other.
+ */
+class string_pool
+{
+public:
+    string_pool() = default;
+    string_pool(const string_pool &) = delete;
+    string_pool & operator=(const string_pool &) = delete;
+
+    /// Pool shared by all caches
+    static string_pool & global() noexcept
+    {
+        // never destroyed so handles in objects with static storage can still release
+        static string_pool * pool = new string_pool;
+        return *pool;
+    }
+
+    /// Get a handle to a string, adding it to the pool if not present
+    /**
+     * @param value String to intern. An empty string returns an empty handle
+     * @returns Handle to the pooled copy of value
+     */
+    interned_string intern(const std::string & value)
+    {
+        if (value.empty())
+            return {};
+        const std::size_t idx = _stripe_index(value);
+        auto & s = _stripes[idx];
+        std::lock_guard<std::mutex> l(s.m);
+        auto it = s.strings.find(value);
+        if (it == s.strings.end())
+        {
+            it = s.strings.emplace(std::piecewise_construct, std::forward_as_tuple(value), std::forward_as_tuple(this, idx)).first;
+            it->second.value = &it->first;
+        }
+        ++it->second.refs;
+        return interned_string(&it->second);
+    }
+
+    /// Number of distinct strings currently pooled
+    std::size_t size() const
+    {
+        std::size_t total = 0;
+        for (auto & s : _stripes)
+        {
+            std::lock_guard<std::mutex> l(s.m);
+            total += s.strings.size();
+        }
+        return total;
+    }
+
+    /// Bytes of string data currently pooled
+    std::size_t bytes() const
+    {
+        std::size_t total = 0;
+        for (auto & s : _stripes)
+        {
+            std::lock_guard<std::mutex> l(s.m);
+            for (auto & kv : s.strings)
+                total += kv.first.capacity();
+        }
+        return total;
+    }
+
+private:
+    friend class interned_string;
+
+    void _add_ref(interned_string::entry * e) noexcept
+    {
+        // the caller holds a reference, so the entry cannot be erased meanwhile
+        e->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void _release(interned_string::entry * e) noexcept
+    {
+        // only dropping what may be the last reference needs the lock, as intern() can
+        // revive an entry under it
+        uint32_t refs = e->refs.load(std::memory_order_relaxed);
+        while (refs > 1)
+        {
+            if (e->refs.compare_exchange_weak(refs, refs - 1, std::memory_order_release, std::memory_order_relaxed))
+                return;
+        }
+        auto & s = _stripes[e->stripe];
+        std::lock_guard<std::mutex> l(s.m);
+        if (e->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            s.strings.erase(s.strings.find(*e->value));
+    }
+
+    static constexpr std::size_t stripe_count = 64;
+
+    struct stripe
+    {
+        mutable std::mutex m;
+        std::unordered_map<std::string, interned_string::entry> strings;
+    };
+
+    static std::size_t _stripe_index(const std::string & value) noexcept
+    {
+        // take the high bits so the stripe does not follow the bucket the map picks
+        uint64_t h = static_cast<uint64_t>(std::hash<std::string>{}(value));
+        h *= 0x9E3779B97F4A7C15ull;
+        return static_cast<std::size_t>(h >> 58) & (stripe_count - 1);
+    }
+
+    std::array<stripe, stripe_count> _stripes;
+};
+
+inline interned_string::interned_string(const interned_string & other) noexcept
+    : _entry(other._entry)
+{
+    if (_entry)
+        _entry->pool->_add_ref(_entry);
+}
+
+inline interned_string & interned_string::operator=(const interned_string & other) noexcept
+{
+    if (_entry != other._entry)
+    {
+        _release();
+        _entry = other._entry;
+        if (_entry)
+            _entry->pool->_add_ref(_entry);
+    }
+    return *this;
+}
+
+inline const std::string & interned_string::str() const noexcept
+{
+    static const std::string none;
+    return _entry ? *_entry->value : none;
+}
+
+inline void interned_string::_release() noexcept
+{
+    if (_entry)
+    {
+        _entry->pool->_release(_entry);
+        _entry = nullptr;
+    }
+}
+
+}
@@ -15,7 +15,14 @@
 #include "aegis/snowflake.hpp"
 #include "aegis/gateway/objects/presence.hpp"
 #include "aegis/fwd.hpp"
+#include "aegis/small_vector.hpp"
+#include "aegis/string_pool.hpp"
+#include "aegis/avatar_hash.hpp"
+#include "aegis/cache_stats.hpp"
+#include "aegis/object_pool.hpp"
 #include <nlohmann/json.hpp>
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <queue>
 #include <memory>
@@ -42,13 +49,15 @@ public:
   
     explicit user(snowflake id) : _member_id(id) {}
 
+    AEGIS_POOLED_ENTITY(user)
+
     /// Member owned guild information
     struct guild_info
     {
         guild_info(snowflake _id) : id(_id) {};
         snowflake id;/**< Snowflake of the guild for this data */
-        std::vector<snowflake> roles;
-		lib::optional<std::string> nickname;/**< Nickname of the user in this guild */
+        small_vector<snowflake, 4> roles;/**< Roles of the user in this guild, including the everyone role */
+        interned_string nickname;/**< Nickname of the user in this guild, empty if none is set */
         uint64_t joined_at = 0;/**< Unix timestamp of when member joined this guild */
         bool deaf = false;/**< Whether member is deafened in a voice channel */
         bool mute = false;/**< Whether member is muted in a voice channel */
@@ -61,6 +70,13 @@ public:
      */
     AEGIS_DECL std::string get_name(snowflake guild_id) noexcept;
 
+    /// Get the nickname of this user without copying the string
+    /**
+     * @param guild_id The snowflake for the guild to check if nickname is set
+     * @returns Handle to the nickname, empty if no nickname is set
+     */
+    AEGIS_DECL interned_string get_name_nocopy(snowflake guild_id) const noexcept;
+
     /// Get the username of this user
     /**
      * @returns string of the username
@@ -68,8 +84,17 @@ public:
     std::string get_username() const noexcept
     {
         std::shared_lock<shared_mutex> l(_m);
-        std::string _username = _name;
-        return std::move(_username);
+        return _name.str();
+    }
+
+    /// Get the username of this user without copying the string
+    /**
+     * @returns Handle to the username
+     */
+    interned_string get_username_nocopy() const noexcept
+    {
+        std::shared_lock<shared_mutex> l(_m);
+        return _name;
     }
 
     /// Get the discriminator of this user
@@ -88,8 +113,17 @@ public:
     std::string get_avatar() const noexcept
     {
         std::shared_lock<shared_mutex> l(_m);
-        std::string t_avatar = _avatar;
-        return std::move(t_avatar);
+        return _avatar.str();
+    }
+
+    /// Get the packed avatar hash of this user
+    /**
+     * @returns avatar_hash of the avatar
+     */
+    avatar_hash get_avatar_nocopy() const noexcept
+    {
+        std::shared_lock<shared_mutex> l(_m);
+        return _avatar;
     }
 
     /// Check whether user is a bot
@@ -122,16 +156,29 @@ public:
      */
     AEGIS_DECL std::string get_nickname_mention() const noexcept;
 
-    /// Get the member owned guild information object
+    /// Get a copy of the member owned guild information object, creating it if needed
     /**
+     * Entries are stored inline and move when the user joins or leaves another guild, so a
+     * copy is returned. Use get_guild_info_nolock while holding the user mutex to modify it.
      * @param guild_id The snowflake for the guild
-     * @returns Pointer to the member owned guild information object
+     * @returns Copy of the member owned guild information object
      */
-    AEGIS_DECL guild_info & get_guild_info(snowflake guild_id) noexcept;
+    AEGIS_DECL guild_info get_guild_info(snowflake guild_id);
 
+    /// Get the member owned guild information object, creating it if needed, without locking
+    /**
+     * The reference is invalidated when the user joins or leaves another guild. Hold the
+     * user mutex exclusively while using it.
+     */
     AEGIS_DECL guild_info & get_guild_info_nolock(snowflake guild_id) noexcept;
 
-    AEGIS_DECL guild_info * get_guild_info_nocreate(snowflake guild_id) const noexcept;
+    /// Find the member owned guild information object
+    /**
+     * Takes a shared lock.
+     * @param guild_id The snowflake for the guild
+     * @returns Copy of the member owned guild information object or an empty optional
+     */
+    AEGIS_DECL lib::optional<guild_info> get_guild_info_nocreate(snowflake guild_id) const;
 
     /// Get the full name (username\#discriminator) of this user
     /**
@@ -195,13 +242,27 @@ private:
     snowflake _member_id = 0;
     snowflake _dm_id = 0;
     presence::user_status _status = presence::user_status::Offline; /**< Member _status */
-    std::string _name; /**< Username of member */
+    interned_string _name; /**< Username of member */
     uint16_t _discriminator = 0; /**< 4 digit discriminator (1-9999) */
-    std::string _avatar; /**< Hash of member avatar */
+    avatar_hash _avatar; /**< Hash of member avatar */
     bool _is_bot = false; /**< true if member is a bot */
     bool _mfa_enabled = false; /**< true if member has Two-factor authentication enabled */
-    std::vector<std::unique_ptr<guild_info>> guilds; /**< Vector of snowflakes to member owned guild information */
+    small_vector<guild_info, 1> guilds; /**< Member owned guild information, sorted by guild id */
     mutable shared_mutex _m;
+    std::atomic<int64_t> _last_seen{ 0 }; /**< steady_clock milliseconds when an event last referenced this user */
+    std::atomic<bool> _evicted{ false }; /**< Set once the cache policy evicts this user. Guilds no longer add it */
+
+    /// Mark this user as recently seen for the cache policy
+    void _touch() noexcept
+    {
+        _last_seen.store(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(), std::memory_order_relaxed);
+    }
+
+    /// Approximate heap and object size of this user. requires the caller to handle locking
+    AEGIS_DECL std::size_t _approx_bytes() const noexcept;
+
+    /// Add this user and its guild_info entries to stats. requires the caller to handle locking
+    AEGIS_DECL void _memory_usage(cache_memory_stats & stats) const noexcept;
 
     /// requires the caller to handle locking
     AEGIS_DECL void _load(guild * _guild, const json & obj, shards::shard * _shard, bool self_add = true);
@@ -209,23 +270,24 @@ private:
     /// does not lock the member object
     AEGIS_DECL void _load_nolock(guild * _guild, const json & obj, shards::shard * _shard, bool self_add = true, bool guild_lock = true);
 
+    /// Load from a member object read by a json_reader. does not lock the member object
+    /**
+     * Empty strings of obj are treated as absent and leave the current value, except nick
+     * which clears the nickname like a null nick does.
+     */
+    AEGIS_DECL void _load_nolock(guild * _guild, const gateway::objects::member & obj, shards::shard * _shard, bool self_add = true, bool guild_lock = true);
+
     /// requires the caller to handle locking
     AEGIS_DECL guild_info & _join(snowflake guild_id);
 
     /// requires the caller to handle locking
     AEGIS_DECL guild_info & _join_nolock(snowflake guild_id);
 
+    /// requires the caller to handle locking
+    AEGIS_DECL guild_info * _find_guild_info(snowflake guild_id) const noexcept;
+
     /// remove this member from the specified guild
-    void leave(snowflake guild_id)
-    {
-        std::unique_lock<shared_mutex> l(mtx());
-        guilds.erase(std::find_if(std::begin(guilds), std::end(guilds), [&guild_id](const std::unique_ptr<guild_info> & gi)
-        {
-            if (gi->id == guild_id)
-                return true;
-            return false;
-        }));
-    }
+    AEGIS_DECL void leave(snowflake guild_id);
 };
 
 }
@@ -0,0 +1,560 @@
+//
+// worker_pool.hpp
+// ***************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#pragma once
+
+#include "aegis/config.hpp"
+#include "aegis/metrics.hpp"
+#include <asio/io_context.hpp>
+#include <asio/post.hpp>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(__linux__)
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+namespace aegis
+{
+
+/// Sizing and scaling of the threads running the io_context
+/**
+ * The pool checks how long a probe posted to the io_context waits before it runs. It adds a
+ * thread when that queue latency reaches grow_latency and retires one after the latency
+ * has stayed under shrink_latency for shrink_after checks in a row. With max_threads left
+ * at 0 the pool keeps a fixed size and only measures.
+ */
+struct worker_pool_config
+{
+    /// Threads kept running, 0 to use the bot's thread count
+    worker_pool_config & min_threads(std::size_t param) noexcept { _min_threads = param; return *this; }
+    /// Upper bound when growing, 0 for a fixed size pool
+    worker_pool_config & max_threads(std::size_t param) noexcept { _max_threads = param; return *this; }
+    /// How often queue latency is measured and the pool resized
+    worker_pool_config & scale_interval(std::chrono::milliseconds param) noexcept { _scale_interval = param; return *this; }
+    /// Queue latency at which a thread is added
+    worker_pool_config & grow_latency(std::chrono::microseconds param) noexcept { _grow_latency = param; return *this; }
+    /// Queue latency under which the pool may shrink, and for how many checks in a row
+    worker_pool_config & shrink_latency(std::chrono::microseconds param, uint32_t after = 20) noexcept { _shrink_latency = param; _shrink_after = after; return *this; }
+    /// Handlers running at least this long are logged as a warning, 0 to disable
+    worker_pool_config & slow_handler(std::chrono::milliseconds param) noexcept { _slow_handler = param; return *this; }
+    /// Pin each thread to one CPU, round robin. Only supported on Linux
+    worker_pool_config & pin_threads(bool param) noexcept { _pin_threads = param; return *this; }
+
+    std::size_t _min_threads{ 0 };
+    std::size_t _max_threads{ 0 };
+    std::chrono::milliseconds _scale_interval{ 250 };
+    std::chrono::microseconds _grow_latency{ 20000 };
+    std::chrono::microseconds _shrink_latency{ 1000 };
+    uint32_t _shrink_after{ 20 };
+    std::chrono::milliseconds _slow_handler{ 1000 };
+    bool _pin_threads{ false };
+};
+
+/// Counters of one worker thread
+struct worker_stats
+{
+    std::size_t id = 0; /**< Sequence number of the thread within the pool */
+    bool active = false; /**< Whether the thread is still running handlers */
+    int cpu = -1; /**< CPU the thread is pinned to, -1 if not pinned */
+    std::chrono::steady_clock::time_point start_time; /**< When the thread started */
+    std::chrono::nanoseconds busy{ 0 }; /**< Time spent running handlers */
+    std::chrono::nanoseconds idle{ 0 }; /**< Time spent waiting for work */
+    uint64_t handlers = 0; /**< Handlers run */
+    std::chrono::nanoseconds longest_handler{ 0 }; /**< Longest single handler */
+
+    /// Share of the thread's time spent running handlers
+    double utilization() const noexcept
+    {
+        auto total = busy + idle;
+        return total.count() ? static_cast<double>(busy.count()) / static_cast<double>(total.count()) : 0.0;
+    }
+};
+
+/// Counters of the whole worker pool
+struct worker_pool_stats
+{
+    std::vector<worker_stats> workers; /**< One entry per running thread */
+    std::chrono::microseconds queue_latency{ 0 }; /**< Wait of the latest probe before it ran */
+    std::chrono::microseconds max_queue_latency{ 0 }; /**< Longest probe wait seen */
+    uint64_t grown = 0; /**< Threads added because of queue latency */
+    uint64_t shrunk = 0; /**< Threads retired because the pool was idle */
+};
+
+/// Threads running an io_context that resize themselves on queue latency
+/**
+ * Each thread runs handlers one at a time so it can time them. A handler found already
+ * queued is timed exactly. A handler that arrives while the thread waits runs inside the
+ * wait, which Asio does not split, so it only counts as busy and is only checked against
+ * slow_handler if it times itself with a handler_scope. core does so for gateway events.
+ *
+ * Threads leave by flag rather than by exception and are joined by the pool.
+ */
+class worker_pool
+{
+public:
+    /// Start the minimum number of threads and the scaling thread
+    /**
+     * @param io_context Context the threads run
+     * @param config Sizing and scaling
+     * @param log Logger for handler exceptions and slow handlers
+     */
+    worker_pool(asio::io_context & io_context, const worker_pool_config & config, std::shared_ptr<spdlog::logger> log)
+        : _io_context(io_context)
+        , _config(config)
+        , _log(std::move(log))
+        , _probe(std::make_shared<probe_state>())
+    {
+        if (_config._max_threads && _config._max_threads < _config._min_threads)
+            _config._max_threads = _config._min_threads;
+        for (std::size_t i = 0; i < _config._min_threads; ++i)
+            add_thread();
+        _controller = std::thread([this] { _control(); });
+    }
+
+    worker_pool(const worker_pool &) = delete;
+    worker_pool & operator=(const worker_pool &) = delete;
+
+    /// Charges the handler it is declared in to the worker thread running it
+    class handler_scope;
+
+    ~worker_pool()
+    {
+        stop();
+    }
+
+    /// Start one more thread
+    /**
+     * @returns Number of running threads
+     */
+    std::size_t add_thread()
+    {
+        std::lock_guard<std::mutex> l(_m);
+        _reap();
+        auto w = std::make_shared<worker>();
+        w->id = _next_id++;
+        w->start_time = std::chrono::steady_clock::now();
+        if (_config._pin_threads)
+            w->cpu = static_cast<int>(w->id % std::max(1u, std::thread::hardware_concurrency()));
+        // the thread keeps its worker alive in case stop() detaches it
+        w->thd = std::thread([this, w] { _run(*w); });
+        // pin before the worker is published so get_stats() only sees the outcome
+        _pin(*w);
+        _workers.push_back(std::move(w));
+        return _running();
+    }
+
+    /// Retire threads once they finish the handler they are running
+    /**
+     * @param count Number of threads to retire
+     */
+    void remove_threads(std::size_t count)
+    {
+        std::lock_guard<std::mutex> l(_m);
+        _reap();
+        for (auto it = _workers.rbegin(); it != _workers.rend() && count > 0; ++it)
+        {
+            if ((*it)->leave.exchange(true, std::memory_order_relaxed))
+                continue;
+            --count;
+            // wake a waiting thread so the retired one notices sooner
+            asio::post(_io_context, [] {});
+        }
+    }
+
+    /// Number of threads not asked to leave
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> l(_m);
+        return _running();
+    }
+
+    /// Record the wait of every probe into a histogram
+    /**
+     * @param histogram Histogram to record into, nullptr to stop recording. Must outlive the
+     * pool or be unset before it is destroyed
+     */
+    void set_lag_histogram(latency_histogram * histogram) noexcept
+    {
+        _probe->lag.store(histogram, std::memory_order_release);
+    }
+
+    /// Get the counters of every running thread and the queue latency
+    worker_pool_stats get_stats() const
+    {
+        worker_pool_stats stats;
+        stats.queue_latency = std::chrono::microseconds(_probe->latency_us.load(std::memory_order_relaxed));
+        stats.max_queue_latency = std::chrono::microseconds(_probe->max_latency_us.load(std::memory_order_relaxed));
+        stats.grown = _grown.load(std::memory_order_relaxed);
+        stats.shrunk = _shrunk.load(std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> l(_m);
+        stats.workers.reserve(_workers.size());
+        for (auto & w : _workers)
+        {
+            if (w->leave.load(std::memory_order_relaxed))
+                continue;
+            worker_stats ws;
+            ws.id = w->id;
+            ws.active = w->active.load(std::memory_order_relaxed);
+            ws.cpu = w->cpu;
+            ws.start_time = w->start_time;
+            ws.busy = std::chrono::nanoseconds(w->busy_ns.load(std::memory_order_relaxed));
+            ws.idle = std::chrono::nanoseconds(w->idle_ns.load(std::memory_order_relaxed));
+            ws.handlers = w->handlers.load(std::memory_order_relaxed);
+            ws.longest_handler = std::chrono::nanoseconds(w->longest_ns.load(std::memory_order_relaxed));
+            stats.workers.push_back(ws);
+        }
+        return stats;
+    }
+
+    /// Get the sizing and scaling in use
+    const worker_pool_config & get_config() const noexcept
+    {
+        return _config;
+    }
+
+    /// Stop scaling, retire every thread and join them
+    /**
+     * Threads finish the handler they are running first. When called from a handler on one
+     * of the pool's threads, that thread is detached instead of joined and exits as soon as
+     * the handler returns, without touching the pool again.
+     */
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> l(_cm);
+            if (_stopping)
+                return;
+            _stopping = true;
+        }
+        _probe->lag.store(nullptr, std::memory_order_release);
+        _cv.notify_all();
+        if (_controller.joinable())
+            _controller.join();
+
+        std::vector<std::shared_ptr<worker>> workers;
+        {
+            std::lock_guard<std::mutex> l(_m);
+            workers.swap(_workers);
+        }
+        for (auto & w : workers)
+            w->leave.store(true, std::memory_order_relaxed);
+        const thread_context & self = _context();
+        for (auto & w : workers)
+        {
+            if (self.pool == this && self.w == w.get())
+            {
+                // joining ourselves would deadlock, the pool may be gone once the handler returns
+                w->detached.store(true, std::memory_order_relaxed);
+                w->thd.detach();
+            }
+            else if (w->thd.joinable())
+                w->thd.join();
+        }
+    }
+
+private:
+    struct worker
+    {
+        std::thread thd;
+        std::size_t id = 0;
+        int cpu = -1;
+        std::chrono::steady_clock::time_point start_time;
+        std::atomic<bool> active{ true };
+        std::atomic<bool> leave{ false };
+        std::atomic<bool> detached{ false }; /**< Set by stop() called on this worker's thread, the pool must not be touched after */
+        std::atomic<int64_t> busy_ns{ 0 };
+        std::atomic<int64_t> idle_ns{ 0 };
+        std::atomic<uint64_t> handlers{ 0 };
+        std::atomic<int64_t> longest_ns{ 0 };
+        int64_t charged_ns = 0; /**< Handler time charged by handler_scope since the last check, only touched by this worker's thread */
+    };
+
+    /// Pool and worker of the calling thread, both null if it is not a pool worker
+    struct thread_context
+    {
+        worker_pool * pool = nullptr;
+        worker * w = nullptr;
+    };
+
+    static thread_context & _context() noexcept
+    {
+        static thread_local thread_context ctx;
+        return ctx;
+    }
+
+    /// Outlives the pool in case a probe is still queued when it is destroyed
+    struct probe_state
+    {
+        std::atomic<bool> pending{ false };
+        std::atomic<int64_t> posted_ns{ 0 };
+        std::atomic<int64_t> latency_us{ 0 };
+        std::atomic<int64_t> max_latency_us{ 0 };
+        std::atomic<latency_histogram *> lag{ nullptr };
+    };
+
+    /// How long an idle thread waits before checking whether it should leave
+    static std::chrono::milliseconds _idle_wait() noexcept
+    {
+        return std::chrono::milliseconds(50);
+    }
+
+    static int64_t _now_ns() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void _store_max(std::atomic<int64_t> & target, int64_t value) noexcept
+    {
+        int64_t cur = target.load(std::memory_order_relaxed);
+        while (value > cur && !target.compare_exchange_weak(cur, value, std::memory_order_relaxed))
+            ;
+    }
+
+    void _warn_slow(const worker & w, int64_t spent)
+    {
+        if (_config._slow_handler.count() && spent >= std::chrono::duration_cast<std::chrono::nanoseconds>(_config._slow_handler).count())
+            _log->warn("Handler ran for {}ms on worker {}", spent / 1000000, w.id);
+    }
+
+    /// Add the time of a handler that timed itself. Called on the worker's own thread
+    void _charge(worker & w, int64_t spent)
+    {
+        w.charged_ns += spent;
+        w.busy_ns.fetch_add(spent, std::memory_order_relaxed);
+        _store_max(w.longest_ns, spent);
+        _warn_slow(w, spent);
+    }
+
+    /// requires the caller to hold _m
+    std::size_t _running() const noexcept
+    {
+        std::size_t count = 0;
+        for (auto & w : _workers)
+            if (!w->leave.load(std::memory_order_relaxed))
+                ++count;
+        return count;
+    }
+
+    /// Join threads that have already left. requires the caller to hold _m
+    void _reap()
+    {
+        for (auto it = _workers.begin(); it != _workers.end();)
+        {
+            if (!(*it)->active.load(std::memory_order_acquire) && (*it)->thd.joinable())
+            {
+                (*it)->thd.join();
+                it = _workers.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+    /// Pin a started worker thread to its cpu. requires the caller to hold _m
+    void _pin(worker & w)
+    {
+#if defined(__linux__)
+        if (w.cpu < 0)
+            return;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w.cpu, &set);
+        if (pthread_setaffinity_np(w.thd.native_handle(), sizeof(set), &set) != 0)
+        {
+            _log->warn("Unable to pin worker {} to cpu {}", w.id, w.cpu);
+            w.cpu = -1;
+        }
+#else
+        w.cpu = -1;
+#endif
+    }
+
+    void _run(worker & w)
+    {
+        _context() = { this, &w };
+        int64_t last = _now_ns();
+        while (!w.leave.load(std::memory_order_relaxed) && !_io_context.stopped())
+        {
+            try
+            {
+                if (_io_context.poll_one())
+                {
+                    if (w.detached.load(std::memory_order_relaxed))
+                        break;
+                    int64_t now = _now_ns();
+                    int64_t spent = now - last;
+                    last = now;
+                    // a handler_scope already charged its part and checked it
+                    const int64_t charged = w.charged_ns;
+                    w.charged_ns = 0;
+                    w.busy_ns.fetch_add(spent - charged, std::memory_order_relaxed);
+                    w.handlers.fetch_add(1, std::memory_order_relaxed);
+                    _store_max(w.longest_ns, spent);
+                    if (!charged)
+                        _warn_slow(w, spent);
+                    continue;
+                }
+                std::size_t ran = _io_context.run_one_for(_idle_wait());
+                if (w.detached.load(std::memory_order_relaxed))
+                    break;
+                int64_t now = _now_ns();
+                // without a handler_scope the handler is counted as part of the wait
+                w.idle_ns.fetch_add(now - last - w.charged_ns, std::memory_order_relaxed);
+                w.charged_ns = 0;
+                last = now;
+                if (ran)
+                    w.handlers.fetch_add(1, std::memory_order_relaxed);
+            }
+            catch (std::exception & e)
+            {
+                if (w.detached.load(std::memory_order_relaxed))
+                    break;
+                _log->critical("Handler exited with exception on worker {}: {}", w.id, e.what());
+                w.charged_ns = 0;
+                last = _now_ns();
+            }
+            catch (...)
+            {
+                if (w.detached.load(std::memory_order_relaxed))
+                    break;
+                _log->critical("Handler exited with unknown exception on worker {}", w.id);
+                w.charged_ns = 0;
+                last = _now_ns();
+            }
+        }
+        _context() = {};
+        w.active.store(false, std::memory_order_release);
+    }
+
+    /// Post a probe unless the last one is still queued, and get the latest queue latency
+    std::chrono::microseconds _measure()
+    {
+        auto probe = _probe;
+        int64_t now = _now_ns();
+        if (probe->pending.load(std::memory_order_acquire))
+            // still queued, so the latency is at least how long it has waited
+            return std::chrono::microseconds((now - probe->posted_ns.load(std::memory_order_relaxed)) / 1000);
+
+        probe->pending.store(true, std::memory_order_relaxed);
+        probe->posted_ns.store(now, std::memory_order_relaxed);
+        asio::post(_io_context, [probe, now]
+        {
+            int64_t waited = (_now_ns() - now) / 1000;
+            probe->latency_us.store(waited, std::memory_order_relaxed);
+            _store_max(probe->max_latency_us, waited);
+            if (auto lag = probe->lag.load(std::memory_order_acquire))
+                lag->record_us(static_cast<uint64_t>(waited));
+            probe->pending.store(false, std::memory_order_release);
+        });
+        return std::chrono::microseconds(probe->latency_us.load(std::memory_order_relaxed));
+    }
+
+    void _control()
+    {
+        uint32_t quiet = 0;
+        std::unique_lock<std::mutex> l(_cm);
+        while (!_stopping)
+        {
+            _cv.wait_for(l, _config._scale_interval);
+            if (_stopping)
+                break;
+            l.unlock();
+
+            auto latency = _measure();
+            std::size_t running;
+            {
+                std::lock_guard<std::mutex> wl(_m);
+                _reap();
+                running = _running();
+            }
+            if (_config._max_threads)
+            {
+                if (latency >= _config._grow_latency && running < _config._max_threads)
+                {
+                    add_thread();
+                    _grown.fetch_add(1, std::memory_order_relaxed);
+                    quiet = 0;
+                }
+                else if (latency <= _config._shrink_latency && running > _config._min_threads)
+                {
+                    if (++quiet >= _config._shrink_after)
+                    {
+                        remove_threads(1);
+                        _shrunk.fetch_add(1, std::memory_order_relaxed);
+                        quiet = 0;
+                    }
+                }
+                else
+                    quiet = 0;
+            }
+
+            l.lock();
+        }
+    }
+
+    asio::io_context & _io_context;
+    worker_pool_config _config;
+    std::shared_ptr<spdlog::logger> _log;
+    std::shared_ptr<probe_state> _probe;
+
+    mutable std::mutex _m; /**< Guards _workers and _next_id */
+    std::vector<std::shared_ptr<worker>> _workers;
+    std::size_t _next_id = 0;
+
+    std::mutex _cm; /**< Guards _stopping for the scaling thread */
+    std::condition_variable _cv;
+    bool _stopping = false;
+    std::thread _controller;
+
+    std::atomic<uint64_t> _grown{ 0 };
+    std::atomic<uint64_t> _shrunk{ 0 };
+};
+
+/**
+ * A handler that arrives while a worker waits for work runs inside the wait and would be
+ * counted as idle time. Declared at the top of such a handler, this times it as busy time
+ * of the worker and checks it against slow_handler. Does nothing on threads that are not
+ * pool workers.
+ */
+class worker_pool::handler_scope
+{
+public:
+    handler_scope() noexcept
+        : _ctx(_context())
+        , _start(_ctx.w ? _now_ns() : 0)
+    {
+
+    }
+
+    ~handler_scope()
+    {
+        // a handler that stopped the pool must not touch it again
+        if (_ctx.w && !_ctx.w->detached.load(std::memory_order_relaxed))
+            _ctx.pool->_charge(*_ctx.w, _now_ns() - _start);
+    }
+
+    handler_scope(const handler_scope &) = delete;
+    handler_scope & operator=(const handler_scope &) = delete;
+
+private:
+    const thread_context _ctx;
+    const int64_t _start;
+};
+
+}
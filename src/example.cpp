@@ -110,10 +110,7 @@ const json example::make_info_obj(aegis::core & bot, aegis::shards::shard * _sha
     int64_t user_count_unique = bot.get_user_count();
     int64_t channel_count = bot.get_channel_count();
 
-    int64_t eventsseen = 0;
-
-    for (auto & e : bot.message_count)
-        eventsseen += e.second;
+    int64_t eventsseen = bot.get_event_count();
 
     std::string members = fmt::format("{}", user_count_unique);
     std::string channels = fmt::format("{}", channel_count);
@@ -0,0 +1,49 @@
+//
+// check.hpp
+// *********
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#pragma once
+
+#include <cstdio>
+
+namespace aegis
+{
+
+namespace test
+{
+
+/// Number of failed checks so far, returned from main so ctest sees the failure
+inline int & failures() noexcept
+{
+    static int count = 0;
+    return count;
+}
+
+inline void check(bool ok, const char * expr, const char * file, int line) noexcept
+{
+    if (ok)
+        return;
+    ++failures();
+    std::printf("%s:%d: check failed: %s\n", file, line, expr);
+}
+
+}
+
+}
+
+/// Record a failure without stopping the test when expr is false
+#define AEGIS_CHECK(expr) ::aegis::test::check(static_cast<bool>(expr), #expr, __FILE__, __LINE__)
+
+/// Record a failure unless stmt throws an exception of type ex
+#define AEGIS_CHECK_THROWS(stmt, ex) \
+    do \
+    { \
+        bool thrown = false; \
+        try { stmt; } catch (ex &) { thrown = true; } \
+        ::aegis::test::check(thrown, #stmt " throws " #ex, __FILE__, __LINE__); \
+    } while (0)
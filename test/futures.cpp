@@ -0,0 +1,168 @@
+//
+// futures.cpp
+// ***********
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#include "check.hpp"
+#include <aegis.hpp>
+#include <thread>
+
+namespace
+{
+
+using aegis::future;
+using aegis::promise;
+
+void when_all_range()
+{
+    std::vector<promise<int>> promises;
+    std::vector<future<int>> futures;
+    for (int i = 0; i < 5; ++i)
+    {
+        promises.emplace_back(nullptr);
+        futures.push_back(promises.back().get_future());
+    }
+
+    auto all = aegis::when_all(futures.begin(), futures.end());
+    // completed out of order, one of them failing
+    for (int i = 4; i >= 0; --i)
+    {
+        AEGIS_CHECK(!all.available());
+        if (i == 1)
+            promises[i].set_exception(std::make_exception_ptr(std::runtime_error("failed")));
+        else
+            promises[i].set_value(i * 10);
+    }
+    AEGIS_CHECK(all.available());
+
+    auto results = all.get();
+    AEGIS_CHECK(results.size() == 5);
+    for (int i = 0; i < 5; ++i)
+    {
+        AEGIS_CHECK(results[i].available());
+        if (i == 1)
+        {
+            AEGIS_CHECK(results[i].failed());
+            AEGIS_CHECK_THROWS(results[i].get(), std::runtime_error);
+        }
+        else
+            AEGIS_CHECK(results[i].get() == i * 10);
+    }
+
+    std::vector<future<int>> none;
+    auto empty = aegis::when_all(none.begin(), none.end());
+    AEGIS_CHECK(empty.available() && empty.get().empty());
+}
+
+void when_all_pack()
+{
+    promise<std::string> text(nullptr);
+    promise<void> done(nullptr);
+
+    auto all = aegis::when_all(aegis::make_ready_future<int>(7), text.get_future(), done.get_future());
+    AEGIS_CHECK(!all.available());
+    done.set_value();
+    AEGIS_CHECK(!all.available());
+    text.set_value("seven");
+
+    auto results = all.get();
+    AEGIS_CHECK(std::get<0>(results).get() == 7);
+    AEGIS_CHECK(std::get<1>(results).get() == "seven");
+    AEGIS_CHECK(std::get<2>(results).available() && !std::get<2>(results).failed());
+
+    AEGIS_CHECK(aegis::when_all().available());
+}
+
+void when_any_range()
+{
+    std::vector<promise<int>> promises;
+    std::vector<future<int>> futures;
+    for (int i = 0; i < 4; ++i)
+    {
+        promises.emplace_back(nullptr);
+        futures.push_back(promises.back().get_future());
+    }
+
+    auto any = aegis::when_any(futures.begin(), futures.end());
+    AEGIS_CHECK(!any.available());
+    promises[2].set_value(2);
+    AEGIS_CHECK(any.available());
+    promises[0].set_value(0);
+
+    auto result = any.get();
+    AEGIS_CHECK(result.index == 2);
+    AEGIS_CHECK(result.futures.size() == 4);
+    AEGIS_CHECK(result.futures[2].get() == 2);
+    AEGIS_CHECK(result.futures[0].get() == 0);
+    // inputs still pending are handed back and complete later
+    AEGIS_CHECK(!result.futures[3].available());
+    promises[3].set_value(3);
+    AEGIS_CHECK(result.futures[3].get() == 3);
+
+    std::vector<future<int>> none;
+    auto empty = aegis::when_any(none.begin(), none.end());
+    AEGIS_CHECK(empty.available() && empty.get().index == static_cast<std::size_t>(-1));
+}
+
+void when_any_pack()
+{
+    promise<int> slow(nullptr);
+    promise<std::string> fast(nullptr);
+
+    auto any = aegis::when_any(slow.get_future(), fast.get_future());
+    fast.set_exception(std::make_exception_ptr(std::runtime_error("failed")));
+    auto result = any.get();
+    AEGIS_CHECK(result.index == 1);
+    AEGIS_CHECK(std::get<1>(result.futures).failed());
+    slow.set_value(1);
+    AEGIS_CHECK(std::get<0>(result.futures).get() == 1);
+}
+
+/// Inputs completed from several io_context threads at once
+void when_all_threads()
+{
+    asio::io_context io;
+    auto work = asio::make_work_guard(io);
+    std::vector<std::thread> pool;
+    for (int i = 0; i < 4; ++i)
+        pool.emplace_back([&io] { io.run(); });
+
+    for (int round = 0; round < 50; ++round)
+    {
+        std::vector<future<int>> futures;
+        for (int i = 0; i < 200; ++i)
+        {
+            promise<int> p(&io);
+            futures.push_back(p.get_future());
+            asio::post(io, [p = std::move(p), i]() mutable { p.set_value(i); });
+        }
+        auto sum = aegis::when_all(futures.begin(), futures.end()).then([](std::vector<future<int>> results)
+        {
+            int total = 0;
+            for (auto & r : results)
+                total += r.get();
+            return total;
+        });
+        AEGIS_CHECK(sum.get() == 199 * 200 / 2);
+    }
+
+    work.reset();
+    for (auto & t : pool)
+        t.join();
+}
+
+}
+
+int main()
+{
+    when_all_range();
+    when_all_pack();
+    when_any_range();
+    when_any_pack();
+    when_all_threads();
+    return aegis::test::failures();
+}
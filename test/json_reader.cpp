@@ -0,0 +1,174 @@
+//
+// json_reader.cpp
+// ***************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#include "check.hpp"
+#include "../bench/bench.hpp"
+#include <aegis.hpp>
+
+namespace
+{
+
+using aegis::json_reader;
+namespace events = aegis::gateway::events;
+namespace objects = aegis::gateway::objects;
+
+void scalars()
+{
+    const std::string doc = R"({"s":"a\"b\\c\n\u00e9\ud83d\ude00","i":-42,"f":1.5e1,"b":true,"n":null,"id":"123456789012345678","nid":98})";
+    json_reader r(doc);
+    std::string key;
+    r.begin_object();
+    AEGIS_CHECK(r.next_key(key) && key == "s");
+    AEGIS_CHECK(r.read_string() == "a\"b\\c\n\xc3\xa9\xf0\x9f\x98\x80");
+    AEGIS_CHECK(r.next_key(key) && key == "i");
+    AEGIS_CHECK(r.read_int() == -42);
+    AEGIS_CHECK(r.next_key(key) && key == "f");
+    AEGIS_CHECK(r.read_int() == 15);
+    AEGIS_CHECK(r.next_key(key) && key == "b");
+    AEGIS_CHECK(r.read_bool());
+    AEGIS_CHECK(r.next_key(key) && key == "n");
+    AEGIS_CHECK(r.read_string().empty());
+    AEGIS_CHECK(r.next_key(key) && key == "id");
+    AEGIS_CHECK(r.read_snowflake() == 123456789012345678);
+    AEGIS_CHECK(r.next_key(key) && key == "nid");
+    AEGIS_CHECK(r.read_snowflake() == 98);
+    AEGIS_CHECK(!r.next_key(key));
+}
+
+void nesting()
+{
+    const std::string doc = R"({"skip":{"a":[1,{"b":"}]"},[]],"c":"\"{"},"arr":[1, 2 ,3],"obj":{"x":[]},"last":7})";
+    json_reader r(doc);
+    std::string key;
+    r.begin_object();
+    AEGIS_CHECK(r.next_key(key) && key == "skip");
+    r.skip();
+    AEGIS_CHECK(r.next_key(key) && key == "arr");
+    AEGIS_CHECK(r.is_array());
+    int64_t sum = 0;
+    r.begin_array();
+    while (r.next_element())
+        sum += r.read_int();
+    AEGIS_CHECK(sum == 6);
+    AEGIS_CHECK(r.next_key(key) && key == "obj");
+    AEGIS_CHECK(r.is_object());
+    AEGIS_CHECK(r.read_json() == nlohmann::json::parse(R"({"x":[]})"));
+    AEGIS_CHECK(r.next_key(key) && key == "last");
+    AEGIS_CHECK(r.read_int() == 7);
+    AEGIS_CHECK(!r.next_key(key));
+}
+
+void malformed()
+{
+    std::string key;
+    const std::string unterminated = R"({"a":"unterminated)";
+    {
+        json_reader r(unterminated);
+        r.begin_object();
+        r.next_key(key);
+        AEGIS_CHECK_THROWS(r.read_string(), aegis::exception);
+    }
+    const std::string escape = R"(["\x"])";
+    {
+        json_reader r(escape);
+        r.begin_array();
+        r.next_element();
+        AEGIS_CHECK_THROWS(r.read_string(), aegis::exception);
+    }
+    const std::string boolean = "[tru]";
+    {
+        json_reader r(boolean);
+        r.begin_array();
+        r.next_element();
+        AEGIS_CHECK_THROWS(r.read_bool(), aegis::exception);
+    }
+    const std::string snowflake = R"(["12x"])";
+    {
+        json_reader r(snowflake);
+        r.begin_array();
+        r.next_element();
+        AEGIS_CHECK_THROWS(r.read_snowflake(), aegis::exception);
+    }
+}
+
+void dispatch()
+{
+    const std::string payload = aegis::bench::message_create(700000000000000042);
+
+    events::dispatch_header hdr;
+    AEGIS_CHECK(events::scan_dispatch(payload, hdr));
+    AEGIS_CHECK(hdr.op == 0 && hdr.s == 42 && hdr.t == "MESSAGE_CREATE");
+    const std::string truncated = "{\"op\":";
+    AEGIS_CHECK(!events::scan_dispatch(truncated, hdr));
+
+    AEGIS_CHECK(events::scan_guild_id(payload.data(), payload.size(), false) == 100000000000000001);
+    const std::string guild = aegis::bench::guild_create(2);
+    AEGIS_CHECK(events::scan_guild_id(guild.data(), guild.size(), true) == 100000000000000001);
+    AEGIS_CHECK(events::scan_guild_id(guild.data(), guild.size(), false) == 0);
+
+    const std::string heartbeat_ack = R"({"t":null,"s":null,"op":11,"d":null})";
+    json_reader r(heartbeat_ack);
+    AEGIS_CHECK(!events::seek_dispatch_data(r));
+}
+
+/// from_reader must fill a message exactly as from_json does
+void message_matches_json()
+{
+    const std::string payload = aegis::bench::message_create(700000000000000042);
+
+    objects::message dom = nlohmann::json::parse(payload)["d"].get<objects::message>();
+
+    objects::message read;
+    aegis::lib::optional<objects::member> member;
+    json_reader r(payload);
+    AEGIS_CHECK(events::seek_dispatch_data(r));
+    objects::from_reader(r, read, member);
+
+    AEGIS_CHECK(read.get_id() == dom.get_id());
+    AEGIS_CHECK(read.get_id() == 700000000000000042);
+    AEGIS_CHECK(read.get_channel_id() == dom.get_channel_id());
+    AEGIS_CHECK(read.get_guild_id() == dom.get_guild_id());
+    AEGIS_CHECK(read.get_author_id() == dom.get_author_id());
+    AEGIS_CHECK(read.get_content() == dom.get_content());
+    AEGIS_CHECK(read.nonce == dom.nonce);
+    AEGIS_CHECK(read.mention_roles == dom.mention_roles);
+    AEGIS_CHECK(read.mention_roles.size() == 1);
+    AEGIS_CHECK(member.has_value());
+}
+
+void guild_matches_json()
+{
+    const std::string payload = aegis::bench::guild_create(25, 5, 3);
+
+    objects::guild dom = nlohmann::json::parse(payload)["d"].get<objects::guild>();
+
+    objects::guild read;
+    json_reader r(payload);
+    AEGIS_CHECK(events::seek_dispatch_data(r));
+    objects::from_reader(r, read);
+
+    AEGIS_CHECK(read.id == dom.id);
+    AEGIS_CHECK(read.name == dom.name);
+    AEGIS_CHECK(read.roles.size() == 3 && read.roles.size() == dom.roles.size());
+    AEGIS_CHECK(read.channels.size() == 5 && read.channels.size() == dom.channels.size());
+    AEGIS_CHECK(read.members.size() == 25 && read.members.size() == dom.members.size());
+}
+
+}
+
+int main()
+{
+    scalars();
+    nesting();
+    malformed();
+    dispatch();
+    message_matches_json();
+    guild_matches_json();
+    return aegis::test::failures();
+}
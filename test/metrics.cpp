@@ -0,0 +1,139 @@
+//
+// metrics.cpp
+// ***********
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#include "check.hpp"
+#include <aegis/metrics.hpp>
+#include <thread>
+
+namespace
+{
+
+using aegis::latency_histogram;
+
+void bucket_bounds()
+{
+    // below sub_count every microsecond has its own bucket
+    for (uint64_t us = 0; us < latency_histogram::sub_count; ++us)
+    {
+        AEGIS_CHECK(latency_histogram::bucket_index(us) == us);
+        AEGIS_CHECK(latency_histogram::bucket_lower(us) == us);
+        AEGIS_CHECK(latency_histogram::bucket_upper(us) == us);
+    }
+
+    // buckets tile the value range without gaps and hold their own edges
+    for (std::size_t i = 0; i + 1 < latency_histogram::bucket_count; ++i)
+    {
+        const uint64_t lower = latency_histogram::bucket_lower(i);
+        const uint64_t upper = latency_histogram::bucket_upper(i);
+        AEGIS_CHECK(lower <= upper);
+        AEGIS_CHECK(latency_histogram::bucket_index(lower) == i);
+        AEGIS_CHECK(latency_histogram::bucket_index(upper) == i);
+        AEGIS_CHECK(latency_histogram::bucket_lower(i + 1) == upper + 1);
+        // log-linear: a bucket is at most 1/16 of its lower edge wide
+        if (i >= latency_histogram::sub_count)
+            AEGIS_CHECK((upper - lower + 1) * latency_histogram::sub_count <= lower);
+    }
+
+    const std::size_t last = latency_histogram::bucket_count - 1;
+    AEGIS_CHECK(latency_histogram::bucket_upper(last) == UINT64_MAX);
+    AEGIS_CHECK(latency_histogram::bucket_index(uint64_t(1) << 40) == last);
+    AEGIS_CHECK(latency_histogram::bucket_index(UINT64_MAX) == last);
+    // the overflow bucket also holds the top sub-bucket of the highest exponent
+    AEGIS_CHECK(latency_histogram::bucket_index((uint64_t(1) << 40) - 1) == last);
+    AEGIS_CHECK(latency_histogram::bucket_index(latency_histogram::bucket_lower(last) - 1) == last - 1);
+}
+
+void record_and_percentiles()
+{
+    latency_histogram h;
+    for (uint64_t us = 1; us <= 1000; ++us)
+        h.record_us(us);
+    h.record(std::chrono::microseconds(-5));
+    h.record(std::chrono::nanoseconds(999));
+
+    AEGIS_CHECK(h.count() == 1002);
+    auto s = h.snapshot();
+    AEGIS_CHECK(s.count == 1002);
+    AEGIS_CHECK(s.counts[0] == 2);
+    AEGIS_CHECK(s.sum == 500500);
+    AEGIS_CHECK(s.max == 1000);
+    AEGIS_CHECK(s.mean().count() == 499);
+
+    // within a bucket width of the exact rank, never past the largest sample
+    const auto p50 = s.percentile(0.5).count();
+    AEGIS_CHECK(p50 >= 500 && p50 <= 500 + 500 / 16);
+    const auto p99 = s.percentile(0.99).count();
+    AEGIS_CHECK(p99 >= 990 && p99 <= 1000);
+    AEGIS_CHECK(s.percentile(1.0).count() == 1000);
+    AEGIS_CHECK(s.percentile(0.0).count() == 0);
+    AEGIS_CHECK(latency_histogram().snapshot().percentile(0.5).count() == 0);
+
+    AEGIS_CHECK(s.count_at_or_below(15) == 2 + 15);
+    AEGIS_CHECK(s.count_at_or_below(100000) == s.count);
+    const uint64_t at_500 = s.count_at_or_below(500);
+    AEGIS_CHECK(at_500 >= 2 + 500 && at_500 <= 2 + 500 + 500 / 16);
+}
+
+void concurrent_record()
+{
+    latency_histogram h;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+        threads.emplace_back([&h, t]
+        {
+            for (uint64_t i = 0; i < 100000; ++i)
+                h.record_us(i % 5000 + static_cast<uint64_t>(t));
+        });
+    for (auto & t : threads)
+        t.join();
+    auto s = h.snapshot();
+    AEGIS_CHECK(s.count == 400000);
+    AEGIS_CHECK(h.count() == 400000);
+    AEGIS_CHECK(s.max == 5002);
+}
+
+void families_and_export()
+{
+    aegis::metrics_registry reg;
+    auto & fam = reg.histogram("aegis_test_seconds", "Test \"latency\"", { "event", "shard" });
+    AEGIS_CHECK(&reg.histogram("aegis_test_seconds", "ignored", { "x" }) == &fam);
+    AEGIS_CHECK(reg.find("aegis_test_seconds") == &fam);
+    AEGIS_CHECK(reg.find("missing") == nullptr);
+
+    auto & a = fam.get("MESSAGE_CREATE", 0);
+    AEGIS_CHECK(&fam.get(std::string("MESSAGE_CREATE"), 0) == &a);
+    AEGIS_CHECK(&fam.get("MESSAGE_CREATE", 1) != &a);
+    AEGIS_CHECK(&fam.get("MESSAGE_CREATE0", 1) != &fam.get("MESSAGE_CREATE", 01));
+
+    a.record_us(40);
+    a.record_us(2000);
+    a.record_us(90000000);
+    fam.get("say \"hi\"\n", 2).record_us(1);
+
+    const std::string text = reg.to_prometheus();
+    const auto has = [&text](const char * line) { return text.find(line) != std::string::npos; };
+    AEGIS_CHECK(has("# TYPE aegis_test_seconds histogram\n"));
+    AEGIS_CHECK(has("aegis_test_seconds_bucket{event=\"MESSAGE_CREATE\",shard=\"0\",le=\"5e-05\"} 1\n"));
+    AEGIS_CHECK(has("aegis_test_seconds_bucket{event=\"MESSAGE_CREATE\",shard=\"0\",le=\"0.0025\"} 2\n"));
+    AEGIS_CHECK(has("aegis_test_seconds_bucket{event=\"MESSAGE_CREATE\",shard=\"0\",le=\"60\"} 2\n"));
+    AEGIS_CHECK(has("aegis_test_seconds_bucket{event=\"MESSAGE_CREATE\",shard=\"0\",le=\"+Inf\"} 3\n"));
+    AEGIS_CHECK(has("aegis_test_seconds_count{event=\"MESSAGE_CREATE\",shard=\"0\"} 3\n"));
+    AEGIS_CHECK(has("event=\"say \\\"hi\\\"\\n\",shard=\"2\""));
+}
+
+}
+
+int main()
+{
+    bucket_bounds();
+    record_and_percentiles();
+    concurrent_record();
+    families_and_export();
+    return aegis::test::failures();
+}
@@ -0,0 +1,162 @@
+//
+// object_pool.cpp
+// ***************
+//
+// Copyright (c) 2020 Sharon Fox (sharon at xandium dot io)
+//
+// Distributed under the MIT License. (See accompanying file LICENSE)
+//
+
+#include "check.hpp"
+#include <aegis.hpp>
+#include <set>
+#include <thread>
+
+namespace
+{
+
+struct entity
+{
+    uint64_t id;
+    char payload[40];
+};
+
+struct shared_entity
+{
+    uint64_t owner;
+    uint64_t serial;
+};
+
+void slabs_and_reuse()
+{
+    aegis::object_pool<entity, 8> pool;
+    AEGIS_CHECK(pool.get_stats().slabs == 0);
+
+    std::set<void *> live;
+    for (int i = 0; i < 20; ++i)
+    {
+        void * p = pool.allocate();
+        AEGIS_CHECK(reinterpret_cast<uintptr_t>(p) % alignof(entity) == 0);
+        AEGIS_CHECK(live.insert(p).second);
+    }
+    auto stats = pool.get_stats();
+    AEGIS_CHECK(stats.slabs == 3);
+    AEGIS_CHECK(stats.capacity == 24);
+    AEGIS_CHECK(stats.in_use == 20);
+    AEGIS_CHECK(stats.bytes >= 24 * sizeof(entity));
+
+    // a freed slot is the next one handed out
+    void * freed = *live.begin();
+    pool.deallocate(freed);
+    AEGIS_CHECK(pool.get_stats().in_use == 19);
+    AEGIS_CHECK(pool.allocate() == freed);
+
+    for (auto p : live)
+        pool.deallocate(p);
+    pool.deallocate(nullptr);
+    stats = pool.get_stats();
+    AEGIS_CHECK(stats.in_use == 0);
+    AEGIS_CHECK(stats.capacity == 24);
+}
+
+void reserve_ahead()
+{
+    aegis::object_pool<entity, 8> pool;
+    pool.reserve(100);
+    auto stats = pool.get_stats();
+    AEGIS_CHECK(stats.slabs == 1);
+    AEGIS_CHECK(stats.capacity == 104);
+
+    // reserved slots are used before any new slab is taken
+    std::vector<void *> held;
+    for (int i = 0; i < 104; ++i)
+        held.push_back(pool.allocate());
+    AEGIS_CHECK(pool.get_stats().slabs == 1);
+    held.push_back(pool.allocate());
+    AEGIS_CHECK(pool.get_stats().slabs == 2);
+
+    // nothing to do when enough slots are free
+    for (auto p : held)
+        pool.deallocate(p);
+    pool.reserve(50);
+    AEGIS_CHECK(pool.get_stats().slabs == 2);
+}
+
+/// instance() routes through per-thread caches that must hand everything back
+void thread_caches()
+{
+    using pool_type = aegis::object_pool<shared_entity>;
+    const uint64_t baseline = pool_type::instance().get_stats().in_use;
+
+    std::vector<std::thread> threads;
+    std::atomic<int> corrupted{ 0 };
+    std::vector<shared_entity *> handoff(4000);
+    for (uint64_t t = 0; t < 4; ++t)
+        threads.emplace_back([&, t]
+        {
+            std::vector<shared_entity *> mine;
+            for (uint64_t i = 0; i < 20000; ++i)
+            {
+                auto e = static_cast<shared_entity *>(pool_type::instance().allocate());
+                e->owner = t;
+                e->serial = i;
+                mine.push_back(e);
+                // free in bursts, larger than a thread cache holds
+                if (mine.size() == 300)
+                {
+                    for (std::size_t n = 0; n < mine.size(); ++n)
+                    {
+                        if (mine[n]->owner != t || mine[n]->serial != i + 1 - mine.size() + n)
+                            ++corrupted;
+                        pool_type::instance().deallocate(mine[n]);
+                    }
+                    mine.clear();
+                }
+            }
+            // leave some to be freed by another thread after this one exits
+            for (std::size_t n = 0; n < 1000; ++n)
+            {
+                handoff[t * 1000 + n] = static_cast<shared_entity *>(pool_type::instance().allocate());
+                handoff[t * 1000 + n]->owner = t;
+            }
+            for (auto e : mine)
+                pool_type::instance().deallocate(e);
+        });
+    for (auto & t : threads)
+        t.join();
+    AEGIS_CHECK(corrupted == 0);
+
+    std::set<shared_entity *> distinct(handoff.begin(), handoff.end());
+    AEGIS_CHECK(distinct.size() == handoff.size());
+    std::thread([&]
+    {
+        for (auto e : handoff)
+            pool_type::instance().deallocate(e);
+    }).join();
+
+    AEGIS_CHECK(pool_type::instance().get_stats().in_use == baseline);
+}
+
+void pooled_entities()
+{
+#if !defined(AEGIS_DISABLE_ENTITY_POOL)
+    const auto before = aegis::object_pool<aegis::user>::instance().get_stats();
+    std::unique_ptr<aegis::user> u(new aegis::user(500000000000000001));
+    AEGIS_CHECK(u->get_id() == 500000000000000001);
+    const auto after = aegis::object_pool<aegis::user>::instance().get_stats();
+    AEGIS_CHECK(after.capacity > 0);
+    AEGIS_CHECK(after.in_use >= before.in_use);
+    AEGIS_CHECK(after.in_use > 0);
+#endif
+}
+
+}
+
+int main()
+{
+    slabs_and_reuse();
+    reserve_ahead();
+    thread_caches();
+    pooled_entities();
+    return aegis::test::failures();
+}